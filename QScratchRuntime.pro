@@ -1,14 +1,4 @@
-QT       += core gui multimedia svg
-
-!wasm {
-	QT += concurrent
-}
-
-greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
-
-wasm {
-    QTPLUGIN += qsvg
-}
+include(runtime.pri)
 
 CONFIG += c++11
 
@@ -23,26 +13,12 @@ DEFINES += QT_DEPRECATED_WARNINGS
 # You can also select to disable deprecated APIs only up to a certain version of Qt.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
-INCLUDEPATH += src/include
-
 SOURCES += \
-    src/core/scratchsprite.cpp \
-    src/core/blocks.cpp \
     src/main.cpp \
-    src/global.cpp \
-    src/mainwindow.cpp \
-    src/projectscene.cpp \
-    src/core/projectparser.cpp \
-    src/core/engine.cpp
+    src/mainwindow.cpp
 
 HEADERS += \
-    src/include/core/scratchsprite.h \
-    src/include/core/blocks.h \
-    src/include/global.h \
-    src/include/mainwindow.h \
-    src/include/projectscene.h \
-    src/include/core/projectparser.h \
-    src/include/core/engine.h
+    src/include/mainwindow.h
 
 FORMS += \
     ui/mainwindow.ui
@@ -51,6 +27,3 @@ FORMS += \
 qnx: target.path = /tmp/$${TARGET}/bin
 else: unix:!android: target.path = /opt/$${TARGET}/bin
 !isEmpty(target.path): INSTALLS += target
-
-RESOURCES += \
-    res/res.qrc
@@ -0,0 +1,14 @@
+include(../../runtime.pri)
+
+TARGET = macro-benchmark
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+SOURCES += \
+    main.cpp \
+    projectgenerator.cpp
+
+HEADERS += \
+    projectgenerator.h
@@ -0,0 +1,161 @@
+/*
+ * main.cpp
+ * This file is part of QScratchRuntime
+ *
+ * Copyright (C) 2023 - adazem009
+ *
+ * QScratchRuntime is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * QScratchRuntime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QScratchRuntime. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QTemporaryDir>
+#include <QProcess>
+#include <QJsonDocument>
+#include <QJsonArray>
+#include <QFile>
+#include <QTextStream>
+#include "projectgenerator.h"
+#include "headlessrunner.h"
+#include "core/engineclock.h"
+#include "core/randomgenerator.h"
+
+/*! Runs the given project in this process and prints the JSON summary. */
+static int runProject(const QString &fileName, int frames)
+{
+	// Use virtual time and a fixed seed, so that every run does the same work
+	EngineClock::setVirtual(true, 1000.0 / 30);
+	RandomGenerator::setProjectSeed(0);
+	HeadlessRunner runner(fileName);
+	runner.setFrameLimit(frames);
+	runner.setSummaryFormat(HeadlessRunner::JsonSummary);
+	if(!runner.load())
+	{
+		qCritical("Error: could not load the project");
+		return 1;
+	}
+	// The scenarios run forever, so they always reach the frame limit
+	int ret = runner.run();
+	// Pixmaps must be destroyed before the application
+	costumeCache.clear();
+	graphicEffectsCache.clear();
+	return (ret == HeadlessRunner::FrameLimitReached) ? 0 : ret;
+}
+
+/*!
+ * Generates the project of the given scenario and runs it in a child process
+ * (so that the peak memory usage of each scenario is measured separately).
+ */
+static QJsonObject runScenario(const QString &scenario, int size, int frames)
+{
+	QJsonObject out;
+	out.insert("scenario", scenario);
+	out.insert("size", size);
+	QTemporaryDir dir;
+	ProjectGenerator generator(size);
+	if(!dir.isValid() || !generator.generate(scenario, dir.path()))
+	{
+		out.insert("error", "could not generate the project");
+		return out;
+	}
+	QProcess process;
+	process.setProcessChannelMode(QProcess::ForwardedErrorChannel);
+	process.start(QCoreApplication::applicationFilePath(),
+		{"--run-project", dir.filePath("project.json"), "--frames", QString::number(frames)});
+	process.waitForFinished(-1);
+	QByteArray result = process.readAllStandardOutput().trimmed();
+	// The summary is the last line
+	QJsonObject summary = QJsonDocument::fromJson(result.mid(result.lastIndexOf('\n') + 1)).object();
+	if((process.exitCode() != 0) || summary.isEmpty())
+	{
+		out.insert("error", "the project failed to run");
+		return out;
+	}
+	QStringList keys = summary.keys();
+	for(int i=0; i < keys.count(); i++)
+		out.insert(keys[i], summary.value(keys[i]));
+	return out;
+}
+
+int main(int argc, char *argv[])
+{
+	// Projects are run without a window
+	qputenv("QT_QPA_PLATFORM", "offscreen");
+	QApplication a(argc, argv);
+	QCoreApplication::setOrganizationName("adazem009");
+	QCoreApplication::setApplicationName("QScratchRuntime");
+	HeadlessRunner::useSeparateSettings();
+	QCommandLineParser parser;
+	parser.setApplicationDescription("QScratchRuntime macro benchmarks");
+	parser.addHelpOption();
+	QCommandLineOption scenarioOption("scenario", "Scenario to run (can be used multiple times, default: all). Available: "
+		+ ProjectGenerator::scenarios().join(", "), "name");
+	QCommandLineOption sizeOption("size", "Size of the generated projects (e.g. number of clones or sprites).", "N", "50");
+	QCommandLineOption framesOption("frames", "Number of frames to run.", "N", "300");
+	QCommandLineOption outputOption("output", "Write the results into a file instead of standard output.", "file");
+	QCommandLineOption generateOption("generate", "Only generate the projects into the given directory.", "dir");
+	QCommandLineOption runProjectOption("run-project", "Run a project and print its summary (used internally).", "file");
+	runProjectOption.setFlags(QCommandLineOption::HiddenFromHelp);
+	parser.addOption(scenarioOption);
+	parser.addOption(sizeOption);
+	parser.addOption(framesOption);
+	parser.addOption(outputOption);
+	parser.addOption(generateOption);
+	parser.addOption(runProjectOption);
+	parser.process(a);
+	int size = parser.value(sizeOption).toInt();
+	int frames = parser.value(framesOption).toInt();
+	if(parser.isSet(runProjectOption))
+		return runProject(parser.value(runProjectOption), frames);
+	QStringList scenarios = parser.values(scenarioOption);
+	if(scenarios.isEmpty())
+		scenarios = ProjectGenerator::scenarios();
+	if(parser.isSet(generateOption))
+	{
+		for(int i=0; i < scenarios.count(); i++)
+		{
+			QDir dir(parser.value(generateOption));
+			dir.mkpath(scenarios[i]);
+			ProjectGenerator generator(size);
+			if(!generator.generate(scenarios[i], dir.filePath(scenarios[i])))
+				return 1;
+		}
+		return 0;
+	}
+	QJsonArray results;
+	for(int i=0; i < scenarios.count(); i++)
+	{
+		qInfo("Running %s...", qPrintable(scenarios[i]));
+		results.append(runScenario(scenarios[i], size, frames));
+	}
+	QJsonObject out;
+	out.insert("frames", frames);
+	out.insert("size", size);
+	out.insert("qtVersion", qVersion());
+	out.insert("results", results);
+	QByteArray json = QJsonDocument(out).toJson();
+	if(parser.isSet(outputOption))
+	{
+		QFile file(parser.value(outputOption));
+		if(!file.open(QIODevice::WriteOnly))
+		{
+			qCritical("Error: could not write %s", qPrintable(file.fileName()));
+			return 1;
+		}
+		file.write(json);
+	}
+	else
+		QTextStream(stdout) << json;
+	return 0;
+}
@@ -0,0 +1,421 @@
+/*
+ * projectgenerator.cpp
+ * This file is part of QScratchRuntime
+ *
+ * Copyright (C) 2023 - adazem009
+ *
+ * QScratchRuntime is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * QScratchRuntime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QScratchRuntime. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QCryptographicHash>
+#include <QJsonDocument>
+#include <QFile>
+#include <QColor>
+#include <QtDebug>
+#include "projectgenerator.h"
+
+/*! Constructs ProjectGenerator. */
+ProjectGenerator::ProjectGenerator(int size) :
+	m_size(qMax(1, size)) { }
+
+/*! Returns the list of scenario names. */
+QStringList ProjectGenerator::scenarios(void)
+{
+	return {"clones", "broadcasts", "nested-repeat", "costumes", "effects", "waits", "pen"};
+}
+
+/*! Generates the project.json and assets of the given scenario in the given directory. */
+bool ProjectGenerator::generate(const QString &scenario, const QString &dirName)
+{
+	dir = QDir(dirName);
+	targets = QJsonArray();
+	blockCount = 0;
+	// Stage
+	beginTarget("Stage");
+	currentTarget.insert("isStage", true);
+	if(scenario == "broadcasts")
+	{
+		QJsonObject broadcasts;
+		for(int i=0; i < 4; i++)
+			broadcasts.insert("broadcast" + QString::number(i), "message" + QString::number(i));
+		currentTarget.insert("broadcasts", broadcasts);
+	}
+	// Sprites
+	if(scenario == "clones")
+		clonesScenario();
+	else if(scenario == "broadcasts")
+		broadcastsScenario();
+	else if(scenario == "nested-repeat")
+		nestedRepeatScenario();
+	else if(scenario == "costumes")
+		costumesScenario();
+	else if(scenario == "effects")
+		effectsScenario();
+	else if(scenario == "waits")
+		waitsScenario();
+	else if(scenario == "pen")
+		penScenario();
+	else
+	{
+		qWarning() << "Warning: unknown scenario" << scenario;
+		return false;
+	}
+	// The stage is the first target, the broadcasts scenario adds its scripts to it
+	if(targets.isEmpty() || !targets.first().toObject().value("isStage").toBool())
+	{
+		qWarning() << "Warning: the stage wasn't generated";
+		return false;
+	}
+	QJsonObject project;
+	project.insert("targets", targets);
+	project.insert("monitors", QJsonArray());
+	project.insert("extensions", QJsonArray());
+	QJsonObject meta;
+	meta.insert("semver", "3.0.0");
+	meta.insert("vm", "0.2.0");
+	meta.insert("agent", "QScratchRuntime benchmarks");
+	project.insert("meta", meta);
+	QFile file(dir.filePath("project.json"));
+	if(!file.open(QIODevice::WriteOnly))
+		return false;
+	file.write(QJsonDocument(project).toJson(QJsonDocument::Compact));
+	return true;
+}
+
+/*!
+ * Clones: a sprite creates \c size clones, each of them moves and bounces forever.\n
+ * The sprite turns before creating each clone, so that the clones move in different directions.
+ */
+void ProjectGenerator::clonesScenario(void)
+{
+	endTarget();
+	beginTarget("Sprite1");
+	QString cloneMenu = menu("control_create_clone_of_menu", "CLONE_OPTION", "_myself_");
+	QString loopBody = script({
+		block("motion_turnright", {{"DEGREES", number(360.0 / m_size)}}),
+		block("control_create_clone_of", {{"CLONE_OPTION", QJsonArray({1, cloneMenu})}})
+	});
+	script({
+		block("event_whenflagclicked"),
+		block("control_repeat", {{"TIMES", number(m_size)}, {"SUBSTACK", substack(loopBody)}})
+	}, true);
+	QString moveBody = script({
+		block("motion_movesteps", {{"STEPS", number(4)}}),
+		block("motion_ifonedgebounce"),
+		block("motion_turnright", {{"DEGREES", number(1)}})
+	});
+	script({
+		block("control_start_as_clone"),
+		block("control_forever", {{"SUBSTACK", substack(moveBody)}})
+	}, true);
+	endTarget();
+}
+
+/*!
+ * Broadcast storm: the stage broadcasts 4 messages on every frame,
+ * \c size sprites receive all of them.
+ */
+void ProjectGenerator::broadcastsScenario(void)
+{
+	QStringList broadcastBlocks;
+	for(int i=0; i < 4; i++)
+	{
+		QString message = "message" + QString::number(i);
+		QJsonArray input({1, QJsonArray({11, message, "broadcast" + QString::number(i)})});
+		broadcastBlocks += block("event_broadcast", {{"BROADCAST_INPUT", input}});
+	}
+	QString loopBody = script(broadcastBlocks);
+	script({
+		block("event_whenflagclicked"),
+		block("control_forever", {{"SUBSTACK", substack(loopBody)}})
+	}, true);
+	endTarget();
+	for(int i=0; i < m_size; i++)
+	{
+		beginTarget("Sprite" + QString::number(i + 1));
+		for(int j=0; j < 4; j++)
+		{
+			QJsonArray option({"message" + QString::number(j), "broadcast" + QString::number(j)});
+			script({
+				block("event_whenbroadcastreceived", QJsonObject(), {{"BROADCAST_OPTION", option}}),
+				block("motion_changexby", {{"DX", number(j % 2 ? -1 : 1)}}),
+				block("motion_turnright", {{"DEGREES", number(15)}})
+			}, true);
+		}
+		endTarget();
+	}
+}
+
+/*! Nested loops: \c size sprites, each of them runs 3 nested repeat loops forever. */
+void ProjectGenerator::nestedRepeatScenario(void)
+{
+	endTarget();
+	for(int i=0; i < m_size; i++)
+	{
+		beginTarget("Sprite" + QString::number(i + 1));
+		QString innerBody = script({
+			block("motion_changexby", {{"DX", number(1)}}),
+			block("motion_changexby", {{"DX", number(-1)}})
+		});
+		QString middleBody = script({
+			block("control_repeat", {{"TIMES", number(10)}, {"SUBSTACK", substack(innerBody)}})
+		});
+		QString outerBody = script({
+			block("control_repeat", {{"TIMES", number(10)}, {"SUBSTACK", substack(middleBody)}}),
+			block("motion_turnright", {{"DEGREES", number(1)}})
+		});
+		QString foreverBody = script({
+			block("control_repeat", {{"TIMES", number(10)}, {"SUBSTACK", substack(outerBody)}})
+		});
+		script({
+			block("event_whenflagclicked"),
+			block("control_forever", {{"SUBSTACK", substack(foreverBody)}})
+		}, true);
+		endTarget();
+	}
+}
+
+/*! Costume animation: \c size sprites with 4 costumes switch to the next costume on every frame. */
+void ProjectGenerator::costumesScenario(void)
+{
+	endTarget();
+	for(int i=0; i < m_size; i++)
+	{
+		beginTarget("Sprite" + QString::number(i + 1));
+		QString loopBody = script({block("looks_nextcostume")});
+		script({
+			block("event_whenflagclicked"),
+			block("control_forever", {{"SUBSTACK", substack(loopBody)}})
+		}, true);
+		endTarget(4);
+	}
+}
+
+/*! Graphic effects: \c size sprites change the color, whirl and brightness effects on every frame. */
+void ProjectGenerator::effectsScenario(void)
+{
+	endTarget();
+	for(int i=0; i < m_size; i++)
+	{
+		beginTarget("Sprite" + QString::number(i + 1));
+		QString loopBody = script({
+			block("looks_changeeffectby", {{"CHANGE", number(5)}}, {{"EFFECT", field("COLOR")}}),
+			block("looks_changeeffectby", {{"CHANGE", number(10)}}, {{"EFFECT", field("WHIRL")}}),
+			block("looks_seteffectto", {{"VALUE", number(i % 50)}}, {{"EFFECT", field("BRIGHTNESS")}})
+		});
+		script({
+			block("event_whenflagclicked"),
+			block("control_forever", {{"SUBSTACK", substack(loopBody)}})
+		}, true);
+		endTarget();
+	}
+}
+
+/*! Waits: \c size sprites move between waits of different lengths. */
+void ProjectGenerator::waitsScenario(void)
+{
+	endTarget();
+	for(int i=0; i < m_size; i++)
+	{
+		beginTarget("Sprite" + QString::number(i + 1));
+		qreal duration = 0.01 * (i % 10 + 1);
+		QString loopBody = script({
+			block("control_wait", {{"DURATION", number(duration)}}),
+			block("motion_changeyby", {{"DY", number(1)}}),
+			block("control_wait", {{"DURATION", number(duration)}}),
+			block("motion_changeyby", {{"DY", number(-1)}})
+		});
+		script({
+			block("event_whenflagclicked"),
+			block("control_forever", {{"SUBSTACK", substack(loopBody)}})
+		}, true);
+		endTarget();
+	}
+}
+
+/*! Pen: \c size sprites draw lines with changing color while moving on every frame. */
+void ProjectGenerator::penScenario(void)
+{
+	endTarget();
+	for(int i=0; i < m_size; i++)
+	{
+		beginTarget("Sprite" + QString::number(i + 1));
+		QString colorParam = menu("pen_menu_colorParam", "colorParam", "color");
+		QString loopBody = script({
+			block("motion_movesteps", {{"STEPS", number(6)}}),
+			block("motion_turnright", {{"DEGREES", number(7 + i % 5)}}),
+			block("motion_ifonedgebounce"),
+			block("pen_changePenColorParamBy", {{"COLOR_PARAM", QJsonArray({1, colorParam})}, {"VALUE", number(1)}})
+		});
+		script({
+			block("event_whenflagclicked"),
+			block("pen_clear"),
+			block("pen_setPenSizeTo", {{"SIZE", number(1 + i % 4)}}),
+			block("pen_penDown"),
+			block("control_forever", {{"SUBSTACK", substack(loopBody)}})
+		}, true);
+		endTarget();
+	}
+}
+
+/*! Starts a new target (sprite or stage). */
+void ProjectGenerator::beginTarget(const QString &name)
+{
+	currentTarget = QJsonObject();
+	currentBlocks = QJsonObject();
+	currentTarget.insert("isStage", false);
+	currentTarget.insert("name", name);
+	currentTarget.insert("variables", QJsonObject());
+	currentTarget.insert("lists", QJsonObject());
+	currentTarget.insert("broadcasts", QJsonObject());
+	currentTarget.insert("comments", QJsonObject());
+	currentTarget.insert("currentCostume", 0);
+	currentTarget.insert("sounds", QJsonArray());
+	currentTarget.insert("volume", 100);
+	currentTarget.insert("layerOrder", targets.count());
+	if(targets.count() > 0)
+	{
+		// Spread the sprites over the stage
+		int index = targets.count() - 1;
+		currentTarget.insert("visible", true);
+		currentTarget.insert("x", (index * 37) % 400 - 200);
+		currentTarget.insert("y", (index * 53) % 300 - 150);
+		currentTarget.insert("size", 100);
+		currentTarget.insert("direction", 90);
+		currentTarget.insert("draggable", false);
+		currentTarget.insert("rotationStyle", "all around");
+	}
+	else
+		currentTarget.insert("tempo", 60);
+}
+
+/*! Adds the blocks and costumes to the current target and adds it to the project. */
+void ProjectGenerator::endTarget(int costumeCount)
+{
+	bool isStage = currentTarget.value("isStage").toBool();
+	QJsonArray costumes;
+	for(int i=0; i < costumeCount; i++)
+		costumes.append(costume(targets.count() * 4 + i, isStage));
+	currentTarget.insert("costumes", costumes);
+	currentTarget.insert("blocks", currentBlocks);
+	targets.append(currentTarget);
+}
+
+/*! Adds a block to the current target and returns its ID. Blocks used in the inputs become its children. */
+QString ProjectGenerator::block(const QString &opcode, const QJsonObject &inputs, const QJsonObject &fields)
+{
+	QString id = "block" + QString::number(blockCount++);
+	QJsonObject newBlock;
+	newBlock.insert("opcode", opcode);
+	newBlock.insert("next", QJsonValue::Null);
+	newBlock.insert("parent", QJsonValue::Null);
+	newBlock.insert("inputs", inputs);
+	newBlock.insert("fields", fields);
+	newBlock.insert("shadow", false);
+	newBlock.insert("topLevel", false);
+	currentBlocks.insert(id, newBlock);
+	QStringList inputNames = inputs.keys();
+	for(int i=0; i < inputNames.count(); i++)
+	{
+		QJsonValue child = inputs.value(inputNames[i]).toArray().at(1);
+		if(child.isString() && currentBlocks.contains(child.toString()))
+		{
+			QJsonObject childBlock = currentBlocks.value(child.toString()).toObject();
+			childBlock.insert("parent", id);
+			currentBlocks.insert(child.toString(), childBlock);
+		}
+	}
+	return id;
+}
+
+/*! Adds a dropdown menu (shadow block) to the current target and returns its ID. */
+QString ProjectGenerator::menu(const QString &opcode, const QString &fieldName, const QString &value)
+{
+	QString id = block(opcode, QJsonObject(), {{fieldName, field(value)}});
+	QJsonObject menuBlock = currentBlocks.value(id).toObject();
+	menuBlock.insert("shadow", true);
+	currentBlocks.insert(id, menuBlock);
+	return id;
+}
+
+/*! Connects the given blocks into a script and returns the ID of its first block. */
+QString ProjectGenerator::script(const QStringList &blockIds, bool topLevel)
+{
+	for(int i=0; i < blockIds.count(); i++)
+	{
+		QJsonObject currentBlock = currentBlocks.value(blockIds[i]).toObject();
+		if(i > 0)
+			currentBlock.insert("parent", blockIds[i - 1]);
+		if(i + 1 < blockIds.count())
+			currentBlock.insert("next", blockIds[i + 1]);
+		if((i == 0) && topLevel)
+		{
+			currentBlock.insert("topLevel", true);
+			currentBlock.insert("x", 0);
+			currentBlock.insert("y", 0);
+		}
+		currentBlocks.insert(blockIds[i], currentBlock);
+	}
+	return blockIds.value(0);
+}
+
+/*!
+ * Writes an SVG costume into the project directory and returns the costume object.\n
+ * Assets are named by the MD5 hash of their content like in .sb3 files.
+ */
+QJsonObject ProjectGenerator::costume(int index, bool backdrop)
+{
+	int width = backdrop ? 480 : 48;
+	int height = backdrop ? 360 : 48;
+	QColor color = QColor::fromHsv((index * 47) % 360, backdrop ? 20 : 200, 230);
+	QString svg = QString("<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%1\" height=\"%2\" viewBox=\"0 0 %1 %2\">"
+		"<rect x=\"2\" y=\"2\" width=\"%3\" height=\"%4\" rx=\"%5\" fill=\"%6\" stroke=\"#000000\" stroke-width=\"2\"/>"
+		"<circle cx=\"%7\" cy=\"%8\" r=\"%9\" fill=\"#ffffff\"/></svg>")
+		.arg(width).arg(height).arg(width - 4).arg(height - 4).arg(backdrop ? 0 : 8).arg(color.name())
+		.arg(width / 2 + index % 5).arg(height / 3).arg(height / 6);
+	QByteArray data = svg.toUtf8();
+	QString assetId = QCryptographicHash::hash(data, QCryptographicHash::Md5).toHex();
+	QFile file(dir.filePath(assetId + ".svg"));
+	if(file.open(QIODevice::WriteOnly))
+		file.write(data);
+	else
+		qWarning() << "Warning: could not write" << file.fileName();
+	QJsonObject out;
+	out.insert("name", (backdrop ? "backdrop" : "costume") + QString::number(index % 4 + 1));
+	out.insert("assetId", assetId);
+	out.insert("md5ext", assetId + ".svg");
+	out.insert("dataFormat", "svg");
+	out.insert("bitmapResolution", 1);
+	out.insert("rotationCenterX", width / 2);
+	out.insert("rotationCenterY", height / 2);
+	return out;
+}
+
+/*! Returns a number input. */
+QJsonArray ProjectGenerator::number(qreal value)
+{
+	return QJsonArray({1, QJsonArray({4, QString::number(value)})});
+}
+
+/*! Returns a substack input. */
+QJsonArray ProjectGenerator::substack(const QString &blockId)
+{
+	return QJsonArray({2, blockId});
+}
+
+/*! Returns a field value. */
+QJsonArray ProjectGenerator::field(const QString &value)
+{
+	return QJsonArray({value, QJsonValue::Null});
+}
@@ -0,0 +1,67 @@
+/*
+ * projectgenerator.h
+ * This file is part of QScratchRuntime
+ *
+ * Copyright (C) 2023 - adazem009
+ *
+ * QScratchRuntime is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * QScratchRuntime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QScratchRuntime. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PROJECTGENERATOR_H
+#define PROJECTGENERATOR_H
+
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QStringList>
+#include <QDir>
+
+/*!
+ * \brief The ProjectGenerator class generates synthetic Scratch 3 projects for benchmarks.
+ *
+ * Each scenario stresses one part of the runtime. The size parameter scales the workload
+ * (e.g. the number of clones or sprites).
+ */
+class ProjectGenerator
+{
+	public:
+		explicit ProjectGenerator(int size);
+		static QStringList scenarios(void);
+		bool generate(const QString &scenario, const QString &dirName);
+
+	private:
+		void clonesScenario(void);
+		void broadcastsScenario(void);
+		void nestedRepeatScenario(void);
+		void costumesScenario(void);
+		void effectsScenario(void);
+		void waitsScenario(void);
+		void penScenario(void);
+		void beginTarget(const QString &name);
+		void endTarget(int costumeCount = 1);
+		QString block(const QString &opcode, const QJsonObject &inputs = QJsonObject(), const QJsonObject &fields = QJsonObject());
+		QString menu(const QString &opcode, const QString &field, const QString &value);
+		QString script(const QStringList &blockIds, bool topLevel = false);
+		QJsonObject costume(int index, bool backdrop);
+		static QJsonArray number(qreal value);
+		static QJsonArray substack(const QString &blockId);
+		static QJsonArray field(const QString &value);
+		int m_size;
+		int blockCount = 0;
+		QDir dir;
+		QJsonArray targets;
+		QJsonObject currentTarget;
+		QJsonObject currentBlocks;
+};
+
+#endif // PROJECTGENERATOR_H
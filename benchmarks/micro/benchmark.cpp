@@ -0,0 +1,159 @@
+/*
+ * benchmark.cpp
+ * This file is part of QScratchRuntime
+ *
+ * Copyright (C) 2023 - adazem009
+ *
+ * QScratchRuntime is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * QScratchRuntime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QScratchRuntime. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QElapsedTimer>
+#include <QTextStream>
+#include <QtDebug>
+#include <algorithm>
+#include "benchmark.h"
+
+/*! Constructs Benchmark. */
+Benchmark::Benchmark() { }
+
+/*! Sets the number of samples of each benchmark. */
+void Benchmark::setSampleCount(int count)
+{
+	sampleCount = qMax(1, count);
+}
+
+/*! Sets the minimum time of a sample in milliseconds. */
+void Benchmark::setMinSampleTime(qint64 msecs)
+{
+	minSampleTime = qMax<qint64>(1, msecs) * 1000000;
+}
+
+/*! Runs only the benchmarks whose name matches the given regular expression. */
+void Benchmark::setFilter(const QRegularExpression &regex)
+{
+	filter = regex;
+}
+
+/*! Calls the function the given number of times and returns the elapsed time in nanoseconds. */
+qint64 Benchmark::measure(const std::function<void()> &function, qint64 iterations)
+{
+	QElapsedTimer timer;
+	timer.start();
+	for(qint64 i=0; i < iterations; i++)
+		function();
+	return timer.nsecsElapsed();
+}
+
+/*! Returns the median of the given values. */
+qreal Benchmark::median(QVector<qreal> values)
+{
+	if(values.isEmpty())
+		return 0;
+	std::sort(values.begin(), values.end());
+	int middle = values.count() / 2;
+	if(values.count() % 2 == 0)
+		return (values[middle - 1] + values[middle]) / 2;
+	return values[middle];
+}
+
+/*!
+ * Measures the given function.\n
+ * The cleanup function is called (untimed) after each sample, e.g. to delete created objects.
+ * If maxIterations isn't 0, samples don't run the function more times than that.
+ */
+void Benchmark::run(const QString &name, const std::function<void()> &function, const std::function<void()> &cleanup, qint64 maxIterations)
+{
+	if(!filter.pattern().isEmpty() && !filter.match(name).hasMatch())
+		return;
+	QTextStream(stderr) << "Running " << name << "...\n";
+	// Warm up and find the number of iterations per sample
+	qint64 iterations = 1;
+	while(true)
+	{
+		qint64 time = measure(function, iterations);
+		if(cleanup)
+			cleanup();
+		if((time >= minSampleTime) || ((maxIterations > 0) && (iterations >= maxIterations)))
+			break;
+		// Aim for slightly more than the minimum time
+		qint64 next = time > 0 ? iterations * minSampleTime * 12 / 10 / time : iterations * 10;
+		iterations = qBound(iterations * 2, next, iterations * 10);
+		if(maxIterations > 0)
+			iterations = qMin(iterations, maxIterations);
+	}
+	// Samples
+	QVector<qreal> times;
+	for(int i=0; i < sampleCount; i++)
+	{
+		times.append((qreal) measure(function, iterations) / iterations);
+		if(cleanup)
+			cleanup();
+	}
+	Result result;
+	result.name = name;
+	result.iterations = iterations;
+	result.samples = times.count();
+	result.median = median(times);
+	QVector<qreal> deviations;
+	for(int i=0; i < times.count(); i++)
+		deviations.append(qAbs(times[i] - result.median));
+	result.mad = median(deviations);
+	result.min = *std::min_element(times.begin(), times.end());
+	result.max = *std::max_element(times.begin(), times.end());
+	m_results.append(result);
+}
+
+/*! Returns the results of all benchmarks which were run. */
+QList<Benchmark::Result> Benchmark::results(void) const
+{
+	return m_results;
+}
+
+/*! Returns the results as a JSON array. */
+QJsonArray Benchmark::toJson(void) const
+{
+	QJsonArray out;
+	for(int i=0; i < m_results.count(); i++)
+	{
+		QJsonObject result;
+		result.insert("name", m_results[i].name);
+		result.insert("iterations", m_results[i].iterations);
+		result.insert("samples", m_results[i].samples);
+		result.insert("medianNs", m_results[i].median);
+		result.insert("madNs", m_results[i].mad);
+		result.insert("minNs", m_results[i].min);
+		result.insert("maxNs", m_results[i].max);
+		out.append(result);
+	}
+	return out;
+}
+
+/*! Returns the results as a text table. */
+QString Benchmark::toTable(void) const
+{
+	int nameWidth = 9;
+	for(int i=0; i < m_results.count(); i++)
+		nameWidth = qMax(nameWidth, m_results[i].name.length());
+	QString out = QString("Benchmark").leftJustified(nameWidth + 2) + QString("median (ns)").rightJustified(14)
+		+ QString("MAD (%)").rightJustified(10) + QString("min (ns)").rightJustified(14) + QString("iterations").rightJustified(12) + "\n";
+	for(int i=0; i < m_results.count(); i++)
+	{
+		const Result &result = m_results[i];
+		qreal madPercent = result.median > 0 ? result.mad / result.median * 100 : 0;
+		out += result.name.leftJustified(nameWidth + 2) + QString::number(result.median, 'f', 1).rightJustified(14)
+			+ QString::number(madPercent, 'f', 2).rightJustified(10) + QString::number(result.min, 'f', 1).rightJustified(14)
+			+ QString::number(result.iterations).rightJustified(12) + "\n";
+	}
+	return out;
+}
@@ -0,0 +1,70 @@
+/*
+ * benchmark.h
+ * This file is part of QScratchRuntime
+ *
+ * Copyright (C) 2023 - adazem009
+ *
+ * QScratchRuntime is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * QScratchRuntime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QScratchRuntime. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <QString>
+#include <QRegularExpression>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <functional>
+
+/*!
+ * \brief The Benchmark class measures the time of small functions.
+ *
+ * After a warm-up, the number of iterations per sample is calibrated so that each sample
+ * takes at least the minimum sample time. The result is the median time per iteration
+ * of all samples, together with the median absolute deviation (MAD) as a measure of noise.
+ */
+class Benchmark
+{
+	public:
+		/*! Result of a benchmark. Times are in nanoseconds per iteration. */
+		struct Result
+		{
+			QString name;
+			qint64 iterations = 0; /*!< Iterations per sample. */
+			int samples = 0;
+			qreal median = 0;
+			qreal mad = 0;
+			qreal min = 0;
+			qreal max = 0;
+		};
+		Benchmark();
+		void setSampleCount(int count);
+		void setMinSampleTime(qint64 msecs);
+		void setFilter(const QRegularExpression &regex);
+		void run(const QString &name, const std::function<void()> &function,
+			const std::function<void()> &cleanup = nullptr, qint64 maxIterations = 0);
+		QList<Result> results(void) const;
+		QJsonArray toJson(void) const;
+		QString toTable(void) const;
+
+	private:
+		qint64 measure(const std::function<void()> &function, qint64 iterations);
+		static qreal median(QVector<qreal> values);
+		int sampleCount = 30;
+		qint64 minSampleTime = 10000000; // ns
+		QRegularExpression filter;
+		QList<Result> m_results;
+};
+
+#endif // BENCHMARK_H
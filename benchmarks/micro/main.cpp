@@ -0,0 +1,400 @@
+/*
+ * main.cpp
+ * This file is part of QScratchRuntime
+ *
+ * Copyright (C) 2023 - adazem009
+ *
+ * QScratchRuntime is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * QScratchRuntime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QScratchRuntime. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QTemporaryDir>
+#include <QJsonDocument>
+#include <QBuffer>
+#include <QFile>
+#include <QTextStream>
+#include <QGraphicsRectItem>
+#include <QtDebug>
+#include "benchmark.h"
+#include "projectgenerator.h"
+#include "projectscene.h"
+#include "core/blocks.h"
+#include "core/engine.h"
+#include "core/projectparser.h"
+
+// Results are written here, so that the compiler doesn't remove the measured code
+static volatile int sink = 0;
+
+// Blocks used by the getInputs() benchmarks
+static const char *testBlocks = R"({
+	"move": {"opcode": "motion_movesteps", "next": null, "parent": null, "shadow": false, "topLevel": false,
+		"inputs": {"STEPS": [1, [4, "10"]]}, "fields": {}},
+	"gotoxy": {"opcode": "motion_gotoxy", "next": null, "parent": null, "shadow": false, "topLevel": false,
+		"inputs": {"X": [1, [4, "-120"]], "Y": [1, [4, "45.5"]]}, "fields": {}},
+	"effect": {"opcode": "looks_changeeffectby", "next": null, "parent": null, "shadow": false, "topLevel": false,
+		"inputs": {"CHANGE": [1, [4, "25"]]}, "fields": {"EFFECT": ["COLOR", null]}},
+	"clone": {"opcode": "control_create_clone_of", "next": null, "parent": null, "shadow": false, "topLevel": false,
+		"inputs": {"CLONE_OPTION": [1, "cloneMenu"]}, "fields": {}},
+	"cloneMenu": {"opcode": "control_create_clone_of_menu", "next": null, "parent": "clone", "shadow": true, "topLevel": false,
+		"inputs": {}, "fields": {"CLONE_OPTION": ["_myself_", null]}}
+})";
+
+/*! Adds an SVG costume of the given size to the asset store and returns the costume object. */
+static QJsonObject svgCostume(int size)
+{
+	QString assetId = "svg" + QString::number(size);
+	QString svg = QString("<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%1\" height=\"%1\" viewBox=\"0 0 %1 %1\">"
+		"<rect x=\"2\" y=\"2\" width=\"%2\" height=\"%2\" rx=\"8\" fill=\"#4c97ff\" stroke=\"#000000\" stroke-width=\"2\"/>"
+		"<circle cx=\"%3\" cy=\"%3\" r=\"%4\" fill=\"#ffab19\"/></svg>").arg(size).arg(size - 4).arg(size / 2).arg(size / 4);
+	projectAssets.insert(assetId, svg.toUtf8());
+	QJsonObject out;
+	out.insert("name", assetId);
+	out.insert("assetId", assetId);
+	out.insert("dataFormat", "svg");
+	out.insert("rotationCenterX", size / 2);
+	out.insert("rotationCenterY", size / 2);
+	return out;
+}
+
+/*! Adds a PNG costume of the given size to the asset store and returns the costume object. */
+static QJsonObject pngCostume(int size)
+{
+	QString assetId = "png" + QString::number(size);
+	QImage image(size, size, QImage::Format_ARGB32);
+	image.fill(Qt::transparent);
+	QPainter painter(&image);
+	painter.setRenderHint(QPainter::Antialiasing);
+	painter.setBrush(QColor(0x4c, 0x97, 0xff));
+	painter.drawEllipse(2, 2, size - 4, size - 4);
+	painter.end();
+	QBuffer buffer;
+	buffer.open(QIODevice::WriteOnly);
+	image.save(&buffer, "PNG");
+	projectAssets.insert(assetId, buffer.data());
+	QJsonObject out;
+	out.insert("name", assetId);
+	out.insert("assetId", assetId);
+	out.insert("dataFormat", "png");
+	out.insert("bitmapResolution", 2);
+	out.insert("rotationCenterX", size / 2);
+	out.insert("rotationCenterY", size / 2);
+	return out;
+}
+
+/*! Creates a sprite with the given costumes and blocks. */
+static scratchSprite *createSprite(const QString &name, const QJsonArray &costumes, const QJsonObject &blocks = QJsonObject())
+{
+	QJsonObject sprite;
+	sprite.insert("isStage", false);
+	sprite.insert("name", name);
+	sprite.insert("costumes", costumes);
+	sprite.insert("currentCostume", 0);
+	sprite.insert("sounds", QJsonArray());
+	sprite.insert("blocks", blocks);
+	sprite.insert("volume", 100);
+	sprite.insert("layerOrder", 1);
+	sprite.insert("visible", true);
+	sprite.insert("x", 0);
+	sprite.insert("y", 0);
+	sprite.insert("size", 100);
+	sprite.insert("direction", 90);
+	sprite.insert("draggable", false);
+	sprite.insert("rotationStyle", "all around");
+	// The sprite is read by projectParser, so the blocks have the same form as in a loaded project
+	QJsonObject project;
+	project.insert("targets", QJsonArray({sprite}));
+	projectParser parser("", QJsonDocument(project).toJson(QJsonDocument::Compact));
+	return parser.sprites().value(0);
+}
+
+/*! Measures Engine::getInputs() on blocks with number inputs, fields and menus. */
+static void getInputsBenchmarks(Benchmark &benchmark)
+{
+	QJsonObject blocks = QJsonDocument::fromJson(testBlocks).object();
+	scratchSprite *sprite = createSprite("GetInputs", {svgCostume(48)}, blocks);
+	QStringList blockIds = {"move", "gotoxy", "effect", "clone"};
+	for(int i=0; i < blockIds.count(); i++)
+	{
+		QVariantMap block = sprite->blocks.value(blockIds[i]);
+		benchmark.run("getInputs/" + blockIds[i], [sprite, block]() {
+			sink += sprite->engine()->getInputs(block).count();
+		});
+	}
+	delete sprite;
+}
+
+/*! Measures Blocks::runBlock() dispatch of a reporter block from each opcode family. */
+static void runBlockBenchmarks(Benchmark &benchmark)
+{
+	scratchSprite *sprite = createSprite("RunBlock", {svgCostume(48)});
+	sprite->engine()->processID = 0;
+	Blocks blocks(sprite);
+	QList<QPair<QString,QString>> opcodes = {
+		{"motion", "motion_xposition"},
+		{"looks", "looks_size"},
+		{"sound", "sound_volume"},
+		{"event", "event_broadcast_menu"},
+		{"control", "control_create_clone_of_menu"},
+		{"unsupported", "operator_add"}
+	};
+	QMap<QString,QString> inputs;
+	inputs.insert("BROADCAST_OPTION", "message1");
+	inputs.insert("CLONE_OPTION", "_myself_");
+	for(int i=0; i < opcodes.count(); i++)
+	{
+		QString opcode = opcodes[i].second;
+		benchmark.run("runBlock/" + opcodes[i].first, [&blocks, opcode, inputs]() {
+			QString returnValue;
+			sink += blocks.runBlock(opcode, inputs, &returnValue);
+			sink += returnValue.length();
+		});
+	}
+	delete sprite;
+}
+
+/*! Measures scratchSprite::setCostume() with SVG and PNG costumes. */
+static void setCostumeBenchmarks(Benchmark &benchmark)
+{
+	scratchSprite *sprite = createSprite("SetCostume", {svgCostume(96), pngCostume(192)});
+	benchmark.run("setCostume/svg", [sprite]() {
+		sprite->setCostume(0);
+	});
+	benchmark.run("setCostume/png", [sprite]() {
+		sprite->setCostume(1);
+	});
+	delete sprite;
+}
+
+/*!
+ * Measures 10 moves of a sprite in a frame followed by the update of the graphics item.\n
+ * The moves only change the SpriteStore, so there is one position update per iteration.
+ */
+static void motionBenchmarks(Benchmark &benchmark)
+{
+	scratchSprite *sprite = createSprite("Motion", {svgCostume(96)});
+	Engine *engine = sprite->engine();
+	benchmark.run("syncView/move10", [sprite, engine]() {
+		for(int i=0; i < 10; i++)
+		{
+			engine->setX(sprite->spriteX() + 1);
+			engine->setY(sprite->spriteY() - 1);
+		}
+		engine->setDirection(sprite->direction() + 15);
+		sprite->syncView();
+	});
+	delete sprite;
+}
+
+/*!
+ * Measures applying graphic effects in scratchSprite::syncView() at several costume sizes.\n
+ * The effect value changes in every iteration, so the results aren't cached.
+ */
+static void graphicEffectsBenchmarks(Benchmark &benchmark)
+{
+	QList<int> sizes = {48, 192, 480};
+	QStringList effects = {"COLOR", "WHIRL"};
+	for(int i=0; i < sizes.count(); i++)
+	{
+		scratchSprite *sprite = createSprite("Effects", {svgCostume(sizes[i])});
+		for(int j=0; j < effects.count(); j++)
+		{
+			QString effect = effects[j];
+			sprite->resetGraphicEffects();
+			benchmark.run("installGraphicEffects/" + effect.toLower() + "/" + QString::number(sizes[i]), [sprite, effect]() {
+				sprite->setGraphicEffect(effect, sprite->graphicEffect(effect) + 0.731);
+				sprite->syncView();
+			});
+		}
+		delete sprite;
+	}
+}
+
+/*! Measures layer changes of 300 clones, each going to the front or the back. */
+static void layerBenchmarks(Benchmark &benchmark)
+{
+	QList<QGraphicsRectItem*> items;
+	for(int i=0; i < 300; i++)
+	{
+		items.append(new QGraphicsRectItem);
+		layerList.insert(items[i], i + 1);
+	}
+	benchmark.run("layers/goToFront/300", [&items]() {
+		for(int i=0; i < items.count(); i++)
+			layerList.goToFront(items[i]);
+	});
+	benchmark.run("layers/goToBack/300", [&items]() {
+		for(int i=0; i < items.count(); i++)
+			layerList.goToBack(items[i]);
+	});
+	for(int i=0; i < items.count(); i++)
+	{
+		layerList.remove(items[i]);
+		delete items[i];
+	}
+}
+
+/*! Measures mixing of 32 voices into one block of the output stream (with and without pitch and pan effects). */
+static void audioBenchmarks(Benchmark &benchmark)
+{
+	audioMixer.setSink(new NullAudioSink);
+	SoundBuffer *buffer = new SoundBuffer;
+	buffer->samples.resize(AudioMixer::sampleRate * 2);
+	for(int i=0; i < buffer->samples.count(); i++)
+		buffer->samples[i] = qSin(i * 0.01) * 0.1;
+	SoundBufferPtr sound(buffer);
+	benchmark.run("audio/mix/32", [sound]() {
+		// The voices are restarted when the sound ends
+		if(audioMixer.voiceCount() == 0)
+		{
+			for(int i=0; i < 32; i++)
+				audioMixer.play(audioMixer.reserveVoice(), sound, i % 4);
+		}
+		audioMixer.renderTo(audioMixer.renderedFrames() + AudioMixer::blockSize);
+	});
+	audioMixer.stopAll();
+	for(int i=0; i < 4; i++)
+		audioMixer.setEffects(i, i * 30 - 45, i * 50 - 75);
+	benchmark.run("audio/pitchPan/32", [sound]() {
+		if(audioMixer.voiceCount() == 0)
+		{
+			for(int i=0; i < 32; i++)
+				audioMixer.play(audioMixer.reserveVoice(), sound, i % 4);
+		}
+		audioMixer.renderTo(audioMixer.renderedFrames() + AudioMixer::blockSize);
+	});
+	for(int i=0; i < 4; i++)
+		audioMixer.releaseChannel(i);
+	audioMixer.setSink(nullptr);
+}
+
+/*! Measures projectScene::createClone(). */
+static void createCloneBenchmarks(Benchmark &benchmark)
+{
+	projectScene scene(1);
+	scene.setTimerEnabled(false);
+	scratchSprite *sprite = createSprite("CreateClone", {svgCostume(96)});
+	scene.addItem(sprite);
+	spriteList.append(sprite);
+	QList<scratchSprite*> clones;
+	// Clones are deleted after each sample and there can be at most 300 clones
+	benchmark.run("createClone", [&scene, sprite, &clones]() {
+		clones.append(scene.createClone(sprite));
+	}, [&scene, &clones]() {
+		for(int i=0; i < clones.count(); i++)
+		{
+			if(clones[i] == nullptr)
+				continue;
+			scene.removeItem(clones[i]);
+			spriteList.removeAll(clones[i]);
+			delete clones[i];
+		}
+		clones.clear();
+	}, 250);
+	scene.removeItem(sprite);
+	spriteList.removeAll(sprite);
+	delete sprite;
+}
+
+/*! Measures projectParser on large generated projects. */
+static void projectParserBenchmarks(Benchmark &benchmark)
+{
+	QTemporaryDir dir;
+	if(!dir.isValid() || !ProjectGenerator(1000).generate("nested-repeat", dir.path()))
+	{
+		qWarning() << "Warning: could not generate the project";
+		return;
+	}
+	QFile file(dir.filePath("project.json"));
+	file.open(QIODevice::ReadOnly);
+	QByteArray json = file.readAll();
+	file.close();
+	benchmark.run("projectParser/parse", [json]() {
+		projectParser parser("", json);
+		sink += parser.assetIDs().count();
+	}, nullptr, 1000);
+	QList<scratchSprite*> sprites;
+	QString fileName = dir.filePath("project.json");
+	benchmark.run("projectParser/sprites", [fileName, &sprites]() {
+		projectParser parser(fileName, "");
+		sprites += parser.sprites();
+	}, [&sprites]() {
+		qDeleteAll(sprites);
+		sprites.clear();
+	}, 10);
+	projectAssets.clear();
+}
+
+int main(int argc, char *argv[])
+{
+	// Sprites are created without a window
+	qputenv("QT_QPA_PLATFORM", "offscreen");
+	QApplication a(argc, argv);
+	QCoreApplication::setOrganizationName("adazem009");
+	QCoreApplication::setApplicationName("QScratchRuntime");
+	QCommandLineParser parser;
+	parser.setApplicationDescription("QScratchRuntime micro benchmarks");
+	parser.addHelpOption();
+	QCommandLineOption filterOption("filter", "Run only benchmarks whose name matches the regular expression.", "regex");
+	QCommandLineOption samplesOption("samples", "Number of samples of each benchmark.", "N", "30");
+	QCommandLineOption minTimeOption("min-time", "Minimum time of a sample in milliseconds.", "ms", "10");
+	QCommandLineOption jsonOption("json", "Print the results as JSON.");
+	QCommandLineOption outputOption("output", "Write the results into a file instead of standard output.", "file");
+	parser.addOption(filterOption);
+	parser.addOption(samplesOption);
+	parser.addOption(minTimeOption);
+	parser.addOption(jsonOption);
+	parser.addOption(outputOption);
+	parser.process(a);
+	Benchmark benchmark;
+	benchmark.setSampleCount(parser.value(samplesOption).toInt());
+	benchmark.setMinSampleTime(parser.value(minTimeOption).toLongLong());
+	if(parser.isSet(filterOption))
+		benchmark.setFilter(QRegularExpression(parser.value(filterOption)));
+	getInputsBenchmarks(benchmark);
+	runBlockBenchmarks(benchmark);
+	setCostumeBenchmarks(benchmark);
+	motionBenchmarks(benchmark);
+	graphicEffectsBenchmarks(benchmark);
+	createCloneBenchmarks(benchmark);
+	layerBenchmarks(benchmark);
+	audioBenchmarks(benchmark);
+	projectParserBenchmarks(benchmark);
+	// Pixmaps must be destroyed before the application
+	costumeCache.clear();
+	graphicEffectsCache.clear();
+	QByteArray out;
+	if(parser.isSet(jsonOption))
+	{
+		QJsonObject results;
+		results.insert("qtVersion", qVersion());
+		results.insert("results", benchmark.toJson());
+		out = QJsonDocument(results).toJson();
+	}
+	else
+		out = benchmark.toTable().toUtf8();
+	if(parser.isSet(outputOption))
+	{
+		QFile file(parser.value(outputOption));
+		if(!file.open(QIODevice::WriteOnly))
+		{
+			qCritical("Error: could not write %s", qPrintable(file.fileName()));
+			return 1;
+		}
+		file.write(out);
+	}
+	else
+		QTextStream(stdout) << out;
+	return 0;
+}
@@ -0,0 +1,19 @@
+include(../../runtime.pri)
+
+TARGET = micro-benchmark
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+# The project generator is shared with the macro benchmarks
+INCLUDEPATH += ../macro
+
+SOURCES += \
+    main.cpp \
+    benchmark.cpp \
+    ../macro/projectgenerator.cpp
+
+HEADERS += \
+    benchmark.h \
+    ../macro/projectgenerator.h
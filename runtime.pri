@@ -0,0 +1,90 @@
+# Runtime sources, which are shared by QScratchRuntime and the benchmarks
+
+QT       += core gui multimedia svg network
+
+!wasm {
+	QT += concurrent
+}
+
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+
+wasm {
+    QTPLUGIN += qsvg
+}
+
+# zlib is used to inflate .sb3 archives
+wasm {
+    QMAKE_CXXFLAGS += -s USE_ZLIB=1
+    QMAKE_LFLAGS += -s USE_ZLIB=1
+} else {
+    LIBS += -lz
+}
+
+# Used to read peak memory usage
+win32: LIBS += -lpsapi
+
+INCLUDEPATH += $$PWD/src/include
+
+SOURCES += \
+    $$PWD/src/core/scratchsprite.cpp \
+    $$PWD/src/core/blocks.cpp \
+    $$PWD/src/global.cpp \
+    $$PWD/src/projectscene.cpp \
+    $$PWD/src/headlessrunner.cpp \
+    $$PWD/src/core/projectparser.cpp \
+    $$PWD/src/core/engine.cpp \
+    $$PWD/src/core/assetstore.cpp \
+    $$PWD/src/core/sb3reader.cpp \
+    $$PWD/src/core/graphiceffects.cpp \
+    $$PWD/src/core/costumecache.cpp \
+    $$PWD/src/core/engineclock.cpp \
+    $$PWD/src/core/randomgenerator.cpp \
+    $$PWD/src/core/profiler.cpp \
+    $$PWD/src/core/framestats.cpp \
+    $$PWD/src/core/penlayer.cpp \
+    $$PWD/src/core/workerpool.cpp \
+    $$PWD/src/core/commandbuffer.cpp \
+    $$PWD/src/core/spritestore.cpp \
+    $$PWD/src/core/layerlist.cpp \
+    $$PWD/src/core/soundcache.cpp \
+    $$PWD/src/core/audiosink.cpp \
+    $$PWD/src/core/audiomixer.cpp \
+    $$PWD/src/core/audioinput.cpp \
+    $$PWD/src/core/loudnessmeter.cpp \
+    $$PWD/src/core/assetcache.cpp \
+    $$PWD/src/core/assetfetcher.cpp \
+    $$PWD/src/core/jsonstreamreader.cpp
+
+HEADERS += \
+    $$PWD/src/include/core/scratchsprite.h \
+    $$PWD/src/include/core/blocks.h \
+    $$PWD/src/include/global.h \
+    $$PWD/src/include/projectscene.h \
+    $$PWD/src/include/headlessrunner.h \
+    $$PWD/src/include/core/projectparser.h \
+    $$PWD/src/include/core/engine.h \
+    $$PWD/src/include/core/assetstore.h \
+    $$PWD/src/include/core/sb3reader.h \
+    $$PWD/src/include/core/graphiceffects.h \
+    $$PWD/src/include/core/costumecache.h \
+    $$PWD/src/include/core/engineclock.h \
+    $$PWD/src/include/core/randomgenerator.h \
+    $$PWD/src/include/core/profiler.h \
+    $$PWD/src/include/core/framestats.h \
+    $$PWD/src/include/core/penlayer.h \
+    $$PWD/src/include/core/workerpool.h \
+    $$PWD/src/include/core/commandbuffer.h \
+    $$PWD/src/include/core/spritestore.h \
+    $$PWD/src/include/core/layerlist.h \
+    $$PWD/src/include/core/soundcache.h \
+    $$PWD/src/include/core/audiosink.h \
+    $$PWD/src/include/core/audiomixer.h \
+    $$PWD/src/include/core/audioinput.h \
+    $$PWD/src/include/core/loudnessmeter.h \
+    $$PWD/src/include/core/assetcache.h \
+    $$PWD/src/include/core/assetfetcher.h \
+    $$PWD/src/include/core/jsonstreamreader.h \
+    $$PWD/src/include/core/targetdata.h
+
+RESOURCES += \
+    $$PWD/res/res.qrc
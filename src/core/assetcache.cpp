@@ -0,0 +1,283 @@
+/*
+ * assetcache.cpp
+ * This file is part of QScratchRuntime
+ *
+ * Copyright (C) 2023 - adazem009
+ *
+ * QScratchRuntime is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * QScratchRuntime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QScratchRuntime. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QDir>
+#include <QSet>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QDateTime>
+#include <QCryptographicHash>
+#include <QSettings>
+#include <QtDebug>
+#ifndef Q_OS_WASM
+#include <QtConcurrent>
+#endif // Q_OS_WASM
+#include "core/assetcache.h"
+
+/*! Cached file which is verified by AssetCache::load(). */
+struct CachedAsset
+{
+	QMap<QString,QString> asset;
+	QString fileName;
+	bool valid;
+};
+
+/*! Constructs AssetCache, creates the directory and reads the list of cached files. */
+AssetCache::AssetCache(const QString &directory, qint64 maxSize, QObject *parent) :
+	QObject(parent),
+	m_directory(directory),
+	m_maxSize(maxSize)
+{
+	// Files are written one by one, so they don't compete with the project for the CPU
+	writer.setMaxThreadCount(1);
+	QDir().mkpath(m_directory);
+	scan();
+}
+
+/*! Waits until all files are written and destroys the AssetCache object. */
+AssetCache::~AssetCache()
+{
+	waitForWrites();
+}
+
+/*! Returns the cache directory. */
+QString AssetCache::directory(void) const
+{
+	return m_directory;
+}
+
+/*! Returns the maximum total size of the cached files (in bytes). */
+qint64 AssetCache::maxSize(void) const
+{
+	return m_maxSize;
+}
+
+/*! Returns the total size of the cached files (in bytes). */
+qint64 AssetCache::size(void) const
+{
+	QMutexLocker locker(&mutex);
+	return m_size;
+}
+
+/*!
+ * Adds the cached assets from the given list (with "assetId" and "dataFormat" keys) to the asset store.\n
+ * The cached files are memory-mapped and verified in parallel. Returns the assets which must be downloaded
+ * (assets which aren't cached or whose files don't match the ID). Each asset is listed only once.
+ */
+QList<QMap<QString,QString>> AssetCache::load(const QList<QMap<QString,QString>> &assets, AssetStore *store)
+{
+	QList<QMap<QString,QString>> missing;
+	QVector<CachedAsset> cached;
+	QSet<QString> listed;
+	mutex.lock();
+	for(int i=0; i < assets.count(); i++)
+	{
+		QString assetId = assets[i].value("assetId");
+		if(listed.contains(assetId))
+			continue;
+		listed.insert(assetId);
+		if(entries.contains(assetId))
+		{
+			CachedAsset asset;
+			asset.asset = assets[i];
+			asset.fileName = entries.value(assetId).fileName;
+			asset.valid = false;
+			cached.append(asset);
+		}
+		else
+			missing.append(assets[i]);
+	}
+	mutex.unlock();
+	// Hash the cached files
+	auto verifyFile = [store](CachedAsset &asset) {
+		QByteArray data = store->mapData(asset.fileName);
+		asset.valid = verify(asset.asset.value("assetId"), data);
+		if(!asset.valid)
+			return;
+		store->insert(asset.asset.value("assetId"), data);
+#if QT_VERSION >= QT_VERSION_CHECK(5, 10, 0)
+		// The modification time is the time of the last use
+		QFile file(asset.fileName);
+		if(file.open(QFile::Append))
+			file.setFileTime(QDateTime::currentDateTimeUtc(), QFileDevice::FileModificationTime);
+#endif
+	};
+#ifdef Q_OS_WASM
+	for(int i=0; i < cached.count(); i++)
+		verifyFile(cached[i]);
+#else
+	QtConcurrent::blockingMap(cached, verifyFile);
+#endif // Q_OS_WASM
+	QMutexLocker locker(&mutex);
+	for(int i=0; i < cached.count(); i++)
+	{
+		QString assetId = cached[i].asset.value("assetId");
+		if(cached[i].valid)
+			touch(assetId);
+		else
+		{
+			qWarning() << "Warning: removing corrupted cached asset" << cached[i].fileName;
+			remove(assetId);
+			missing.append(cached[i].asset);
+		}
+	}
+	return missing;
+}
+
+/*!
+ * Writes a downloaded asset into the cache and removes the least recently used files if the cache is full.\n
+ * Assets whose data doesn't match the ID aren't cached. Returns true if the asset was written.
+ * \see insertLater()
+ */
+bool AssetCache::insert(const QString &assetId, const QString &dataFormat, const QByteArray &data)
+{
+	if(!verify(assetId, data))
+	{
+		qWarning() << "Warning: asset" << assetId << "doesn't match its ID, it won't be cached";
+		return false;
+	}
+	QString fileName = m_directory + "/" + assetId + "." + dataFormat;
+	// The file is renamed when it's complete, so there are no partially written files
+	QSaveFile file(fileName);
+	if(!file.open(QFile::WriteOnly) || (file.write(data) != data.size()) || !file.commit())
+	{
+		qWarning() << "Warning: could not write" << fileName;
+		return false;
+	}
+	QMutexLocker locker(&mutex);
+	if(entries.contains(assetId))
+	{
+		Entry &entry = entries[assetId];
+		m_size -= entry.size;
+		entry.fileName = fileName;
+		entry.size = data.size();
+		m_size += entry.size;
+		touch(assetId);
+	}
+	else
+	{
+		Entry entry;
+		entry.fileName = fileName;
+		entry.size = data.size();
+		entry.lastUse = useCounter++;
+		entries.insert(assetId, entry);
+		lruList.insert(entry.lastUse, assetId);
+		m_size += entry.size;
+	}
+	evict();
+	return true;
+}
+
+/*!
+ * Verifies and writes a downloaded asset on the writer thread. assetWritten() is emitted when it's done.\n
+ * The data must not be changed until then (QByteArray is implicitly shared, so a copy can be passed).
+ */
+void AssetCache::insertLater(const QString &assetId, const QString &dataFormat, const QByteArray &data)
+{
+#ifdef Q_OS_WASM
+	emit assetWritten(assetId, insert(assetId, dataFormat, data));
+#else
+	QtConcurrent::run(&writer, [this, assetId, dataFormat, data]() {
+		emit assetWritten(assetId, insert(assetId, dataFormat, data));
+	});
+#endif // Q_OS_WASM
+}
+
+/*! Waits until all assets passed to insertLater() are written. */
+void AssetCache::waitForWrites(void)
+{
+	writer.waitForDone();
+}
+
+/*! Removes all cached files. */
+void AssetCache::clear(void)
+{
+	QMutexLocker locker(&mutex);
+	QStringList assetIds = entries.keys();
+	for(int i=0; i < assetIds.count(); i++)
+		remove(assetIds[i]);
+}
+
+/*! Returns true if the MD5 hash of the data is the given asset ID. */
+bool AssetCache::verify(const QString &assetId, const QByteArray &data)
+{
+	if(data.isEmpty())
+		return false;
+	return QCryptographicHash::hash(data, QCryptographicHash::Md5).toHex() == assetId.toLatin1().toLower();
+}
+
+/*! Returns the size limit set by the user (main/assetCacheSize in MiB, 256 by default) in bytes. */
+qint64 AssetCache::maxSizeSetting(void)
+{
+	QSettings settings;
+	return settings.value("main/assetCacheSize", 256).toLongLong() * 1024 * 1024;
+}
+
+/*! Reads the list of cached files, from the least recently used one. */
+void AssetCache::scan(void)
+{
+	QFileInfoList files = QDir(m_directory).entryInfoList(QDir::Files, QDir::Time | QDir::Reversed);
+	QMutexLocker locker(&mutex);
+	for(int i=0; i < files.count(); i++)
+	{
+		QString assetId = files[i].completeBaseName();
+		if((assetId.length() != 32) || files[i].suffix().isEmpty())
+		{
+			// Temporary files of QSaveFile ("<asset ID>.<format>.XXXXXX") are left by interrupted writes
+			if((files[i].fileName().count('.') == 2) && (files[i].baseName().length() == 32))
+				QFile::remove(files[i].absoluteFilePath());
+			continue;
+		}
+		Entry entry;
+		entry.fileName = files[i].absoluteFilePath();
+		entry.size = files[i].size();
+		entry.lastUse = useCounter++;
+		entries.insert(assetId, entry);
+		lruList.insert(entry.lastUse, assetId);
+		m_size += entry.size;
+	}
+	evict();
+}
+
+/*! Marks the given asset as the most recently used one. The mutex must be locked. */
+void AssetCache::touch(const QString &assetId)
+{
+	Entry &entry = entries[assetId];
+	lruList.remove(entry.lastUse);
+	entry.lastUse = useCounter++;
+	lruList.insert(entry.lastUse, assetId);
+}
+
+/*! Removes the file of the given asset. The mutex must be locked. */
+void AssetCache::remove(const QString &assetId)
+{
+	Entry entry = entries.take(assetId);
+	lruList.remove(entry.lastUse);
+	m_size -= entry.size;
+	if(!QFile::remove(entry.fileName))
+		qWarning() << "Warning: could not remove" << entry.fileName;
+}
+
+/*! Removes the least recently used files until the cache fits into the size limit. The mutex must be locked. */
+void AssetCache::evict(void)
+{
+	while((m_size > m_maxSize) && !lruList.isEmpty())
+		remove(lruList.first());
+}
@@ -0,0 +1,328 @@
+/*
+ * assetfetcher.cpp
+ * This file is part of QScratchRuntime
+ *
+ * Copyright (C) 2023 - adazem009
+ *
+ * QScratchRuntime is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * QScratchRuntime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QScratchRuntime. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QtDebug>
+#include "core/assetfetcher.h"
+
+// Delay of the first retry (doubled for each next retry)
+static const int retryDelay = 500;
+
+/*! Constructs AssetFetcher, which adds the downloaded assets to the given store. */
+AssetFetcher::AssetFetcher(AssetStore *store, QObject *parent) :
+	QObject(parent),
+	manager(new QNetworkAccessManager(this)),
+	m_store(store),
+	m_urlTemplate("https://assets.scratch.mit.edu/internalapi/asset/%1.%2/get/") { }
+
+/*! Aborts all requests and destroys the AssetFetcher object. */
+AssetFetcher::~AssetFetcher()
+{
+	abort();
+}
+
+/*!
+ * Sets the URL of the assets. %1 is replaced by the asset ID and %2 by the data format.\n
+ * This can be used to download the assets from another server (e.g. a local one).
+ */
+void AssetFetcher::setUrlTemplate(const QString &urlTemplate)
+{
+	m_urlTemplate = urlTemplate;
+}
+
+/*! Returns the URL of the assets. \see setUrlTemplate() */
+QString AssetFetcher::urlTemplate(void) const
+{
+	return m_urlTemplate;
+}
+
+/*! Sets the maximum number of requests which run at the same time. */
+void AssetFetcher::setMaxConcurrent(int count)
+{
+	m_maxConcurrent = qMax(1, count);
+	startRequests();
+}
+
+/*! Returns the maximum number of requests which run at the same time. */
+int AssetFetcher::maxConcurrent(void) const
+{
+	return m_maxConcurrent;
+}
+
+/*! Sets the number of retries of requests which fail with a transient error. */
+void AssetFetcher::setMaxRetries(int count)
+{
+	m_maxRetries = qMax(0, count);
+}
+
+/*! Returns the number of retries of requests which fail with a transient error. */
+int AssetFetcher::maxRetries(void) const
+{
+	return m_maxRetries;
+}
+
+/*! Sets the time without received data (in ms) after which a request is aborted and retried. */
+void AssetFetcher::setTransferTimeout(int msecs)
+{
+	m_transferTimeout = qMax(1, msecs);
+}
+
+/*! Returns the time without received data (in ms) after which a request is aborted and retried. */
+int AssetFetcher::transferTimeout(void) const
+{
+	return m_transferTimeout;
+}
+
+/*! Sets the cache which the downloaded assets are written into (nullptr to disable it). */
+void AssetFetcher::setCache(AssetCache *cache)
+{
+	m_cache = cache;
+}
+
+/*!
+ * Adds the given assets (with "assetId" and "dataFormat" keys) to the queue.
+ * Assets with a lower priority value are downloaded first.\n
+ * finished() is emitted when all assets are loaded or failed (even if the list is empty).
+ */
+void AssetFetcher::fetch(const QList<QMap<QString,QString>> &assets, int priority)
+{
+	for(int i=0; i < assets.count(); i++)
+	{
+		// Each asset is downloaded once
+		if(queued.contains(assets[i].value("assetId")))
+			continue;
+		Request *request = new Request;
+		request->asset = assets[i];
+		request->priority = priority;
+		enqueue(request);
+		m_total++;
+	}
+	finishedEmitted = false;
+	// The signals are emitted after the caller connects them
+	QTimer::singleShot(0, this, [this]() {
+		startRequests();
+		checkFinished();
+	});
+}
+
+/*!
+ * Moves the given asset to the front of the queue (e.g. if a script waits for it).
+ * Does nothing if the asset isn't queued.
+ */
+void AssetFetcher::prioritize(const QString &assetId)
+{
+	Request *request = queued.value(assetId);
+	if(!request)
+		return;
+	queue[request->priority].removeOne(request);
+	if(queue[request->priority].isEmpty())
+		queue.remove(request->priority);
+	if(!queue.isEmpty())
+		request->priority = qMin(request->priority, queue.firstKey());
+	enqueue(request, true);
+	startRequests();
+}
+
+/*! Aborts all requests and clears the queue. finished() isn't emitted. */
+void AssetFetcher::abort(void)
+{
+	generation++;
+	QList<Request*> requests = running.values() + delayed.values() + queued.values();
+	for(int i=0; i < requests.count(); i++)
+	{
+		if(requests[i]->reply)
+		{
+			requests[i]->timer->stop();
+			disconnect(requests[i]->reply, nullptr, this, nullptr);
+			requests[i]->reply->abort();
+			requests[i]->reply->deleteLater();
+		}
+		delete requests[i];
+	}
+	queue.clear();
+	queued.clear();
+	running.clear();
+	delayed.clear();
+	m_total = 0;
+	loaded = 0;
+	failed = 0;
+	finishedEmitted = true;
+}
+
+/*! Returns the number of assets passed to fetch() since the last abort(). */
+int AssetFetcher::total(void) const
+{
+	return m_total;
+}
+
+/*! Returns the number of loaded assets. */
+int AssetFetcher::loadedCount(void) const
+{
+	return loaded;
+}
+
+/*! Returns the number of assets which couldn't be downloaded. */
+int AssetFetcher::failedCount(void) const
+{
+	return failed;
+}
+
+/*! Returns the number of requests which are in flight. */
+int AssetFetcher::runningCount(void) const
+{
+	return running.count();
+}
+
+/*! Returns true if all assets are loaded or failed. */
+bool AssetFetcher::isFinished(void) const
+{
+	return loaded + failed == m_total;
+}
+
+/*! Adds a request to the queue of its priority. */
+void AssetFetcher::enqueue(Request *request, bool front)
+{
+	if(front)
+		queue[request->priority].prepend(request);
+	else
+		queue[request->priority].append(request);
+	queued.insert(request->asset.value("assetId"), request);
+}
+
+/*! Starts the requests from the queue until the concurrency limit is reached. */
+void AssetFetcher::startRequests(void)
+{
+	while((running.count() < m_maxConcurrent) && !queue.isEmpty())
+	{
+		QMap<int,QList<Request*>>::iterator it = queue.begin();
+		Request *request = it.value().takeFirst();
+		if(it.value().isEmpty())
+			queue.erase(it);
+		queued.remove(request->asset.value("assetId"));
+		start(request);
+	}
+}
+
+/*! Starts the download of an asset. */
+void AssetFetcher::start(Request *request)
+{
+	QNetworkRequest networkRequest(QUrl(m_urlTemplate.arg(request->asset.value("assetId"), request->asset.value("dataFormat"))));
+	request->data.clear();
+	request->attempts++;
+	request->timedOut = false;
+	request->reply = manager->get(networkRequest);
+	running.insert(request);
+	// QNetworkRequest::setTransferTimeout() aborts the reply with OperationCanceledError,
+	// which looks like abort(), so the timeout is tracked here (the timer is deleted with the reply)
+	request->timer = new QTimer(request->reply);
+	request->timer->setSingleShot(true);
+	connect(request->timer, &QTimer::timeout, this, [request]() {
+		request->timedOut = true;
+		request->reply->abort();
+	});
+	request->timer->start(m_transferTimeout);
+	connect(request->reply, &QNetworkReply::readyRead, this, [this, request]() {
+		receive(request);
+	});
+	connect(request->reply, &QNetworkReply::finished, this, [this, request]() {
+		finish(request);
+	});
+}
+
+/*! Appends the received data to the request buffer. */
+void AssetFetcher::receive(Request *request)
+{
+	if(request->data.isEmpty())
+	{
+		qint64 size = request->reply->header(QNetworkRequest::ContentLengthHeader).toLongLong();
+		if(size > 0)
+			request->data.reserve(size);
+	}
+	request->data += request->reply->readAll();
+	request->timer->start();
+}
+
+/*! Adds the downloaded asset to the store, or retries the request if it failed with a transient error. */
+void AssetFetcher::finish(Request *request)
+{
+	QNetworkReply *reply = request->reply;
+	running.remove(request);
+	request->timer->stop();
+	request->timer = nullptr;
+	request->reply = nullptr;
+	reply->deleteLater();
+	QString assetId = request->asset.value("assetId");
+	QString errorString = request->timedOut ? QString("transfer timeout") : reply->errorString();
+	if(reply->error() == QNetworkReply::NoError)
+	{
+		request->data += reply->readAll();
+		m_store->insert(assetId, request->data);
+		if(m_cache)
+			m_cache->insertLater(assetId, request->asset.value("dataFormat"), request->data);
+		loaded++;
+		delete request;
+		emit assetLoaded(assetId);
+	}
+	else if((request->timedOut || isTransient(reply->error())) && (request->attempts <= m_maxRetries))
+	{
+		qWarning() << "Warning: retrying download of asset" << assetId << "-" << errorString;
+		delayed.insert(request);
+		int currentGeneration = generation;
+		QTimer::singleShot(retryDelay << (request->attempts - 1), this, [this, request, currentGeneration]() {
+			// The request was deleted if the fetcher was aborted
+			if((currentGeneration != generation) || !delayed.remove(request))
+				return;
+			enqueue(request, true);
+			startRequests();
+		});
+		startRequests();
+		return;
+	}
+	else
+	{
+		qWarning() << "Warning: could not download asset" << assetId << "-" << errorString;
+		// Scripts don't wait for assets which failed
+		m_store->removePending(assetId);
+		failed++;
+		delete request;
+		emit assetFailed(assetId);
+	}
+	emit progress(loaded + failed, m_total);
+	startRequests();
+	checkFinished();
+}
+
+/*! Emits finished() once all assets are loaded or failed. */
+void AssetFetcher::checkFinished(void)
+{
+	if(!finishedEmitted && isFinished())
+	{
+		finishedEmitted = true;
+		emit finished();
+	}
+}
+
+/*! Returns true if a request which failed with the given error can be retried. */
+bool AssetFetcher::isTransient(QNetworkReply::NetworkError error)
+{
+	if(error == QNetworkReply::OperationCanceledError)
+		return false;
+	// Network and proxy errors (below 200) and server errors (401 - 499)
+	return (error < 200) || ((error >= 401) && (error <= 499));
+}
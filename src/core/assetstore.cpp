@@ -0,0 +1,167 @@
+/*
+ * assetstore.cpp
+ * This file is part of QScratchRuntime
+ *
+ * Copyright (C) 2023 - adazem009
+ *
+ * QScratchRuntime is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * QScratchRuntime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QScratchRuntime. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "core/assetstore.h"
+
+/*! Constructs AssetStore. */
+AssetStore::AssetStore() { }
+
+/*! Destroys the AssetStore object and unmaps all mapped files. */
+AssetStore::~AssetStore()
+{
+	clear();
+}
+
+/*!
+ * Returns the data of the given asset.\n
+ * The returned QByteArray doesn't own the data if the asset is memory-mapped,
+ * so it must not be used after clear() is called.
+ */
+QByteArray AssetStore::asset(const QString &assetId) const
+{
+	QMutexLocker locker(&mutex);
+	return assets.value(assetId);
+}
+
+/*!
+ * Memory-maps the given asset file (if it isn't mapped yet) and returns a view of its data.
+ * \see mapData()
+ */
+QByteArray AssetStore::mapFile(const QString &assetId, const QString &fileName)
+{
+	mutex.lock();
+	if(assets.contains(assetId))
+	{
+		QByteArray data = assets.value(assetId);
+		mutex.unlock();
+		return data;
+	}
+	mutex.unlock();
+	QByteArray data = mapData(fileName);
+	insert(assetId, data);
+	return data;
+}
+
+/*!
+ * Memory-maps the given file and returns a view of its data.
+ * The file stays mapped until clear() is called.\n
+ * Falls back to reading the file if it can't be mapped (e.g. on WebAssembly).
+ * The read data is kept until clear() is called too, so views of it (see Sb3Reader) stay valid.
+ */
+QByteArray AssetStore::mapData(const QString &fileName)
+{
+	QFile *file = new QFile(fileName);
+	if(!file->open(QFile::ReadOnly))
+	{
+		delete file;
+		return QByteArray();
+	}
+	QByteArray data;
+	qint64 size = file->size();
+	uchar *mappedData = nullptr;
+	if(size > 0)
+		mappedData = file->map(0, size);
+	if(mappedData)
+	{
+		data = QByteArray::fromRawData((const char*) mappedData, size);
+		// The mapping stays valid after the file is closed, as long as the QFile exists
+		file->close();
+		QMutexLocker locker(&mutex);
+		mappedFiles.append(file);
+	}
+	else
+	{
+		data = file->readAll();
+		delete file;
+		QMutexLocker locker(&mutex);
+		readFiles.append(data);
+	}
+	return data;
+}
+
+/*! Adds an asset which is already in memory (e.g. downloaded or extracted). */
+void AssetStore::insert(const QString &assetId, const QByteArray &data)
+{
+	QMutexLocker locker(&mutex);
+	assets.insert(assetId, data);
+	pending.remove(assetId);
+}
+
+/*! Returns true if the asset is in the store. */
+bool AssetStore::contains(const QString &assetId) const
+{
+	QMutexLocker locker(&mutex);
+	return assets.contains(assetId);
+}
+
+/*! Marks the given assets as pending (they're being downloaded and will be added later). */
+void AssetStore::setPending(const QStringList &assetIds)
+{
+	QMutexLocker locker(&mutex);
+	for(int i=0; i < assetIds.count(); i++)
+	{
+		if(!assets.contains(assetIds[i]))
+			pending.insert(assetIds[i]);
+	}
+}
+
+/*! Returns true if the asset is pending. \see setPending() */
+bool AssetStore::isPending(const QString &assetId) const
+{
+	QMutexLocker locker(&mutex);
+	return pending.contains(assetId);
+}
+
+/*! Marks the given asset as not pending (e.g. if it couldn't be downloaded). */
+void AssetStore::removePending(const QString &assetId)
+{
+	QMutexLocker locker(&mutex);
+	pending.remove(assetId);
+}
+
+/*! Asks the request handler to load the given pending asset as soon as possible. This can be called from any thread. */
+void AssetStore::request(const QString &assetId)
+{
+	mutex.lock();
+	std::function<void(const QString&)> handler = requestHandler;
+	bool isPending = pending.contains(assetId);
+	mutex.unlock();
+	if(isPending && handler)
+		handler(assetId);
+}
+
+/*! Sets the function which is called by request(). */
+void AssetStore::setRequestHandler(std::function<void(const QString&)> handler)
+{
+	QMutexLocker locker(&mutex);
+	requestHandler = handler;
+}
+
+/*! Removes all assets (pending assets too) and unmaps all mapped files. */
+void AssetStore::clear(void)
+{
+	QMutexLocker locker(&mutex);
+	assets.clear();
+	pending.clear();
+	for(int i=0; i < mappedFiles.count(); i++)
+		delete mappedFiles[i];
+	mappedFiles.clear();
+	readFiles.clear();
+}
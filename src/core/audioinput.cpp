@@ -0,0 +1,237 @@
+/*
+ * audioinput.cpp
+ * This file is part of QScratchRuntime
+ *
+ * Copyright (C) 2023 - adazem009
+ *
+ * QScratchRuntime is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * QScratchRuntime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QScratchRuntime. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QFile>
+#include <QtEndian>
+#include <QtMath>
+#include <QtDebug>
+#include "core/audioinput.h"
+#include "core/audiomixer.h"
+#include "core/soundcache.h"
+
+// Capacity of the ring buffer (one second)
+static const int ringSize = AudioMixer::sampleRate;
+// Frequency of the generated tone
+static const qreal toneFrequency = 440;
+
+/*! Constructs AudioInput. */
+AudioInput::AudioInput() :
+	writePosition(0),
+	readPosition(0)
+{
+	ring.resize(ringSize);
+}
+
+/*!
+ * Reads at most count samples from the ring buffer and returns the number of read samples.
+ * This is called by the meter (the consumer).
+ */
+int AudioInput::read(float *samples, int count)
+{
+	qint64 position = readPosition.loadAcquire();
+	count = qMin((qint64) count, writePosition.loadAcquire() - position);
+	for(int i=0; i < count; i++)
+		samples[i] = ring[(position + i) % ringSize];
+	readPosition.storeRelease(position + count);
+	return count;
+}
+
+/*!
+ * Writes the samples into the ring buffer and returns the number of written samples.
+ * Samples which don't fit are dropped. This is called by the input (the producer).
+ */
+int AudioInput::write(const float *samples, int count)
+{
+	qint64 position = writePosition.loadAcquire();
+	count = qMin((qint64) count, ringSize - (position - readPosition.loadAcquire()));
+	for(int i=0; i < count; i++)
+		ring[(position + i) % ringSize] = samples[i];
+	writePosition.storeRelease(position + count);
+	return count;
+}
+
+/*! Constructs WavFileAudioInput and decodes the file. */
+WavFileAudioInput::WavFileAudioInput(const QString &fileName, bool realTime) :
+	m_realTime(realTime)
+{
+	QFile file(fileName);
+	if(!file.open(QFile::ReadOnly))
+	{
+		qWarning() << "Warning: could not open" << fileName;
+		return;
+	}
+	SoundBufferPtr sound = SoundCache::decode(file.readAll());
+	if(!sound)
+		return;
+	// The channels are mixed down to mono
+	int frameCount = sound->frameCount();
+	samples.resize(frameCount);
+	for(int i=0; i < frameCount; i++)
+		samples[i] = (sound->samples[i * 2] + sound->samples[i * 2 + 1]) * 0.5f;
+}
+
+/*! Returns true if the file was decoded. */
+bool WavFileAudioInput::isOpen(void) const
+{
+	return !samples.isEmpty();
+}
+
+/*! Returns true if the file is played in real time. */
+bool WavFileAudioInput::isRealTime(void) const
+{
+	return m_realTime;
+}
+
+/*! Writes the samples of the file until the given frame. The file is repeated when it ends. */
+void WavFileAudioInput::update(qint64 frame)
+{
+	if(samples.isEmpty())
+		return;
+	while(position < frame)
+	{
+		int offset = position % samples.count();
+		int count = qMin(frame - position, (qint64) (samples.count() - offset));
+		write(samples.constData() + offset, count);
+		position += count;
+	}
+}
+
+/*! Constructs ToneAudioInput. The period is in milliseconds (0 for a continuous tone). */
+ToneAudioInput::ToneAudioInput(qreal amplitude, int period, bool realTime) :
+	m_amplitude(qBound(0.0, amplitude, 1.0)),
+	periodFrames((qint64) period * AudioMixer::sampleRate / 1000),
+	m_realTime(realTime) { }
+
+/*! Returns true if the tone is generated in real time. */
+bool ToneAudioInput::isRealTime(void) const
+{
+	return m_realTime;
+}
+
+/*! Generates the samples until the given frame. */
+void ToneAudioInput::update(qint64 frame)
+{
+	float buffer[256];
+	while(position < frame)
+	{
+		int count = qMin(frame - position, (qint64) 256);
+		for(int i=0; i < count; i++)
+		{
+			qint64 current = position + i;
+			bool silent = (periodFrames > 0) && ((current / periodFrames) % 2 == 1);
+			buffer[i] = silent ? 0 : m_amplitude * qSin(2 * M_PI * toneFrequency * current / AudioMixer::sampleRate);
+		}
+		write(buffer, count);
+		position += count;
+	}
+}
+
+/*! Returns the format of the samples captured by DeviceAudioInput. */
+static QAudioFormat inputFormat(void)
+{
+	QAudioFormat format;
+	format.setCodec("audio/pcm");
+	format.setSampleType(QAudioFormat::SignedInt);
+	format.setSampleSize(16);
+	format.setByteOrder(QAudioFormat::LittleEndian);
+	format.setChannelCount(1);
+	format.setSampleRate(AudioMixer::sampleRate);
+	return format;
+}
+
+/*! Constructs DeviceAudioInput. The device is opened by start(). */
+DeviceAudioInput::DeviceAudioInput(QObject *parent) :
+	QIODevice(parent),
+	startRequested(0) { }
+
+/*! Stops capturing and destroys the DeviceAudioInput object. */
+DeviceAudioInput::~DeviceAudioInput()
+{
+	if(input)
+		input->stop();
+	close();
+}
+
+/*! Returns true. */
+bool DeviceAudioInput::isRealTime(void) const
+{
+	return true;
+}
+
+/*! Starts capturing. QAudioInput is created in the thread of this object, so this can be called from any thread. */
+void DeviceAudioInput::start(void)
+{
+	if(startRequested.testAndSetOrdered(0, 1))
+		QMetaObject::invokeMethod(this, "startCapture", Qt::QueuedConnection);
+}
+
+/*! Does nothing (the samples are written by QAudioInput). */
+void DeviceAudioInput::update(qint64 frame)
+{
+	Q_UNUSED(frame);
+}
+
+/*! Returns true (the samples are a stream). */
+bool DeviceAudioInput::isSequential(void) const
+{
+	return true;
+}
+
+/*! Does nothing (the device is write-only). */
+qint64 DeviceAudioInput::readData(char *data, qint64 maxSize)
+{
+	Q_UNUSED(data);
+	Q_UNUSED(maxSize);
+	return -1;
+}
+
+/*! Converts the captured samples and writes them into the ring buffer. */
+qint64 DeviceAudioInput::writeData(const char *data, qint64 maxSize)
+{
+	const uchar *in = (const uchar*) data;
+	int count = maxSize / 2;
+	float buffer[256];
+	for(int i=0; i < count; i += 256)
+	{
+		int chunk = qMin(count - i, 256);
+		for(int j=0; j < chunk; j++)
+			buffer[j] = qFromLittleEndian<qint16>(in + (i + j) * 2) / 32768.0f;
+		// Both base classes have a write() function
+		AudioInput::write(buffer, chunk);
+	}
+	return maxSize;
+}
+
+/*! Opens the default audio input device and starts capturing in push mode. */
+void DeviceAudioInput::startCapture(void)
+{
+	QAudioFormat format = inputFormat();
+	QAudioDeviceInfo device = QAudioDeviceInfo::defaultInputDevice();
+	if(device.isNull())
+	{
+		qWarning() << "Warning: there's no audio input device";
+		return;
+	}
+	if(!device.isFormatSupported(format))
+		qWarning() << "Warning: the audio input device doesn't support" << AudioMixer::sampleRate << "Hz 16-bit mono";
+	open(QIODevice::WriteOnly);
+	input = new QAudioInput(device, format, this);
+	input->start(this);
+}
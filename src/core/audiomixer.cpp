@@ -0,0 +1,454 @@
+/*
+ * audiomixer.cpp
+ * This file is part of QScratchRuntime
+ *
+ * Copyright (C) 2023 - adazem009
+ *
+ * QScratchRuntime is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * QScratchRuntime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QScratchRuntime. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QThread>
+#include <QtMath>
+#include <limits>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif // __SSE2__
+#include "core/audiomixer.h"
+
+AudioMixer audioMixer;
+
+const int AudioMixer::sampleRate;
+const int AudioMixer::blockSize;
+
+// End of voices which are reserved or playing
+static const qint64 unknownEnd = std::numeric_limits<qint64>::max();
+
+/*! Thread which runs AudioMixer::threadLoop(). */
+class AudioMixer::Thread : public QThread
+{
+	public:
+		explicit Thread(AudioMixer *mixer) :
+			m_mixer(mixer) { }
+
+	protected:
+		void run(void) override
+		{
+			m_mixer->threadLoop();
+		}
+
+	private:
+		AudioMixer *m_mixer;
+};
+
+/*! Constructs AudioMixer. There's no output until setSink() is called. */
+AudioMixer::AudioMixer() :
+	nextVoice(1),
+	stopping(0)
+{
+	mixBuffer.resize(blockSize * 2);
+	voiceBuffer.resize(blockSize * 2);
+	outBuffer.resize(blockSize * 2);
+}
+
+/*! Stops the mixer thread and destroys the AudioMixer object. */
+AudioMixer::~AudioMixer()
+{
+	setSink(nullptr);
+}
+
+/*!
+ * Sets the output of the mixer and takes its ownership. The previous sink is deleted.\n
+ * A thread feeds real-time sinks (except on WebAssembly, where renderAvailable() must be called regularly).
+ * Use nullptr to stop the output.
+ */
+void AudioMixer::setSink(AudioSink *sink)
+{
+	if(thread)
+	{
+		stopping.storeRelease(1);
+		thread->wait();
+		delete thread;
+		thread = nullptr;
+		stopping.storeRelease(0);
+	}
+	stopAll();
+	if(m_sink)
+		delete m_sink;
+	m_sink = sink;
+	frames = 0;
+#ifndef Q_OS_WASM
+	if(m_sink && m_sink->isRealTime())
+	{
+		thread = new Thread(this);
+		thread->start(QThread::TimeCriticalPriority);
+	}
+#endif // Q_OS_WASM
+}
+
+/*! Returns the output of the mixer. */
+AudioSink *AudioMixer::sink(void) const
+{
+	return m_sink;
+}
+
+/*! Returns a new voice ID. The voice is playing until it's started and finished (or finish() is called). */
+quint64 AudioMixer::reserveVoice(void)
+{
+	quint64 voice = nextVoice.fetchAndAddOrdered(1);
+	QMutexLocker locker(&mutex);
+	voiceEnds.insert(voice, unknownEnd);
+	return voice;
+}
+
+/*!
+ * Starts playing a sound using a reserved voice ID in the given channel.\n
+ * Nothing is played if the voice was finished or stopped after it was reserved.
+ */
+void AudioMixer::play(quint64 voice, const SoundBufferPtr &sound, int channel)
+{
+	QMutexLocker locker(&mutex);
+	if(!m_sink || !sound || (sound->frameCount() == 0) || !voiceEnds.contains(voice))
+	{
+		voiceEnds.remove(voice);
+		return;
+	}
+	Voice newVoice;
+	newVoice.id = voice;
+	newVoice.sound = sound;
+	newVoice.position = 0;
+	newVoice.channel = channel;
+	newVoice.started = false;
+	voices.append(newVoice);
+	voiceEnds.insert(voice, unknownEnd);
+}
+
+/*! Marks a reserved voice as finished (e.g. if the sound doesn't exist). */
+void AudioMixer::finish(quint64 voice)
+{
+	QMutexLocker locker(&mutex);
+	voiceEnds.remove(voice);
+}
+
+/*! Returns true until the sink plays the last frame of the voice. This can be called from any thread. */
+bool AudioMixer::isPlaying(quint64 voice) const
+{
+	QMutexLocker locker(&mutex);
+	QHash<quint64,qint64>::const_iterator it = voiceEnds.constFind(voice);
+	if(it == voiceEnds.constEnd())
+		return false;
+	return (it.value() == unknownEnd) || (m_sink->playedFrames() < it.value());
+}
+
+/*! Stops all voices. */
+void AudioMixer::stopAll(void)
+{
+	QMutexLocker locker(&mutex);
+	voices.clear();
+	voiceEnds.clear();
+}
+
+/*! Stops the voices of the given channel. */
+void AudioMixer::stopChannel(int channel)
+{
+	QMutexLocker locker(&mutex);
+	for(int i=0; i < voices.count(); i++)
+	{
+		if(voices[i].channel == channel)
+		{
+			voiceEnds.remove(voices[i].id);
+			voices.removeAt(i);
+			i--;
+		}
+	}
+}
+
+/*! Stops the voices of the given channel and resets its settings (e.g. when a sprite is deleted). */
+void AudioMixer::releaseChannel(int channel)
+{
+	stopChannel(channel);
+	QMutexLocker locker(&mutex);
+	channels.remove(channel);
+}
+
+/*! Sets the volume (0 - 100) of the given channel. This affects the playing voices too. */
+void AudioMixer::setVolume(int channel, qreal volume)
+{
+	QMutexLocker locker(&mutex);
+	channels[channel].volume = qBound(0.0, volume, 100.0) / 100;
+}
+
+/*!
+ * Sets the pitch (-360 - 360, 10 is a semitone) and pan (-100 - 100) effects of the given channel.\n
+ * This affects the playing voices too, they continue from their current position.
+ */
+void AudioMixer::setEffects(int channel, qreal pitch, qreal pan)
+{
+	QMutexLocker locker(&mutex);
+	Channel &settings = channels[channel];
+	settings.rate = qPow(2, qBound(-360.0, pitch, 360.0) / 120);
+	settings.pan = qBound(-100.0, pan, 100.0) / 100;
+}
+
+/*! Returns the number of playing voices. */
+int AudioMixer::voiceCount(void) const
+{
+	QMutexLocker locker(&mutex);
+	return voices.count();
+}
+
+/*! Renders as many frames as the real-time sink can take. */
+void AudioMixer::renderAvailable(void)
+{
+	if(m_sink)
+		render(m_sink->writableFrames());
+}
+
+/*!
+ * Renders the frames until the given frame of the output stream.\n
+ * This is used for sinks which aren't real-time, e.g. by HeadlessRunner with the EngineClock time.
+ */
+void AudioMixer::renderTo(qint64 frame)
+{
+	if(m_sink && (frame > frames))
+		render(frame - frames);
+}
+
+/*! Returns the number of rendered frames. */
+qint64 AudioMixer::renderedFrames(void) const
+{
+	QMutexLocker locker(&mutex);
+	return frames;
+}
+
+/*! Converts count samples to 16-bit integers. Samples out of the range from -1 to 1 are clipped. */
+void AudioMixer::toInt16(const float *in, qint16 *out, int count)
+{
+	int i = 0;
+#ifdef __SSE2__
+	__m128 scale = _mm_set1_ps(32767.0f);
+	for(; i + 8 <= count; i += 8)
+	{
+		// _mm_packs_epi32() saturates, so the samples are clipped
+		__m128i a = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(in + i), scale));
+		__m128i b = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(in + i + 4), scale));
+		_mm_storeu_si128((__m128i*) (out + i), _mm_packs_epi32(a, b));
+	}
+#endif // __SSE2__
+	for(; i < count; i++)
+		out[i] = qRound(qBound(-1.0f, in[i], 1.0f) * 32767.0f);
+}
+
+/*! Returns the sample of the given frame and channel, or 0 if the frame is out of the sound. */
+static inline float sampleAt(const float *samples, int frameCount, int frame, int channel)
+{
+	if((frame < 0) || (frame >= frameCount))
+		return 0;
+	return samples[frame * 2 + channel];
+}
+
+/*!
+ * Resamples a sound using cubic (Catmull-Rom) interpolation.\n
+ * Reads frames of the sound from the given position (which is advanced by step for each frame)
+ * and writes at most the given number of frames to out. Returns the number of written frames,
+ * which is lower if the end of the sound is reached.
+ */
+int AudioMixer::resample(const float *samples, int frameCount, double *position, double step, float *out, int frames)
+{
+	double pos = *position;
+	int i = 0;
+	for(; (i < frames) && (pos < frameCount); i++, pos += step)
+	{
+		int index = (int) pos;
+		float t = pos - index;
+		float t2 = t * t;
+		float t3 = t2 * t;
+		// Weights of the frames from index - 1 to index + 2
+		float w0 = (-t3 + 2 * t2 - t) * 0.5f;
+		float w1 = (3 * t3 - 5 * t2 + 2) * 0.5f;
+		float w2 = (-3 * t3 + 4 * t2 + t) * 0.5f;
+		float w3 = (t3 - t2) * 0.5f;
+		if((index >= 1) && (index + 2 < frameCount))
+		{
+			const float *taps = samples + (index - 1) * 2;
+#ifdef __SSE2__
+			// The 4 stereo frames are 8 consecutive samples
+			__m128 a = _mm_mul_ps(_mm_loadu_ps(taps), _mm_set_ps(w1, w1, w0, w0));
+			__m128 b = _mm_mul_ps(_mm_loadu_ps(taps + 4), _mm_set_ps(w3, w3, w2, w2));
+			__m128 sum = _mm_add_ps(a, b);
+			sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+			_mm_storel_pi((__m64*) (out + i * 2), sum);
+#else
+			out[i * 2] = w0 * taps[0] + w1 * taps[2] + w2 * taps[4] + w3 * taps[6];
+			out[i * 2 + 1] = w0 * taps[1] + w1 * taps[3] + w2 * taps[5] + w3 * taps[7];
+#endif // __SSE2__
+		}
+		else
+		{
+			// Frames out of the sound are silent
+			for(int c=0; c < 2; c++)
+			{
+				out[i * 2 + c] = w0 * sampleAt(samples, frameCount, index - 1, c) + w1 * sampleAt(samples, frameCount, index, c)
+					+ w2 * sampleAt(samples, frameCount, index + 1, c) + w3 * sampleAt(samples, frameCount, index + 2, c);
+			}
+		}
+	}
+	*position = pos;
+	return i;
+}
+
+/*!
+ * Adds the given number of stereo frames to out using a 2x2 gain matrix (see channelGains()).\n
+ * The gains change linearly from fromGains to toGains, so volume and pan changes don't click.
+ */
+void AudioMixer::mixPanned(float *out, const float *in, int frames, const float *fromGains, const float *toGains)
+{
+	if(frames <= 0)
+		return;
+	float step[4];
+	for(int k=0; k < 4; k++)
+		step[k] = (toGains[k] - fromGains[k]) / frames;
+	int i = 0;
+#ifdef __SSE2__
+	// Two frames per vector: the samples are multiplied by (LL, RR) and the swapped samples by (LR, RL)
+	__m128 direct = _mm_set_ps(fromGains[3] + step[3], fromGains[0] + step[0], fromGains[3], fromGains[0]);
+	__m128 cross = _mm_set_ps(fromGains[2] + step[2], fromGains[1] + step[1], fromGains[2], fromGains[1]);
+	__m128 directStep = _mm_set_ps(step[3] * 2, step[0] * 2, step[3] * 2, step[0] * 2);
+	__m128 crossStep = _mm_set_ps(step[2] * 2, step[1] * 2, step[2] * 2, step[1] * 2);
+	for(; i + 2 <= frames; i += 2)
+	{
+		__m128 samples = _mm_loadu_ps(in + i * 2);
+		__m128 swapped = _mm_shuffle_ps(samples, samples, _MM_SHUFFLE(2, 3, 0, 1));
+		__m128 sum = _mm_add_ps(_mm_mul_ps(samples, direct), _mm_mul_ps(swapped, cross));
+		_mm_storeu_ps(out + i * 2, _mm_add_ps(_mm_loadu_ps(out + i * 2), sum));
+		direct = _mm_add_ps(direct, directStep);
+		cross = _mm_add_ps(cross, crossStep);
+	}
+#endif // __SSE2__
+	for(; i < frames; i++)
+	{
+		float left = in[i * 2], right = in[i * 2 + 1];
+		out[i * 2] += (fromGains[0] + step[0] * i) * left + (fromGains[1] + step[1] * i) * right;
+		out[i * 2 + 1] += (fromGains[2] + step[2] * i) * left + (fromGains[3] + step[3] * i) * right;
+	}
+}
+
+/*!
+ * Computes the gain matrix of a channel: the left output is gains[0] * left + gains[1] * right
+ * and the right output is gains[2] * left + gains[3] * right.\n
+ * Panning works like in Scratch (StereoPannerNode of the Web Audio API), which bypasses the panner if pan is 0.
+ */
+void AudioMixer::channelGains(const Channel &channel, bool mono, float *gains)
+{
+	gains[0] = gains[3] = channel.volume;
+	gains[1] = gains[2] = 0;
+	if(channel.pan == 0)
+		return;
+	if(mono)
+	{
+		// Equal-power panning
+		float angle = (channel.pan + 1) * float(M_PI) / 4;
+		gains[0] *= qCos(angle);
+		gains[3] *= qSin(angle);
+	}
+	else if(channel.pan < 0)
+	{
+		// The right channel is moved to the left
+		float angle = (channel.pan + 1) * float(M_PI) / 2;
+		gains[1] = channel.volume * qCos(angle);
+		gains[3] *= qSin(angle);
+	}
+	else
+	{
+		float angle = channel.pan * float(M_PI) / 2;
+		gains[0] *= qCos(angle);
+		gains[2] = channel.volume * qSin(angle);
+	}
+}
+
+/*! Mixes the voices into the given number of frames and writes them to the sink. */
+void AudioMixer::render(int count)
+{
+	while(count > 0)
+	{
+		int blockFrames = qMin(count, (int) blockSize);
+		float *mix = mixBuffer.data();
+		memset(mix, 0, blockFrames * 2 * sizeof(float));
+		mutex.lock();
+		for(int i=0; i < voices.count(); i++)
+		{
+			Voice &voice = voices[i];
+			const SoundBuffer &sound = *voice.sound;
+			const Channel channel = channels.value(voice.channel);
+			float gains[4];
+			channelGains(channel, sound.mono, gains);
+			if(!voice.started)
+			{
+				// New voices start with the current gains
+				memcpy(voice.gains, gains, sizeof(gains));
+				voice.started = true;
+			}
+			const float *source;
+			int voiceFrames;
+			if((channel.rate == 1) && (voice.position == (int) voice.position))
+			{
+				// Without the pitch effect, the samples are used directly
+				int position = (int) voice.position;
+				voiceFrames = qMin(blockFrames, sound.frameCount() - position);
+				source = sound.samples.constData() + position * 2;
+				voice.position += voiceFrames;
+			}
+			else
+			{
+				voiceFrames = resample(sound.samples.constData(), sound.frameCount(), &voice.position, channel.rate, voiceBuffer.data(), blockFrames);
+				source = voiceBuffer.constData();
+			}
+			mixPanned(mix, source, voiceFrames, voice.gains, gains);
+			memcpy(voice.gains, gains, sizeof(gains));
+			if(voice.position >= sound.frameCount())
+			{
+				// The voice ends at this frame of the output stream
+				voiceEnds.insert(voice.id, frames + voiceFrames);
+				voices.removeAt(i);
+				i--;
+			}
+		}
+		// Forget voices which were played
+		qint64 played = m_sink->playedFrames();
+		QHash<quint64,qint64>::iterator it = voiceEnds.begin();
+		while(it != voiceEnds.end())
+		{
+			if(it.value() <= played)
+				it = voiceEnds.erase(it);
+			else
+				++it;
+		}
+		frames += blockFrames;
+		mutex.unlock();
+		toInt16(mix, outBuffer.data(), blockFrames * 2);
+		m_sink->write(outBuffer.constData(), blockFrames);
+		count -= blockFrames;
+	}
+}
+
+/*! Feeds the real-time sink until setSink() is called again. */
+void AudioMixer::threadLoop(void)
+{
+	while(!stopping.loadAcquire())
+	{
+		if(m_sink->writableFrames() >= blockSize)
+			renderAvailable();
+		else
+			QThread::msleep(2);
+	}
+}
@@ -0,0 +1,258 @@
+/*
+ * audiosink.cpp
+ * This file is part of QScratchRuntime
+ *
+ * Copyright (C) 2023 - adazem009
+ *
+ * QScratchRuntime is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * QScratchRuntime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QScratchRuntime. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QtEndian>
+#include <QtDebug>
+#include "core/audiosink.h"
+#include "core/audiomixer.h"
+
+// Number of frames written ahead of the device
+#ifdef Q_OS_WASM
+static const int deviceLatency = 4096;
+#else
+static const int deviceLatency = 2048;
+#endif // Q_OS_WASM
+
+/*! Returns the format of the samples written to the sinks. */
+static QAudioFormat sinkFormat(void)
+{
+	QAudioFormat format;
+	format.setCodec("audio/pcm");
+	format.setSampleType(QAudioFormat::SignedInt);
+	format.setSampleSize(16);
+	format.setByteOrder(QAudioFormat::LittleEndian);
+	format.setChannelCount(2);
+	format.setSampleRate(AudioMixer::sampleRate);
+	return format;
+}
+
+/*! Constructs NullAudioSink. A real-time null sink takes the frames at the rate they would be played. */
+NullAudioSink::NullAudioSink(bool realTime) :
+	m_realTime(realTime),
+	writtenFrames(0)
+{
+	timer.start();
+}
+
+/*! Returns true if the sink takes the frames in real time. */
+bool NullAudioSink::isRealTime(void) const
+{
+	return m_realTime;
+}
+
+/*! Returns the number of frames which would fit into the device buffer. */
+int NullAudioSink::writableFrames(void)
+{
+	qint64 played = timer.elapsed() * AudioMixer::sampleRate / 1000;
+	return qMax((qint64) 0, played + deviceLatency - writtenFrames.loadAcquire());
+}
+
+/*! Drops the frames. */
+void NullAudioSink::write(const qint16 *samples, int frames)
+{
+	Q_UNUSED(samples);
+	writtenFrames.fetchAndAddOrdered(frames);
+}
+
+/*! Returns the number of frames which were played. */
+qint64 NullAudioSink::playedFrames(void) const
+{
+	if(m_realTime)
+		return qMin(writtenFrames.loadAcquire(), timer.elapsed() * AudioMixer::sampleRate / 1000);
+	return writtenFrames.loadAcquire();
+}
+
+/*! Constructs WavFileAudioSink and opens the file. */
+WavFileAudioSink::WavFileAudioSink(const QString &fileName) :
+	file(fileName),
+	writtenFrames(0)
+{
+	if(file.open(QFile::WriteOnly | QFile::Truncate))
+		writeHeader();
+	else
+		qWarning() << "Warning: could not open" << fileName;
+}
+
+/*! Updates the WAV header and closes the file. */
+WavFileAudioSink::~WavFileAudioSink()
+{
+	if(file.isOpen())
+	{
+		writeHeader();
+		file.close();
+	}
+}
+
+/*! Returns true if the file is open. */
+bool WavFileAudioSink::isOpen(void) const
+{
+	return file.isOpen();
+}
+
+/*! Returns false. The samples are written as fast as they're rendered. */
+bool WavFileAudioSink::isRealTime(void) const
+{
+	return false;
+}
+
+/*! Returns 0 (not used by sinks which aren't real-time). */
+int WavFileAudioSink::writableFrames(void)
+{
+	return 0;
+}
+
+/*! Writes the frames into the file. */
+void WavFileAudioSink::write(const qint16 *samples, int frames)
+{
+	if(!file.isOpen())
+		return;
+#if Q_BYTE_ORDER == Q_BIG_ENDIAN
+	QVector<qint16> data(frames * 2);
+	for(int i=0; i < data.count(); i++)
+		data[i] = qToLittleEndian(samples[i]);
+	samples = data.constData();
+#endif
+	file.write((const char*) samples, frames * 4);
+	writtenFrames.fetchAndAddOrdered(frames);
+}
+
+/*! Returns the number of frames written into the file. */
+qint64 WavFileAudioSink::playedFrames(void) const
+{
+	return writtenFrames.loadAcquire();
+}
+
+/*! Writes the RIFF header with the current data size at the beginning of the file. */
+void WavFileAudioSink::writeHeader(void)
+{
+	quint32 dataSize = writtenFrames.loadAcquire() * 4;
+	uchar header[44];
+	memcpy(header, "RIFF", 4);
+	qToLittleEndian<quint32>(36 + dataSize, header + 4);
+	memcpy(header + 8, "WAVEfmt ", 8);
+	qToLittleEndian<quint32>(16, header + 16);
+	qToLittleEndian<quint16>(1, header + 20); // PCM
+	qToLittleEndian<quint16>(2, header + 22);
+	qToLittleEndian<quint32>(AudioMixer::sampleRate, header + 24);
+	qToLittleEndian<quint32>(AudioMixer::sampleRate * 4, header + 28);
+	qToLittleEndian<quint16>(4, header + 32);
+	qToLittleEndian<quint16>(16, header + 34);
+	memcpy(header + 36, "data", 4);
+	qToLittleEndian<quint32>(dataSize, header + 40);
+	qint64 position = file.pos();
+	file.seek(0);
+	file.write((const char*) header, sizeof(header));
+	if(position > 0)
+		file.seek(position);
+}
+
+/*! Constructs DeviceAudioSink and starts the audio output in pull mode. */
+DeviceAudioSink::DeviceAudioSink(QObject *parent) :
+	QIODevice(parent),
+	capacity(deviceLatency * 2),
+	writePosition(0),
+	readPosition(0)
+{
+	ring.resize(capacity * 2);
+	QAudioFormat format = sinkFormat();
+	if(!QAudioDeviceInfo::defaultOutputDevice().isFormatSupported(format))
+		qWarning() << "Warning: the audio output device doesn't support" << AudioMixer::sampleRate << "Hz 16-bit stereo";
+	output = new QAudioOutput(format, this);
+	output->setBufferSize(deviceLatency * 4);
+	open(QIODevice::ReadOnly);
+	output->start(this);
+}
+
+/*! Stops the audio output and destroys the DeviceAudioSink object. */
+DeviceAudioSink::~DeviceAudioSink()
+{
+	output->stop();
+	close();
+}
+
+/*! Returns true. */
+bool DeviceAudioSink::isRealTime(void) const
+{
+	return true;
+}
+
+/*! Returns the number of frames which can be written before the latency limit is reached. */
+int DeviceAudioSink::writableFrames(void)
+{
+	return qMax((qint64) 0, deviceLatency - (writePosition.loadAcquire() - readPosition.loadAcquire()));
+}
+
+/*! Writes the frames into the ring buffer. This is called by the mixer thread. */
+void DeviceAudioSink::write(const qint16 *samples, int frames)
+{
+	qint64 position = writePosition.loadAcquire();
+	frames = qMin(frames, (int) (capacity - (position - readPosition.loadAcquire())));
+	for(int i=0; i < frames; i++)
+	{
+		int index = ((position + i) % capacity) * 2;
+		ring[index] = samples[i * 2];
+		ring[index + 1] = samples[i * 2 + 1];
+	}
+	writePosition.storeRelease(position + frames);
+}
+
+/*! Returns the number of frames read by the audio output. */
+qint64 DeviceAudioSink::playedFrames(void) const
+{
+	return readPosition.loadAcquire();
+}
+
+/*! Returns true (the samples are a stream). */
+bool DeviceAudioSink::isSequential(void) const
+{
+	return true;
+}
+
+/*! Returns the size of the device buffer, so QAudioOutput keeps reading. */
+qint64 DeviceAudioSink::bytesAvailable(void) const
+{
+	return deviceLatency * 4 + QIODevice::bytesAvailable();
+}
+
+/*! Reads the frames from the ring buffer. Silence is returned if there aren't enough frames (underrun). */
+qint64 DeviceAudioSink::readData(char *data, qint64 maxSize)
+{
+	int frames = maxSize / 4;
+	qint16 *out = (qint16*) data;
+	qint64 position = readPosition.loadAcquire();
+	int available = qMin((qint64) frames, writePosition.loadAcquire() - position);
+	for(int i=0; i < available; i++)
+	{
+		int index = ((position + i) % capacity) * 2;
+		out[i * 2] = qToLittleEndian(ring[index]);
+		out[i * 2 + 1] = qToLittleEndian(ring[index + 1]);
+	}
+	memset(out + available * 2, 0, (frames - available) * 4);
+	readPosition.storeRelease(position + available);
+	return frames * 4;
+}
+
+/*! Does nothing (the device is read-only). */
+qint64 DeviceAudioSink::writeData(const char *data, qint64 maxSize)
+{
+	Q_UNUSED(data);
+	Q_UNUSED(maxSize);
+	return -1;
+}
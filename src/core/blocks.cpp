@@ -20,6 +20,11 @@
 
 #include "core/blocks.h"
 #include "core/engine.h"
+#include "core/engineclock.h"
+#include "core/loudnessmeter.h"
+
+// Maximum time (in ms) a script waits for an asset which is still being downloaded
+static const int assetWaitTime = 2000;
 
 /*! Constructs Blocks. */
 Blocks::Blocks(scratchSprite *spritePtr, QObject *parent) :
@@ -37,7 +42,16 @@ bool Blocks::runBlock(QString opcode, QMap<QString,QString> inputs, QString *ret
 	}
 	processID = engine->processID;
 	if(opcode.startsWith("motion"))
-		return motionBlocks(opcode, inputs, returnValue);
+	{
+		qreal oldX = sprite->spriteX();
+		qreal oldY = sprite->spriteY();
+		bool ret = motionBlocks(opcode, inputs, returnValue);
+		// Draw a line if the sprite moved with the pen down
+		PenLayer *layer = penLayer();
+		if(sprite->pen.down && ((sprite->spriteX() != oldX) || (sprite->spriteY() != oldY)) && layer)
+			engine->commands.appendPenLine(QPointF(oldX, oldY), QPointF(sprite->spriteX(), sprite->spriteY()), sprite->pen);
+		return ret;
+	}
 	else if(opcode.startsWith("looks"))
 		return looksBlocks(opcode, inputs, returnValue);
 	else if(opcode.startsWith("sound"))
@@ -46,6 +60,10 @@ bool Blocks::runBlock(QString opcode, QMap<QString,QString> inputs, QString *ret
 		return eventBlocks(opcode, inputs, returnValue);
 	else if(opcode.startsWith("control"))
 		return controlBlocks(opcode, inputs, returnValue);
+	else if(opcode.startsWith("pen"))
+		return penBlocks(opcode, inputs, returnValue);
+	else if(opcode.startsWith("sensing"))
+		return sensingBlocks(opcode, inputs, returnValue);
 	else
 		return false;
 }
@@ -58,15 +76,15 @@ bool Blocks::motionBlocks(QString opcode, QMap<QString,QString> inputs, QString
 	{
 		qreal steps = inputs.value("STEPS").toDouble();
 		// https://en.scratch-wiki.info/wiki/Move_()_Steps_(block)#Workaround
-		emit engine->setX(sprite->spriteX + qSin(qDegreesToRadians(sprite->direction))*steps);
-		emit engine->setY(sprite->spriteY + qCos(qDegreesToRadians(sprite->direction))*steps);
+		engine->setX(sprite->spriteX() + qSin(qDegreesToRadians(sprite->direction()))*steps);
+		engine->setY(sprite->spriteY() + qCos(qDegreesToRadians(sprite->direction()))*steps);
 	}
 	else if(opcode == "motion_turnright")
-		emit engine->setDirection(sprite->direction + inputs.value("DEGREES").toDouble());
+		engine->setDirection(sprite->direction() + inputs.value("DEGREES").toDouble());
 	else if(opcode == "motion_turnleft")
-		emit engine->setDirection(sprite->direction - inputs.value("DEGREES").toDouble());
+		engine->setDirection(sprite->direction() - inputs.value("DEGREES").toDouble());
 	else if(opcode == "motion_pointindirection")
-		emit engine->setDirection(inputs.value("DIRECTION").toDouble());
+		engine->setDirection(inputs.value("DIRECTION").toDouble());
 	else if(opcode == "motion_pointtowards")
 	{
 		QString targetName = inputs.value("TOWARDS");
@@ -74,37 +92,37 @@ bool Blocks::motionBlocks(QString opcode, QMap<QString,QString> inputs, QString
 		qreal deltaX = 0, deltaY = 0;
 		if(targetSprite == nullptr)
 		{
-			deltaX = sprite->mouseX - sprite->spriteX;
-			deltaY = sprite->mouseY - sprite->spriteY;
+			deltaX = sprite->mouseX - sprite->spriteX();
+			deltaY = sprite->mouseY - sprite->spriteY();
 		}
 		else
 		{
-			deltaX = targetSprite->spriteX - sprite->spriteX;
-			deltaY = targetSprite->spriteY - sprite->spriteY;
+			deltaX = spriteState(targetSprite).x - sprite->spriteX();
+			deltaY = spriteState(targetSprite).y - sprite->spriteY();
 		}
 		// https://en.scratch-wiki.info/wiki/Point_Towards_()_(block)#Workaround
 		if(deltaY == 0)
 		{
 			if(deltaX < 0)
-				emit engine->setDirection(-90);
+				engine->setDirection(-90);
 			else
-				emit engine->setDirection(90);
+				engine->setDirection(90);
 		}
 		else
 		{
 			qreal atanResult = qRadiansToDegrees(qAtan(deltaX/deltaY));
 			if(deltaY < 0)
-				emit engine->setDirection(180 + atanResult);
+				engine->setDirection(180 + atanResult);
 			else
-				emit engine->setDirection(atanResult);
+				engine->setDirection(atanResult);
 		}
 	}
 	else if(opcode == "motion_gotoxy")
 	{
 		if(inputs.contains("X"))
 		{
-				emit engine->setX(inputs.value("X").toDouble());
-				emit engine->setY(inputs.value("Y").toDouble());
+				engine->setX(inputs.value("X").toDouble());
+				engine->setY(inputs.value("Y").toDouble());
 		}
 	}
 	else if(opcode == "motion_goto")
@@ -115,24 +133,20 @@ bool Blocks::motionBlocks(QString opcode, QMap<QString,QString> inputs, QString
 		{
 			if(targetName == "_mouse_")
 			{
-				emit engine->setX(sprite->mouseX);
-				emit engine->setY(sprite->mouseY);
+				engine->setX(sprite->mouseX);
+				engine->setY(sprite->mouseY);
 			}
 			else if(targetName == "_random_")
 			{
-#if QT_VERSION >= QT_VERSION_CHECK(5, 10, 0)
-				emit engine->setX(QRandomGenerator::global()->bounded(-240,241));
-				emit engine->setY(QRandomGenerator::global()->bounded(-180,181));
-#else
-				emit engine->setX(qrand()%481 - 240);
-				emit engine->setY(qrand()%361 - 180);
-#endif
+				engine->setX(engine->random.bounded(-240,241));
+				engine->setY(engine->random.bounded(-180,181));
 			}
 		}
 		else
 		{
-			emit engine->setX(targetSprite->spriteX);
-			emit engine->setY(targetSprite->spriteY);
+			SpriteSnapshot target = spriteState(targetSprite);
+			engine->setX(target.x);
+			engine->setY(target.y);
 		}
 	}
 	else if((opcode == "motion_glidesecstoxy") || (opcode == "motion_glideto"))
@@ -164,88 +178,80 @@ bool Blocks::motionBlocks(QString opcode, QMap<QString,QString> inputs, QString
 					}
 					else if(targetName == "_random_")
 					{
-#if QT_VERSION >= QT_VERSION_CHECK(5, 10, 0)
-						endX = QRandomGenerator::global()->bounded(-240,241);
-						endY = QRandomGenerator::global()->bounded(-180,181);
-#else
-						endX = qrand()%481 - 240;
-						endY = qrand()%361 - 180;
-#endif
+						endX = engine->random.bounded(-240,241);
+						endY = engine->random.bounded(-180,181);
 					}
 				}
 				else
 				{
-					endX = targetSprite->spriteX;
-					endY = targetSprite->spriteY;
+					endX = spriteState(targetSprite).x;
+					endY = spriteState(targetSprite).y;
 				}
 			}
 			engine->currentExecPos[processID]["special"] = "glide";
-			engine->currentExecPos[processID]["startX"] = sprite->spriteX;
-			engine->currentExecPos[processID]["startY"] = sprite->spriteY;
+			engine->currentExecPos[processID]["startX"] = sprite->spriteX();
+			engine->currentExecPos[processID]["startY"] = sprite->spriteY();
 			engine->currentExecPos[processID]["endX"] = endX;
 			engine->currentExecPos[processID]["endY"] = endY;
-			engine->currentExecPos[processID]["startTime"] = QDateTime::currentDateTimeUtc();
-			engine->currentExecPos[processID]["endTime"] = QDateTime::currentDateTimeUtc().addMSecs(inputs.value("SECS").toDouble() * 1000);
+			engine->currentExecPos[processID]["startTime"] = EngineClock::msecs();
 		}
 		qreal startX = engine->currentExecPos[processID]["startX"].toDouble();
 		qreal startY = engine->currentExecPos[processID]["startY"].toDouble();
-		QDateTime startTime = engine->currentExecPos[processID]["startTime"].toDateTime();
-		QDateTime endTime = engine->currentExecPos[processID]["endTime"].toDateTime();
-		QDateTime currentTime = QDateTime::currentDateTimeUtc();
-		qreal progress = (startTime.msecsTo(endTime) - currentTime.msecsTo(endTime)) / (inputs.value("SECS").toDouble() * 1000.0);
+		qint64 startTime = engine->currentExecPos[processID]["startTime"].toLongLong();
+		qint64 currentTime = EngineClock::msecs();
+		qreal progress = (currentTime - startTime) / (inputs.value("SECS").toDouble() * 1000.0);
 		if(progress >= 1)
 		{
-			emit engine->setX(endX);
-			emit engine->setY(endY);
+			engine->setX(endX);
+			engine->setY(endY);
 			engine->processEnd = true;
 			engine->frameEnd = false;
 		}
 		else
 		{
-			emit engine->setX(startX + (endX-startX)*progress);
-			emit engine->setY(startY + (endY-startY)*progress);
+			engine->setX(startX + (endX-startX)*progress);
+			engine->setY(startY + (endY-startY)*progress);
 		}
 	}
 	else if(opcode == "motion_changexby")
-		emit engine->setX(sprite->spriteX + inputs.value("DX").toDouble());
+		engine->setX(sprite->spriteX() + inputs.value("DX").toDouble());
 	else if(opcode == "motion_setx")
-		emit engine->setX(inputs.value("X").toDouble());
+		engine->setX(inputs.value("X").toDouble());
 	else if(opcode == "motion_changeyby")
-		emit engine->setY(sprite->spriteY + inputs.value("DY").toDouble());
+		engine->setY(sprite->spriteY() + inputs.value("DY").toDouble());
 	else if(opcode == "motion_sety")
-		emit engine->setY(inputs.value("Y").toDouble());
+		engine->setY(inputs.value("Y").toDouble());
 	else if(opcode == "motion_ifonedgebounce")
 	{
 		QRectF spriteRect = sprite->boundingRect();
 		// Right edge
-		if(sprite->spriteX + (spriteRect.width()/2 / sprite->sceneScale) > 240)
+		if(sprite->spriteX() + (spriteRect.width()/2 / sprite->sceneScale) > 240)
 		{
-			emit engine->setDirection(-sprite->direction);
-			emit engine->setX(240 - (spriteRect.width()/2 / sprite->sceneScale));
+			engine->setDirection(-sprite->direction());
+			engine->setX(240 - (spriteRect.width()/2 / sprite->sceneScale));
 		}
 		// Left edge
-		if(sprite->spriteX - (spriteRect.width()/2 / sprite->sceneScale) < -240)
+		if(sprite->spriteX() - (spriteRect.width()/2 / sprite->sceneScale) < -240)
 		{
-			emit engine->setDirection(-sprite->direction);
-			emit engine->setX(-240 + (spriteRect.width()/2 / sprite->sceneScale));
+			engine->setDirection(-sprite->direction());
+			engine->setX(-240 + (spriteRect.width()/2 / sprite->sceneScale));
 		}
 		// Top edge
-		if(sprite->spriteY + (spriteRect.height()/2 / sprite->sceneScale) > 180)
+		if(sprite->spriteY() + (spriteRect.height()/2 / sprite->sceneScale) > 180)
 		{
-			emit engine->setDirection(180-sprite->direction);
-			emit engine->setY(180 - (spriteRect.height()/2 / sprite->sceneScale));
+			engine->setDirection(180-sprite->direction());
+			engine->setY(180 - (spriteRect.height()/2 / sprite->sceneScale));
 		}
 		// Bottom edge
-		if(sprite->spriteY - (spriteRect.height()/2 / sprite->sceneScale) < -180)
+		if(sprite->spriteY() - (spriteRect.height()/2 / sprite->sceneScale) < -180)
 		{
-			emit engine->setDirection(180-sprite->direction);
-			emit engine->setY(-180 + (spriteRect.height()/2 / sprite->sceneScale));
+			engine->setDirection(180-sprite->direction());
+			engine->setY(-180 + (spriteRect.height()/2 / sprite->sceneScale));
 		}
 	}
 	else if(opcode == "motion_setrotationstyle")
 	{
-		sprite->rotationStyle = inputs.value("STYLE");
-		emit engine->setDirection(sprite->direction);
+		engine->setRotationStyle(inputs.value("STYLE"));
 	}
 	// Reporter blocks
 	else if(opcode == "motion_pointtowards_menu")
@@ -255,11 +261,11 @@ bool Blocks::motionBlocks(QString opcode, QMap<QString,QString> inputs, QString
 	else if(opcode == "motion_glideto_menu")
 		*returnValue = inputs.value("TO");
 	else if(opcode == "motion_xposition")
-		*returnValue = QString::number(sprite->spriteX);
+		*returnValue = QString::number(sprite->spriteX());
 	else if(opcode == "motion_yposition")
-		*returnValue = QString::number(sprite->spriteY);
+		*returnValue = QString::number(sprite->spriteY());
 	else if(opcode == "motion_direction")
-		*returnValue = QString::number(sprite->direction);
+		*returnValue = QString::number(sprite->direction());
 	else
 		return false;
 	return true;
@@ -272,91 +278,91 @@ bool Blocks::looksBlocks(QString opcode, QMap<QString,QString> inputs, QString *
 	if(opcode == "looks_sayforsecs")
 	{
 		engine->frameEnd = true;
-		emit engine->showBubble(inputs.value("MESSAGE"));
+		engine->showBubble(inputs.value("MESSAGE"));
 		if(engine->currentExecPos[processID]["special"].toString() != "wait")
 		{
 			engine->currentExecPos[processID]["special"] = "wait";
-			engine->currentExecPos[processID]["startTime"] = QDateTime::currentDateTimeUtc();
-			engine->currentExecPos[processID]["endTime"] = QDateTime::currentDateTimeUtc().addMSecs(inputs.value("SECS").toDouble() * 1000);
+			engine->currentExecPos[processID]["startTime"] = EngineClock::msecs();
 		}
-		QDateTime startTime = engine->currentExecPos[processID]["startTime"].toDateTime();
-		QDateTime endTime = engine->currentExecPos[processID]["endTime"].toDateTime();
-		QDateTime currentTime = QDateTime::currentDateTimeUtc();
-		qreal progress = (startTime.msecsTo(endTime) - currentTime.msecsTo(endTime)) / (inputs.value("SECS").toDouble() * 1000.0);
+		qint64 startTime = engine->currentExecPos[processID]["startTime"].toLongLong();
+		qint64 currentTime = EngineClock::msecs();
+		qreal progress = (currentTime - startTime) / (inputs.value("SECS").toDouble() * 1000.0);
 		if(progress >= 1)
 		{
-			emit engine->showBubble("");
+			engine->showBubble("");
 			engine->processEnd = true;
 			engine->frameEnd = false;
 		}
 	}
 	else if(opcode == "looks_say")
-		emit engine->showBubble(inputs.value("MESSAGE"));
+		engine->showBubble(inputs.value("MESSAGE"));
 	else if(opcode == "looks_thinkforsecs")
 	{
 		engine->frameEnd = true;
-		emit engine->showBubble(inputs.value("MESSAGE"),true);
+		engine->showBubble(inputs.value("MESSAGE"),true);
 		if(engine->currentExecPos[processID]["special"].toString() != "wait")
 		{
 			engine->currentExecPos[processID]["special"] = "wait";
-			engine->currentExecPos[processID]["startTime"] = QDateTime::currentDateTimeUtc();
-			engine->currentExecPos[processID]["endTime"] = QDateTime::currentDateTimeUtc().addMSecs(inputs.value("SECS").toDouble() * 1000);
+			engine->currentExecPos[processID]["startTime"] = EngineClock::msecs();
 		}
-		QDateTime startTime = engine->currentExecPos[processID]["startTime"].toDateTime();
-		QDateTime endTime = engine->currentExecPos[processID]["endTime"].toDateTime();
-		QDateTime currentTime = QDateTime::currentDateTimeUtc();
-		qreal progress = (startTime.msecsTo(endTime) - currentTime.msecsTo(endTime)) / (inputs.value("SECS").toDouble() * 1000.0);
+		qint64 startTime = engine->currentExecPos[processID]["startTime"].toLongLong();
+		qint64 currentTime = EngineClock::msecs();
+		qreal progress = (currentTime - startTime) / (inputs.value("SECS").toDouble() * 1000.0);
 		if(progress >= 1)
 		{
-			emit engine->showBubble("");
+			engine->showBubble("");
 			engine->processEnd = true;
 			engine->frameEnd = false;
 		}
 	}
 	else if(opcode == "looks_think")
-		emit engine->showBubble(inputs.value("MESSAGE"),true);
+		engine->showBubble(inputs.value("MESSAGE"),true);
 	else if(opcode == "looks_show")
-		emit engine->setVisible(true);
+		engine->setVisible(true);
 	else if(opcode == "looks_hide")
-		emit engine->setVisible(false);
+		engine->setVisible(false);
 	else if(opcode == "looks_changeeffectby")
 	{
-		sprite->graphicEffects[inputs.value("EFFECT")] += inputs.value("CHANGE").toDouble();
-		emit engine->installGraphicEffects();
+		QString effect = inputs.value("EFFECT");
+		sprite->setGraphicEffect(effect, sprite->graphicEffect(effect) + inputs.value("CHANGE").toDouble());
 	}
 	else if(opcode == "looks_seteffectto")
 	{
-		sprite->graphicEffects[inputs.value("EFFECT")] = inputs.value("VALUE").toDouble();
-		emit engine->installGraphicEffects();
+		sprite->setGraphicEffect(inputs.value("EFFECT"), inputs.value("VALUE").toDouble());
 	}
 	else if(opcode == "looks_cleargraphiceffects")
-		emit engine->resetGraphicEffects();
+		engine->resetGraphicEffects();
 	else if(opcode == "looks_changesizeby")
-		emit engine->setSize(sprite->size + inputs.value("CHANGE").toDouble());
+		engine->setSize(sprite->size() + inputs.value("CHANGE").toDouble());
 	else if(opcode == "looks_setsizeto")
-		emit engine->setSize(inputs.value("SIZE").toDouble());
+		engine->setSize(inputs.value("SIZE").toDouble());
 	else if(opcode == "looks_switchcostumeto")
 	{
-		int newCostume = sprite->currentCostume;
+		int newCostume = sprite->currentCostume();
 		for(int i=0; i < sprite->costumes.count(); i++)
 		{
 			if((sprite->costumes[i].contains("name")) && (sprite->costumes[i].value("name").toString() == inputs.value("COSTUME")))
 				newCostume = i;
 		}
-		emit engine->setCostume(newCostume);
+		if(waitForAsset(sprite->costumes.value(newCostume)))
+			return true;
+		engine->setCostume(newCostume);
 	}
 	else if(opcode == "looks_nextcostume")
 	{
-		int newCostume = sprite->currentCostume + 1;
+		int newCostume = sprite->currentCostume() + 1;
 		if(newCostume >= sprite->costumes.count())
 			newCostume = 0;
-		emit engine->setCostume(newCostume);
+		if(waitForAsset(sprite->costumes.value(newCostume)))
+			return true;
+		engine->setCostume(newCostume);
 	}
 	else if((opcode == "looks_switchbackdropto") || (opcode == "looks_switchbackdroptoandwait"))
 	{
 		scratchSprite *stagePtr = sprite->getSprite("Stage");
 		QList<QVariantMap> *backdrops = &stagePtr->costumes;
-		int newCostume = stagePtr->currentCostume;
+		int currentBackdrop = spriteState(stagePtr).costume;
+		int newCostume = currentBackdrop;
 		bool backdropFound = false;
 		for(int i=0; i < backdrops->count(); i++)
 		{
@@ -371,25 +377,24 @@ bool Blocks::looksBlocks(QString opcode, QMap<QString,QString> inputs, QString *
 		{
 			if(inputs.value("BACKDROP") == "next backdrop")
 			{
-				newCostume = stagePtr->currentCostume + 1;
+				newCostume = currentBackdrop + 1;
 				if(newCostume >= stagePtr->costumes.count())
 					newCostume = 0;
 			}
 			else if(inputs.value("BACKDROP") == "previous backdrop")
 			{
-				newCostume = stagePtr->currentCostume - 1;
+				newCostume = currentBackdrop - 1;
 				if(newCostume < 0)
 					newCostume = stagePtr->costumes.count() - 1;
 			}
 			else if(inputs.value("BACKDROP") == "random backdrop")
 			{
-#if QT_VERSION >= QT_VERSION_CHECK(5, 10, 0)
-				newCostume = QRandomGenerator::global()->bounded(0,stagePtr->costumes.count());
-#else
-				newCostume = qrand() % stagePtr->costumes.count();
-#endif
+				newCostume = engine->random.bounded(0,stagePtr->costumes.count());
 			}
 		}
+		bool started = (engine->currentExecPos[processID]["special"].toString() == "waituntilend");
+		if(!started && waitForAsset(backdrops->value(newCostume)))
+			return true;
 		if(opcode == "looks_switchbackdroptoandwait")
 		{
 			engine->frameEnd = true;
@@ -397,7 +402,7 @@ bool Blocks::looksBlocks(QString opcode, QMap<QString,QString> inputs, QString *
 			{
 				engine->currentExecPos[processID]["special"] = "waituntilend";
 				engine->currentExecPos[processID]["activescripts"] = 0;
-				emit stagePtr->engine()->setCostume(newCostume,&engine->currentExecPos[processID]);
+				engine->commands.append(CommandBuffer::SetBackdropCommand, newCostume, &engine->currentExecPos[processID]);
 			}
 			else
 			{
@@ -409,52 +414,34 @@ bool Blocks::looksBlocks(QString opcode, QMap<QString,QString> inputs, QString *
 			}
 		}
 		else
-			emit stagePtr->engine()->setCostume(newCostume);
+			engine->commands.append(CommandBuffer::SetBackdropCommand, newCostume);
 	}
 	else if(opcode == "looks_nextbackdrop")
 	{
 		scratchSprite *stagePtr = sprite->getSprite("Stage");
-		int newCostume = stagePtr->currentCostume + 1;
+		int newCostume = spriteState(stagePtr).costume + 1;
 		if(newCostume >= stagePtr->costumes.count())
 			newCostume = 0;
-		emit stagePtr->engine()->setCostume(newCostume);
+		engine->commands.append(CommandBuffer::SetBackdropCommand, newCostume);
 	}
+	// Layer changes depend on other sprites, so they're done when the writes are committed
 	else if(opcode == "looks_gotofrontback")
 	{
 		if(inputs.value("FRONT_BACK") == "front")
-		{
-			int maxLayer = 0;
-			for(int i=0; i < spriteList.count(); i++)
-			{
-				if(spriteList[i]->zValue() > maxLayer)
-					maxLayer = spriteList[i]->zValue();
-			}
-			emit engine->setZValue(maxLayer+1);
-		}
+			engine->commands.append(CommandBuffer::GoToFrontCommand);
 		else
-		{
-			for(int i=0; i < spriteList.count(); i++)
-				spriteList[i]->setZValue(spriteList[i]->zValue() + 1);
-			emit engine->setZValue(1);
-		}
+			engine->commands.append(CommandBuffer::GoToBackCommand);
 	}
 	else if(opcode == "looks_goforwardbackwardlayers")
 	{
 		int delta = inputs.value("NUM").toInt();
 		if(inputs.value("FORWARD_BACKWARD") == "backward")
 			delta *= -1;
-		if(delta < 0)
-		{
-			for(int i=0; i < spriteList.count(); i++)
-				spriteList[i]->setZValue(spriteList[i]->zValue() + 1);
-		}
-		emit engine->setZValue(sprite->zValue() + delta);
-		if(sprite->zValue() < 1)
-			emit engine->setZValue(1);
+		engine->commands.append(CommandBuffer::MoveLayersCommand, delta);
 	}
 	// Reporter blocks
 	else if(opcode == "looks_size")
-		*returnValue = QString::number(sprite->size);
+		*returnValue = QString::number(sprite->size());
 	else if(opcode == "looks_costume")
 		*returnValue = inputs.value("COSTUME");
 	else if(opcode == "looks_backdrops")
@@ -462,17 +449,18 @@ bool Blocks::looksBlocks(QString opcode, QMap<QString,QString> inputs, QString *
 	else if(opcode == "looks_backdropnumbername")
 	{
 		scratchSprite *stagePtr = sprite->getSprite("Stage");
+		int backdrop = spriteState(stagePtr).costume;
 		if(inputs.value("NUMBER_NAME") == "number")
-			*returnValue = QString::number(stagePtr->currentCostume);
+			*returnValue = QString::number(backdrop);
 		else
-			*returnValue = stagePtr->costumes[stagePtr->currentCostume].value("name").toString();
+			*returnValue = stagePtr->costumes[backdrop].value("name").toString();
 	}
 	else if(opcode == "looks_costumenumbername")
 	{
 		if(inputs.value("NUMBER_NAME") == "number")
-			*returnValue = QString::number(sprite->currentCostume);
+			*returnValue = QString::number(sprite->currentCostume());
 		else
-			*returnValue = sprite->costumes[sprite->currentCostume].value("name").toString();
+			*returnValue = sprite->costumes[sprite->currentCostume()].value("name").toString();
 	}
 	else
 		return false;
@@ -483,37 +471,72 @@ bool Blocks::looksBlocks(QString opcode, QMap<QString,QString> inputs, QString *
 bool Blocks::soundBlocks(QString opcode, QMap<QString,QString> inputs, QString *returnValue)
 {
 	Q_UNUSED(returnValue);
+	// Sounds are started and stopped when the writes are committed
 	if(opcode == "sound_play")
-		sprite->playSound(inputs.value("SOUND_MENU"));
+	{
+		if(waitForSound(inputs.value("SOUND_MENU")))
+			return true;
+		engine->commands.appendText(CommandBuffer::PlaySoundCommand, inputs.value("SOUND_MENU"));
+	}
 	else if(opcode == "sound_playuntildone")
 	{
+		if((engine->currentExecPos[processID]["special"].toString() != "soundwait") && waitForSound(inputs.value("SOUND_MENU")))
+			return true;
 		engine->frameEnd = true;
 		if(engine->currentExecPos[processID]["special"].toString() != "soundwait")
 		{
 			engine->currentExecPos[processID]["special"] = "soundwait";
-			engine->currentExecPos[processID]["sound"] = (qlonglong) (intptr_t) sprite->playSound(inputs.value("SOUND_MENU"));
+			// The voice is reserved now, so it's playing until the sound is started and finished
+			quint64 voice = audioMixer.reserveVoice();
+			engine->currentExecPos[processID]["sound"] = voice;
+			engine->commands.appendText(CommandBuffer::PlaySoundCommand, inputs.value("SOUND_MENU"), voice);
 		}
-		else
+		else if(!audioMixer.isPlaying(engine->currentExecPos[processID]["sound"].toULongLong()))
 		{
-			QPointer<QMediaPlayer> sound = *((QPointer<QMediaPlayer>*) engine->currentExecPos[processID]["sound"].toLongLong());
-			if((sound == nullptr) || (sound->state() == QMediaPlayer::StoppedState))
-			{
-				engine->processEnd = true;
-				engine->frameEnd = false;
-				sound->deleteLater();
-			}
+			engine->processEnd = true;
+			engine->frameEnd = false;
 		}
 	}
 	else if(opcode == "sound_stopallsounds")
-		sprite->stopAllSounds();
-	else if(opcode == "sound_seteffectto");
-		// TODO: Add sound effects (see QAudioDecoder)
-	else if(opcode == "sound_changeeffectby");
-	else if(opcode == "sound_cleareffects");
-	else if(opcode == "sound_changevolumeby")
-		sprite->setVolume(sprite->volume + inputs.value("VOLUME").toDouble());
-	else if(opcode == "sound_setvolumeto")
-		sprite->setVolume(inputs.value("VOLUME").toDouble());
+		engine->commands.append(CommandBuffer::StopAllSoundsCommand);
+	else if((opcode == "sound_seteffectto") || (opcode == "sound_changeeffectby"))
+	{
+		QString effect = inputs.value("EFFECT").toUpper();
+		qreal value = inputs.value("VALUE").toDouble();
+		if(effect == "PITCH")
+		{
+			if(opcode == "sound_changeeffectby")
+				value += sprite->pitchEffect;
+			value = qBound(-360.0, value, 360.0);
+			sprite->pitchEffect = value;
+		}
+		else if(effect == "PAN")
+		{
+			if(opcode == "sound_changeeffectby")
+				value += sprite->panEffect;
+			value = qBound(-100.0, value, 100.0);
+			sprite->panEffect = value;
+		}
+		else
+			return true;
+		// Playing sounds continue with the new effect
+		engine->commands.appendText(CommandBuffer::SetSoundEffectCommand, effect, value);
+	}
+	else if(opcode == "sound_cleareffects")
+	{
+		sprite->pitchEffect = 0;
+		sprite->panEffect = 0;
+		engine->commands.append(CommandBuffer::ClearSoundEffectsCommand);
+	}
+	else if((opcode == "sound_changevolumeby") || (opcode == "sound_setvolumeto"))
+	{
+		qreal newVolume = inputs.value("VOLUME").toDouble();
+		if(opcode == "sound_changevolumeby")
+			newVolume += sprite->volume;
+		newVolume = qBound(0.0, newVolume, 100.0);
+		sprite->volume = newVolume;
+		engine->commands.append(CommandBuffer::SetVolumeCommand, newVolume);
+	}
 	// Reporter blocks
 	else if(opcode == "sound_sounds_menu")
 		*returnValue = inputs.value("SOUND_MENU");
@@ -528,8 +551,9 @@ bool Blocks::soundBlocks(QString opcode, QMap<QString,QString> inputs, QString *
 bool Blocks::eventBlocks(QString opcode, QMap<QString,QString> inputs, QString *returnValue)
 {
 	Q_UNUSED(returnValue);
+	// Broadcasts start scripts of other sprites, so they're sent when the writes are committed
 	if(opcode == "event_broadcast")
-		sprite->emitBroadcast(inputs.value("BROADCAST_INPUT"));
+		engine->commands.appendText(CommandBuffer::BroadcastCommand, inputs.value("BROADCAST_INPUT"));
 	else if(opcode == "event_broadcastandwait")
 	{
 		engine->frameEnd = true;
@@ -537,7 +561,7 @@ bool Blocks::eventBlocks(QString opcode, QMap<QString,QString> inputs, QString *
 		{
 			engine->currentExecPos[processID]["special"] = "waituntilend";
 			engine->currentExecPos[processID]["activescripts"] = 0;
-			sprite->emitBroadcast(inputs.value("BROADCAST_INPUT"),&engine->currentExecPos[processID]);
+			engine->commands.appendText(CommandBuffer::BroadcastCommand, inputs.value("BROADCAST_INPUT"), 0, &engine->currentExecPos[processID]);
 		}
 		else
 		{
@@ -675,8 +699,9 @@ bool Blocks::controlBlocks(QString opcode, QMap<QString,QString> inputs, QString
 	{
 		if(inputs.value("STOP_OPTION") == "all")
 		{
-			for(int i=0; i < spriteList.count(); i++)
-				spriteList[i]->stopSprite();
+			// Other sprites are stopped when the writes are committed
+			engine->currentExecPos.clear();
+			engine->commands.append(CommandBuffer::StopAllCommand);
 		}
 		else if(inputs.value("STOP_OPTION") == "this script")
 			engine->currentExecPos[processID]["special"] = "remove_operation";
@@ -698,8 +723,8 @@ bool Blocks::controlBlocks(QString opcode, QMap<QString,QString> inputs, QString
 	{
 		if(engine->currentExecPos[processID]["special"].toString() == "wait_secs")
 		{
-			QDateTime currentTime = QDateTime::currentDateTimeUtc();
-			if(currentTime >= engine->currentExecPos[processID]["endTime"].toDateTime())
+			qint64 currentTime = EngineClock::msecs();
+			if(currentTime >= engine->currentExecPos[processID]["endTime"].toLongLong())
 			{
 				engine->currentExecPos[processID]["special"] = "";
 				engine->processEnd = true;
@@ -711,7 +736,7 @@ bool Blocks::controlBlocks(QString opcode, QMap<QString,QString> inputs, QString
 		{
 			engine->frameEnd = true;
 			engine->currentExecPos[processID]["special"] = "wait_secs";
-			engine->currentExecPos[processID]["endTime"] = QDateTime::currentDateTimeUtc().addMSecs(inputs.value("DURATION").toDouble() * 1000);
+			engine->currentExecPos[processID]["endTime"] = EngineClock::msecs() + (qint64) (inputs.value("DURATION").toDouble() * 1000);
 			engine->runFrameAgain = true;
 		}
 	}
@@ -754,12 +779,15 @@ bool Blocks::controlBlocks(QString opcode, QMap<QString,QString> inputs, QString
 		if(targetSprite == nullptr)
 			qWarning() << "Warning: could not create clone; sprite" << cloneName << "not found";
 		else
-			cloneRequests.append(targetSprite);
+			engine->commands.append(CommandBuffer::CreateCloneCommand, 0, targetSprite);
 	}
 	else if(opcode == "control_delete_this_clone")
 	{
 		if(sprite->isClone())
-			sprite->stopAll();
+		{
+			engine->currentExecPos.clear();
+			engine->commands.append(CommandBuffer::DeleteCloneCommand);
+		}
 	}
 	// Reporter blocks
 	else if(opcode == "control_create_clone_of_menu")
@@ -768,3 +796,139 @@ bool Blocks::controlBlocks(QString opcode, QMap<QString,QString> inputs, QString
 		return false;
 	return true;
 }
+
+/*!
+ * Returns the values of the given sprite.\n
+ * Other sprites can run in parallel, so their values are read from the snapshot taken before the frame.
+ */
+SpriteSnapshot Blocks::spriteState(scratchSprite *target)
+{
+	if(target == sprite)
+		return sprite->state();
+	return target->snapshot();
+}
+
+/*! Returns the pen layer of the scene, or nullptr if the sprite isn't in a projectScene. */
+PenLayer *Blocks::penLayer(void)
+{
+	projectScene *scene = qobject_cast<projectScene*>(sprite->scene());
+	if(scene == nullptr)
+		return nullptr;
+	return scene->penLayer();
+}
+
+/*! Runs pen blocks. */
+bool Blocks::penBlocks(QString opcode, QMap<QString,QString> inputs, QString *returnValue)
+{
+	PenLayer *layer = penLayer();
+	QPointF position(sprite->spriteX(), sprite->spriteY());
+	if(opcode == "pen_clear")
+	{
+		if(layer)
+			engine->commands.append(CommandBuffer::PenClearCommand);
+	}
+	else if(opcode == "pen_stamp")
+	{
+		if(layer)
+			engine->commands.appendStamp(sprite->state());
+	}
+	else if(opcode == "pen_penDown")
+	{
+		sprite->pen.down = true;
+		// Draw a dot
+		if(layer)
+			engine->commands.appendPenLine(position, position, sprite->pen);
+	}
+	else if(opcode == "pen_penUp")
+		sprite->pen.down = false;
+	else if(opcode == "pen_setPenColorToColor")
+		sprite->pen.setColor(inputs.value("COLOR"));
+	else if(opcode == "pen_changePenColorParamBy")
+	{
+		QString param = inputs.value("COLOR_PARAM");
+		sprite->pen.setParam(param, sprite->pen.param(param) + inputs.value("VALUE").toDouble());
+	}
+	else if(opcode == "pen_setPenColorParamTo")
+		sprite->pen.setParam(inputs.value("COLOR_PARAM"), inputs.value("VALUE").toDouble());
+	else if(opcode == "pen_changePenSizeBy")
+		sprite->pen.size = qBound(1.0, sprite->pen.size + inputs.value("SIZE").toDouble(), 1200.0);
+	else if(opcode == "pen_setPenSizeTo")
+		sprite->pen.size = qBound(1.0, inputs.value("SIZE").toDouble(), 1200.0);
+	// Legacy blocks (hue is 0-200)
+	else if((opcode == "pen_changePenHueBy") || (opcode == "pen_setPenHueToNumber"))
+	{
+		qreal hue = inputs.value("HUE").toDouble() / 2;
+		if(opcode == "pen_changePenHueBy")
+			hue += sprite->pen.color;
+		sprite->pen.setParam("color", hue);
+		// Only "set pen color to" resets the transparency
+		if(opcode == "pen_setPenHueToNumber")
+			sprite->pen.transparency = 0;
+		sprite->pen.updateLegacyColor();
+	}
+	else if((opcode == "pen_changePenShadeBy") || (opcode == "pen_setPenShadeToNumber"))
+	{
+		qreal shade = inputs.value("SHADE").toDouble();
+		if(opcode == "pen_changePenShadeBy")
+			shade += sprite->pen.shade;
+		sprite->pen.shade = shade - 200 * qFloor(shade / 200);
+		sprite->pen.updateLegacyColor();
+	}
+	// Reporter blocks
+	else if(opcode == "pen_menu_colorParam")
+		*returnValue = inputs.value("colorParam");
+	else
+		return false;
+	return true;
+}
+
+/*! Runs sensing blocks. */
+bool Blocks::sensingBlocks(QString opcode, QMap<QString,QString> inputs, QString *returnValue)
+{
+	Q_UNUSED(inputs);
+	// Reporter blocks
+	if(opcode == "sensing_loudness")
+		*returnValue = QString::number(loudnessMeter.loudness());
+	else
+		return false;
+	return true;
+}
+
+/*!
+ * Returns true if the script should wait for the given asset (costume or sound), which is still being downloaded.
+ * The block is run again in the next frame. The asset is downloaded before the other ones
+ * and the script waits for it at most assetWaitTime ms, then the block continues without it.
+ */
+bool Blocks::waitForAsset(const QVariantMap &asset)
+{
+	QString assetId = asset.value("assetId").toString();
+	QVariantMap &position = engine->currentExecPos[processID];
+	if(!projectAssets.isPending(assetId))
+	{
+		position.remove("assetwait");
+		return false;
+	}
+	if(!position.contains("assetwait"))
+	{
+		position["assetwait"] = EngineClock::msecs();
+		projectAssets.request(assetId);
+	}
+	else if(EngineClock::msecs() - position["assetwait"].toLongLong() >= assetWaitTime)
+	{
+		position.remove("assetwait");
+		return false;
+	}
+	engine->frameEnd = true;
+	return true;
+}
+
+/*! Returns true if the script should wait for the sound with the given name. \see waitForAsset() */
+bool Blocks::waitForSound(const QString &soundName)
+{
+	for(int i=0; i < sprite->sounds.count(); i++)
+	{
+		if(sprite->sounds[i].value("name").toString() == soundName)
+			return waitForAsset(sprite->sounds[i]);
+	}
+	return false;
+}
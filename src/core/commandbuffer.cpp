@@ -0,0 +1,105 @@
+/*
+ * commandbuffer.cpp
+ * This file is part of QScratchRuntime
+ *
+ * Copyright (C) 2023 - adazem009
+ *
+ * QScratchRuntime is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * QScratchRuntime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QScratchRuntime. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "core/commandbuffer.h"
+
+/*! Constructs CommandBuffer. */
+CommandBuffer::CommandBuffer()
+{
+	commands.reserve(64);
+}
+
+/*! Records a command. */
+void CommandBuffer::append(Type type, qreal value, void *pointer)
+{
+	Command command;
+	command.type = type;
+	command.index = -1;
+	command.value = value;
+	command.pointer = pointer;
+	commands.append(command);
+}
+
+/*! Records a command with text (e.g. a broadcast name). */
+void CommandBuffer::appendText(Type type, const QString &text, qreal value, void *pointer)
+{
+	append(type, value, pointer);
+	commands.last().index = texts.count();
+	texts.append(text);
+}
+
+/*! Records a pen line. */
+void CommandBuffer::appendPenLine(QPointF from, QPointF to, const PenState &pen)
+{
+	append(PenLineCommand);
+	commands.last().index = penLines.count();
+	PenLine line;
+	line.from = from;
+	line.to = to;
+	line.pen = pen;
+	penLines.append(line);
+}
+
+/*! Records a pen stamp of a sprite with the given values. */
+void CommandBuffer::appendStamp(const SpriteSnapshot &state)
+{
+	append(PenStampCommand);
+	commands.last().index = stamps.count();
+	stamps.append(state);
+}
+
+/*! Returns the number of recorded commands. */
+int CommandBuffer::count(void) const
+{
+	return commands.count();
+}
+
+/*! Returns the command at the given index. */
+const CommandBuffer::Command &CommandBuffer::at(int index) const
+{
+	return commands[index];
+}
+
+/*! Returns the text of the given command. */
+const QString &CommandBuffer::text(const Command &command) const
+{
+	return texts[command.index];
+}
+
+/*! Returns the pen line of the given command. */
+const CommandBuffer::PenLine &CommandBuffer::penLine(const Command &command) const
+{
+	return penLines[command.index];
+}
+
+/*! Returns the sprite values of the given stamp command. */
+const SpriteSnapshot &CommandBuffer::stamp(const Command &command) const
+{
+	return stamps[command.index];
+}
+
+/*! Removes all commands. The capacity is kept. */
+void CommandBuffer::clear(void)
+{
+	commands.clear();
+	texts.clear();
+	penLines.clear();
+	stamps.clear();
+}
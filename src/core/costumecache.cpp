@@ -0,0 +1,72 @@
+/*
+ * costumecache.cpp
+ * This file is part of QScratchRuntime
+ *
+ * Copyright (C) 2023 - adazem009
+ *
+ * QScratchRuntime is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * QScratchRuntime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QScratchRuntime. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "core/costumecache.h"
+
+CostumeCache costumeCache;
+
+/*! Constructs CostumeCache. */
+CostumeCache::CostumeCache()
+{
+	// Cost is in KiB
+	cache.setMaxCost(64 * 1024);
+}
+
+/*! Returns the cached pixmap of the given costume, or a null pixmap if it isn't in the cache. */
+QPixmap CostumeCache::pixmap(const QString &costume, qreal scale, bool hqSvg)
+{
+	CostumeKey key;
+	key.costume = costume;
+	key.scale = scale;
+	key.hqSvg = hqSvg;
+	QPixmap *cached = cache.object(key);
+	if(cached)
+		return *cached;
+	return QPixmap();
+}
+
+/*! Adds the decoded pixmap of the given costume. Null pixmaps (e.g. of assets which aren't downloaded yet) aren't cached. */
+void CostumeCache::insert(const QString &costume, qreal scale, bool hqSvg, const QPixmap &pixmap)
+{
+	if(pixmap.isNull())
+		return;
+	CostumeKey key;
+	key.costume = costume;
+	key.scale = scale;
+	key.hqSvg = hqSvg;
+	cache.insert(key, new QPixmap(pixmap), qMax(1, pixmap.width() * pixmap.height() * 4 / 1024));
+}
+
+/*! Removes the cached pixmaps of the given costume (e.g. after it's downloaded). */
+void CostumeCache::remove(const QString &costume)
+{
+	QList<CostumeKey> keys = cache.keys();
+	for(int i=0; i < keys.count(); i++)
+	{
+		if(keys[i].costume == costume)
+			cache.remove(keys[i]);
+	}
+}
+
+/*! Removes all pixmaps (e.g. when another project is loaded). */
+void CostumeCache::clear(void)
+{
+	cache.clear();
+}
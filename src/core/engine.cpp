@@ -21,6 +21,10 @@
 #include "core/engine.h"
 #include "core/scratchsprite.h"
 #include "core/blocks.h"
+#include "core/engineclock.h"
+#include "core/profiler.h"
+#include "core/loudnessmeter.h"
+#include "projectscene.h"
 
 /*! Constructs Engine. */
 Engine::Engine(scratchSprite *sprite, QObject *parent) :
@@ -28,8 +32,8 @@ Engine::Engine(scratchSprite *sprite, QObject *parent) :
 	m_sprite(sprite),
 	blocks(new Blocks(sprite, this)) { }
 
-/*! Runs blocks that can be run without screen refresh.*/
-void Engine::frame(void)
+/*! Checks the hat blocks which are checked on every frame (e.g. timer events). This is called before frame(). */
+void Engine::frameEvents(void)
 {
 	QStringList frameEventBlocks = m_sprite->frameEvents.keys();
 	for(int i=0; i < frameEventBlocks.count(); i++)
@@ -39,11 +43,19 @@ void Engine::frame(void)
 		QMap<QString,QString> inputs = getInputs(block);
 		if(opcode == "event_whengreaterthan")
 		{
-			if(inputs.value("WHENGREATERTHANMENU") == "LOUDNESS"); // TODO: Implement audio input loudness
+			if(inputs.value("WHENGREATERTHANMENU") == "LOUDNESS")
+				spriteLoudnessEvent(frameEventBlocks[i], inputs.value("VALUE").toDouble());
 			else if(inputs.value("WHENGREATERTHANMENU") == "TIMER")
 				spriteTimerEvent();
 		}
 	}
+}
+
+/*! Runs blocks that can be run without screen refresh.*/
+void Engine::frame(void)
+{
+	bool profiling = Profiler::isEnabled();
+	qint64 frameStart = profiling ? Profiler::now() : 0;
 	do {
 		runFrameAgain = false;
 		QList<QVariantMap> operationsToRemove;
@@ -55,6 +67,7 @@ void Engine::frame(void)
 		for(int frame_i=0; frame_i < currentExecPos.count(); frame_i++)
 		{
 			QString next = currentExecPos[frame_i]["id"].toString();
+			qint64 scriptStart = profiling ? Profiler::now() : 0;
 			frameEnd = false;
 			while(!frameEnd)
 			{
@@ -69,6 +82,7 @@ void Engine::frame(void)
 					currentExecPos[frame_i] = posMap;
 				}
 				QString opcode = block.value("opcode").toString();
+				qint64 blockStart = profiling ? Profiler::now() : 0;
 				QMap<QString,QString> inputs = getInputs(block);
 				processEnd = false;
 				newStack = nullptr;
@@ -77,6 +91,8 @@ void Engine::frame(void)
 				processID = frame_i;
 				if(!blocks->runBlock(opcode, inputs))
 					qWarning() << "Warning: unsupported block:" << opcode;
+				if(profiling)
+					Profiler::recordBlock(opcode, blockStart);
 				if(currentExecPos.count() != previousLength)
 				{
 					end = true;
@@ -167,6 +183,8 @@ void Engine::frame(void)
 					}
 				}
 			}
+			if(profiling && (frame_i < currentExecPos.count()))
+				Profiler::recordScript(m_sprite->name, currentExecPos[frame_i]["toplevelblock"].toString(), scriptStart);
 			if(end)
 				break;
 		}
@@ -175,40 +193,180 @@ void Engine::frame(void)
 		for(int i=0; i < operationsToRemove.count(); i++)
 			currentExecPos.removeAll(operationsToRemove[i]);
 	} while(runFrameAgain);
+	if(profiling)
+		Profiler::recordSprite(m_sprite->name, frameStart);
+}
+
+/*! Sets the X position. The graphics item is updated by commitWrites(). */
+void Engine::setX(qreal x)
+{
+	spriteStore.setX(m_sprite->handle(), x);
+}
+
+/*! Sets the Y position. The graphics item is updated by commitWrites(). */
+void Engine::setY(qreal y)
+{
+	spriteStore.setY(m_sprite->handle(), y);
+}
+
+/*! Sets the size. The graphics item is updated by commitWrites(). */
+void Engine::setSize(qreal size)
+{
+	spriteStore.setSize(m_sprite->handle(), qMax(0.0, size));
+}
+
+/*! Sets the direction. The graphics item is updated by commitWrites(). */
+void Engine::setDirection(qreal angle)
+{
+	spriteStore.setDirection(m_sprite->handle(), scratchSprite::normalizeDirection(angle));
+}
+
+/*! Sets the costume. The graphics item is updated by commitWrites(). */
+void Engine::setCostume(int id)
+{
+	spriteStore.setCostume(m_sprite->handle(), id);
+}
+
+/*! Sets the rotation style ("all around", "left-right", or "don't rotate"). The graphics item is updated by commitWrites(). */
+void Engine::setRotationStyle(const QString &style)
+{
+	m_sprite->rotationStyle = style;
+	spriteStore.markDirty(m_sprite->handle(), SpriteStore::TransformDirty);
+}
+
+/*! Shows or hides the sprite. The graphics item is updated by commitWrites(). */
+void Engine::setVisible(bool visible)
+{
+	spriteStore.setVisible(m_sprite->handle(), visible);
+}
+
+/*! Resets the values of the graphic effects. The image is updated by commitWrites(). */
+void Engine::resetGraphicEffects(void)
+{
+	m_sprite->clearGraphicEffects();
+}
+
+/*! Shows a speech or thought bubble when the writes are committed (an empty text hides the bubble). */
+void Engine::showBubble(QString text, bool thought)
+{
+	commands.appendText(CommandBuffer::ShowBubbleCommand, text, thought);
+}
+
+/*! Applies the recorded commands and updates the graphics item. This is called on the main thread after the frame. */
+void Engine::commitWrites(void)
+{
+	projectScene *scene = qobject_cast<projectScene*>(m_sprite->scene());
+	PenLayer *penLayer = scene ? scene->penLayer() : nullptr;
+	for(int i=0; i < commands.count(); i++)
+	{
+		const CommandBuffer::Command &command = commands.at(i);
+		switch(command.type)
+		{
+			case CommandBuffer::ShowBubbleCommand:
+				m_sprite->showBubble(commands.text(command), command.value != 0);
+				break;
+			case CommandBuffer::GoToFrontCommand:
+				layerList.goToFront(m_sprite);
+				break;
+			case CommandBuffer::GoToBackCommand:
+				layerList.goToBack(m_sprite);
+				break;
+			case CommandBuffer::MoveLayersCommand:
+				layerList.moveLayers(m_sprite, (int) command.value);
+				break;
+			case CommandBuffer::SetBackdropCommand:
+			{
+				scratchSprite *stage = m_sprite->getSprite("Stage");
+				if(stage)
+					stage->setCostume((int) command.value, (QVariantMap*) command.pointer);
+				break;
+			}
+			case CommandBuffer::BroadcastCommand:
+				m_sprite->emitBroadcast(commands.text(command), (QVariantMap*) command.pointer);
+				break;
+			case CommandBuffer::CreateCloneCommand:
+				cloneRequests.append((scratchSprite*) command.pointer);
+				break;
+			case CommandBuffer::StopAllCommand:
+				for(int j=0; j < spriteList.count(); j++)
+					spriteList[j]->stopSprite();
+				break;
+			case CommandBuffer::DeleteCloneCommand:
+				m_sprite->stopAll();
+				break;
+			case CommandBuffer::PlaySoundCommand:
+				m_sprite->playSound(commands.text(command), (quint64) command.value);
+				break;
+			case CommandBuffer::StopAllSoundsCommand:
+				scratchSprite::stopAllSounds();
+				break;
+			case CommandBuffer::SetVolumeCommand:
+				m_sprite->setVolume(command.value);
+				break;
+			case CommandBuffer::SetSoundEffectCommand:
+				m_sprite->setSoundEffect(commands.text(command), command.value);
+				break;
+			case CommandBuffer::ClearSoundEffectsCommand:
+				m_sprite->clearSoundEffects();
+				break;
+			case CommandBuffer::PenClearCommand:
+				if(penLayer)
+					penLayer->clear();
+				break;
+			case CommandBuffer::PenLineCommand:
+				if(penLayer)
+				{
+					const CommandBuffer::PenLine &line = commands.penLine(command);
+					penLayer->drawLine(line.from, line.to, line.pen);
+				}
+				break;
+			case CommandBuffer::PenStampCommand:
+				// Show the sprite like it was when the stamp was made
+				if(penLayer)
+				{
+					m_sprite->syncView(commands.stamp(command));
+					penLayer->stamp(m_sprite->pixmap(), m_sprite->sceneTransform(), m_sprite->opacity());
+				}
+				break;
+		}
+	}
+	commands.clear();
+	m_sprite->syncView();
 }
 
 /*! Reads block inputs and fields and returns a map. */
-QMap<QString,QString> Engine::getInputs(QVariantMap block, bool readFields)
+QMap<QString,QString> Engine::getInputs(const QVariantMap &block, bool readFields)
 {
-	QJsonObject blockInputs;
+	// Inputs and fields are read from the maps and lists built by projectParser
+	QVariantMap blockInputs;
 	if(readFields)
-		blockInputs = block.value("fields").toJsonObject();
+		blockInputs = block.value("fields").toMap();
 	else
-		blockInputs = block.value("inputs").toJsonObject();
-	QStringList blockInputsList = blockInputs.keys();
+		blockInputs = block.value("inputs").toMap();
 	QMap<QString,QString> out;
 	out.clear();
-	for(int i=0; i < blockInputsList.count(); i++)
+	for(auto it = blockInputs.constBegin(); it != blockInputs.constEnd(); ++it)
 	{
-		QJsonValue inputValue = blockInputs.value(blockInputsList[i]).toArray().at(1);
+		QVariantList input = it.value().toList();
+		QVariant inputValue = input.value(1);
 		bool typeConverted = false;
-		QJsonValue finalRawValue;
+		QVariant finalRawValue;
 		QString finalValue = "";
-		if(blockInputsList[i].contains("SUBSTACK"))
+		if(it.key().contains("SUBSTACK"))
 		{
 			// Start of a blocks stack
 			typeConverted = true;
-			finalValue = blockInputs.value(blockInputsList[i]).toArray().at(1).toString();
+			finalValue = inputValue.toString();
 		}
 		else if(readFields)
 		{
 			// Input is in the first item
-			finalRawValue = blockInputs.value(blockInputsList[i]).toArray().at(0);
+			finalRawValue = input.value(0);
 		}
-		else if(inputValue.isArray())
+		else if(inputValue.type() == QVariant::List)
 		{
 			// Input representation as an array
-			finalRawValue = inputValue.toArray().at(1);
+			finalRawValue = inputValue.toList().value(1);
 		}
 		else
 		{
@@ -228,14 +386,12 @@ QMap<QString,QString> Engine::getInputs(QVariantMap block, bool readFields)
 		}
 		if(!typeConverted)
 		{
-			if(finalRawValue.isString())
+			if(finalRawValue.type() == QVariant::String)
 				finalValue = finalRawValue.toString();
-			else if(finalRawValue.isDouble())
+			else if(finalRawValue.type() == QVariant::Double)
 				finalValue = QString::number(finalRawValue.toDouble());
-			else if(finalRawValue.isBool())
-				finalValue = finalRawValue.toString();
 		}
-		out.insert(blockInputsList[i],finalValue);
+		out.insert(it.key(),finalValue);
 	}
 	if(!readFields)
 	{
@@ -259,28 +415,46 @@ void Engine::spriteTimerEvent(void)
 		if(block.value("opcode").toString() == "event_whengreaterthan")
 		{
 			QMap<QString,QString> inputs = getInputs(block);
-			if((inputs.value("WHENGREATERTHANMENU") == "TIMER") && (m_sprite->timer.elapsed()/1000.0 > inputs.value("VALUE").toDouble())
+			if((inputs.value("WHENGREATERTHANMENU") == "TIMER") && ((EngineClock::msecs() - m_sprite->timerStart)/1000.0 > inputs.value("VALUE").toDouble())
 				&& !block.value("special_timereventused").toBool())
 			{
-				// Stop running instances of this event
-				QList<QVariantMap> operationsToRemove;
-				operationsToRemove.clear();
-				for(int i2=0; i2 < currentExecPos.count(); i2++)
-				{
-					if(currentExecPos[i2]["toplevelblock"] == blocksList[i])
-						operationsToRemove += currentExecPos[i2];
-				}
-				for(int i2=0; i2 < operationsToRemove.count(); i2++)
-					currentExecPos.removeAll(operationsToRemove[i2]);
-				// Start the script
 				block.insert("special_timereventused",true);
 				m_sprite->frameEvents.insert(blocksList[i],block);
-				QVariantMap blockMap;
-				blockMap.clear();
-				blockMap.insert("id",blocksList[i]);
-				blockMap.insert("special","");
-				currentExecPos += blockMap;
+				restartScript(blocksList[i]);
 			}
 		}
 	}
 }
+
+/*!
+ * Starts the given "when loudness is greater than" event block when the loudness rises above the input value.\n
+ * The loudness is read from LoudnessMeter, so this doesn't wait for the audio input.
+ */
+void Engine::spriteLoudnessEvent(const QString &blockID, qreal value)
+{
+	bool above = loudnessMeter.loudness() > value;
+	QVariantMap block = m_sprite->frameEvents.value(blockID);
+	if(above == block.value("special_loudnessabove").toBool())
+		return;
+	block.insert("special_loudnessabove", above);
+	m_sprite->frameEvents.insert(blockID, block);
+	if(above)
+		restartScript(blockID);
+}
+
+/*! Stops running instances of the script with the given top level block and starts it again. */
+void Engine::restartScript(const QString &topLevelBlock)
+{
+	QList<QVariantMap> operationsToRemove;
+	for(int i=0; i < currentExecPos.count(); i++)
+	{
+		if(currentExecPos[i]["toplevelblock"] == topLevelBlock)
+			operationsToRemove += currentExecPos[i];
+	}
+	for(int i=0; i < operationsToRemove.count(); i++)
+		currentExecPos.removeAll(operationsToRemove[i]);
+	QVariantMap blockMap;
+	blockMap.insert("id",topLevelBlock);
+	blockMap.insert("special","");
+	currentExecPos += blockMap;
+}
@@ -0,0 +1,63 @@
+/*
+ * engineclock.cpp
+ * This file is part of QScratchRuntime
+ *
+ * Copyright (C) 2023 - adazem009
+ *
+ * QScratchRuntime is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * QScratchRuntime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QScratchRuntime. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "core/engineclock.h"
+
+/*! Returns a started QElapsedTimer. */
+static QElapsedTimer startedTimer(void)
+{
+	QElapsedTimer timer;
+	timer.start();
+	return timer;
+}
+
+QElapsedTimer EngineClock::realTimer = startedTimer();
+bool EngineClock::virtualMode = false;
+qreal EngineClock::virtualTime = 0;
+qreal EngineClock::step = 1000.0 / 30;
+
+/*! Returns the current time in milliseconds. */
+qint64 EngineClock::msecs(void)
+{
+	if(virtualMode)
+		return virtualTime;
+	return realTimer.elapsed();
+}
+
+/*! Switches between real time and virtual time, which advances by stepMsecs on every frame. */
+void EngineClock::setVirtual(bool enabled, qreal stepMsecs)
+{
+	virtualMode = enabled;
+	virtualTime = 0;
+	step = stepMsecs;
+}
+
+/*! Returns true if the clock uses virtual time. */
+bool EngineClock::isVirtual(void)
+{
+	return virtualMode;
+}
+
+/*! Called at the beginning of every frame. Advances the virtual time by one step. */
+void EngineClock::advance(void)
+{
+	if(virtualMode)
+		virtualTime += step;
+}
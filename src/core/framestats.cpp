@@ -0,0 +1,159 @@
+/*
+ * framestats.cpp
+ * This file is part of QScratchRuntime
+ *
+ * Copyright (C) 2023 - adazem009
+ *
+ * QScratchRuntime is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * QScratchRuntime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QScratchRuntime. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QtMath>
+#include <algorithm>
+#include "core/framestats.h"
+
+std::atomic<qint64> FrameStats::effectsTime(0);
+
+/*! Constructs FrameStats, which keeps the last windowSize samples of each phase. */
+FrameStats::FrameStats(int windowSize) :
+	m_windowSize(qMax(1, windowSize)) { }
+
+/*! Adds a sample to the ring buffer. */
+void FrameStats::add(Window &window, qint64 value)
+{
+	if(window.samples.count() < m_windowSize)
+		window.samples.append(value);
+	else
+		window.samples[window.next] = value;
+	window.next = (window.next + 1) % m_windowSize;
+}
+
+/*! Adds the duration of a phase in nanoseconds. */
+void FrameStats::addSample(Phase phase, qint64 nsecs)
+{
+	add(windows[phase], nsecs);
+}
+
+/*! Adds the difference between the measured and expected frame timer interval in nanoseconds. */
+void FrameStats::addJitter(qint64 nsecs)
+{
+	add(jitter, qAbs(nsecs));
+}
+
+/*! Returns the given percentile (0-100) of the samples in milliseconds. */
+qreal FrameStats::windowPercentile(const Window &window, qreal p)
+{
+	if(window.samples.isEmpty())
+		return 0;
+	QVector<qint64> sorted = window.samples;
+	std::sort(sorted.begin(), sorted.end());
+	int index = qBound(0, qCeil(p / 100 * sorted.count()) - 1, sorted.count() - 1);
+	return sorted[index] / 1e6;
+}
+
+/*! Returns the given percentile (0-100) of the recent durations of the phase in milliseconds. */
+qreal FrameStats::percentile(Phase phase, qreal p) const
+{
+	return windowPercentile(windows[phase], p);
+}
+
+/*! Returns the given percentile (0-100) of the recent frame timer jitter in milliseconds. */
+qreal FrameStats::jitterPercentile(qreal p) const
+{
+	return windowPercentile(jitter, p);
+}
+
+/*! Removes all samples. */
+void FrameStats::clear(void)
+{
+	for(int i=0; i < PhaseCount; i++)
+		windows[i] = Window();
+	jitter = Window();
+}
+
+/*! Returns the name of the phase. */
+QString FrameStats::phaseName(Phase phase)
+{
+	switch(phase)
+	{
+		case EventsPhase:
+			return "Events";
+		case ScriptsPhase:
+			return "Scripts";
+		case CloneDeletionPhase:
+			return "Clone deletion";
+		case CloneCreationPhase:
+			return "Clone creation";
+		case EffectsPhase:
+			return "Effects";
+		case PenPhase:
+			return "Pen";
+		case PaintingPhase:
+			return "Painting";
+		case TickPhase:
+			return "Frame";
+		default:
+			return QString();
+	}
+}
+
+/*! Returns a text table with p50, p95 and p99 of each phase and the jitter in milliseconds. */
+QString FrameStats::text(void) const
+{
+	QString out = QString("ms").leftJustified(16) + QString("p50").rightJustified(8)
+		+ QString("p95").rightJustified(8) + QString("p99").rightJustified(8);
+	for(int i=0; i < PhaseCount; i++)
+	{
+		Phase phase = (Phase) i;
+		out += "\n" + phaseName(phase).leftJustified(16) + QString::number(percentile(phase, 50), 'f', 2).rightJustified(8)
+			+ QString::number(percentile(phase, 95), 'f', 2).rightJustified(8)
+			+ QString::number(percentile(phase, 99), 'f', 2).rightJustified(8);
+	}
+	out += "\n" + QString("Timer jitter").leftJustified(16) + QString::number(jitterPercentile(50), 'f', 2).rightJustified(8)
+		+ QString::number(jitterPercentile(95), 'f', 2).rightJustified(8)
+		+ QString::number(jitterPercentile(99), 'f', 2).rightJustified(8);
+	return out;
+}
+
+/*! Returns p50, p95 and p99 of each phase and the jitter in milliseconds. */
+QJsonObject FrameStats::toJson(void) const
+{
+	static const char *keys[PhaseCount] = {"events", "scripts", "cloneDeletion", "cloneCreation", "effects", "pen", "painting", "frame"};
+	QJsonObject out;
+	for(int i=0; i < PhaseCount; i++)
+	{
+		QJsonObject percentiles;
+		percentiles.insert("p50", percentile((Phase) i, 50));
+		percentiles.insert("p95", percentile((Phase) i, 95));
+		percentiles.insert("p99", percentile((Phase) i, 99));
+		out.insert(keys[i], percentiles);
+	}
+	QJsonObject jitterPercentiles;
+	jitterPercentiles.insert("p50", jitterPercentile(50));
+	jitterPercentiles.insert("p95", jitterPercentile(95));
+	jitterPercentiles.insert("p99", jitterPercentile(99));
+	out.insert("timerJitter", jitterPercentiles);
+	return out;
+}
+
+/*! Adds time spent on graphic effects. This can be called from any thread. */
+void FrameStats::addEffectsTime(qint64 nsecs)
+{
+	effectsTime += nsecs;
+}
+
+/*! Returns the time spent on graphic effects since the last call and resets it. */
+qint64 FrameStats::takeEffectsTime(void)
+{
+	return effectsTime.exchange(0);
+}
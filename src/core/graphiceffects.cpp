@@ -0,0 +1,480 @@
+/*
+ * graphiceffects.cpp
+ * This file is part of QScratchRuntime
+ *
+ * Copyright (C) 2023 - adazem009
+ *
+ * QScratchRuntime is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * QScratchRuntime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QScratchRuntime. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QtMath>
+#include <QMutex>
+#include <QThread>
+#ifndef Q_OS_WASM
+#include <QtConcurrent>
+#endif // Q_OS_WASM
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif // __SSE2__
+#include "core/graphiceffects.h"
+
+/*! Cache key of a displacement table. */
+struct DisplacementKey
+{
+	int width;
+	int height;
+	qreal fisheye;
+	qreal whirl;
+	qreal pixelate;
+	qreal mosaic;
+	bool operator==(const DisplacementKey &other) const
+	{
+		return (width == other.width) && (height == other.height) && (fisheye == other.fisheye) &&
+			(whirl == other.whirl) && (pixelate == other.pixelate) && (mosaic == other.mosaic);
+	}
+};
+
+static inline uint qHash(const DisplacementKey &key, uint seed = 0)
+{
+	return qHash(key.width, seed) ^ (qHash(key.height, seed) << 1) ^ (qHash(key.fisheye, seed) << 2) ^
+		(qHash(key.whirl, seed) << 3) ^ (qHash(key.pixelate, seed) << 4) ^ (qHash(key.mosaic, seed) << 5);
+}
+
+/*! Displacement tables shared by all sprites (cost is in KiB). */
+static QCache<DisplacementKey,QVector<int>> displacementTables(64 * 1024);
+static QMutex displacementTablesMutex;
+static bool multithreaded = true;
+
+/*! Parameters of the color kernel, which are the same for every pixel. */
+struct ColorKernelParams
+{
+	float hueShift; // degrees
+	float saturationScale;
+	float valueScale;
+	float valueAdd;
+};
+
+/*
+ * Both kernels use the same math:
+ * RGB -> HSV, hue rotation, saturation and value scaling,
+ * and a branchless HSV -> RGB conversion: f(n) = v - v*s*clamp(min(k, 4-k), 0, 1), k = (n + h/60) mod 6
+ * The alpha channel isn't modified (the ghost effect is applied using item opacity).
+ */
+
+/*! Scalar color kernel. Processes one ARGB32 scanline. */
+static void colorKernelScalar(const QRgb *src, QRgb *dst, int count, const ColorKernelParams &params)
+{
+	for(int i=0; i < count; i++)
+	{
+		QRgb pixel = src[i];
+		float r = qRed(pixel), g = qGreen(pixel), b = qBlue(pixel);
+		float mx = qMax(r, qMax(g, b));
+		float mn = qMin(r, qMin(g, b));
+		float delta = mx - mn;
+		float h = 0;
+		if(delta > 0)
+		{
+			if(mx == r)
+				h = 60 * (g - b) / delta;
+			else if(mx == g)
+				h = 60 * ((b - r) / delta + 2);
+			else
+				h = 60 * ((r - g) / delta + 4);
+		}
+		float s = (mx > 0) ? delta / mx : 0;
+		float v = mx;
+		// Effects
+		h += params.hueShift + 720;
+		h -= 360 * (int) (h / 360);
+		s *= params.saturationScale;
+		v = v * params.valueScale + params.valueAdd;
+		// HSV -> RGB
+		float hue = h / 60;
+		float vs = v * s;
+		float out[3];
+		const float n[3] = { 5, 3, 1 };
+		for(int c=0; c < 3; c++)
+		{
+			float k = n[c] + hue;
+			k -= 6 * (int) (k / 6);
+			float f = qBound(0.0f, qMin(k, 4 - k), 1.0f);
+			out[c] = qBound(0.0f, v - vs * f, 255.0f);
+		}
+		dst[i] = qRgba(qRound(out[0]), qRound(out[1]), qRound(out[2]), qAlpha(pixel));
+	}
+}
+
+#ifdef __SSE2__
+/*! Selects a where mask is set, otherwise b. */
+static inline __m128 blend(__m128 mask, __m128 a, __m128 b)
+{
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+/*! Returns x mod y for positive x. */
+static inline __m128 positiveMod(__m128 x, __m128 y)
+{
+	__m128 quotient = _mm_cvtepi32_ps(_mm_cvttps_epi32(_mm_div_ps(x, y)));
+	return _mm_sub_ps(x, _mm_mul_ps(y, quotient));
+}
+
+/*! Converts one channel from HSV to RGB. */
+static inline __m128 hsvChannel(__m128 n, __m128 hue, __m128 v, __m128 vs)
+{
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1);
+	const __m128 four = _mm_set1_ps(4);
+	const __m128 six = _mm_set1_ps(6);
+	__m128 k = positiveMod(_mm_add_ps(n, hue), six);
+	__m128 f = _mm_max_ps(zero, _mm_min_ps(one, _mm_min_ps(k, _mm_sub_ps(four, k))));
+	return _mm_sub_ps(v, _mm_mul_ps(vs, f));
+}
+
+/*! SSE2 color kernel. Processes 4 pixels of an ARGB32 scanline at once. */
+static void colorKernel(const QRgb *src, QRgb *dst, int count, const ColorKernelParams &params)
+{
+	const __m128i byteMask = _mm_set1_epi32(0xFF);
+	const __m128i alphaMask = _mm_set1_epi32((int) 0xFF000000);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 sixty = _mm_set1_ps(60);
+	const __m128 two = _mm_set1_ps(2);
+	const __m128 four = _mm_set1_ps(4);
+	const __m128 threeSixty = _mm_set1_ps(360);
+	const __m128 hueShift = _mm_set1_ps(params.hueShift + 720);
+	const __m128 saturationScale = _mm_set1_ps(params.saturationScale);
+	const __m128 valueScale = _mm_set1_ps(params.valueScale);
+	const __m128 valueAdd = _mm_set1_ps(params.valueAdd);
+	const __m128 max = _mm_set1_ps(255);
+	int i = 0;
+	for(; i + 4 <= count; i += 4)
+	{
+		__m128i pixels = _mm_loadu_si128((const __m128i*) (src + i));
+		__m128 r = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(pixels, 16), byteMask));
+		__m128 g = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(pixels, 8), byteMask));
+		__m128 b = _mm_cvtepi32_ps(_mm_and_si128(pixels, byteMask));
+		// RGB -> HSV
+		__m128 mx = _mm_max_ps(r, _mm_max_ps(g, b));
+		__m128 mn = _mm_min_ps(r, _mm_min_ps(g, b));
+		__m128 delta = _mm_sub_ps(mx, mn);
+		__m128 hasDelta = _mm_cmpgt_ps(delta, zero);
+		__m128 safeDelta = blend(hasDelta, delta, _mm_set1_ps(1));
+		__m128 hueR = _mm_div_ps(_mm_sub_ps(g, b), safeDelta);
+		__m128 hueG = _mm_add_ps(_mm_div_ps(_mm_sub_ps(b, r), safeDelta), two);
+		__m128 hueB = _mm_add_ps(_mm_div_ps(_mm_sub_ps(r, g), safeDelta), four);
+		__m128 h = blend(_mm_cmpeq_ps(mx, r), hueR, blend(_mm_cmpeq_ps(mx, g), hueG, hueB));
+		h = _mm_and_ps(hasDelta, _mm_mul_ps(h, sixty));
+		__m128 hasValue = _mm_cmpgt_ps(mx, zero);
+		__m128 s = _mm_and_ps(hasValue, _mm_div_ps(delta, blend(hasValue, mx, _mm_set1_ps(1))));
+		// Effects
+		h = positiveMod(_mm_add_ps(h, hueShift), threeSixty);
+		s = _mm_mul_ps(s, saturationScale);
+		__m128 v = _mm_add_ps(_mm_mul_ps(mx, valueScale), valueAdd);
+		// HSV -> RGB
+		__m128 hue = _mm_div_ps(h, sixty);
+		__m128 vs = _mm_mul_ps(v, s);
+		r = _mm_max_ps(zero, _mm_min_ps(max, hsvChannel(_mm_set1_ps(5), hue, v, vs)));
+		g = _mm_max_ps(zero, _mm_min_ps(max, hsvChannel(_mm_set1_ps(3), hue, v, vs)));
+		b = _mm_max_ps(zero, _mm_min_ps(max, hsvChannel(_mm_set1_ps(1), hue, v, vs)));
+		__m128i out = _mm_and_si128(pixels, alphaMask);
+		out = _mm_or_si128(out, _mm_slli_epi32(_mm_cvtps_epi32(r), 16));
+		out = _mm_or_si128(out, _mm_slli_epi32(_mm_cvtps_epi32(g), 8));
+		out = _mm_or_si128(out, _mm_cvtps_epi32(b));
+		_mm_storeu_si128((__m128i*) (dst + i), out);
+	}
+	colorKernelScalar(src + i, dst + i, count - i, params);
+}
+#else
+/*! Color kernel (without SIMD). */
+static void colorKernel(const QRgb *src, QRgb *dst, int count, const ColorKernelParams &params)
+{
+	colorKernelScalar(src, dst, count, params);
+}
+#endif // __SSE2__
+
+/*! Returns true if no effect modifies the image. */
+bool ImageEffects::isNull(void) const
+{
+	return (color == 0) && (brightness == 0) && !hasDistortion();
+}
+
+/*! Returns true if there's an effect which moves pixels (fisheye, whirl, pixelate or mosaic). */
+bool ImageEffects::hasDistortion(void) const
+{
+	return (fisheye != 0) || (whirl != 0) || (pixelate != 0) || (mosaic > 1);
+}
+
+/*! Compares the values of all effects. */
+bool ImageEffects::operator==(const ImageEffects &other) const
+{
+	return (color == other.color) && (brightness == other.brightness) && (fisheye == other.fisheye) &&
+		(whirl == other.whirl) && (pixelate == other.pixelate) && (mosaic == other.mosaic);
+}
+
+/*! Returns the color effect value in range [0, 200) (the color effect repeats every 200). */
+qreal GraphicEffects::normalizeColor(qreal color)
+{
+	color = std::fmod(color, 200.0);
+	if(color < 0)
+		color += 200;
+	return color;
+}
+
+/*! Returns the brightness effect value in range [-100, 100]. */
+qreal GraphicEffects::normalizeBrightness(qreal brightness)
+{
+	return qBound(-100.0, brightness, 100.0);
+}
+
+/*! Returns the Effect with the given name (e.g. "COLOR"), or -1 if there's no such effect. */
+int GraphicEffects::effectIndex(const QString &name)
+{
+	static const QStringList names = {"COLOR", "FISHEYE", "WHIRL", "PIXELATE", "MOSAIC", "BRIGHTNESS", "GHOST"};
+	return names.indexOf(name.toUpper());
+}
+
+/*!
+ * Returns the normalized values of the image effects in the given array of graphic effects (indexed by Effect).\n
+ * Values which result in the same image are normalized to the same value, so they share cache entries.
+ */
+ImageEffects GraphicEffects::imageEffects(const qreal *values)
+{
+	ImageEffects out;
+	out.color = normalizeColor(values[ColorEffect]);
+	out.brightness = normalizeBrightness(values[BrightnessEffect]);
+	out.fisheye = qMax(-100.0, values[FisheyeEffect]);
+	out.whirl = values[WhirlEffect];
+	// Size of the pixelate cells in Scratch units (scratch-render uses abs(value) / 10)
+	out.pixelate = qAbs(values[PixelateEffect]) / 10;
+	// Number of mosaic tiles in each direction
+	out.mosaic = qBound(1, qRound((qAbs(values[MosaicEffect]) + 10) / 10), 512);
+	return out;
+}
+
+/*!
+ * Enables or disables splitting the work into bands processed in parallel (enabled by default).
+
+ * Cached displacement tables are dropped, so the next images are computed entirely in the new mode.
+ * This must not be called while an image is being processed.
+ */
+void GraphicEffects::setMultithreaded(bool enabled)
+{
+	displacementTablesMutex.lock();
+	multithreaded = enabled;
+	displacementTables.clear();
+	displacementTablesMutex.unlock();
+}
+
+/*! Runs the function on bands of rows in parallel, function takes the first row and the end row. */
+template<typename Function>
+void GraphicEffects::forEachBand(int width, int height, Function function)
+{
+#ifndef Q_OS_WASM
+	// Small images aren't worth the overhead
+	if(multithreaded && (width * height >= 128 * 128))
+	{
+		int bandHeight = qMax(16, height / (QThread::idealThreadCount() * 2));
+		QVector<QPair<int,int>> bands;
+		for(int y=0; y < height; y += bandHeight)
+			bands.append(qMakePair(y, qMin(height, y + bandHeight)));
+		// The calling thread takes part in the work too
+		QtConcurrent::blockingMap(bands, [&function](const QPair<int,int> &band) {
+			function(band.first, band.second);
+		});
+		return;
+	}
+#else
+	Q_UNUSED(width);
+#endif // Q_OS_WASM
+	function(0, height);
+}
+
+/*!
+ * Returns a table with the index of the source pixel for each pixel of an image with the given size.\n
+ * This is based on the sprite shader of scratch-render (the effects are applied in texture coordinates,
+ * in this order: mosaic, pixelate, whirl, fisheye).
+ * The image size doesn't change, so the rotation center of the costume stays the same.
+ * pixelScale is the number of image pixels per Scratch unit.
+ */
+QVector<int> GraphicEffects::displacementTable(int width, int height, const ImageEffects &effects, qreal pixelScale)
+{
+	DisplacementKey key;
+	key.width = width;
+	key.height = height;
+	key.fisheye = effects.fisheye;
+	key.whirl = effects.whirl;
+	key.pixelate = effects.pixelate * pixelScale;
+	key.mosaic = effects.mosaic;
+	displacementTablesMutex.lock();
+	QVector<int> *cached = displacementTables.object(key);
+	if(cached)
+	{
+		QVector<int> table = *cached;
+		displacementTablesMutex.unlock();
+		return table;
+	}
+	displacementTablesMutex.unlock();
+	QVector<int> table(width * height);
+	int *tableData = table.data();
+	const qreal fisheye = qMax(0.0, (effects.fisheye + 100) / 100.0);
+	const qreal whirl = qDegreesToRadians(-effects.whirl);
+	// Size of pixelate cells in texture coordinates
+	const qreal pixelateX = key.pixelate / width;
+	const qreal pixelateY = key.pixelate / height;
+	const qreal mosaic = effects.mosaic;
+	forEachBand(width, height, [&](int startY, int endY) {
+		for(int y = startY; y < endY; y++)
+		{
+			for(int x=0; x < width; x++)
+			{
+				qreal u = (x + 0.5) / width;
+				qreal v = (y + 0.5) / height;
+				if(mosaic > 1)
+				{
+					u = mosaic * u - qFloor(mosaic * u);
+					v = mosaic * v - qFloor(mosaic * v);
+				}
+				if(key.pixelate != 0)
+				{
+					u = (qFloor(u / pixelateX) + 0.5) * pixelateX;
+					v = (qFloor(v / pixelateY) + 0.5) * pixelateY;
+				}
+				if(whirl != 0)
+				{
+					qreal offsetX = u - 0.5, offsetY = v - 0.5;
+					qreal whirlFactor = qMax(1 - qSqrt(offsetX * offsetX + offsetY * offsetY) / 0.5, 0.0);
+					qreal angle = whirl * whirlFactor * whirlFactor;
+					qreal sinAngle = qSin(angle), cosAngle = qCos(angle);
+					u = cosAngle * offsetX + sinAngle * offsetY + 0.5;
+					v = -sinAngle * offsetX + cosAngle * offsetY + 0.5;
+				}
+				if(fisheye != 1)
+				{
+					qreal vecX = (u - 0.5) / 0.5, vecY = (v - 0.5) / 0.5;
+					qreal length = qSqrt(vecX * vecX + vecY * vecY);
+					if(length > 0)
+					{
+						qreal r = qPow(qMin(length, 1.0), fisheye) * qMax(1.0, length);
+						u = 0.5 + r * vecX / length * 0.5;
+						v = 0.5 + r * vecY / length * 0.5;
+					}
+				}
+				// Textures are clamped to edge
+				int sourceX = qBound(0, qFloor(u * width), width - 1);
+				int sourceY = qBound(0, qFloor(v * height), height - 1);
+				tableData[y * width + x] = sourceY * width + sourceX;
+			}
+		}
+	});
+	displacementTablesMutex.lock();
+	displacementTables.insert(key, new QVector<int>(table), qMax(1, width * height * (int) sizeof(int) / 1024));
+	displacementTablesMutex.unlock();
+	return table;
+}
+
+/*!
+ * Returns a copy of the image with the effects applied.\n
+ * The work is split into bands of rows which are processed in parallel.
+ * pixelScale is the number of image pixels per Scratch unit (used by the pixelate effect).
+ */
+QImage GraphicEffects::apply(const QImage &image, const ImageEffects &effects, qreal pixelScale)
+{
+	QImage source = image.convertToFormat(QImage::Format_ARGB32);
+	int width = source.width(), height = source.height();
+	QImage out(source.size(), QImage::Format_ARGB32);
+	if((width == 0) || (height == 0))
+		return out;
+	QVector<int> table;
+	if(effects.hasDistortion())
+		table = displacementTable(width, height, effects, pixelScale);
+	bool colorEffects = (effects.color != 0) || (effects.brightness != 0);
+	ColorKernelParams params;
+	params.hueShift = effects.color * 1.8;
+	params.saturationScale = 1;
+	params.valueScale = 1;
+	params.valueAdd = 0;
+	if(effects.brightness >= 100)
+	{
+		params.saturationScale = 0;
+		params.valueScale = 0;
+		params.valueAdd = 255;
+	}
+	else if(effects.brightness > 0)
+		params.saturationScale = 1 - effects.brightness / 100.0;
+	else
+		params.valueScale = 1 + effects.brightness / 100.0;
+	// ARGB32 scanlines don't have any padding, so the table indices can be used directly
+	const QRgb *sourceData = (const QRgb*) source.constBits();
+	const int *tableData = table.constData();
+	forEachBand(width, height, [&](int startY, int endY) {
+		for(int y = startY; y < endY; y++)
+		{
+			QRgb *line = (QRgb*) out.scanLine(y);
+			const QRgb *sourceLine = sourceData + y * width;
+			if(!table.isEmpty())
+			{
+				// Gather the displaced pixels
+				const int *tableLine = tableData + y * width;
+				for(int x=0; x < width; x++)
+					line[x] = sourceData[tableLine[x]];
+				sourceLine = line;
+			}
+			if(colorEffects)
+				colorKernel(sourceLine, line, width, params);
+			else if(sourceLine != line)
+				memcpy(line, sourceLine, width * sizeof(QRgb));
+		}
+	});
+	return out;
+}
+
+GraphicEffectsCache graphicEffectsCache;
+
+/*! Constructs GraphicEffectsCache. */
+GraphicEffectsCache::GraphicEffectsCache()
+{
+	// Cost is in KiB
+	cache.setMaxCost(64 * 1024);
+}
+
+/*! Returns the costume pixmap with the given image effects applied. */
+QPixmap GraphicEffectsCache::pixmap(const QString &costume, const QPixmap &costumePixmap, const ImageEffects &effects, qreal pixelScale)
+{
+	GraphicEffectsKey key;
+	key.costume = costume;
+	key.effects = effects;
+	key.scale = pixelScale;
+	QPixmap *cached = cache.object(key);
+	if(cached)
+		return *cached;
+	QPixmap result = QPixmap::fromImage(GraphicEffects::apply(costumePixmap.toImage(), effects, pixelScale));
+	cache.insert(key, new QPixmap(result), qMax(1, result.width() * result.height() * 4 / 1024));
+	return result;
+}
+
+/*! Removes the cached images of the given costume (e.g. after it's downloaded). */
+void GraphicEffectsCache::remove(const QString &costume)
+{
+	QList<GraphicEffectsKey> keys = cache.keys();
+	for(int i=0; i < keys.count(); i++)
+	{
+		if(keys[i].costume == costume)
+			cache.remove(keys[i]);
+	}
+}
+
+/*! Removes all cached images (e.g. when another project is loaded). */
+void GraphicEffectsCache::clear(void)
+{
+	cache.clear();
+}
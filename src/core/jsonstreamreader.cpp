@@ -0,0 +1,408 @@
+/*
+ * jsonstreamreader.cpp
+ * This file is part of QScratchRuntime
+ *
+ * Copyright (C) 2023 - adazem009
+ *
+ * QScratchRuntime is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * QScratchRuntime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QScratchRuntime. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "core/jsonstreamreader.h"
+
+/*! Constructs JsonStreamReader. The data must be a UTF-8 encoded JSON document. */
+JsonStreamReader::JsonStreamReader(const QByteArray &data) :
+	m_data(data)
+{
+	pos = m_data.constData();
+	end = pos + m_data.size();
+	// Skip UTF-8 byte order mark
+	if((end - pos >= 3) && (uchar(pos[0]) == 0xEF) && (uchar(pos[1]) == 0xBB) && (uchar(pos[2]) == 0xBF))
+		pos += 3;
+}
+
+/*! Reads the next token and returns its type. */
+JsonStreamReader::TokenType JsonStreamReader::readNext(void)
+{
+	if((m_token == Invalid) || (m_token == EndDocument))
+		return m_token;
+	skipWhitespace();
+	switch(state)
+	{
+		case AfterValue:
+			if(containers.isEmpty())
+			{
+				if(pos != end)
+					return setError("garbage at the end of the document");
+				return m_token = EndDocument;
+			}
+			if(pos == end)
+				return setError("unterminated object or array");
+			if(*pos == ',')
+			{
+				pos++;
+				state = (containers.last() == '{') ? ExpectName : ExpectValue;
+				skipWhitespace();
+				break;
+			}
+			if(*pos == ((containers.last() == '{') ? '}' : ']'))
+			{
+				pos++;
+				m_token = (containers.last() == '{') ? EndObject : EndArray;
+				containers.removeLast();
+				return m_token;
+			}
+			return setError("missing comma");
+		case ExpectFirstName:
+		case ExpectFirstValue:
+			if((pos != end) && (*pos == ((state == ExpectFirstName) ? '}' : ']')))
+			{
+				pos++;
+				m_token = (state == ExpectFirstName) ? EndObject : EndArray;
+				containers.removeLast();
+				state = AfterValue;
+				return m_token;
+			}
+			state = (state == ExpectFirstName) ? ExpectName : ExpectValue;
+			break;
+		default:
+			break;
+	}
+	if(state == ExpectName)
+	{
+		if((pos == end) || (*pos != '"'))
+			return setError("expected object key");
+		if(!readStringToken(&m_name))
+			return m_token;
+		skipWhitespace();
+		if((pos == end) || (*pos != ':'))
+			return setError("missing colon after object key");
+		pos++;
+		state = ExpectValue;
+		return m_token = Name;
+	}
+	return readValueToken();
+}
+
+/*! Reads the token which starts a value. */
+JsonStreamReader::TokenType JsonStreamReader::readValueToken(void)
+{
+	if(pos == end)
+		return setError("unexpected end of the document");
+	state = AfterValue;
+	switch(*pos)
+	{
+		case '{':
+		case '[':
+			if(containers.count() >= maxDepth)
+				return setError("too deeply nested document");
+			containers.append(*pos);
+			state = (*pos == '{') ? ExpectFirstName : ExpectFirstValue;
+			m_token = (*pos == '{') ? StartObject : StartArray;
+			pos++;
+			return m_token;
+		case '"':
+			if(!readStringToken(&m_string))
+				return m_token;
+			return m_token = String;
+		case 't':
+		case 'f':
+		case 'n':
+		{
+			const char *literal = (*pos == 't') ? "true" : ((*pos == 'f') ? "false" : "null");
+			int length = qstrlen(literal);
+			if((end - pos < length) || (qstrncmp(pos, literal, length) != 0))
+				return setError("invalid literal");
+			pos += length;
+			if(*literal == 'n')
+				return m_token = Null;
+			m_bool = (*literal == 't');
+			return m_token = Bool;
+		}
+		default:
+		{
+			const char *start = pos;
+			while((pos != end) && (((*pos >= '0') && (*pos <= '9')) || (*pos == '-') || (*pos == '+') || (*pos == '.') || (*pos == 'e') || (*pos == 'E')))
+				pos++;
+			bool ok = false;
+			if(pos != start)
+				m_number = QByteArray::fromRawData(start, pos - start).toDouble(&ok);
+			if(!ok)
+			{
+				pos = start;
+				return setError("invalid value");
+			}
+			return m_token = Number;
+		}
+	}
+}
+
+/*! Reads a string starting at the current position. Short strings are interned. */
+bool JsonStreamReader::readStringToken(QString *out)
+{
+	const char *start = ++pos;
+	bool escaped = false;
+	while((pos != end) && (*pos != '"'))
+	{
+		if(*pos == '\\')
+		{
+			escaped = true;
+			if(++pos == end)
+				break;
+		}
+		pos++;
+	}
+	if(pos == end)
+	{
+		setError("unterminated string");
+		return false;
+	}
+	int length = pos - start;
+	pos++;
+	if(length > maxInternedLength)
+	{
+		*out = escaped ? unescape(start, length) : QString::fromUtf8(start, length);
+		return m_token != Invalid;
+	}
+	// The raw data is used as the key, so interned strings don't need to be decoded again
+	auto it = strings.constFind(QByteArray::fromRawData(start, length));
+	if(it != strings.constEnd())
+	{
+		*out = it.value();
+		return true;
+	}
+	*out = escaped ? unescape(start, length) : QString::fromUtf8(start, length);
+	if(m_token == Invalid)
+		return false;
+	strings.insert(QByteArray(start, length), *out);
+	return true;
+}
+
+/*! Decodes a string with escape sequences. */
+QString JsonStreamReader::unescape(const char *data, int length)
+{
+	QString out;
+	out.reserve(length);
+	const char *p = data;
+	const char *stringEnd = data + length;
+	const char *run = p;
+	while(p != stringEnd)
+	{
+		if(*p != '\\')
+		{
+			p++;
+			continue;
+		}
+		out += QString::fromUtf8(run, p - run);
+		p++;
+		switch(*p)
+		{
+			case '"':
+			case '\\':
+			case '/':
+				out += QChar(*p);
+				break;
+			case 'b':
+				out += QChar('\b');
+				break;
+			case 'f':
+				out += QChar('\f');
+				break;
+			case 'n':
+				out += QChar('\n');
+				break;
+			case 'r':
+				out += QChar('\r');
+				break;
+			case 't':
+				out += QChar('\t');
+				break;
+			case 'u':
+			{
+				// Surrogate pairs are two escape sequences, which are added as two UTF-16 code units
+				bool ok = false;
+				if(stringEnd - p >= 5)
+					out += QChar(ushort(QByteArray::fromRawData(p + 1, 4).toUInt(&ok, 16)));
+				if(!ok)
+				{
+					setError("invalid escape sequence");
+					return QString();
+				}
+				p += 4;
+				break;
+			}
+			default:
+				setError("invalid escape sequence");
+				return QString();
+		}
+		p++;
+		run = p;
+	}
+	out += QString::fromUtf8(run, p - run);
+	return out;
+}
+
+/*! Skips whitespace characters. */
+void JsonStreamReader::skipWhitespace(void)
+{
+	while((pos != end) && ((*pos == ' ') || (*pos == '\n') || (*pos == '\r') || (*pos == '\t')))
+		pos++;
+}
+
+/*! Sets the error string and returns Invalid. */
+JsonStreamReader::TokenType JsonStreamReader::setError(const QString &message)
+{
+	m_errorString = message;
+	m_errorOffset = pos - m_data.constData();
+	return m_token = Invalid;
+}
+
+/*! Returns the type of the current token. */
+JsonStreamReader::TokenType JsonStreamReader::tokenType(void) const
+{
+	return m_token;
+}
+
+/*!
+ * Reads the next key of the current object.\n
+ * Returns false at the end of the object (or if there's an error).
+ * Call readNext() to get to the value of the key.
+ */
+bool JsonStreamReader::readNextName(void)
+{
+	return readNext() == Name;
+}
+
+/*!
+ * Reads the start of the next item of the current array.\n
+ * Returns false at the end of the array (or if there's an error).
+ */
+bool JsonStreamReader::readNextItem(void)
+{
+	TokenType token = readNext();
+	return (token != EndArray) && (token != Invalid) && (token != Name) && (token != EndObject) && (token != EndDocument);
+}
+
+/*! Returns the current object key. */
+const QString &JsonStreamReader::name(void) const
+{
+	return m_name;
+}
+
+/*!
+ * Reads the value which starts at the current token.\n
+ * Objects are returned as QVariantMap, arrays as QVariantList and null as an invalid QVariant.
+ */
+QVariant JsonStreamReader::readValue(void)
+{
+	switch(m_token)
+	{
+		case StartObject:
+		{
+			QVariantMap map;
+			while(readNextName())
+			{
+				QString key = m_name;
+				readNext();
+				map.insert(key, readValue());
+			}
+			return map;
+		}
+		case StartArray:
+		{
+			QVariantList list;
+			while(readNextItem())
+				list.append(readValue());
+			return list;
+		}
+		case String:
+			return m_string;
+		case Number:
+			return m_number;
+		case Bool:
+			return m_bool;
+		default:
+			return QVariant();
+	}
+}
+
+/*! Reads the value which starts at the current token as a string. Other values are skipped and an empty string is returned. */
+QString JsonStreamReader::readString(void)
+{
+	if(m_token == String)
+		return m_string;
+	skipValue();
+	return QString();
+}
+
+/*! Reads the value which starts at the current token as a number. Other values are skipped and 0 is returned. */
+double JsonStreamReader::readDouble(void)
+{
+	if(m_token == Number)
+		return m_number;
+	skipValue();
+	return 0;
+}
+
+/*! Reads the value which starts at the current token as a boolean. Other values are skipped and false is returned. */
+bool JsonStreamReader::readBool(void)
+{
+	if(m_token == Bool)
+		return m_bool;
+	skipValue();
+	return false;
+}
+
+/*! Skips the value which starts at the current token. */
+void JsonStreamReader::skipValue(void)
+{
+	if((m_token != StartObject) && (m_token != StartArray))
+		return;
+	int depth = 1;
+	while(depth > 0)
+	{
+		switch(readNext())
+		{
+			case StartObject:
+			case StartArray:
+				depth++;
+				break;
+			case EndObject:
+			case EndArray:
+				depth--;
+				break;
+			case Invalid:
+				return;
+			default:
+				break;
+		}
+	}
+}
+
+/*! Returns true if the document is invalid. */
+bool JsonStreamReader::hasError(void) const
+{
+	return m_token == Invalid;
+}
+
+/*! Returns the description of the error. */
+QString JsonStreamReader::errorString(void) const
+{
+	return m_errorString;
+}
+
+/*! Returns the position of the error in the document. */
+qint64 JsonStreamReader::errorOffset(void) const
+{
+	return m_errorOffset;
+}
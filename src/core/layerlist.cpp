@@ -0,0 +1,165 @@
+/*
+ * layerlist.cpp
+ * This file is part of QScratchRuntime
+ *
+ * Copyright (C) 2023 - adazem009
+ *
+ * QScratchRuntime is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * QScratchRuntime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QScratchRuntime. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QtMath>
+#include "core/layerlist.h"
+
+LayerList layerList;
+
+/*! The stage is in layer 0 and the pen layer is in layer 0.5. */
+const qreal LayerList::bottomLayer = 0.5;
+
+// Smallest gap between two layers before the layers are renumbered
+static const qreal minimumGap = 1e-6;
+// Layer of the bottom item after renumbering, so there's space for many "go to back" moves
+static const qreal renumberedBottom = 1 << 20;
+
+/*!
+ * Adds an item to the given layer (e.g. layerOrder from the project).\n
+ * If another item is in the layer, the item is placed behind it.
+ */
+void LayerList::insert(QGraphicsItem *item, qreal layer)
+{
+	remove(item);
+	layer = qMax(layer, bottomLayer + 0.5);
+	if(items.contains(layer))
+		moveBehind(item, items.value(layer));
+	else
+		setLayer(item, layer);
+}
+
+/*! Removes an item from the layer list. */
+void LayerList::remove(QGraphicsItem *item)
+{
+	QMap<qreal,QGraphicsItem*>::iterator it = items.find(item->zValue());
+	if((it != items.end()) && (it.value() == item))
+		items.erase(it);
+}
+
+/*! Returns true if the item is in the layer list. */
+bool LayerList::contains(QGraphicsItem *item) const
+{
+	QMap<qreal,QGraphicsItem*>::const_iterator it = items.constFind(item->zValue());
+	return (it != items.constEnd()) && (it.value() == item);
+}
+
+/*! Returns the number of items. */
+int LayerList::count(void) const
+{
+	return items.count();
+}
+
+/*! Moves an item in front of all items. */
+void LayerList::goToFront(QGraphicsItem *item)
+{
+	if(!contains(item))
+		return;
+	remove(item);
+	placeBetween(item, items.isEmpty() ? nullptr : items.last(), nullptr);
+}
+
+/*! Moves an item behind all items. */
+void LayerList::goToBack(QGraphicsItem *item)
+{
+	if(!contains(item))
+		return;
+	remove(item);
+	placeBetween(item, nullptr, items.isEmpty() ? nullptr : items.first());
+}
+
+/*! Moves an item forward (positive delta) or backward (negative delta) by the given number of layers. */
+void LayerList::moveLayers(QGraphicsItem *item, int delta)
+{
+	QMap<qreal,QGraphicsItem*>::const_iterator it = items.constFind(item->zValue());
+	if((it == items.constEnd()) || (it.value() != item))
+		return;
+	QGraphicsItem *below = nullptr, *above = nullptr;
+	if(delta > 0)
+	{
+		for(int i=0; (i < delta) && (it + 1 != items.constEnd()); i++)
+			++it;
+		below = it.value();
+		if(it + 1 != items.constEnd())
+			above = (it + 1).value();
+	}
+	else if(delta < 0)
+	{
+		for(int i=0; (i < -delta) && (it != items.constBegin()); i++)
+			--it;
+		above = it.value();
+		if(it != items.constBegin())
+			below = (it - 1).value();
+	}
+	if((below == item) || (above == item) || (delta == 0))
+		return;
+	remove(item);
+	placeBetween(item, below, above);
+}
+
+/*! Moves an item directly behind another item (e.g. a clone behind its parent). */
+void LayerList::moveBehind(QGraphicsItem *item, QGraphicsItem *other)
+{
+	remove(item);
+	QMap<qreal,QGraphicsItem*>::const_iterator it = items.constFind(other->zValue());
+	if(it == items.constEnd())
+		return;
+	placeBetween(item, (it == items.constBegin()) ? nullptr : (it - 1).value(), other);
+}
+
+/*! Sets the layer of an item. The item must not be in the map. */
+void LayerList::setLayer(QGraphicsItem *item, qreal layer)
+{
+	item->setZValue(layer);
+	items.insert(layer, item);
+}
+
+/*!
+ * Places an item between two neighbouring items.\n
+ * Use nullptr for below if the item is placed behind all items and for above if it's placed in front of all items.
+ */
+void LayerList::placeBetween(QGraphicsItem *item, QGraphicsItem *below, QGraphicsItem *above)
+{
+	qreal low = below ? below->zValue() : bottomLayer;
+	if(!above)
+	{
+		setLayer(item, qFloor(low) + 1);
+		return;
+	}
+	if(!below && (above->zValue() - 1 > bottomLayer))
+	{
+		setLayer(item, qCeil(above->zValue()) - 1);
+		return;
+	}
+	if(above->zValue() - low < minimumGap)
+	{
+		renumber();
+		low = below ? below->zValue() : bottomLayer;
+	}
+	setLayer(item, (low + above->zValue()) / 2);
+}
+
+/*! Renumbers all layers, so there are gaps between them again. */
+void LayerList::renumber(void)
+{
+	QList<QGraphicsItem*> list = items.values();
+	items.clear();
+	for(int i=0; i < list.count(); i++)
+		setLayer(list[i], renumberedBottom + i);
+}
@@ -0,0 +1,183 @@
+/*
+ * loudnessmeter.cpp
+ * This file is part of QScratchRuntime
+ *
+ * Copyright (C) 2023 - adazem009
+ *
+ * QScratchRuntime is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * QScratchRuntime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QScratchRuntime. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QThread>
+#include <QtMath>
+#include "core/loudnessmeter.h"
+#include "core/audiomixer.h"
+
+LoudnessMeter loudnessMeter;
+
+const int LoudnessMeter::windowSize;
+const int LoudnessMeter::hopSize;
+
+/*! Thread which runs LoudnessMeter::threadLoop(). */
+class LoudnessMeter::Thread : public QThread
+{
+	public:
+		explicit Thread(LoudnessMeter *meter) :
+			m_meter(meter) { }
+
+	protected:
+		void run(void) override
+		{
+			m_meter->threadLoop();
+		}
+
+	private:
+		LoudnessMeter *m_meter;
+};
+
+/*! Constructs LoudnessMeter. The loudness is -1 until setInput() is called. */
+LoudnessMeter::LoudnessMeter() :
+	stopping(0),
+	m_loudness(-1),
+	started(0)
+{
+	squares.resize(windowSize);
+	readBuffer.resize(hopSize);
+	reset();
+}
+
+/*! Stops the meter thread and destroys the LoudnessMeter object. */
+LoudnessMeter::~LoudnessMeter()
+{
+	setInput(nullptr);
+}
+
+/*!
+ * Sets the input of the meter and takes its ownership. The previous input is deleted.\n
+ * A thread reads real-time inputs (except on WebAssembly, where processAvailable() must be called regularly).
+ * Use nullptr to remove the input.
+ */
+void LoudnessMeter::setInput(AudioInput *input)
+{
+	if(thread)
+	{
+		stopping.storeRelease(1);
+		thread->wait();
+		delete thread;
+		thread = nullptr;
+		stopping.storeRelease(0);
+	}
+	if(m_input)
+		delete m_input;
+	m_input = input;
+	reset();
+	started.storeRelease(0);
+	m_loudness.storeRelease(-1);
+	timer.start();
+#ifndef Q_OS_WASM
+	if(m_input && m_input->isRealTime())
+	{
+		thread = new Thread(this);
+		thread->start();
+	}
+#endif // Q_OS_WASM
+}
+
+/*! Returns the input of the meter. */
+AudioInput *LoudnessMeter::input(void) const
+{
+	return m_input;
+}
+
+/*!
+ * Returns the loudness (0 - 100), or -1 if there's no input (like in Scratch without a microphone).\n
+ * The input is started on the first call. This can be called from any thread.
+ */
+int LoudnessMeter::loudness(void)
+{
+	if(m_input && !started.loadAcquire() && started.testAndSetOrdered(0, 1))
+		m_input->start();
+	return m_loudness.loadAcquire();
+}
+
+/*! Reads the samples which were produced by the real-time input until now. */
+void LoudnessMeter::processAvailable(void)
+{
+	if(!m_input)
+		return;
+	m_input->update(timer.elapsed() * AudioMixer::sampleRate / 1000);
+	process();
+}
+
+/*!
+ * Lets the input produce the samples until the given frame of the input stream and reads them.\n
+ * This is used for inputs which aren't real-time, e.g. by HeadlessRunner with the EngineClock time.
+ */
+void LoudnessMeter::processTo(qint64 frame)
+{
+	if(!m_input)
+		return;
+	m_input->update(frame);
+	process();
+}
+
+/*! Reads the samples from the input, updates the RMS of the window and the loudness value. */
+void LoudnessMeter::process(void)
+{
+	int count;
+	while((count = m_input->read(readBuffer.data(), readBuffer.count())) > 0)
+	{
+		for(int i=0; i < count; i++)
+		{
+			float square = readBuffer[i] * readBuffer[i];
+			sum += square - squares[windowPosition];
+			squares[windowPosition] = square;
+			windowPosition = (windowPosition + 1) % windowSize;
+			if(windowPosition == 0)
+			{
+				// Recompute the sum once per window, so rounding errors don't accumulate
+				sum = 0;
+				for(int j=0; j < windowSize; j++)
+					sum += squares[j];
+			}
+			if(++hopPosition == hopSize)
+			{
+				hopPosition = 0;
+				// Like Scratch: loud sounds fade out slowly and quiet sounds are boosted
+				qreal rms = qSqrt(qMax(0.0, sum) / windowSize);
+				level = qMax(rms, level * 0.6);
+				m_loudness.storeRelease(qMin(100, qRound(qSqrt(level * 1.63) * 100)));
+			}
+		}
+	}
+}
+
+/*! Clears the window. */
+void LoudnessMeter::reset(void)
+{
+	squares.fill(0);
+	windowPosition = 0;
+	hopPosition = 0;
+	sum = 0;
+	level = 0;
+}
+
+/*! Reads the real-time input until setInput() is called again. */
+void LoudnessMeter::threadLoop(void)
+{
+	while(!stopping.loadAcquire())
+	{
+		processAvailable();
+		QThread::msleep(10);
+	}
+}
@@ -0,0 +1,587 @@
+/*
+ * penlayer.cpp
+ * This file is part of QScratchRuntime
+ *
+ * Copyright (C) 2023 - adazem009
+ *
+ * QScratchRuntime is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * QScratchRuntime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QScratchRuntime. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QPainter>
+#include <QtMath>
+#include <QThread>
+#ifndef Q_OS_WASM
+#include <QtConcurrent>
+#endif // Q_OS_WASM
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif // __SSE2__
+#include "core/penlayer.h"
+
+/*! Returns the pen color as non-premultiplied ARGB. */
+QRgb PenState::rgba(void) const
+{
+	return QColor::fromHsvF(color / 100, saturation / 100, brightness / 100, 1 - transparency / 100).rgba();
+}
+
+/*! Sets the pen color from a color input ("#rrggbb" or a number, e.g. from a reporter). */
+void PenState::setColor(const QString &value)
+{
+	QColor newColor;
+	if(value.startsWith('#'))
+		newColor = QColor(value);
+	else
+	{
+		quint32 number = (quint32) value.toDouble();
+		int alpha = number >> 24;
+		newColor = QColor((number >> 16) & 0xFF, (number >> 8) & 0xFF, number & 0xFF, alpha == 0 ? 255 : alpha);
+	}
+	if(!newColor.isValid())
+		newColor = Qt::black;
+	color = qMax(0.0, newColor.hsvHueF()) * 100;
+	saturation = newColor.hsvSaturationF() * 100;
+	brightness = newColor.valueF() * 100;
+	transparency = (1 - newColor.alphaF()) * 100;
+}
+
+/*! Sets a color parameter ("color", "saturation", "brightness" or "transparency"). */
+void PenState::setParam(const QString &param, qreal value)
+{
+	if(param == "color")
+	{
+		// The color wraps around
+		color = value - 100 * qFloor(value / 100);
+	}
+	else if(param == "saturation")
+		saturation = qBound(0.0, value, 100.0);
+	else if(param == "brightness")
+		brightness = qBound(0.0, value, 100.0);
+	else if(param == "transparency")
+		transparency = qBound(0.0, value, 100.0);
+}
+
+/*! Returns the value of a color parameter. \see setParam() */
+qreal PenState::param(const QString &param) const
+{
+	if(param == "color")
+		return color;
+	else if(param == "saturation")
+		return saturation;
+	else if(param == "brightness")
+		return brightness;
+	else if(param == "transparency")
+		return transparency;
+	return 0;
+}
+
+/*!
+ * Updates the color from the color and shade, which is used by the legacy hue and shade blocks.\n
+ * Based on _legacyUpdatePenColor() of the Scratch 3 pen extension.
+ */
+void PenState::updateLegacyColor(void)
+{
+	QColor newColor = QColor::fromHsvF(color / 100, 1, 1);
+	qreal currentShade = (shade > 100) ? 200 - shade : shade;
+	qreal r = newColor.redF(), g = newColor.greenF(), b = newColor.blueF();
+	if(currentShade < 50)
+	{
+		// Mix with black
+		qreal fraction = (10 + currentShade) / 60;
+		r *= fraction;
+		g *= fraction;
+		b *= fraction;
+	}
+	else
+	{
+		// Mix with white
+		qreal fraction = (currentShade - 50) / 60;
+		r += (1 - r) * fraction;
+		g += (1 - g) * fraction;
+		b += (1 - b) * fraction;
+	}
+	newColor = QColor::fromRgbF(qBound(0.0, r, 1.0), qBound(0.0, g, 1.0), qBound(0.0, b, 1.0));
+	color = qMax(0.0, newColor.hsvHueF()) * 100;
+	saturation = newColor.hsvSaturationF() * 100;
+	brightness = newColor.valueF() * 100;
+}
+
+/*! Parameters of the line kernel, which are the same for every pixel of a segment. */
+struct LineKernelParams
+{
+	float ax, ay; // start point
+	float dx, dy; // end point - start point
+	float invLength2; // 1 / |d|^2 (0 for a dot)
+	float edge; // radius + 0.5
+};
+
+/*
+ * The coverage of a pixel is clamp(radius + 0.5 - distance, 0, 1), where distance is the distance
+ * of the pixel center from the segment. This gives round caps like in Scratch.
+ */
+
+/*! Scalar line kernel. Computes the coverage of count pixels starting at pixel center x (in row with center y). */
+static void lineCoverageScalar(float *coverage, int count, float x, float y, const LineKernelParams &params)
+{
+	float fy = y - params.ay;
+	for(int i=0; i < count; i++)
+	{
+		float fx = x + i - params.ax;
+		float t = qBound(0.0f, (fx * params.dx + fy * params.dy) * params.invLength2, 1.0f);
+		float ex = fx - t * params.dx;
+		float ey = fy - t * params.dy;
+		coverage[i] = qBound(0.0f, params.edge - std::sqrt(ex * ex + ey * ey), 1.0f);
+	}
+}
+
+#ifdef __SSE2__
+/*! SSE2 line kernel. Computes the coverage of 4 pixels at a time. \see lineCoverageScalar() */
+static void lineCoverage(float *coverage, int count, float x, float y, const LineKernelParams &params)
+{
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1);
+	const __m128 dx = _mm_set1_ps(params.dx);
+	const __m128 dy = _mm_set1_ps(params.dy);
+	const __m128 invLength2 = _mm_set1_ps(params.invLength2);
+	const __m128 edge = _mm_set1_ps(params.edge);
+	const __m128 fy = _mm_set1_ps(y - params.ay);
+	const __m128 fyDy = _mm_mul_ps(fy, dy);
+	__m128 fx = _mm_add_ps(_mm_set1_ps(x - params.ax), _mm_set_ps(3, 2, 1, 0));
+	const __m128 step = _mm_set1_ps(4);
+	int i = 0;
+	for(; i + 4 <= count; i += 4)
+	{
+		__m128 t = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(fx, dx), fyDy), invLength2);
+		t = _mm_max_ps(zero, _mm_min_ps(one, t));
+		__m128 ex = _mm_sub_ps(fx, _mm_mul_ps(t, dx));
+		__m128 ey = _mm_sub_ps(fy, _mm_mul_ps(t, dy));
+		__m128 distance = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(ex, ex), _mm_mul_ps(ey, ey)));
+		_mm_storeu_ps(coverage + i, _mm_max_ps(zero, _mm_min_ps(one, _mm_sub_ps(edge, distance))));
+		fx = _mm_add_ps(fx, step);
+	}
+	lineCoverageScalar(coverage + i, count - i, x + i, y, params);
+}
+#else
+static void lineCoverage(float *coverage, int count, float x, float y, const LineKernelParams &params)
+{
+	lineCoverageScalar(coverage, count, x, y, params);
+}
+#endif // __SSE2__
+
+/*! Returns x / 255 for x in 0..65025 (rounded). */
+static inline uint div255(uint x)
+{
+	x += 128;
+	return (x + (x >> 8)) >> 8;
+}
+
+/*! Blends a premultiplied color into count pixels using the given coverage. */
+static void blendSpan(QRgb *dst, const float *coverage, int count, QRgb color)
+{
+	uint alpha = qAlpha(color);
+	for(int i=0; i < count; i++)
+	{
+		if(coverage[i] <= 0)
+			continue;
+		uint k = (uint) (coverage[i] * 256 + 0.5f);
+		if((k >= 256) && (alpha == 255))
+		{
+			dst[i] = color;
+			continue;
+		}
+		uint inverse = 255 - ((alpha * k) >> 8);
+		QRgb pixel = dst[i];
+		QRgb out = 0;
+		for(int shift=0; shift < 32; shift += 8)
+		{
+			uint source = (((color >> shift) & 0xFF) * k) >> 8;
+			out |= qMin(255u, source + div255(((pixel >> shift) & 0xFF) * inverse)) << shift;
+		}
+		dst[i] = out;
+	}
+}
+
+/*! Blends count premultiplied source pixels over the destination pixels (source over). */
+static void blendRowScalar(QRgb *dst, const QRgb *src, int count)
+{
+	for(int i=0; i < count; i++)
+	{
+		QRgb source = src[i];
+		uint alpha = qAlpha(source);
+		if(alpha == 0)
+			continue;
+		if(alpha == 255)
+		{
+			dst[i] = source;
+			continue;
+		}
+		uint inverse = 255 - alpha;
+		QRgb pixel = dst[i];
+		QRgb out = 0;
+		for(int shift=0; shift < 32; shift += 8)
+			out |= qMin(255u, ((source >> shift) & 0xFF) + div255(((pixel >> shift) & 0xFF) * inverse)) << shift;
+		dst[i] = out;
+	}
+}
+
+#ifdef __SSE2__
+/*! SSE2 source over blending of 4 pixels at a time. \see blendRowScalar() */
+static void blendRow(QRgb *dst, const QRgb *src, int count)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i alphaMask = _mm_set1_epi32(0xFF000000);
+	const __m128i max = _mm_set1_epi16(255);
+	const __m128i half = _mm_set1_epi16(128);
+	int i = 0;
+	for(; i + 4 <= count; i += 4)
+	{
+		__m128i source = _mm_loadu_si128((const __m128i*) (src + i));
+		__m128i alpha = _mm_and_si128(source, alphaMask);
+		// Transparent and opaque groups are common in costumes
+		if(_mm_movemask_epi8(_mm_cmpeq_epi32(alpha, zero)) == 0xFFFF)
+			continue;
+		if(_mm_movemask_epi8(_mm_cmpeq_epi32(alpha, alphaMask)) == 0xFFFF)
+		{
+			_mm_storeu_si128((__m128i*) (dst + i), source);
+			continue;
+		}
+		__m128i pixels = _mm_loadu_si128((const __m128i*) (dst + i));
+		// 255 - alpha in both 16-bit halves of each pixel, then spread to the 4 channels
+		__m128i inverse = _mm_srli_epi32(source, 24);
+		inverse = _mm_sub_epi16(max, _mm_or_si128(inverse, _mm_slli_epi32(inverse, 16)));
+		__m128i low = _mm_mullo_epi16(_mm_unpacklo_epi8(pixels, zero), _mm_unpacklo_epi32(inverse, inverse));
+		__m128i high = _mm_mullo_epi16(_mm_unpackhi_epi8(pixels, zero), _mm_unpackhi_epi32(inverse, inverse));
+		// div255()
+		low = _mm_add_epi16(low, half);
+		high = _mm_add_epi16(high, half);
+		low = _mm_srli_epi16(_mm_add_epi16(low, _mm_srli_epi16(low, 8)), 8);
+		high = _mm_srli_epi16(_mm_add_epi16(high, _mm_srli_epi16(high, 8)), 8);
+		_mm_storeu_si128((__m128i*) (dst + i), _mm_adds_epu8(source, _mm_packus_epi16(low, high)));
+	}
+	blendRowScalar(dst + i, src + i, count - i);
+}
+#else
+static void blendRow(QRgb *dst, const QRgb *src, int count)
+{
+	blendRowScalar(dst, src, count);
+}
+#endif // __SSE2__
+
+/*! Constructs PenLayer. */
+PenLayer::PenLayer(QGraphicsItem *parent) :
+	QGraphicsItem(parent)
+{
+	// Cost is in KiB
+	stampCache.setMaxCost(32 * 1024);
+	setStageScale(1);
+}
+
+/*! Overrides QGraphicsItem#type(). */
+int PenLayer::type(void) const
+{
+	return Type;
+}
+
+/*! Overrides QGraphicsItem#boundingRect(). The pen layer covers the stage. */
+QRectF PenLayer::boundingRect(void) const
+{
+	return QRectF(-240 * stageScale, -180 * stageScale, 480 * stageScale, 360 * stageScale);
+}
+
+/*! Overrides QGraphicsItem#paint(). */
+void PenLayer::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget)
+{
+	Q_UNUSED(option);
+	Q_UNUSED(widget);
+	painter->drawImage(boundingRect().topLeft(), m_image);
+}
+
+/*! Sets the scale of the stage. The image is resized, existing drawings are scaled. */
+void PenLayer::setStageScale(qreal value)
+{
+	QMutexLocker locker(&mutex);
+	// Cached stamps are transformed to the old scale
+	stampCache.clear();
+	QImage newImage(qMax(1, qRound(480 * value)), qMax(1, qRound(360 * value)), QImage::Format_ARGB32_Premultiplied);
+	newImage.fill(0);
+	if(!m_image.isNull())
+	{
+		QPainter painter(&newImage);
+		painter.setRenderHint(QPainter::SmoothPixmapTransform);
+		painter.drawImage(newImage.rect(), m_image);
+	}
+	prepareGeometryChange();
+	m_image = newImage;
+	stageScale = value;
+}
+
+/*! Queues clearing of the pen layer (pen_clear). */
+void PenLayer::clear(void)
+{
+	QMutexLocker locker(&mutex);
+	// Previous commands don't need to be drawn
+	queue.clear();
+	Command command;
+	command.type = Command::ClearCommand;
+	queue.append(command);
+}
+
+/*! Queues a line between the given points (in Scratch coordinates). */
+void PenLayer::drawLine(QPointF from, QPointF to, const PenState &pen)
+{
+	Segment segment;
+	segment.x1 = (from.x() + 240) * stageScale;
+	segment.y1 = (180 - from.y()) * stageScale;
+	segment.x2 = (to.x() + 240) * stageScale;
+	segment.y2 = (180 - to.y()) * stageScale;
+	segment.radius = qMax(0.5, pen.size * stageScale / 2);
+	segment.color = qPremultiply(pen.rgba());
+	if(qAlpha(segment.color) == 0)
+		return;
+	QMutexLocker locker(&mutex);
+	if(queue.isEmpty() || (queue.last().type != Command::LinesCommand))
+	{
+		Command command;
+		command.type = Command::LinesCommand;
+		queue.append(command);
+	}
+	queue.last().segments.append(segment);
+}
+
+/*! Queues drawing of a pixmap with the given scene transform and opacity (pen_stamp). */
+void PenLayer::stamp(const QPixmap &pixmap, const QTransform &transform, qreal opacity)
+{
+	QMutexLocker locker(&mutex);
+	Command command;
+	command.type = Command::StampCommand;
+	command.pixmap = pixmap;
+	command.transform = transform;
+	command.opacity = opacity;
+	queue.append(command);
+}
+
+/*! Draws all queued commands. This is called once per frame. */
+void PenLayer::flush(void)
+{
+	mutex.lock();
+	QVector<Command> commands;
+	commands.swap(queue);
+	mutex.unlock();
+	if(commands.isEmpty())
+		return;
+	for(int i=0; i < commands.count(); i++)
+	{
+		const Command &command = commands[i];
+		if(command.type == Command::ClearCommand)
+			m_image.fill(0);
+		else if(command.type == Command::LinesCommand)
+			drawSegments(command.segments);
+		else if(command.type == Command::StampCommand)
+		{
+			// Consecutive stamps are drawn in one batch, runs of identical stamps share the cache lookup
+			QVector<StampBlit> stamps;
+			StampKey previousKey;
+			StampImage previousImage;
+			bool first = true;
+			for(; (i < commands.count()) && (commands[i].type == Command::StampCommand); i++)
+			{
+				QPoint origin;
+				StampKey key = stampKey(commands[i], &origin);
+				if(first || !(key == previousKey))
+				{
+					previousImage = stampImage(key, commands[i]);
+					previousKey = key;
+					first = false;
+				}
+				if(previousImage.image.isNull())
+					continue;
+				StampBlit stamp;
+				stamp.image = previousImage.image;
+				stamp.position = origin + previousImage.offset;
+				stamps.append(stamp);
+			}
+			i--;
+			drawStamps(stamps);
+		}
+	}
+	update();
+}
+
+/*! Returns the pen layer image. */
+const QImage &PenLayer::image(void) const
+{
+	return m_image;
+}
+
+/*!
+ * Calls function(firstRow, endRow) for bands of rows of the image.\n
+ * Batches of at least 16 items are drawn in parallel. Bands don't overlap, so the order of the items is kept in each pixel.
+ */
+template<typename Function>
+void PenLayer::forEachBand(int itemCount, Function function)
+{
+	int height = m_image.height();
+#ifndef Q_OS_WASM
+	if((itemCount >= 16) && (height >= 64))
+	{
+		int bandHeight = qMax(16, height / (QThread::idealThreadCount() * 2));
+		QVector<QPair<int,int>> bands;
+		for(int y=0; y < height; y += bandHeight)
+			bands.append(qMakePair(y, qMin(height, y + bandHeight)));
+		QtConcurrent::blockingMap(bands, [&function](const QPair<int,int> &band) {
+			function(band.first, band.second);
+		});
+		return;
+	}
+#else
+	Q_UNUSED(itemCount);
+#endif // Q_OS_WASM
+	function(0, height);
+}
+
+/*! Draws the segments in order. Large batches are drawn in parallel in bands of rows. */
+void PenLayer::drawSegments(const QVector<Segment> &segments)
+{
+	int width = m_image.width();
+	// Detach the image before the threads start
+	uchar *bits = m_image.bits();
+	int bytesPerLine = m_image.bytesPerLine();
+	forEachBand(segments.count(), [bits, bytesPerLine, &segments, width](int firstRow, int endRow) {
+		QVector<float> coverage(width + 1);
+		for(int i=0; i < segments.count(); i++)
+			drawSegment(bits, bytesPerLine, width, segments[i], firstRow, endRow, coverage.data());
+	});
+}
+
+/*! Draws the rows of a segment between firstRow and endRow. coverage must have space for a row. */
+void PenLayer::drawSegment(uchar *bits, int bytesPerLine, int width, const Segment &segment, int firstRow, int endRow, float *coverage)
+{
+	// Pixels further than this from the segment aren't covered
+	float reach = segment.radius + 1;
+	int top = qMax(firstRow, (int) std::floor(qMin(segment.y1, segment.y2) - reach));
+	int bottom = qMin(endRow, (int) std::ceil(qMax(segment.y1, segment.y2) + reach));
+	if(top >= bottom)
+		return;
+	LineKernelParams params;
+	params.ax = segment.x1;
+	params.ay = segment.y1;
+	params.dx = segment.x2 - segment.x1;
+	params.dy = segment.y2 - segment.y1;
+	float length = std::sqrt(params.dx * params.dx + params.dy * params.dy);
+	params.invLength2 = length > 0 ? 1 / (length * length) : 0;
+	params.edge = segment.radius + 0.5f;
+	float boxLeft = qMin(segment.x1, segment.x2) - reach;
+	float boxRight = qMax(segment.x1, segment.x2) + reach;
+	// Unit normal direction, used to limit the rows to the band around the line
+	float nx = length > 0 ? params.dx / length : 0;
+	float ny = length > 0 ? params.dy / length : 0;
+	for(int y = top; y < bottom; y++)
+	{
+		float centerY = y + 0.5f;
+		float left = boxLeft, right = boxRight;
+		if(qAbs(ny) > 0.001f)
+		{
+			float center = segment.x1 + (centerY - segment.y1) * nx / ny;
+			float halfWidth = reach / qAbs(ny);
+			left = qMax(left, center - halfWidth);
+			right = qMin(right, center + halfWidth);
+		}
+		int x0 = qMax(0, (int) std::floor(left));
+		int x1 = qMin(width, (int) std::ceil(right));
+		if(x0 >= x1)
+			continue;
+		lineCoverage(coverage, x1 - x0, x0 + 0.5f, centerY, params);
+		blendSpan((QRgb*) (bits + y * bytesPerLine) + x0, coverage, x1 - x0, segment.color);
+	}
+}
+
+/*!
+ * Returns the cache key of a stamp and stores the integer part of its position in origin.\n
+ * The position is rounded to 1/4 pixel, so a moving sprite uses a few cached images.
+ */
+StampKey PenLayer::stampKey(const Command &command, QPoint *origin) const
+{
+	const QTransform &transform = command.transform;
+	// The origin of the scene is in the center of the stage
+	qreal x = transform.dx() + m_image.width() / 2.0;
+	qreal y = transform.dy() + m_image.height() / 2.0;
+	int quarterX = qFloor(x * 4);
+	int quarterY = qFloor(y * 4);
+	*origin = QPoint(quarterX >> 2, quarterY >> 2);
+	StampKey key;
+	key.pixmap = command.pixmap.cacheKey();
+	key.m11 = transform.m11();
+	key.m12 = transform.m12();
+	key.m21 = transform.m21();
+	key.m22 = transform.m22();
+	key.opacity = command.opacity;
+	key.subpixelX = quarterX & 3;
+	key.subpixelY = quarterY & 3;
+	return key;
+}
+
+/*! Returns the transformed stamp image with opacity applied. The image is cached. */
+PenLayer::StampImage PenLayer::stampImage(const StampKey &key, const Command &command)
+{
+	StampImage *cached = stampCache.object(key);
+	if(cached)
+		return *cached;
+	QTransform transform(key.m11, key.m12, key.m21, key.m22, key.subpixelX / 4.0, key.subpixelY / 4.0);
+	QRect rect = transform.mapRect(QRectF(command.pixmap.rect())).toAlignedRect();
+	StampImage *out = new StampImage;
+	if(!rect.isEmpty())
+	{
+		out->image = QImage(rect.size(), QImage::Format_ARGB32_Premultiplied);
+		out->image.fill(0);
+		out->offset = rect.topLeft();
+		QPainter painter(&out->image);
+		painter.setRenderHint(QPainter::SmoothPixmapTransform);
+		painter.translate(-rect.topLeft());
+		painter.setTransform(transform, true);
+		painter.setOpacity(command.opacity);
+		painter.drawPixmap(0, 0, command.pixmap);
+	}
+	StampImage ret = *out;
+	stampCache.insert(key, out, qMax(1, (int) (out->image.sizeInBytes() / 1024)));
+	return ret;
+}
+
+/*! Draws the stamps in order. Large batches are drawn in parallel in bands of rows. */
+void PenLayer::drawStamps(const QVector<StampBlit> &stamps)
+{
+	int width = m_image.width();
+	// Detach the image before the threads start
+	uchar *bits = m_image.bits();
+	int bytesPerLine = m_image.bytesPerLine();
+	forEachBand(stamps.count(), [bits, bytesPerLine, &stamps, width](int firstRow, int endRow) {
+		for(int i=0; i < stamps.count(); i++)
+			blendImage(bits, bytesPerLine, width, stamps[i], firstRow, endRow);
+	});
+}
+
+/*! Blends the rows of a stamp image between firstRow and endRow. */
+void PenLayer::blendImage(uchar *bits, int bytesPerLine, int width, const StampBlit &stamp, int firstRow, int endRow)
+{
+	const QImage &image = stamp.image;
+	int top = qMax(firstRow, stamp.position.y());
+	int bottom = qMin(endRow, stamp.position.y() + image.height());
+	int left = qMax(0, stamp.position.x());
+	int right = qMin(width, stamp.position.x() + image.width());
+	if((top >= bottom) || (left >= right))
+		return;
+	for(int y = top; y < bottom; y++)
+	{
+		const QRgb *src = (const QRgb*) image.constScanLine(y - stamp.position.y()) + (left - stamp.position.x());
+		blendRow((QRgb*) (bits + y * bytesPerLine) + left, src, right - left);
+	}
+}
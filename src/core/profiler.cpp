@@ -0,0 +1,239 @@
+/*
+ * profiler.cpp
+ * This file is part of QScratchRuntime
+ *
+ * Copyright (C) 2023 - adazem009
+ *
+ * QScratchRuntime is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * QScratchRuntime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QScratchRuntime. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QFile>
+#include <QTextStream>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <algorithm>
+#include "core/profiler.h"
+
+// Maximum number of trace events per thread, the statistics are recorded even after the limit is reached
+static const int maxEvents = 1000000;
+
+bool Profiler::enabled = false;
+QElapsedTimer Profiler::timer;
+QMutex Profiler::mutex;
+QList<Profiler::Buffer*> Profiler::buffers;
+thread_local Profiler::Buffer *Profiler::currentBuffer = nullptr;
+
+/*! Enables or disables the profiler. The recorded data is kept until reset() is called. */
+void Profiler::setEnabled(bool value)
+{
+	if(value && !timer.isValid())
+		timer.start();
+	enabled = value;
+}
+
+/*! Removes all recorded data. */
+void Profiler::reset(void)
+{
+	QMutexLocker locker(&mutex);
+	for(int i=0; i < buffers.count(); i++)
+	{
+		buffers[i]->opcodes.clear();
+		buffers[i]->scripts.clear();
+		buffers[i]->sprites.clear();
+		buffers[i]->events.clear();
+	}
+	timer.start();
+}
+
+/*! Returns the time since the profiler was started in nanoseconds. */
+qint64 Profiler::now(void)
+{
+	return timer.nsecsElapsed();
+}
+
+/*! Returns the buffer of the current thread. */
+Profiler::Buffer *Profiler::threadBuffer(void)
+{
+	if(!currentBuffer)
+	{
+		// Buffers are never deleted, threads of the thread pool can exit and be started again
+		QMutexLocker locker(&mutex);
+		currentBuffer = new Buffer;
+		currentBuffer->threadIndex = buffers.count();
+		buffers.append(currentBuffer);
+	}
+	return currentBuffer;
+}
+
+/*! Adds a trace event to the buffer (unless it's full). */
+void Profiler::addEvent(Buffer *buffer, const QString &name, const char *category, qint64 start, qint64 duration)
+{
+	if(buffer->events.count() >= maxEvents)
+		return;
+	Event event;
+	event.name = name;
+	event.category = category;
+	event.start = start;
+	event.duration = duration;
+	buffer->events.append(event);
+}
+
+/*! Records a block (including its inputs) which started at the given time and ends now. */
+void Profiler::recordBlock(const QString &opcode, qint64 start)
+{
+	qint64 duration = now() - start;
+	Buffer *buffer = threadBuffer();
+	Stats &stats = buffer->opcodes[opcode];
+	stats.count++;
+	stats.time += duration;
+	addEvent(buffer, opcode, "block", start, duration);
+}
+
+/*! Records a part of a script run in one frame. Scripts are identified by the ID of their top level block. */
+void Profiler::recordScript(const QString &sprite, const QString &script, qint64 start)
+{
+	qint64 duration = now() - start;
+	Buffer *buffer = threadBuffer();
+	QString name = sprite + ": " + script;
+	Stats &stats = buffer->scripts[name];
+	stats.count++;
+	stats.time += duration;
+	addEvent(buffer, name, "script", start, duration);
+}
+
+/*! Records a frame of a sprite (clones are counted together with their sprite). */
+void Profiler::recordSprite(const QString &sprite, qint64 start)
+{
+	qint64 duration = now() - start;
+	Buffer *buffer = threadBuffer();
+	Stats &stats = buffer->sprites[sprite];
+	stats.count++;
+	stats.time += duration;
+	addEvent(buffer, sprite, "sprite", start, duration);
+}
+
+/*! Records a tick of the project scene. */
+void Profiler::recordTick(qint64 start)
+{
+	addEvent(threadBuffer(), "tick", "frame", start, now() - start);
+}
+
+/*! Merges the statistics of all threads. */
+QHash<QString,Profiler::Stats> Profiler::merge(QHash<QString,Stats> Buffer::*member)
+{
+	QMutexLocker locker(&mutex);
+	QHash<QString,Stats> out;
+	for(int i=0; i < buffers.count(); i++)
+	{
+		const QHash<QString,Stats> &stats = buffers[i]->*member;
+		for(auto it = stats.constBegin(); it != stats.constEnd(); ++it)
+		{
+			Stats &total = out[it.key()];
+			total.count += it.value().count;
+			total.time += it.value().time;
+		}
+	}
+	return out;
+}
+
+/*! Returns the number of calls and cumulative time of each opcode. */
+QHash<QString,Profiler::Stats> Profiler::opcodeStats(void)
+{
+	return merge(&Buffer::opcodes);
+}
+
+/*! Returns the number of runs and cumulative time of each script ("sprite: top level block ID"). */
+QHash<QString,Profiler::Stats> Profiler::scriptStats(void)
+{
+	return merge(&Buffer::scripts);
+}
+
+/*! Returns the number of frames and cumulative time of each sprite. */
+QHash<QString,Profiler::Stats> Profiler::spriteStats(void)
+{
+	return merge(&Buffer::sprites);
+}
+
+/*! Returns a text table of the given statistics sorted by time. */
+QString Profiler::table(const QString &title, const QHash<QString,Stats> &stats, int maxRows)
+{
+	QList<QString> names = stats.keys();
+	std::sort(names.begin(), names.end(), [&stats](const QString &a, const QString &b) {
+		return stats.value(a).time > stats.value(b).time;
+	});
+	qint64 totalTime = 0;
+	int nameWidth = title.length();
+	for(int i=0; i < names.count(); i++)
+	{
+		totalTime += stats.value(names[i]).time;
+		if(i < maxRows)
+			nameWidth = qMax(nameWidth, names[i].length());
+	}
+	QString out = title.leftJustified(nameWidth + 2) + QString("count").rightJustified(12) + QString("total (ms)").rightJustified(12)
+		+ QString("avg (us)").rightJustified(12) + QString("%").rightJustified(8) + "\n";
+	for(int i=0; (i < names.count()) && (i < maxRows); i++)
+	{
+		Stats row = stats.value(names[i]);
+		out += names[i].leftJustified(nameWidth + 2) + QString::number(row.count).rightJustified(12)
+			+ QString::number(row.time / 1e6, 'f', 3).rightJustified(12)
+			+ QString::number(row.count > 0 ? row.time / 1e3 / row.count : 0, 'f', 2).rightJustified(12)
+			+ QString::number(totalTime > 0 ? row.time * 100.0 / totalTime : 0, 'f', 1).rightJustified(8) + "\n";
+	}
+	if(names.count() > maxRows)
+		out += "(" + QString::number(names.count() - maxRows) + " more)\n";
+	return out;
+}
+
+/*! Returns a summary table of opcodes, scripts and sprites sorted by time. */
+QString Profiler::summary(int maxRows)
+{
+	return table("Opcode", opcodeStats(), maxRows) + "\n" + table("Script", scriptStats(), maxRows) + "\n"
+		+ table("Sprite", spriteStats(), maxRows);
+}
+
+/*!
+ * Writes the recorded events into a Chrome trace file (JSON), which can be opened
+ * in chrome://tracing or Perfetto. Returns false if the file can't be written.
+ */
+bool Profiler::writeTrace(const QString &fileName)
+{
+	QFile file(fileName);
+	if(!file.open(QIODevice::WriteOnly | QIODevice::Text))
+		return false;
+	QTextStream out(&file);
+	out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	QMutexLocker locker(&mutex);
+	bool first = true;
+	for(int i=0; i < buffers.count(); i++)
+	{
+		const QVector<Event> &events = buffers[i]->events;
+		for(int j=0; j < events.count(); j++)
+		{
+			QJsonObject event;
+			event.insert("name", events[j].name);
+			event.insert("cat", events[j].category);
+			event.insert("ph", "X");
+			event.insert("ts", events[j].start / 1e3);
+			event.insert("dur", events[j].duration / 1e3);
+			event.insert("pid", 1);
+			event.insert("tid", buffers[i]->threadIndex);
+			if(!first)
+				out << ",\n";
+			out << QJsonDocument(event).toJson(QJsonDocument::Compact);
+			first = false;
+		}
+	}
+	out << "\n]}\n";
+	return true;
+}
@@ -18,13 +18,33 @@
  * along with QScratchRuntime. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <QtDebug>
+#include <QSettings>
+#ifndef Q_OS_WASM
+#include <QtConcurrent>
+#endif // Q_OS_WASM
 #include "core/projectparser.h"
+#include "core/soundcache.h"
+
+/*! Assets of a target which are prepared on a worker thread. \see projectParser#sprites() */
+struct PreparedTarget
+{
+	const TargetData *target;
+	QImage costumeImage;
+};
 
 /*! Constructs projectParser. */
 projectParser::projectParser(QString fileName, QByteArray projectJson, QObject *parent) :
 	QObject(parent)
 {
-	if(projectJson == "")
+	if((projectJson == "") && fileName.endsWith(".sb3", Qt::CaseInsensitive))
+	{
+		// Extract the assets in the background while project.json is being parsed
+		archive = new Sb3Reader(fileName, &projectAssets);
+		archive->extractAssets();
+		readProject(archive->projectJson());
+	}
+	else if(projectJson == "")
 	{
 		QFileInfo fileInfo(fileName);
 		assetDir = fileInfo.path();
@@ -36,62 +56,216 @@ projectParser::projectParser(QString fileName, QByteArray projectJson, QObject *
 			jsonFile.close();
 		}
 		jsonFile.open(QIODevice::ReadOnly | QIODevice::Text);
-		document = QJsonDocument::fromJson(jsonFile.readAll());
+		readProject(jsonFile.readAll());
 		jsonFile.close();
 	}
 	else
-		document = document = QJsonDocument::fromJson(projectJson);
-	// Read object
-	mainObject = document.object();
+		readProject(projectJson);
 }
 
-/*! Returns list of sprites (including stage). */
-QList<scratchSprite*> projectParser::sprites(void)
+/*! Destroys the projectParser object. */
+projectParser::~projectParser()
 {
+	if(archive)
+		delete archive;
+}
+
+/*!
+ * Reads the targets from project.json in a single pass.\n
+ * The blocks are converted directly to the form used by the engine, without building a document tree.
+ * Parts of the project which aren't used (e.g. comments and monitors) are skipped.
+ */
+void projectParser::readProject(const QByteArray &projectJson)
+{
+	targets.clear();
+	JsonStreamReader reader(projectJson);
+	if(reader.readNext() == JsonStreamReader::StartObject)
+	{
+		while(reader.readNextName())
+		{
+			QString key = reader.name();
+			reader.readNext();
+			if((key == "targets") && (reader.tokenType() == JsonStreamReader::StartArray))
+			{
+				while(reader.readNextItem())
+				{
+					TargetData target;
+					readTarget(reader, &target);
+					targets += target;
+				}
+			}
+			else
+				reader.skipValue();
+		}
+	}
+	if(reader.hasError())
+		qWarning() << "Warning: could not read project.json:" << reader.errorString() << "at offset" << reader.errorOffset();
+}
+
+/*! Reads a target object. */
+void projectParser::readTarget(JsonStreamReader &reader, TargetData *target)
+{
+	if(reader.tokenType() != JsonStreamReader::StartObject)
+	{
+		reader.skipValue();
+		return;
+	}
+	while(reader.readNextName())
+	{
+		QString key = reader.name();
+		reader.readNext();
+		if(key == "blocks")
+			readBlocks(reader, &target->blocks);
+		else if(key == "costumes")
+			readAssets(reader, &target->costumes);
+		else if(key == "sounds")
+			readAssets(reader, &target->sounds);
+		else if(key == "isStage")
+			target->isStage = reader.readBool();
+		else if(key == "name")
+			target->name = reader.readString();
+		else if(key == "currentCostume")
+			target->currentCostume = reader.readDouble();
+		else if(key == "volume")
+			target->volume = reader.readDouble();
+		else if(key == "tempo")
+			target->tempo = reader.readDouble();
+		else if(key == "layerOrder")
+			target->layerOrder = reader.readDouble();
+		else if(key == "visible")
+			target->visible = reader.readBool();
+		else if(key == "x")
+			target->x = reader.readDouble();
+		else if(key == "y")
+			target->y = reader.readDouble();
+		else if(key == "size")
+			target->size = reader.readDouble();
+		else if(key == "direction")
+			target->direction = reader.readDouble();
+		else if(key == "rotationStyle")
+			target->rotationStyle = reader.readString();
+		else if(key == "draggable")
+			target->draggable = reader.readBool();
+		else
+			reader.skipValue();
+	}
+}
+
+/*! Reads an array of costumes or sounds. */
+void projectParser::readAssets(JsonStreamReader &reader, QList<QVariantMap> *assets)
+{
+	if(reader.tokenType() != JsonStreamReader::StartArray)
+	{
+		reader.skipValue();
+		return;
+	}
+	while(reader.readNextItem())
+		*assets += reader.readValue().toMap();
+}
+
+/*! Reads the blocks object of a target. */
+void projectParser::readBlocks(JsonStreamReader &reader, QMap<QString,QVariantMap> *blocks)
+{
+	if(reader.tokenType() != JsonStreamReader::StartObject)
+	{
+		reader.skipValue();
+		return;
+	}
+	while(reader.readNextName())
+	{
+		QString blockID = reader.name();
+		reader.readNext();
+		blocks->insert(blockID, reader.readValue().toMap());
+	}
+}
+
+/*!
+ * Returns list of sprites (including stage).\n
+ * The current costumes (at the given scene scale) and the sounds of all targets are decoded in parallel.
+ * Only the sprites (graphics items) are created on this thread, in the order of the targets,
+ * so the initial layer order doesn't depend on the order in which the threads finish.
+ */
+QList<scratchSprite*> projectParser::sprites(qreal sceneScale)
+{
+	if(archive)
+		archive->waitForAssets();
+	QSettings settings;
+	bool hqSvg = settings.value("main/hqsvg", true).toBool();
+	QVector<PreparedTarget> prepared(targets.count());
+	for(int i=0; i < targets.count(); i++)
+		prepared[i].target = &targets[i];
+	auto prepareTarget = [this, sceneScale, hqSvg](PreparedTarget &current) {
+		const TargetData &target = *current.target;
+		// Sounds which are still being downloaded are decoded by scratchSprite#assetLoaded()
+		for(int i=0; i < target.sounds.count(); i++)
+		{
+			QByteArray data = scratchSprite::assetData(target.sounds[i], assetDir);
+			if(!data.isEmpty())
+				soundCache.preload(target.sounds[i].value("assetId").toString(), data);
+		}
+		if((target.currentCostume >= 0) && (target.currentCostume < target.costumes.count()))
+		{
+			const QVariantMap &costume = target.costumes[target.currentCostume];
+			current.costumeImage = scratchSprite::costumeImage(costume, scratchSprite::assetData(costume, assetDir), sceneScale, hqSvg);
+		}
+	};
+#ifdef Q_OS_WASM
+	for(int i=0; i < prepared.count(); i++)
+		prepareTarget(prepared[i]);
+#else
+	QtConcurrent::blockingMap(prepared, prepareTarget);
+#endif // Q_OS_WASM
 	QList<scratchSprite*> out;
 	out.clear();
-	QJsonArray targets = mainObject.value("targets").toArray();
 	for(int i=0; i < targets.count(); i++)
-		out += new scratchSprite(targets[i].toObject(),assetDir);
+		out += new scratchSprite(targets[i], assetDir, sceneScale, prepared[i].costumeImage);
 	return out;
 }
 
 /*! Returns a pointer to stage. */
 scratchSprite *projectParser::stage(void)
 {
-	QJsonArray targets = mainObject.value("targets").toArray();
-	scratchSprite *currentSprite;
+	if(archive)
+		archive->waitForAssets();
 	for(int i=0; i < targets.count(); i++)
 	{
-		currentSprite = new scratchSprite(targets[i].toObject(),assetDir);
-		if(currentSprite->isStage)
-			return currentSprite;
+		if(targets[i].isStage)
+			return new scratchSprite(targets[i],assetDir);
 	}
 	return nullptr;
 }
 
-/*! Returns list of asset maps (asset ID and data format). */
+/*!
+ * Returns list of asset maps (asset ID, data format and type - "costume" or "sound").\n
+ * "initial" is "true" for the current costumes of the stage and the visible sprites,
+ * which are needed to show the first frame.
+ */
 QList<QMap<QString,QString>> projectParser::assetIDs(void)
 {
 	QList<QMap<QString,QString>> out;
 	out.clear();
-	QJsonArray targets = mainObject.value("targets").toArray();
 	for(int i=0; i < targets.count(); i++)
 	{
-		QJsonObject currentTarget = targets[i].toObject();
-		QJsonArray costumes = currentTarget.value("costumes").toArray();
+		const TargetData &currentTarget = targets[i];
+		bool shown = currentTarget.isStage || currentTarget.visible;
+		int currentCostume = currentTarget.currentCostume;
+		const QList<QVariantMap> &costumes = currentTarget.costumes;
 		QMap<QString,QString> asset;
 		for(int i2=0; i2 < costumes.count(); i2++)
 		{
-			asset.insert("assetId",costumes[i2].toObject().value("assetId").toString());
-			asset.insert("dataFormat",costumes[i2].toObject().value("dataFormat").toString());
+			asset.insert("assetId",costumes[i2].value("assetId").toString());
+			asset.insert("dataFormat",costumes[i2].value("dataFormat").toString());
+			asset.insert("type","costume");
+			asset.insert("initial",(shown && (i2 == currentCostume)) ? "true" : "false");
 			out += asset;
 		}
-		QJsonArray sounds = currentTarget.value("sounds").toArray();
+		const QList<QVariantMap> &sounds = currentTarget.sounds;
 		for(int i2=0; i2 < sounds.count(); i2++)
 		{
-			asset.insert("assetId",sounds[i2].toObject().value("assetId").toString());
-			asset.insert("dataFormat",sounds[i2].toObject().value("dataFormat").toString());
+			asset.insert("assetId",sounds[i2].value("assetId").toString());
+			asset.insert("dataFormat",sounds[i2].value("dataFormat").toString());
+			asset.insert("type","sound");
+			asset.insert("initial","false");
 			out += asset;
 		}
 	}
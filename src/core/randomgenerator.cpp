@@ -0,0 +1,112 @@
+/*
+ * randomgenerator.cpp
+ * This file is part of QScratchRuntime
+ *
+ * Copyright (C) 2023 - adazem009
+ *
+ * QScratchRuntime is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * QScratchRuntime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QScratchRuntime. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QDateTime>
+#if QT_VERSION >= QT_VERSION_CHECK(5, 10, 0)
+#include <QRandomGenerator>
+#endif
+#include "core/randomgenerator.h"
+
+/*! Returns a random project seed (used if no seed is set). */
+static quint64 defaultSeed(void)
+{
+#if QT_VERSION >= QT_VERSION_CHECK(5, 10, 0)
+	return QRandomGenerator::global()->generate64();
+#else
+	return QDateTime::currentMSecsSinceEpoch() ^ ((quint64) qrand() << 32);
+#endif
+}
+
+quint64 RandomGenerator::m_projectSeed = defaultSeed();
+
+/*! Rotates x left by k bits. */
+static inline quint64 rotl(quint64 x, int k)
+{
+	return (x << k) | (x >> (64 - k));
+}
+
+/*! Constructs RandomGenerator seeded with the project seed. */
+RandomGenerator::RandomGenerator()
+{
+	seed(m_projectSeed);
+}
+
+/*! Seeds the generator. The state is filled using splitmix64. */
+void RandomGenerator::seed(quint64 value)
+{
+	for(int i=0; i < 4; i++)
+	{
+		value += 0x9E3779B97F4A7C15ULL;
+		quint64 z = value;
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+		state[i] = z ^ (z >> 31);
+	}
+}
+
+/*! Returns the next 64-bit number. */
+quint64 RandomGenerator::next(void)
+{
+	const quint64 result = rotl(state[1] * 5, 7) * 9;
+	const quint64 t = state[1] << 17;
+	state[2] ^= state[0];
+	state[3] ^= state[1];
+	state[1] ^= state[2];
+	state[0] ^= state[3];
+	state[2] ^= t;
+	state[3] = rotl(state[3], 45);
+	return result;
+}
+
+/*! Returns a random number in range [lowest, highest). */
+int RandomGenerator::bounded(int lowest, int highest)
+{
+	if(highest <= lowest)
+		return lowest;
+	quint64 range = (quint64) ((qint64) highest - lowest);
+	return lowest + (int) (((next() >> 32) * range) >> 32);
+}
+
+/*! Sets the project seed. Must be called before the sprites are created. */
+void RandomGenerator::setProjectSeed(quint64 value)
+{
+	m_projectSeed = value;
+}
+
+/*! Returns the project seed. */
+quint64 RandomGenerator::projectSeed(void)
+{
+	return m_projectSeed;
+}
+
+/*!
+ * Returns the seed of the stream with the given name (e.g. sprite name).\n
+ * This uses FNV-1a because qHash() is randomized per process.
+ */
+quint64 RandomGenerator::streamSeed(const QString &name)
+{
+	quint64 hash = 0xCBF29CE484222325ULL;
+	for(int i=0; i < name.size(); i++)
+	{
+		hash ^= name.at(i).unicode();
+		hash *= 0x100000001B3ULL;
+	}
+	return hash ^ m_projectSeed;
+}
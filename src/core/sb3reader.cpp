@@ -0,0 +1,195 @@
+/*
+ * sb3reader.cpp
+ * This file is part of QScratchRuntime
+ *
+ * Copyright (C) 2023 - adazem009
+ *
+ * QScratchRuntime is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * QScratchRuntime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QScratchRuntime. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QtEndian>
+#include <QtDebug>
+#ifndef Q_OS_WASM
+#include <QtConcurrent>
+#endif // Q_OS_WASM
+#include <zlib.h>
+#include "core/sb3reader.h"
+
+// Zip record signatures
+static const quint32 endOfCentralDirSignature = 0x06054b50;
+static const quint32 centralDirHeaderSignature = 0x02014b50;
+static const quint32 localHeaderSignature = 0x04034b50;
+
+/*! Constructs Sb3Reader and reads the list of files in the archive. */
+Sb3Reader::Sb3Reader(const QString &fileName, AssetStore *store) :
+	m_store(store)
+{
+	archiveData = m_store->mapData(fileName);
+	m_valid = readCentralDirectory();
+	if(!m_valid)
+		qWarning() << "Warning: could not read project archive" << fileName;
+}
+
+/*! Destroys the Sb3Reader object. Waits until all assets are extracted. */
+Sb3Reader::~Sb3Reader()
+{
+	waitForAssets();
+}
+
+/*! Returns true if the archive was read successfully. */
+bool Sb3Reader::isValid(void) const
+{
+	return m_valid;
+}
+
+/*! Reads the central directory of the zip archive. */
+bool Sb3Reader::readCentralDirectory(void)
+{
+	const uchar *data = (const uchar*) archiveData.constData();
+	qint64 size = archiveData.size();
+	if(size < 22)
+		return false;
+	// Find end of central directory record (it's followed by a comment of up to 65535 bytes)
+	qint64 eocdOffset = -1;
+	for(qint64 i = size - 22; (i >= 0) && (i >= size - 22 - 65535); i--)
+	{
+		if(qFromLittleEndian<quint32>(data + i) == endOfCentralDirSignature)
+		{
+			eocdOffset = i;
+			break;
+		}
+	}
+	if(eocdOffset == -1)
+		return false;
+	quint16 entryCount = qFromLittleEndian<quint16>(data + eocdOffset + 10);
+	qint64 offset = qFromLittleEndian<quint32>(data + eocdOffset + 16);
+	entries.clear();
+	for(int i=0; i < entryCount; i++)
+	{
+		if((offset + 46 > size) || (qFromLittleEndian<quint32>(data + offset) != centralDirHeaderSignature))
+			return false;
+		Entry entry;
+		entry.method = qFromLittleEndian<quint16>(data + offset + 10);
+		entry.compressedSize = qFromLittleEndian<quint32>(data + offset + 20);
+		entry.size = qFromLittleEndian<quint32>(data + offset + 24);
+		quint16 nameLength = qFromLittleEndian<quint16>(data + offset + 28);
+		quint16 extraLength = qFromLittleEndian<quint16>(data + offset + 30);
+		quint16 commentLength = qFromLittleEndian<quint16>(data + offset + 32);
+		qint64 localHeaderOffset = qFromLittleEndian<quint32>(data + offset + 42);
+		if(offset + 46 + nameLength > size)
+			return false;
+		entry.name = QString::fromUtf8((const char*) data + offset + 46, nameLength);
+		// Some tools put the files in a directory
+		entry.name = entry.name.section('/', -1);
+		offset += 46 + nameLength + extraLength + commentLength;
+		// The local header can have a different extra field length
+		if((localHeaderOffset + 30 > size) || (qFromLittleEndian<quint32>(data + localHeaderOffset) != localHeaderSignature))
+			return false;
+		quint16 localNameLength = qFromLittleEndian<quint16>(data + localHeaderOffset + 26);
+		quint16 localExtraLength = qFromLittleEndian<quint16>(data + localHeaderOffset + 28);
+		entry.dataOffset = localHeaderOffset + 30 + localNameLength + localExtraLength;
+		if(entry.dataOffset + entry.compressedSize > size)
+			return false;
+		// Stored entries are read using the uncompressed size
+		if((entry.method == 0) && (entry.size != entry.compressedSize))
+			return false;
+		if(!entry.name.isEmpty())
+			entries.append(entry);
+	}
+	return true;
+}
+
+/*!
+ * Returns the uncompressed data of the given entry.\n
+ * Stored entries are returned as views of the archive data, which is kept by the AssetStore until it's cleared.
+ */
+QByteArray Sb3Reader::entryData(const Entry &entry) const
+{
+	const char *data = archiveData.constData() + entry.dataOffset;
+	if(entry.method == 0)
+		return QByteArray::fromRawData(data, entry.size);
+	else if(entry.method != 8)
+	{
+		qWarning() << "Warning: unsupported compression method" << entry.method << "in" << entry.name;
+		return QByteArray();
+	}
+	// Inflate raw deflate data
+	QByteArray out(entry.size, Qt::Uninitialized);
+	z_stream stream;
+	memset(&stream, 0, sizeof(stream));
+	if(inflateInit2(&stream, -MAX_WBITS) != Z_OK)
+		return QByteArray();
+	stream.next_in = (Bytef*) data;
+	stream.avail_in = entry.compressedSize;
+	stream.next_out = (Bytef*) out.data();
+	stream.avail_out = entry.size;
+	int ret = inflate(&stream, Z_FINISH);
+	inflateEnd(&stream);
+	if(ret != Z_STREAM_END)
+	{
+		qWarning() << "Warning: could not inflate" << entry.name;
+		return QByteArray();
+	}
+	return out;
+}
+
+/*! Returns the content of project.json. */
+QByteArray Sb3Reader::projectJson(void)
+{
+	for(int i=0; i < entries.count(); i++)
+	{
+		if(entries[i].name == "project.json")
+			return entryData(entries[i]);
+	}
+	return QByteArray();
+}
+
+/*! Adds the given entry to the asset store. Asset IDs are file names without the extension. */
+void Sb3Reader::extractEntry(const Entry &entry)
+{
+	m_store->insert(entry.name.left(entry.name.lastIndexOf('.')), entryData(entry));
+}
+
+/*!
+ * Adds all assets to the asset store.\n
+ * Stored assets are added immediately, deflated assets are inflated in parallel in the background.
+ * Use waitForAssets() to wait until all assets are available.
+ */
+void Sb3Reader::extractAssets(void)
+{
+	deflatedEntries.clear();
+	for(int i=0; i < entries.count(); i++)
+	{
+		if(entries[i].name == "project.json")
+			continue;
+		if(entries[i].method == 8)
+			deflatedEntries.append(entries[i]);
+		else
+			extractEntry(entries[i]);
+	}
+#ifdef Q_OS_WASM
+	for(int i=0; i < deflatedEntries.count(); i++)
+		extractEntry(deflatedEntries[i]);
+#else
+	extraction = QtConcurrent::map(deflatedEntries, [this](const Entry &entry) {
+		extractEntry(entry);
+	});
+#endif // Q_OS_WASM
+}
+
+/*! Waits until all assets are extracted. */
+void Sb3Reader::waitForAssets(void)
+{
+	extraction.waitForFinished();
+}
@@ -20,37 +20,42 @@
 
 #include "core/scratchsprite.h"
 #include "core/engine.h"
+#include "core/engineclock.h"
+#include "core/framestats.h"
 
 QList<scratchSprite*> spriteList;
 QList<scratchSprite*> cloneRequests;
 QList<scratchSprite*> deleteRequests;
 
-/*! Constructs scratchSprite. */
-scratchSprite::scratchSprite(QJsonObject spriteObject, QString spriteAssetDir, QGraphicsItem *parent) :
+/*!
+ * Constructs scratchSprite at the given scene scale.\n
+ * initialCostume can be the current costume decoded by costumeImage() at this scale
+ * (e.g. on another thread, see projectParser#sprites()), so it doesn't have to be decoded again.
+ */
+scratchSprite::scratchSprite(const TargetData &target, QString spriteAssetDir, qreal scale, const QImage &initialCostume, QGraphicsItem *parent) :
 	QGraphicsPixmapItem(parent),
-	jsonObject(spriteObject),
+	targetData(target),
 	assetDir(spriteAssetDir),
-	m_engine(new Engine(this, this))
+	m_engine(new Engine(this, this)),
+	m_handle(spriteStore.create())
 {
 	assetDir = spriteAssetDir;
-	int i;
 	pointingLeft = false;
+	sceneScale = scale;
 	// Load costumes
-	QJsonArray costumesArray = spriteObject.value("costumes").toArray();
-	costumes.clear();
-	for(i=0; i < costumesArray.count(); i++)
-		costumes += costumesArray[i].toObject().toVariantMap();
-	currentCostume = spriteObject.value("currentCostume").toInt();
-	setCostume(currentCostume);
+	costumes = target.costumes;
+	preparedCostume = initialCostume;
+	preparedCostumeId = target.currentCostume;
+	setCostume(target.currentCostume);
 	// Load attributes
-	isStage = spriteObject.value("isStage").toBool();
-	name = spriteObject.value("name").toString();
-	setVolume(spriteObject.value("volume").toDouble());
-	tempo = spriteObject.value("tempo").toInt();
+	isStage = target.isStage;
+	name = target.name;
+	setVolume(target.volume);
+	tempo = target.tempo;
 	if(isStage)
 	{
 		setZValue(0);
-		setVisible(true);
+		spriteStore.setVisible(m_handle, true);
 		setXPos(0);
 		setYPos(0);
 		setSize(100);
@@ -65,59 +70,46 @@ scratchSprite::scratchSprite(QJsonObject spriteObject, QString spriteAssetDir, Q
 		speechBubbleText->setPos(10,10);
 		speechBubble->setVisible(false);
 		speechBubbleText->setVisible(false);
-		setZValue(spriteObject.value("layerOrder").toInt());
-		setVisible(spriteObject.value("visible").toBool());
-		setXPos(spriteObject.value("x").toDouble());
-		setYPos(spriteObject.value("y").toDouble());
-		setSize(spriteObject.value("size").toDouble());
-		rotationStyle = spriteObject.value("rotationStyle").toString();
-		setDirection(spriteObject.value("direction").toDouble());
-		draggable = spriteObject.value("draggable").toBool();
+		layerList.insert(this, target.layerOrder);
+		spriteStore.setVisible(m_handle, target.visible);
+		setXPos(target.x);
+		setYPos(target.y);
+		setSize(target.size);
+		rotationStyle = target.rotationStyle;
+		setDirection(target.direction);
+		draggable = target.draggable;
 	}
 	resetGraphicEffects();
-	timer.start();
-	// Load sounds
-	QJsonArray soundsArray = spriteObject.value("sounds").toArray();
-	sounds.clear();
-	for(i=0; i < soundsArray.count(); i++)
-		sounds += soundsArray[i].toObject().toVariantMap();
+	timerStart = EngineClock::msecs();
+	// Each sprite has its own random number stream
+	m_engine->random.seed(RandomGenerator::streamSeed(name));
+	// Load sounds (they're preloaded by projectParser#sprites(), clones use the sounds of the original sprite)
+	sounds = target.sounds;
 	// TODO: Load variables
 	// TODO: Load lists
-	// Load blocks
-	QJsonObject blocksObject = spriteObject.value("blocks").toObject();
-	QStringList blocksList = blocksObject.keys();
-	blocks.clear();
+	// Load blocks (the map is shared with the target data until a block changes)
+	blocks = target.blocks;
 	frameEvents.clear();
-	for(i=0; i < blocksList.count(); i++)
+	for(auto it = target.blocks.constBegin(); it != target.blocks.constEnd(); ++it)
 	{
-		blocks.insert(blocksList[i],blocksObject.value(blocksList[i]).toObject().toVariantMap());
-		QString opcode = blocks.value(blocksList[i]).value("opcode").toString();
-		if(opcode == "event_whengreaterthan")
+		if(it.value().value("opcode").toString() == "event_whengreaterthan")
 		{
-			QVariantMap block = blocks[blocksList[i]];
+			QVariantMap block = it.value();
 			block.insert("special_timereventused",false);
-			blocks.insert(blocksList[i],block);
-			frameEvents.insert(blocksList[i],blocks.value(blocksList[i]));
+			blocks.insert(it.key(),block);
+			frameEvents.insert(it.key(),block);
 		}
 	}
-	// Connections
-	connect(m_engine, &Engine::setSceneScale, this, &scratchSprite::setSceneScale);
-	connect(m_engine, &Engine::setX, this, &scratchSprite::setXPos);
-	connect(m_engine, &Engine::setY, this, &scratchSprite::setYPos);
-	connect(m_engine, &Engine::setCostume, this, &scratchSprite::setCostume);
-	connect(m_engine, &Engine::setSize, this, &scratchSprite::setSize);
-	connect(m_engine, &Engine::setDirection, this, &scratchSprite::setDirection);
-	connect(m_engine, &Engine::resetGraphicEffects, this, &scratchSprite::resetGraphicEffects);
-	connect(m_engine, &Engine::installGraphicEffects, this, &scratchSprite::installGraphicEffects);
-	connect(m_engine, &Engine::showBubble, this, &scratchSprite::showBubble);
-	connect(m_engine, &Engine::setVisible, this, [this](bool visible) { setVisible(visible); });
-	connect(m_engine, &Engine::setZValue, this, [this](qreal z) { setZValue(z); });
-	
+	takeSnapshot();
 }
 
 /*! Destroys the scratchSprite object. */
 scratchSprite::~scratchSprite()
 {
+	spriteStore.release(m_handle);
+	stopPendingSounds();
+	audioMixer.releaseChannel(m_handle);
+	layerList.remove(this);
 	for(int i=0; i < stackPointers.count(); i++)
 	{
 		if(stackPointers[i])
@@ -173,7 +165,8 @@ void scratchSprite::stopAll(void)
 {
 	stopSprite();
 	resetTimer();
-	stopAllSounds();
+	stopPendingSounds();
+	audioMixer.stopChannel(m_handle);
 	if(isClone() && !deleteRequests.contains(this))
 		deleteRequests += this;
 }
@@ -181,7 +174,7 @@ void scratchSprite::stopAll(void)
 /*! Resets the timer. */
 void scratchSprite::resetTimer(void)
 {
-	timer.start();
+	timerStart = EngineClock::msecs();
 	QStringList blocksList = frameEvents.keys();
 	for(int i=0; i < blocksList.count(); i++)
 	{
@@ -290,7 +283,7 @@ void scratchSprite::backdropSwitchEvent(QVariantMap *script)
 		{
 			QMap<QString,QString> inputs = m_engine->getInputs(block);
 			scratchSprite *stagePtr = getSprite("Stage");
-			if(inputs.value("BACKDROP") == stagePtr->costumes[stagePtr->currentCostume].value("name"))
+			if(inputs.value("BACKDROP") == stagePtr->costumes[stagePtr->currentCostume()].value("name"))
 			{
 				// Stop running instances of this event
 				QList<QVariantMap> operationsToRemove;
@@ -387,20 +380,21 @@ void scratchSprite::stopSprite(void)
 		speechBubbleText->setVisible(false);
 	}
 	resetGraphicEffects();
+	clearSoundEffects();
 }
 
 /*! Sets sprite X position. */
 void scratchSprite::setXPos(qreal x)
 {
-	spriteX = x;
-	setX(translateX(x));
+	spriteStore.setX(m_handle, x);
+	syncView();
 }
 
 /*! Sets sprite Y position. */
 void scratchSprite::setYPos(qreal y)
 {
-	spriteY = y;
-	setY(translateY(y));
+	spriteStore.setY(m_handle, y);
+	syncView();
 }
 
 /*! Translates X position from Scratch coordinate system to QGraphicsScene coordinate system or vice versa. */
@@ -438,174 +432,185 @@ void scratchSprite::setMousePos(QPointF pos)
 	mouseY = -pos.y();
 }
 
-/*! Sets the sprite costume. */
-void scratchSprite::setCostume(int id, QVariantMap *script)
+/*!
+ * Returns the data of the given costume or sound.\n
+ * Assets of projects loaded from a directory are memory-mapped on first use.
+ */
+QByteArray scratchSprite::assetData(const QVariantMap &asset)
 {
-	currentCostume = id;
-	QString dataFormat = costumes[id].value("dataFormat").toString();
-	QString assetId = costumes[id].value("assetId").toString();
-	QByteArray data;
+	return assetData(asset, assetDir);
+}
+
+/*!
+ * Returns the data of the given costume or sound of a project in the given asset directory
+ * (or in the asset store if assetDir is empty). This can be called from any thread.
+ */
+QByteArray scratchSprite::assetData(const QVariantMap &asset, const QString &assetDir)
+{
+	QString assetId = asset.value("assetId").toString();
 	if(assetDir == "")
-		data = *projectAssets[assetId];
+		return projectAssets.asset(assetId);
 	else
-	{
-		QFile assetFile(assetDir + "/" + assetId + "." + dataFormat);
-		assetFile.open(QFile::ReadOnly);
-		data = assetFile.readAll();
-	}
+		return projectAssets.mapFile(assetId, assetDir + "/" + assetId + "." + asset.value("dataFormat").toString());
+}
+
+/*! Sets the sprite costume. The costume image is always reloaded. */
+void scratchSprite::setCostume(int id, QVariantMap *script)
+{
+	spriteStore.setCostume(m_handle, id);
+	spriteStore.markDirty(m_handle, SpriteStore::CostumeDirty);
+	syncView();
+	if((isStage) && (script != nullptr))
+		emit backdropSwitched(script);
+}
+
+/*!
+ * Decodes the image of the given costume at the given scene scale.
+ * SVG costumes are rendered at the scene scale if hqSvg is true.\n
+ * Only QImage is used, so this can be called from any thread.
+ */
+QImage scratchSprite::costumeImage(const QVariantMap &costume, const QByteArray &data, qreal sceneScale, bool hqSvg)
+{
+	QString dataFormat = costume.value("dataFormat").toString();
 	double scale = 1;
-	if((dataFormat == "svg") && settings.value("main/hqsvg", true).toBool())
+	QImage image;
+	if((dataFormat == "svg") && hqSvg)
 	{
 		QSvgRenderer renderer(data);
-		QImage image(renderer.defaultSize() * sceneScale, QImage::Format_ARGB32);
+		image = QImage(renderer.defaultSize() * sceneScale, QImage::Format_ARGB32);
 		image.fill(0);
 		QPainter painter(&image);
 		renderer.render(&painter);
-		costumePixmap = QPixmap::fromImage(image);
 	}
 	else
 	{
 		if(dataFormat != "svg")
 			scale = 0.5;
-		costumePixmap = QPixmap();
-		costumePixmap.loadFromData(data);
-		costumePixmap = costumePixmap.scaled(costumePixmap.width() * sceneScale, costumePixmap.height() * sceneScale);
+		image.loadFromData(data);
+		image = image.scaled(image.width() * sceneScale, image.height() * sceneScale);
+	}
+	return image.scaledToHeight(image.height() * scale);
+}
+
+/*! Loads the image of the given costume to the graphics item. Costumes which were shown before aren't decoded again. */
+void scratchSprite::loadCostume(int id)
+{
+	QString assetId = costumes[id].value("assetId").toString();
+	bool hqSvg = settings.value("main/hqsvg", true).toBool();
+	costumePixmap = costumeCache.pixmap(assetId, sceneScale, hqSvg);
+	if(costumePixmap.isNull())
+	{
+		if(!preparedCostume.isNull() && (id == preparedCostumeId))
+			costumePixmap = QPixmap::fromImage(preparedCostume);
+		else
+			costumePixmap = QPixmap::fromImage(costumeImage(costumes[id], assetData(costumes[id]), sceneScale, hqSvg));
+		costumeCache.insert(assetId, sceneScale, hqSvg, costumePixmap);
 	}
-	costumePixmap = costumePixmap.scaledToHeight(costumePixmap.height() * scale);
 	setPixmap(costumePixmap);
+	// Bitmap costumes have double resolution
+	double scale = (costumes[id].value("dataFormat").toString() == "svg") ? 1 : 0.5;
 	rotationCenterX = costumes[id].value("rotationCenterX").toDouble() * scale * sceneScale;
 	rotationCenterY = costumes[id].value("rotationCenterY").toDouble() * scale * sceneScale;
-	setTransformOriginPoint(QPointF(rotationCenterX,rotationCenterY));
-	setXPos(spriteX);
-	setYPos(spriteY);
-	installGraphicEffects();
-	if((isStage) && (script != nullptr))
-		emit backdropSwitched(script);
 }
 
-/*! Resets the values of all graphic effects. */
+/*! Resets the values of all graphic effects and updates the image. */
 void scratchSprite::resetGraphicEffects(void)
 {
-	graphicEffects.clear();
-	graphicEffects.insert("COLOR",0);
-	graphicEffects.insert("FISHEYE",0);
-	graphicEffects.insert("WHIRL",0);
-	graphicEffects.insert("PIXELATE",0);
-	graphicEffects.insert("MOSAIC",0);
-	graphicEffects.insert("BRIGHTNESS",0);
-	graphicEffects.insert("GHOST",0);
-	installGraphicEffects();
+	clearGraphicEffects();
+	syncView();
+}
+
+/*! Resets the values of all graphic effects without updating the image. \see syncView() */
+void scratchSprite::clearGraphicEffects(void)
+{
+	spriteStore.clearEffects(m_handle);
+}
+
+/*! Returns the value of the graphic effect with the given name (e.g. "COLOR"). */
+qreal scratchSprite::graphicEffect(const QString &name) const
+{
+	int effect = GraphicEffects::effectIndex(name);
+	if(effect == -1)
+		return 0;
+	return spriteStore.effects(m_handle)[effect];
+}
+
+/*! Sets the value of the graphic effect with the given name. The image is updated by syncView(). */
+void scratchSprite::setGraphicEffect(const QString &name, qreal value)
+{
+	int effect = GraphicEffects::effectIndex(name);
+	if(effect != -1)
+		spriteStore.setEffect(m_handle, effect, value);
 }
 
 /*!
- * Sets graphic effects.\n
- * Note: Only ghost, color and brightness is supported.
+ * Applies the given graphic effect values (indexed by GraphicEffects::Effect) to the image
+ * of the given costume, which must be the loaded costume (e.g. of a pen stamp, see syncView()).
  */
-void scratchSprite::installGraphicEffects(void)
-{
-	/*
-	 * TODO: Implement other effects in the loop below.
-	 * It should be possible without using QGraphicsEffect.
-	 */
-	qreal colorEffect = graphicEffects["COLOR"];
-	qreal brightnessEffect = graphicEffects["BRIGHTNESS"];
-	qreal ghostEffect = graphicEffects["GHOST"];
-	if((colorEffect != 0) || (colorEffect != 0) || (ghostEffect != 0))
+void scratchSprite::applyGraphicEffects(int costume, const qreal *values)
+{
+	ImageEffects effects = GraphicEffects::imageEffects(values);
+	qreal ghostEffect = qBound(0.0, values[GraphicEffects::GhostEffect], 100.0);
+	// Ghost effect doesn't modify the image
+	setOpacity((100 - ghostEffect) / 100.0);
+	QPixmap newPixmap = costumePixmap;
+	if(!effects.isNull())
 	{
-		if((colorEffect == 0) && (brightnessEffect == 0))
-		{
-			setOpacity((100 - ghostEffect) / 100.0);
-			return;
-		}
-		QImage costumeImage = costumePixmap.toImage().convertToFormat(QImage::Format_ARGB32);
-		int h=0, s=0, v=0, a=0;
-		for(int y=0; y < costumeImage.height(); y++)
-		{
-			for(int x=0; x < costumeImage.width(); x++)
-			{
-				costumeImage.pixelColor(x,y).getHsv(&h,&s,&v,&a);
-				// Color effect
-				h += colorEffect*1.8;
-				h %= 360;
-				if(h < 0)
-					h += 360;
-				// Brightness effect
-				int brightness = brightnessEffect;
-				if(brightness >= 100)
-				{
-					v = 255;
-					s = 0;
-				}
-				else if(brightness > 0)
-					s -= brightness * (s/100.0);
-				else if(brightness > -100)
-					v += brightness * (v/100.0);
-				else if(brightness <= -100)
-					v = 0;
-				// Ghost effect
-				int ghost = ghostEffect;
-				if(ghost >= 100)
-					a = 0;
-				else if(ghost > 0)
-					a -= ghost * (a/100.0);
-				costumeImage.setPixelColor(x,y,QColor::fromHsv(h,s,v,a));
-			}
-		}
-		setPixmap(QPixmap::fromImage(costumeImage));
+		QElapsedTimer effectsTimer;
+		effectsTimer.start();
+		newPixmap = graphicEffectsCache.pixmap(costumes.value(costume).value("assetId").toString(), costumePixmap, effects, sceneScale);
+		FrameStats::addEffectsTime(effectsTimer.nsecsElapsed());
 	}
+	if(pixmap().cacheKey() != newPixmap.cacheKey())
+		setPixmap(newPixmap);
 }
 
 /*! Sets the sprite size. */
 void scratchSprite::setSize(qreal newSize)
 {
-	if(newSize < 0)
-		newSize = 0;
-	setScale(newSize/100.0);
-	size = newSize;
+	spriteStore.setSize(m_handle, qMax(0.0, newSize));
+	syncView();
 }
 
 /*! Sets the sprite direction. */
 void scratchSprite::setDirection(qreal angle)
 {
-	direction = angle;
-	if(direction > 180)
-		direction -= 360;
-	else if(direction < -180)
-		direction += 360;
-	resetTransform();
+	spriteStore.setDirection(m_handle, normalizeDirection(angle));
+	syncView();
+}
+
+/*!
+ * Sets the transform of the graphics item from the size, the direction and the rotation style.\n
+ * The scale, rotation and flip are combined into a single QTransform (around the rotation center),
+ * so the graphics item is only updated once.
+ */
+void scratchSprite::updateTransform(qreal size, qreal angle)
+{
 	pointingLeft = false;
+	qreal rotation = 0; // direction 90°
 	if(rotationStyle == "left-right")
-	{
-		setRotation(0); // direction 90°
-		if(direction < 0)
-		{
-			pointingLeft = true;
-			setTransform(transform().scale(-1,1));
-			setXPos(spriteX);
-			setYPos(spriteY);
-		}
-		else
-			setTransform(transform().scale(1,1));
-	}
-	else if(rotationStyle == "don't rotate")
-	{
-		setRotation(0); // direction 90°
-		setTransform(transform().scale(1,1));
-	}
+		pointingLeft = (angle < 0);
 	else if(rotationStyle == "all around")
-	{
-		setRotation(direction-90);
-		setTransform(transform().scale(1,1));
-	}
+		rotation = angle - 90;
+	QTransform transform;
+	transform.translate(rotationCenterX, rotationCenterY);
+	transform.rotate(rotation);
+	transform.scale(size / 100.0, size / 100.0);
+	transform.translate(-rotationCenterX, -rotationCenterY);
+	// Mirror horizontally around the item origin, translateX() moves the sprite back
+	if(pointingLeft)
+		transform *= QTransform::fromScale(-1, 1);
+	setTransform(transform);
 }
 
 /*!
- * Starts playing a sound and returns a pointer to the QPointer<QMediaPlayer> object of the playing sound.\n
- * Returns nullptr if the sound isn't found.
+ * Starts playing a sound in the channel of this sprite.\n
+ * If a voice ID reserved by AudioMixer::reserveVoice() is given, the sound uses it
+ * (the voice is finished immediately if the sound isn't found).\n
+ * If the sound isn't decoded yet, the voice stays reserved and starts when the decoding finishes.
  */
-QPointer<QMediaPlayer> *scratchSprite::playSound(QString soundName)
+void scratchSprite::playSound(QString soundName, quint64 voice)
 {
-	// Play the sound
 	int soundID = -1;
 	for(int i=0; i < sounds.count(); i++)
 	{
@@ -615,48 +620,79 @@ QPointer<QMediaPlayer> *scratchSprite::playSound(QString soundName)
 			break;
 		}
 	}
-	if(soundID != -1)
+	if(soundID == -1)
 	{
-		QPointer<QMediaPlayer> sound = new QMediaPlayer(this);
-		if(assetDir == "")
-		{
-			QBuffer *buffer = new QBuffer(sound);
-			buffer->setData(*projectAssets[sounds[soundID].value("assetId").toString()]);
-			buffer->open(QBuffer::ReadOnly);
-			sound->setMedia(QMediaContent(), buffer);
-		}
-		else
-			sound->setMedia(QUrl::fromLocalFile(assetDir + "/" + sounds[soundID].value("assetId").toString() + "." + sounds[soundID].value("dataFormat").toString()));
-		sound->setVolume(volume);
-		sound->play();
-		connect(sound, &QMediaPlayer::stateChanged, this, [sound](QMediaPlayer::State state) {
-			if(state == QMediaPlayer::StoppedState)
-				sound->deleteLater(); // delete the sound after it stops
-		});
-		allSounds += sound;
-		return &allSounds[allSounds.count() - 1];
+		if(voice != 0)
+			audioMixer.finish(voice);
+		return;
 	}
-	else
-		return nullptr;
+	if(voice == 0)
+		voice = audioMixer.reserveVoice();
+	pendingVoices.append(voice);
+	soundCache.request(sounds[soundID].value("assetId").toString(), assetData(sounds[soundID]), this, [this, voice](SoundBufferPtr sound) {
+		// The voice isn't pending anymore if the sounds were stopped
+		if(pendingVoices.removeOne(voice))
+			audioMixer.play(voice, sound, m_handle);
+	});
 }
 
-/*! Stops all sounds. */
-void scratchSprite::stopAllSounds(void)
+/*! Finishes the voices of sounds which are still being decoded, so they don't start later. */
+void scratchSprite::stopPendingSounds(void)
+{
+	for(int i=0; i < pendingVoices.count(); i++)
+		audioMixer.finish(pendingVoices[i]);
+	pendingVoices.clear();
+}
+
+/*!
+ * Updates the sprite when an asset is downloaded after the project started:
+ * the current costume is reloaded and sounds are decoded.
+ */
+void scratchSprite::assetLoaded(const QString &assetId)
 {
-	for(int i=0; i < allSounds.count(); i++)
+	if(costumes.value(currentCostume()).value("assetId").toString() == assetId)
 	{
-		if(!allSounds[i].isNull() && (allSounds[i]->state() == QMediaPlayer::PlayingState))
-			allSounds[i]->stop();
+		costumeCache.remove(assetId);
+		graphicEffectsCache.remove(assetId);
+		setCostume(currentCostume());
 	}
-	allSounds.clear();
+	for(int i=0; i < sounds.count(); i++)
+	{
+		if(sounds[i].value("assetId").toString() == assetId)
+			soundCache.preload(assetId, assetData(sounds[i]));
+	}
+}
+
+/*! Stops all sounds. */
+void scratchSprite::stopAllSounds(void)
+{
+	// Pending voices of all sprites are finished too (see AudioMixer::play())
+	audioMixer.stopAll();
 }
 
 /*! Sets sound volume. */
 void scratchSprite::setVolume(qreal newVolume)
 {
 	volume = newVolume;
-	for(int i=0; i < allSounds.count(); i++)
-		allSounds[i]->setVolume(newVolume/100.0);
+	audioMixer.setVolume(m_handle, newVolume);
+}
+
+/*! Sets the "PITCH" or "PAN" sound effect. Playing sounds of this sprite continue with the new value. */
+void scratchSprite::setSoundEffect(QString effect, qreal value)
+{
+	if(effect == "PITCH")
+		pitchEffect = qBound(-360.0, value, 360.0);
+	else if(effect == "PAN")
+		panEffect = qBound(-100.0, value, 100.0);
+	audioMixer.setEffects(m_handle, pitchEffect, panEffect);
+}
+
+/*! Clears the sound effects. */
+void scratchSprite::clearSoundEffects(void)
+{
+	pitchEffect = 0;
+	panEffect = 0;
+	audioMixer.setEffects(m_handle, 0, 0);
 }
 
 /*! Shows a speech or thought bubble. */
@@ -684,6 +720,7 @@ void scratchSprite::showBubble(QString text, bool thought)
 /*! Runs blocks that can be run without screen refresh.*/
 void scratchSprite::frame(void)
 {
+	m_engine->frameEvents();
 	m_engine->frame();
 }
 
@@ -696,10 +733,13 @@ Engine* scratchSprite::engine(void)
 /*! Sets scene scale. */
 void scratchSprite::setSceneScale(qreal value)
 {
+	if(value != sceneScale)
+		preparedCostume = QImage();
 	sceneScale = value;
-	setXPos(spriteX);
-	setYPos(spriteY);
-	setCostume(currentCostume);
+	spriteStore.markDirty(m_handle, SpriteStore::AllDirty);
+	syncView();
+	// The prepared costume is only needed until the sprite is added to the scene
+	preparedCostume = QImage();
 }
 
 /*! Returns true if this is a clone. */
@@ -707,3 +747,154 @@ bool scratchSprite::isClone(void)
 {
 	return m_isClone;
 }
+
+/*! Converts the direction to the range from -180 to 180. */
+qreal scratchSprite::normalizeDirection(qreal angle)
+{
+	if(angle > 180)
+		angle -= 360;
+	else if(angle < -180)
+		angle += 360;
+	return angle;
+}
+
+/*! Returns the current values of the sprite. Only the sprite itself should use this during a frame. */
+SpriteSnapshot scratchSprite::state(void)
+{
+	SpriteSnapshot out;
+	spriteStore.snapshot(m_handle, &out);
+	return out;
+}
+
+/*!
+ * Returns the values of the sprite from the start of the frame.\n
+ * Frames of sprites can run in parallel, so other sprites read these values instead of the current values.
+ */
+SpriteSnapshot scratchSprite::snapshot(void) const
+{
+	SpriteSnapshot out;
+	spriteStore.frameSnapshot(m_handle, &out);
+	return out;
+}
+
+/*!
+ * Stores the current values for snapshot().\n
+ * The values of all sprites are stored by SpriteStore#takeSnapshot() before each frame,
+ * this is used for sprites created after that (e.g. clones).
+ */
+void scratchSprite::takeSnapshot(void)
+{
+	spriteStore.takeSnapshot(m_handle);
+}
+
+/*! Stores the layer in the SpriteStore when the LayerList changes the Z value of the graphics item. */
+QVariant scratchSprite::itemChange(GraphicsItemChange change, const QVariant &value)
+{
+	if(change == ItemZValueHasChanged)
+		spriteStore.setLayer(m_handle, value.toReal());
+	return QGraphicsPixmapItem::itemChange(change, value);
+}
+
+/*! Returns the handle of the sprite in the SpriteStore. */
+int scratchSprite::handle(void) const
+{
+	return m_handle;
+}
+
+/*! Returns the X position of the sprite. */
+qreal scratchSprite::spriteX(void) const
+{
+	return spriteStore.x[m_handle];
+}
+
+/*! Returns the Y position of the sprite. */
+qreal scratchSprite::spriteY(void) const
+{
+	return spriteStore.y[m_handle];
+}
+
+/*! Returns the size of the sprite in percent. */
+qreal scratchSprite::size(void) const
+{
+	return spriteStore.size[m_handle];
+}
+
+/*! Returns the direction of the sprite. */
+qreal scratchSprite::direction(void) const
+{
+	return spriteStore.direction[m_handle];
+}
+
+/*! Returns the index of the current costume. */
+int scratchSprite::currentCostume(void) const
+{
+	return spriteStore.costume[m_handle];
+}
+
+/*!
+ * Returns the image of the costume shown by the graphics item at the scene scale (without graphic effects).\n
+ * This is the current costume after the writes are committed.
+ */
+QImage scratchSprite::currentCostumeImage(void) const
+{
+	return costumePixmap.toImage();
+}
+
+/*! Updates the parts of the graphics item which changed since the last update. */
+void scratchSprite::syncView(void)
+{
+	int flags = spriteStore.takeDirty(m_handle);
+	if(flags == 0)
+		return;
+	SpriteSnapshot state;
+	spriteStore.snapshot(m_handle, &state);
+	updateView(state, flags);
+}
+
+/*!
+ * Shows the sprite with the given values (e.g. for a pen stamp).\n
+ * The changed parts are marked as dirty, so the next syncView() shows the current values again.
+ */
+void scratchSprite::syncView(const SpriteSnapshot &state)
+{
+	int flags = 0;
+	if(state.x != view.x || state.y != view.y)
+		flags |= SpriteStore::PositionDirty;
+	if(state.size != view.size || state.direction != view.direction)
+		flags |= SpriteStore::TransformDirty;
+	if(state.costume != view.costume)
+		flags |= SpriteStore::CostumeDirty;
+	for(int i=0; i < GraphicEffects::EffectCount; i++)
+	{
+		if(state.effects[i] != view.effects[i])
+			flags |= SpriteStore::EffectsDirty;
+	}
+	if(flags == 0)
+		return;
+	spriteStore.markDirty(m_handle, flags);
+	updateView(state, flags);
+}
+
+/*! Applies the given parts (see SpriteStore::DirtyFlag) of the values to the graphics item. */
+void scratchSprite::updateView(const SpriteSnapshot &state, int flags)
+{
+	if(flags & SpriteStore::CostumeDirty)
+	{
+		loadCostume(state.costume);
+		// The rotation center and the image depend on the costume
+		flags |= SpriteStore::TransformDirty | SpriteStore::EffectsDirty;
+	}
+	if(flags & SpriteStore::TransformDirty)
+	{
+		updateTransform(state.size, state.direction);
+		// The position depends on the rotation center and the flip
+		flags |= SpriteStore::PositionDirty;
+	}
+	if(flags & SpriteStore::PositionDirty)
+		setPos(translateX(state.x), translateY(state.y));
+	if(flags & SpriteStore::EffectsDirty)
+		applyGraphicEffects(state.costume, state.effects);
+	if(flags & SpriteStore::VisibilityDirty)
+		setVisible(state.visible);
+	view = state;
+}
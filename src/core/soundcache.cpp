@@ -0,0 +1,370 @@
+/*
+ * soundcache.cpp
+ * This file is part of QScratchRuntime
+ *
+ * Copyright (C) 2023 - adazem009
+ *
+ * QScratchRuntime is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * QScratchRuntime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QScratchRuntime. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QtEndian>
+#include <QBuffer>
+#include <QEventLoop>
+#include <QTimer>
+#include <QAudioDecoder>
+#include <QtDebug>
+#ifndef Q_OS_WASM
+#include <QtConcurrent>
+#include <QFutureWatcher>
+#endif // Q_OS_WASM
+#include "core/soundcache.h"
+#include "core/audiomixer.h"
+
+SoundCache soundCache;
+
+// IMA ADPCM tables
+static const int imaIndexTable[16] = {
+	-1, -1, -1, -1, 2, 4, 6, 8,
+	-1, -1, -1, -1, 2, 4, 6, 8
+};
+
+static const int imaStepTable[89] = {
+	7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+	50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+	253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+	1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+	3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487,
+	12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+/*! Starts decoding the given sound in the background, so it's ready when it's played. */
+void SoundCache::preload(const QString &assetId, const QByteArray &data)
+{
+#ifdef Q_OS_WASM
+	Q_UNUSED(assetId);
+	Q_UNUSED(data);
+#else
+	QMutexLocker locker(&mutex);
+	if(sounds.contains(assetId) || pending.contains(assetId))
+		return;
+	pending.insert(assetId, QtConcurrent::run(&SoundCache::decode, data));
+#endif // Q_OS_WASM
+}
+
+/*!
+ * Calls the callback with the decoded sound.\n
+ * Sounds in the cache are passed immediately. Other sounds are decoded in the background and the callback
+ * is called from the event loop of the context object when the decoding finishes (it isn't called
+ * if the context object is deleted before).\n
+ * The callback gets a null pointer if the sound can't be decoded. Sounds without data (e.g. still being downloaded)
+ * aren't cached, so they can be decoded later.
+ */
+void SoundCache::request(const QString &assetId, const QByteArray &data, QObject *context, const std::function<void(SoundBufferPtr)> &callback)
+{
+	mutex.lock();
+	if(sounds.contains(assetId) || (!pending.contains(assetId) && data.isEmpty()))
+	{
+		SoundBufferPtr out = sounds.value(assetId);
+		mutex.unlock();
+		callback(out);
+		return;
+	}
+#ifdef Q_OS_WASM
+	// There are no worker threads
+	Q_UNUSED(context);
+	mutex.unlock();
+	SoundBufferPtr out = decode(data);
+	mutex.lock();
+	sounds.insert(assetId, out);
+	mutex.unlock();
+	callback(out);
+#else
+	if(!pending.contains(assetId))
+		pending.insert(assetId, QtConcurrent::run(&SoundCache::decode, data));
+	QFuture<SoundBufferPtr> future = pending.value(assetId);
+	mutex.unlock();
+	QFutureWatcher<SoundBufferPtr> *watcher = new QFutureWatcher<SoundBufferPtr>(context);
+	QObject::connect(watcher, &QFutureWatcherBase::finished, context, [this, assetId, watcher, callback]() {
+		SoundBufferPtr out = watcher->result();
+		mutex.lock();
+		// Don't cache the sound if the cache was cleared in the meantime
+		if(pending.value(assetId) == watcher->future())
+		{
+			pending.remove(assetId);
+			sounds.insert(assetId, out);
+		}
+		mutex.unlock();
+		watcher->deleteLater();
+		callback(out);
+	});
+	watcher->setFuture(future);
+#endif // Q_OS_WASM
+}
+
+/*!
+ * Waits until the background decoding finishes.\n
+ * This is used by the headless runner, so the sounds start in the same frame on every run.
+ */
+void SoundCache::waitForDecoding(void)
+{
+	QMutexLocker locker(&mutex);
+	QHash<QString,QFuture<SoundBufferPtr>>::iterator it;
+	for(it = pending.begin(); it != pending.end(); it++)
+		sounds.insert(it.key(), it.value().result());
+	pending.clear();
+}
+
+/*! Removes all sounds (e.g. when another project is loaded). Sounds which are being decoded aren't cached. */
+void SoundCache::clear(void)
+{
+	QMutexLocker locker(&mutex);
+	pending.clear();
+	sounds.clear();
+}
+
+/*! Decodes a sound and converts it to the format of the AudioMixer. Returns a null pointer on failure. */
+SoundBufferPtr SoundCache::decode(const QByteArray &data)
+{
+	QVector<float> samples;
+	int channels = 0, sampleRate = 0;
+	if(!decodeWav(data, &samples, &channels, &sampleRate) && !decodeWithQt(data, &samples, &channels, &sampleRate))
+	{
+		qWarning() << "Warning: could not decode sound";
+		return SoundBufferPtr();
+	}
+	SoundBuffer *out = new SoundBuffer;
+	out->samples = convert(samples, channels, sampleRate);
+	out->mono = (channels == 1);
+	return SoundBufferPtr(out);
+}
+
+/*!
+ * Decodes a WAV file with PCM (8, 16, 24 or 32 bit), 32-bit float or IMA ADPCM samples.\n
+ * Returns false if the data isn't a supported WAV file.
+ */
+bool SoundCache::decodeWav(const QByteArray &data, QVector<float> *samples, int *channels, int *sampleRate)
+{
+	const uchar *bytes = (const uchar*) data.constData();
+	int size = data.size();
+	if((size < 12) || (memcmp(bytes, "RIFF", 4) != 0) || (memcmp(bytes + 8, "WAVE", 4) != 0))
+		return false;
+	int format = -1, bits = 0, blockAlign = 0;
+	const uchar *sampleData = nullptr;
+	int sampleDataSize = 0;
+	qint64 offset = 12;
+	while(offset + 8 <= size)
+	{
+		quint32 chunkSize = qFromLittleEndian<quint32>(bytes + offset + 4);
+		const uchar *chunk = bytes + offset + 8;
+		int available = qMin((qint64) chunkSize, size - offset - 8);
+		if((memcmp(bytes + offset, "fmt ", 4) == 0) && (available >= 16))
+		{
+			format = qFromLittleEndian<quint16>(chunk);
+			*channels = qFromLittleEndian<quint16>(chunk + 2);
+			*sampleRate = qFromLittleEndian<quint32>(chunk + 4);
+			blockAlign = qFromLittleEndian<quint16>(chunk + 12);
+			bits = qFromLittleEndian<quint16>(chunk + 14);
+			// WAVE_FORMAT_EXTENSIBLE has the format in the sub-format GUID
+			if((format == 0xFFFE) && (available >= 26))
+				format = qFromLittleEndian<quint16>(chunk + 24);
+		}
+		else if(memcmp(bytes + offset, "data", 4) == 0)
+		{
+			sampleData = chunk;
+			sampleDataSize = available;
+		}
+		offset += 8 + chunkSize + (chunkSize & 1);
+	}
+	if(!sampleData || (*channels <= 0) || (*sampleRate <= 0) || (blockAlign <= 0))
+		return false;
+	samples->clear();
+	if(format == 1)
+	{
+		// PCM
+		int bytesPerSample = bits / 8;
+		if((bytesPerSample < 1) || (bytesPerSample > 4))
+			return false;
+		int count = sampleDataSize / bytesPerSample;
+		samples->resize(count);
+		float *out = samples->data();
+		for(int i=0; i < count; i++)
+		{
+			const uchar *sample = sampleData + i * bytesPerSample;
+			switch(bytesPerSample)
+			{
+				case 1:
+					out[i] = (sample[0] - 128) / 128.0f;
+					break;
+				case 2:
+					out[i] = qFromLittleEndian<qint16>(sample) / 32768.0f;
+					break;
+				case 3:
+					out[i] = ((qint32) ((sample[0] << 8) | (sample[1] << 16) | ((quint32) sample[2] << 24))) / 2147483648.0f;
+					break;
+				default:
+					out[i] = qFromLittleEndian<qint32>(sample) / 2147483648.0f;
+					break;
+			}
+		}
+	}
+	else if((format == 3) && (bits == 32))
+	{
+		// IEEE float
+		int count = sampleDataSize / 4;
+		samples->resize(count);
+		for(int i=0; i < count; i++)
+		{
+			quint32 value = qFromLittleEndian<quint32>(sampleData + i * 4);
+			memcpy(samples->data() + i, &value, 4);
+		}
+	}
+	else if(format == 0x11)
+		decodeImaAdpcm(sampleData, sampleDataSize, *channels, blockAlign, samples);
+	else
+		return false;
+	return true;
+}
+
+/*! Decodes IMA ADPCM blocks (used by sounds recorded in Scratch 2.0) into interleaved samples. */
+void SoundCache::decodeImaAdpcm(const uchar *data, int size, int channels, int blockAlign, QVector<float> *samples)
+{
+	int headerSize = 4 * channels;
+	if(blockAlign <= headerSize)
+		return;
+	int samplesPerBlock = (blockAlign - headerSize) * 2 / channels + 1;
+	QVector<int> predictor(channels), index(channels);
+	QVector<qint16> block(samplesPerBlock * channels);
+	for(int blockStart = 0; blockStart + blockAlign <= size; blockStart += blockAlign)
+	{
+		const uchar *in = data + blockStart;
+		for(int c=0; c < channels; c++)
+		{
+			predictor[c] = qFromLittleEndian<qint16>(in + c * 4);
+			index[c] = qBound(0, (int) in[c * 4 + 2], 88);
+			block[c] = predictor[c];
+		}
+		in += headerSize;
+		// Each channel has 4 bytes (8 samples) at a time
+		int groups = (blockAlign - headerSize) / (4 * channels);
+		for(int g=0; g < groups; g++)
+		{
+			for(int c=0; c < channels; c++)
+			{
+				for(int n=0; n < 8; n++)
+				{
+					int nibble = (in[n / 2] >> ((n & 1) * 4)) & 0x0F;
+					int step = imaStepTable[index[c]];
+					int diff = step >> 3;
+					if(nibble & 1)
+						diff += step >> 2;
+					if(nibble & 2)
+						diff += step >> 1;
+					if(nibble & 4)
+						diff += step;
+					if(nibble & 8)
+						diff = -diff;
+					predictor[c] = qBound(-32768, predictor[c] + diff, 32767);
+					index[c] = qBound(0, index[c] + imaIndexTable[nibble], 88);
+					block[(1 + g * 8 + n) * channels + c] = predictor[c];
+				}
+				in += 4;
+			}
+		}
+		for(int i=0; i < block.count(); i++)
+			samples->append(block[i] / 32768.0f);
+	}
+}
+
+/*! Decodes a sound using QAudioDecoder (e.g. MP3). Returns false if it can't be decoded. */
+bool SoundCache::decodeWithQt(const QByteArray &data, QVector<float> *samples, int *channels, int *sampleRate)
+{
+	QBuffer buffer;
+	buffer.setData(data);
+	buffer.open(QBuffer::ReadOnly);
+	QAudioDecoder decoder;
+	QAudioFormat format;
+	format.setCodec("audio/pcm");
+	format.setSampleType(QAudioFormat::SignedInt);
+	format.setSampleSize(16);
+	format.setByteOrder(QAudioFormat::LittleEndian);
+	format.setChannelCount(2);
+	format.setSampleRate(AudioMixer::sampleRate);
+	decoder.setAudioFormat(format);
+	decoder.setSourceDevice(&buffer);
+	bool failed = false;
+	*channels = 0;
+	samples->clear();
+	QEventLoop loop;
+	QObject::connect(&decoder, &QAudioDecoder::bufferReady, [&]() {
+		QAudioBuffer audioBuffer = decoder.read();
+		QAudioFormat bufferFormat = audioBuffer.format();
+		if(*channels == 0)
+		{
+			*channels = bufferFormat.channelCount();
+			*sampleRate = bufferFormat.sampleRate();
+		}
+		if((bufferFormat.sampleType() == QAudioFormat::Float) && (bufferFormat.sampleSize() == 32))
+		{
+			const float *in = audioBuffer.constData<float>();
+			for(int i=0; i < audioBuffer.sampleCount(); i++)
+				samples->append(in[i]);
+		}
+		else if((bufferFormat.sampleType() == QAudioFormat::SignedInt) && (bufferFormat.sampleSize() == 16))
+		{
+			const qint16 *in = audioBuffer.constData<qint16>();
+			for(int i=0; i < audioBuffer.sampleCount(); i++)
+				samples->append(in[i] / 32768.0f);
+		}
+		else
+		{
+			failed = true;
+			decoder.stop();
+			loop.quit();
+		}
+	});
+	QObject::connect(&decoder, &QAudioDecoder::finished, &loop, &QEventLoop::quit);
+	QObject::connect(&decoder, QOverload<QAudioDecoder::Error>::of(&QAudioDecoder::error), [&]() {
+		failed = true;
+		loop.quit();
+	});
+	// Don't wait forever if there's no decoder backend
+	QTimer::singleShot(10000, &loop, &QEventLoop::quit);
+	decoder.start();
+	if(decoder.error() != QAudioDecoder::NoError)
+		return false;
+	loop.exec();
+	return !failed && (*channels > 0) && (*sampleRate > 0) && !samples->isEmpty();
+}
+
+/*! Converts interleaved samples to stereo at AudioMixer::sampleRate (using linear interpolation). */
+QVector<float> SoundCache::convert(const QVector<float> &samples, int channels, int sampleRate)
+{
+	int inFrames = samples.count() / channels;
+	const float *in = samples.constData();
+	qreal step = (qreal) sampleRate / AudioMixer::sampleRate;
+	int outFrames = (sampleRate == AudioMixer::sampleRate) ? inFrames : (int) (inFrames / step);
+	QVector<float> out(outFrames * 2);
+	int right = (channels > 1) ? 1 : 0;
+	for(int i=0; i < outFrames; i++)
+	{
+		qreal position = i * step;
+		int frame = (int) position;
+		float t = position - frame;
+		int next = qMin(frame + 1, inFrames - 1);
+		const float *a = in + frame * channels, *b = in + next * channels;
+		out[i * 2] = a[0] + (b[0] - a[0]) * t;
+		out[i * 2 + 1] = a[right] + (b[right] - a[right]) * t;
+	}
+	return out;
+}
@@ -0,0 +1,277 @@
+/*
+ * spritestore.cpp
+ * This file is part of QScratchRuntime
+ *
+ * Copyright (C) 2023 - adazem009
+ *
+ * QScratchRuntime is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * QScratchRuntime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QScratchRuntime. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include "core/spritestore.h"
+
+SpriteStore spriteStore;
+
+/*! Creates a sprite with default values and returns its handle. Released handles are reused. */
+int SpriteStore::create(void)
+{
+	int handle;
+	if(freeHandles.isEmpty())
+	{
+		handle = x.count();
+		x.append(0);
+		y.append(0);
+		size.append(100);
+		direction.append(90);
+		costume.append(0);
+		visible.append(true);
+		layer.append(0);
+		dirty.append(AllDirty);
+		effectValues.resize(effectValues.count() + GraphicEffects::EffectCount);
+	}
+	else
+	{
+		handle = freeHandles.takeLast();
+		x[handle] = 0;
+		y[handle] = 0;
+		size[handle] = 100;
+		direction[handle] = 90;
+		costume[handle] = 0;
+		visible[handle] = true;
+		layer[handle] = 0;
+		dirty[handle] = AllDirty;
+	}
+	qreal *values = effects(handle);
+	for(int i=0; i < GraphicEffects::EffectCount; i++)
+		values[i] = 0;
+	return handle;
+}
+
+/*! Releases the given handle, so it can be used by another sprite. */
+void SpriteStore::release(int handle)
+{
+	freeHandles.append(handle);
+}
+
+/*! Returns the number of handles, including released handles. */
+int SpriteStore::capacity(void) const
+{
+	return x.count();
+}
+
+/*! Returns the graphic effect values of the given sprite (indexed by GraphicEffects::Effect). */
+qreal *SpriteStore::effects(int handle)
+{
+	return effectValues.data() + handle * GraphicEffects::EffectCount;
+}
+
+/*! Copies the values of the given sprite to out. */
+void SpriteStore::snapshot(int handle, SpriteSnapshot *out) const
+{
+	out->x = x[handle];
+	out->y = y[handle];
+	out->size = size[handle];
+	out->direction = direction[handle];
+	out->costume = costume[handle];
+	out->layer = layer[handle];
+	out->visible = visible[handle];
+	const qreal *values = effectValues.constData() + handle * GraphicEffects::EffectCount;
+	for(int i=0; i < GraphicEffects::EffectCount; i++)
+		out->effects[i] = values[i];
+}
+
+/*!
+ * Copies the values of all sprites for frameSnapshot(). This is called on the main thread before each frame.\n
+ * The arrays are copied (not shared), so writing the current values during the frame doesn't detach them.
+ */
+void SpriteStore::takeSnapshot(void)
+{
+	copyArray(x, &frameStart.x);
+	copyArray(y, &frameStart.y);
+	copyArray(size, &frameStart.size);
+	copyArray(direction, &frameStart.direction);
+	copyArray(costume, &frameStart.costume);
+	copyArray(visible, &frameStart.visible);
+	copyArray(layer, &frameStart.layer);
+	copyArray(effectValues, &frameStart.effectValues);
+}
+
+/*! Copies the values of the given sprite for frameSnapshot() (e.g. of a new clone during the frame). */
+void SpriteStore::takeSnapshot(int handle)
+{
+	// New handles are appended to the arrays
+	if(frameStart.x.count() < x.count())
+	{
+		int count = x.count();
+		frameStart.x.resize(count);
+		frameStart.y.resize(count);
+		frameStart.size.resize(count);
+		frameStart.direction.resize(count);
+		frameStart.costume.resize(count);
+		frameStart.visible.resize(count);
+		frameStart.layer.resize(count);
+		frameStart.effectValues.resize(effectValues.count());
+	}
+	frameStart.x[handle] = x[handle];
+	frameStart.y[handle] = y[handle];
+	frameStart.size[handle] = size[handle];
+	frameStart.direction[handle] = direction[handle];
+	frameStart.costume[handle] = costume[handle];
+	frameStart.visible[handle] = visible[handle];
+	frameStart.layer[handle] = layer[handle];
+	const qreal *values = effectValues.constData() + handle * GraphicEffects::EffectCount;
+	qreal *out = frameStart.effectValues.data() + handle * GraphicEffects::EffectCount;
+	for(int i=0; i < GraphicEffects::EffectCount; i++)
+		out[i] = values[i];
+}
+
+/*! Copies the values of the given sprite from the start of the frame to out. \see takeSnapshot() */
+void SpriteStore::frameSnapshot(int handle, SpriteSnapshot *out) const
+{
+	out->x = frameStart.x[handle];
+	out->y = frameStart.y[handle];
+	out->size = frameStart.size[handle];
+	out->direction = frameStart.direction[handle];
+	out->costume = frameStart.costume[handle];
+	out->layer = frameStart.layer[handle];
+	out->visible = frameStart.visible[handle];
+	const qreal *values = frameStart.effectValues.constData() + handle * GraphicEffects::EffectCount;
+	for(int i=0; i < GraphicEffects::EffectCount; i++)
+		out->effects[i] = values[i];
+}
+
+/*! Copies the array from to the array to, which doesn't share its data with other arrays. */
+template<typename T>
+void SpriteStore::copyArray(const QVector<T> &from, QVector<T> *to)
+{
+	to->resize(from.count());
+	std::copy(from.constBegin(), from.constEnd(), to->begin());
+}
+
+/*!
+ * Copies the values of the sprite with handle from to the sprite with handle to (e.g. when a clone is created).\n
+ * The layer isn't copied, because it's set by the LayerList.
+ */
+void SpriteStore::copy(int from, int to)
+{
+	x[to] = x[from];
+	y[to] = y[from];
+	size[to] = size[from];
+	direction[to] = direction[from];
+	costume[to] = costume[from];
+	visible[to] = visible[from];
+	qreal *values = effects(to);
+	const qreal *source = effects(from);
+	for(int i=0; i < GraphicEffects::EffectCount; i++)
+		values[i] = source[i];
+	dirty[to] = AllDirty;
+}
+
+/*! Sets the X position of the given sprite. */
+void SpriteStore::setX(int handle, qreal value)
+{
+	if(x[handle] != value)
+	{
+		x[handle] = value;
+		dirty[handle] |= PositionDirty;
+	}
+}
+
+/*! Sets the Y position of the given sprite. */
+void SpriteStore::setY(int handle, qreal value)
+{
+	if(y[handle] != value)
+	{
+		y[handle] = value;
+		dirty[handle] |= PositionDirty;
+	}
+}
+
+/*! Sets the size of the given sprite. */
+void SpriteStore::setSize(int handle, qreal value)
+{
+	if(size[handle] != value)
+	{
+		size[handle] = value;
+		dirty[handle] |= TransformDirty;
+	}
+}
+
+/*! Sets the direction of the given sprite. */
+void SpriteStore::setDirection(int handle, qreal value)
+{
+	if(direction[handle] != value)
+	{
+		direction[handle] = value;
+		dirty[handle] |= TransformDirty;
+	}
+}
+
+/*! Sets the costume of the given sprite. */
+void SpriteStore::setCostume(int handle, int value)
+{
+	if(costume[handle] != value)
+	{
+		costume[handle] = value;
+		dirty[handle] |= CostumeDirty;
+	}
+}
+
+/*! Shows or hides the given sprite. */
+void SpriteStore::setVisible(int handle, bool value)
+{
+	if(visible[handle] != value)
+	{
+		visible[handle] = value;
+		dirty[handle] |= VisibilityDirty;
+	}
+}
+
+/*! Stores the layer (Z value) of the given sprite. The graphics item already has this value. */
+void SpriteStore::setLayer(int handle, qreal value)
+{
+	layer[handle] = value;
+}
+
+/*! Sets the value of a graphic effect (see GraphicEffects::Effect) of the given sprite. */
+void SpriteStore::setEffect(int handle, int effect, qreal value)
+{
+	qreal *values = effects(handle);
+	if(values[effect] != value)
+	{
+		values[effect] = value;
+		dirty[handle] |= EffectsDirty;
+	}
+}
+
+/*! Resets the values of all graphic effects of the given sprite. */
+void SpriteStore::clearEffects(int handle)
+{
+	for(int i=0; i < GraphicEffects::EffectCount; i++)
+		setEffect(handle, i, 0);
+}
+
+/*! Marks the given parts (see DirtyFlag) of the graphics item of the sprite as dirty. */
+void SpriteStore::markDirty(int handle, int flags)
+{
+	dirty[handle] |= flags;
+}
+
+/*! Returns the dirty flags of the given sprite and clears them. */
+int SpriteStore::takeDirty(int handle)
+{
+	int flags = dirty[handle];
+	dirty[handle] = 0;
+	return flags;
+}
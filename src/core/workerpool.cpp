@@ -0,0 +1,163 @@
+/*
+ * workerpool.cpp
+ * This file is part of QScratchRuntime
+ *
+ * Copyright (C) 2023 - adazem009
+ *
+ * QScratchRuntime is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * QScratchRuntime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QScratchRuntime. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "core/workerpool.h"
+
+/*! Thread which runs WorkerPool::workerLoop(). */
+class WorkerPool::Worker : public QThread
+{
+	public:
+		Worker(WorkerPool *pool, int range) :
+			m_pool(pool),
+			m_range(range) { }
+
+	protected:
+		void run(void) override
+		{
+			m_pool->workerLoop(m_range);
+		}
+
+	private:
+		WorkerPool *m_pool;
+		int m_range;
+};
+
+/*! Constructs WorkerPool and starts threadCount - 1 threads (the thread which calls run() is used too). */
+WorkerPool::WorkerPool(int threadCount)
+{
+#ifdef Q_OS_WASM
+	threadCount = 1;
+#endif // Q_OS_WASM
+	threadCount = qMax(1, threadCount);
+	for(int i=0; i < threadCount; i++)
+		ranges.append(new Range);
+	for(int i=1; i < threadCount; i++)
+	{
+		Worker *worker = new Worker(this, i);
+		workers.append(worker);
+		worker->start();
+	}
+}
+
+/*! Stops the threads and destroys the WorkerPool object. */
+WorkerPool::~WorkerPool()
+{
+	mutex.lock();
+	stopping = true;
+	startCondition.wakeAll();
+	mutex.unlock();
+	for(int i=0; i < workers.count(); i++)
+	{
+		workers[i]->wait();
+		delete workers[i];
+	}
+	for(int i=0; i < ranges.count(); i++)
+		delete ranges[i];
+}
+
+/*! Returns the number of threads, including the calling thread. */
+int WorkerPool::threadCount(void) const
+{
+	return ranges.count();
+}
+
+/*! Calls task(i) for i from 0 to count - 1 in parallel and returns when all tasks have finished. */
+void WorkerPool::run(int count, const std::function<void(int)> &task)
+{
+	if((count <= 1) || workers.isEmpty())
+	{
+		for(int i=0; i < count; i++)
+			task(i);
+		return;
+	}
+	// Split the indices into contiguous ranges
+	int threads = ranges.count();
+	for(int i=0; i < threads; i++)
+	{
+		ranges[i]->begin = (qint64) count * i / threads;
+		ranges[i]->end = (qint64) count * (i + 1) / threads;
+	}
+	mutex.lock();
+	currentTask = &task;
+	busyWorkers = workers.count();
+	generation++;
+	startCondition.wakeAll();
+	mutex.unlock();
+	work(0);
+	mutex.lock();
+	while(busyWorkers > 0)
+		doneCondition.wait(&mutex);
+	currentTask = nullptr;
+	mutex.unlock();
+}
+
+/*! Takes a task from the front of the given range, or steals one from the back of another range. */
+bool WorkerPool::takeTask(int range, int *index)
+{
+	{
+		QMutexLocker locker(&ranges[range]->mutex);
+		if(ranges[range]->begin < ranges[range]->end)
+		{
+			*index = ranges[range]->begin++;
+			return true;
+		}
+	}
+	for(int i=1; i < ranges.count(); i++)
+	{
+		Range *victim = ranges[(range + i) % ranges.count()];
+		QMutexLocker locker(&victim->mutex);
+		if(victim->begin < victim->end)
+		{
+			*index = --victim->end;
+			return true;
+		}
+	}
+	return false;
+}
+
+/*! Runs tasks until there are no tasks left. */
+void WorkerPool::work(int range)
+{
+	int index;
+	while(takeTask(range, &index))
+		(*currentTask)(index);
+}
+
+/*! Main loop of the worker threads. */
+void WorkerPool::workerLoop(int range)
+{
+	quint64 lastGeneration = 0;
+	mutex.lock();
+	while(true)
+	{
+		while(!stopping && (generation == lastGeneration))
+			startCondition.wait(&mutex);
+		if(stopping)
+			break;
+		lastGeneration = generation;
+		mutex.unlock();
+		work(range);
+		mutex.lock();
+		busyWorkers--;
+		if(busyWorkers == 0)
+			doneCondition.wakeAll();
+	}
+	mutex.unlock();
+}
@@ -20,8 +20,6 @@
 
 #include "global.h"
 
-/*! List of QMediaPlayer pointers. */
-QList<QPointer<QMediaPlayer>> allSounds;
 
-/*! Map of project assets. */
-QMap<QString,QByteArray*> projectAssets = QMap<QString,QByteArray*>();
+/*! Store of project assets. */
+AssetStore projectAssets;
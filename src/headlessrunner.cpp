@@ -0,0 +1,253 @@
+/*
+ * headlessrunner.cpp
+ * This file is part of QScratchRuntime
+ *
+ * Copyright (C) 2023 - adazem009
+ *
+ * QScratchRuntime is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * QScratchRuntime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QScratchRuntime. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QCoreApplication>
+#include <QEventLoop>
+#include <QTimer>
+#include <QTextStream>
+#include <QPainter>
+#include <QJsonDocument>
+#include <QtDebug>
+#include <algorithm>
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#include <psapi.h>
+#elif defined(Q_OS_UNIX) && !defined(Q_OS_WASM)
+#include <sys/resource.h>
+#endif
+#include "headlessrunner.h"
+#include "core/engineclock.h"
+#include "core/audiomixer.h"
+#include "core/soundcache.h"
+#include "core/loudnessmeter.h"
+
+/*! Constructs HeadlessRunner. */
+HeadlessRunner::HeadlessRunner(QString projectFileName, QObject *parent) :
+	QObject(parent),
+	fileName(projectFileName),
+	scene(new projectScene(1, this))
+{
+	// Frames are run by frame()
+	scene->setTimerEnabled(false);
+}
+
+/*! Sets the number of frames to run. If it's 0, the project runs until all scripts finish. */
+void HeadlessRunner::setFrameLimit(int count)
+{
+	frameLimit = count;
+}
+
+/*! Sets a fixed frame rate. If it's 0, frames are run as fast as possible. */
+void HeadlessRunner::setFps(int value)
+{
+	fps = value;
+}
+
+/*! Enables or disables rendering of the scene into an offscreen image after each frame. */
+void HeadlessRunner::setRenderEnabled(bool enabled)
+{
+	render = enabled;
+}
+
+/*! Sets the format of the summary printed at the end of run(). */
+void HeadlessRunner::setSummaryFormat(SummaryFormat format)
+{
+	summaryFormat = format;
+}
+
+/*! Loads the project. Returns false if it can't be loaded. */
+bool HeadlessRunner::load(void)
+{
+	parser = new projectParser(fileName, "", this);
+	QList<scratchSprite*> sprites = parser->sprites(scene->sceneScale());
+	if(sprites.isEmpty())
+		return false;
+	for(int i=0; i < sprites.count(); i++)
+		scene->addItem(sprites[i]);
+	scene->loadSpriteList(sprites);
+	if(render)
+	{
+		renderTarget = QImage(480, 360, QImage::Format_ARGB32_Premultiplied);
+		renderTarget.fill(Qt::white);
+	}
+	return true;
+}
+
+/*! Runs one frame. Returns false if the run is finished. */
+bool HeadlessRunner::frame(void)
+{
+	if((frameLimit > 0) && (frameCount >= frameLimit))
+	{
+		limitReached = scene->isRunning();
+		return false;
+	}
+	if((frameLimit == 0) && (frameCount > 0) && !scene->isRunning())
+		return false;
+	QElapsedTimer timer;
+	timer.start();
+	scene->tick();
+	if(render)
+	{
+		QPainter painter(&renderTarget);
+		scene->render(&painter);
+	}
+	// Process queued signals and deleteLater() calls
+	QCoreApplication::processEvents();
+	tickTimes.append(timer.nsecsElapsed());
+	// Render the sounds until the current time (virtual time in deterministic mode)
+	audioMixer.renderTo((EngineClock::msecs() - audioStart) * AudioMixer::sampleRate / 1000);
+	// The loudness of the next frame is measured until the same time
+	loudnessMeter.processTo((EngineClock::msecs() - audioStart) * AudioMixer::sampleRate / 1000);
+	frameCount++;
+	return true;
+}
+
+/*!
+ * Starts the green flag scripts, runs the frames and prints a timing summary.\n
+ * Returns FrameLimitReached if the scripts didn't finish within the frame limit, otherwise Finished.
+ */
+int HeadlessRunner::run(void)
+{
+	// Sounds start without waiting for the decoder
+	soundCache.waitForDecoding();
+	audioStart = EngineClock::msecs();
+	scene->greenFlag();
+	QElapsedTimer timer;
+	timer.start();
+	if(fps <= 0)
+	{
+		while(frame())
+			;
+	}
+	else
+	{
+		QEventLoop loop;
+		QTimer frameTimer;
+		frameTimer.setTimerType(Qt::PreciseTimer);
+		connect(&frameTimer, &QTimer::timeout, this, [this, &loop]() {
+			if(!frame())
+				loop.quit();
+		});
+		frameTimer.start(1000 / fps);
+		loop.exec();
+	}
+	totalTime = timer.nsecsElapsed();
+	scene->stop();
+	printSummary();
+	if(limitReached)
+	{
+		qWarning() << "Warning: the frame limit was reached before all scripts finished";
+		return FrameLimitReached;
+	}
+	return Finished;
+}
+
+/*!
+ * Makes QSettings use a separate scope for headless runs, so they don't depend on the settings
+ * of the GUI (e.g. multithreading, FPS or high quality SVG) and always use the default settings.\n
+ * This must be called after the application name is set and before any settings are read.
+ */
+void HeadlessRunner::useSeparateSettings(void)
+{
+	QCoreApplication::setApplicationName(QCoreApplication::applicationName() + "-headless");
+}
+
+/*! Returns the given percentile (0-100) of the sorted tick times in nanoseconds. */
+qreal HeadlessRunner::percentile(const QVector<qint64> &sortedTimes, qreal p)
+{
+	if(sortedTimes.isEmpty())
+		return 0;
+	// Linear interpolation between the closest ranks
+	qreal rank = p / 100 * (sortedTimes.count() - 1);
+	int lower = (int) rank;
+	int upper = qMin(lower + 1, sortedTimes.count() - 1);
+	return sortedTimes[lower] + (sortedTimes[upper] - sortedTimes[lower]) * (rank - lower);
+}
+
+/*!
+ * Returns the peak resident set size of the process in KiB.\n
+ * Returns 0 if it isn't available on this platform.
+ */
+qint64 HeadlessRunner::peakMemoryUsage(void)
+{
+#if defined(Q_OS_WIN)
+	PROCESS_MEMORY_COUNTERS counters;
+	if(GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return counters.PeakWorkingSetSize / 1024;
+	return 0;
+#elif defined(Q_OS_UNIX) && !defined(Q_OS_WASM)
+	struct rusage usage;
+	if(getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+#ifdef Q_OS_MACOS
+	// macOS reports bytes
+	return usage.ru_maxrss / 1024;
+#else
+	return usage.ru_maxrss;
+#endif // Q_OS_MACOS
+#else
+	return 0;
+#endif
+}
+
+/*! Returns the number of frames, tick times (in milliseconds) and peak memory usage. */
+QJsonObject HeadlessRunner::summary(void) const
+{
+	QVector<qint64> sortedTimes = tickTimes;
+	std::sort(sortedTimes.begin(), sortedTimes.end());
+	qint64 sum = 0;
+	for(int i=0; i < sortedTimes.count(); i++)
+		sum += sortedTimes[i];
+	QJsonObject times;
+	times.insert("avg", sortedTimes.isEmpty() ? 0 : sum / 1e6 / sortedTimes.count());
+	times.insert("min", sortedTimes.isEmpty() ? 0 : sortedTimes.first() / 1e6);
+	times.insert("p50", percentile(sortedTimes, 50) / 1e6);
+	times.insert("p90", percentile(sortedTimes, 90) / 1e6);
+	times.insert("p99", percentile(sortedTimes, 99) / 1e6);
+	times.insert("max", sortedTimes.isEmpty() ? 0 : sortedTimes.last() / 1e6);
+	QJsonObject out;
+	out.insert("frames", frameCount);
+	out.insert("totalTimeMs", totalTime / 1e6);
+	out.insert("ticksPerSecond", totalTime > 0 ? frameCount / (totalTime / 1e9) : 0);
+	out.insert("tickTimeMs", times);
+	out.insert("peakRssKiB", peakMemoryUsage());
+	out.insert("recentPhasesMs", scene->frameStats().toJson());
+	return out;
+}
+
+/*! Prints the summary as text or JSON. */
+void HeadlessRunner::printSummary(void)
+{
+	QTextStream out(stdout);
+	QJsonObject data = summary();
+	if(summaryFormat == JsonSummary)
+	{
+		out << QJsonDocument(data).toJson(QJsonDocument::Compact) << "\n";
+		return;
+	}
+	QJsonObject times = data.value("tickTimeMs").toObject();
+	out << "Frames: " << frameCount << "\n";
+	out << "Total time: " << data.value("totalTimeMs").toDouble() << " ms\n";
+	out << "Ticks per second: " << data.value("ticksPerSecond").toDouble() << "\n";
+	out << "Tick time: avg " << times.value("avg").toDouble() << " ms, min " << times.value("min").toDouble() << " ms, max " << times.value("max").toDouble() << " ms\n";
+	out << "Tick time percentiles: p50 " << times.value("p50").toDouble() << " ms, p90 " << times.value("p90").toDouble() << " ms, p99 " << times.value("p99").toDouble() << " ms\n";
+	out << "Peak memory usage: " << data.value("peakRssKiB").toDouble() << " KiB\n";
+	out << "\nPhases of the last frames:\n" << scene->frameStats().text() << "\n";
+}
@@ -0,0 +1,91 @@
+/*
+ * assetcache.h
+ * This file is part of QScratchRuntime
+ *
+ * Copyright (C) 2023 - adazem009
+ *
+ * QScratchRuntime is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * QScratchRuntime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QScratchRuntime. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ASSETCACHE_H
+#define ASSETCACHE_H
+
+#include <QObject>
+#include <QMap>
+#include <QHash>
+#include <QList>
+#include <QByteArray>
+#include <QMutex>
+#include <QThreadPool>
+#include "core/assetstore.h"
+
+/*!
+ * \brief The AssetCache class keeps downloaded assets in a directory on disk.
+ *
+ * Scratch asset IDs are MD5 hashes of the asset data, so the cache is content-addressed:
+ * a cached file is valid if its hash matches its name, regardless of the project it was downloaded for.
+ * Cached files are verified in parallel when a project is loaded and files which don't match are removed.\n
+ * The total size of the cache is limited. When it's exceeded, the least recently used files are removed
+ * (the modification time of the files is used as the time of the last use, so the order is kept between runs).\n
+ * Downloaded assets are verified and written by insertLater() on a writer thread, so a project which is running
+ * isn't interrupted.
+ */
+class AssetCache : public QObject
+{
+	Q_OBJECT
+	public:
+		explicit AssetCache(const QString &directory, qint64 maxSize, QObject *parent = nullptr);
+		~AssetCache();
+		QString directory(void) const;
+		qint64 maxSize(void) const;
+		qint64 size(void) const;
+		QList<QMap<QString,QString>> load(const QList<QMap<QString,QString>> &assets, AssetStore *store);
+		bool insert(const QString &assetId, const QString &dataFormat, const QByteArray &data);
+		void insertLater(const QString &assetId, const QString &dataFormat, const QByteArray &data);
+		void waitForWrites(void);
+		void clear(void);
+		static bool verify(const QString &assetId, const QByteArray &data);
+		static qint64 maxSizeSetting(void);
+
+	signals:
+		/*!
+		 * Emitted from the writer thread when an asset passed to insertLater() is written
+		 * (ok is false if it doesn't match its ID or it couldn't be written). Use a queued connection.
+		 */
+		void assetWritten(const QString &assetId, bool ok);
+
+	private:
+		Q_DISABLE_COPY(AssetCache)
+		/*! Cached file. */
+		struct Entry
+		{
+			QString fileName;
+			qint64 size;
+			qint64 lastUse;
+		};
+		void scan(void);
+		void touch(const QString &assetId);
+		void remove(const QString &assetId);
+		void evict(void);
+		QString m_directory;
+		qint64 m_maxSize;
+		qint64 m_size = 0;
+		qint64 useCounter = 0;
+		QHash<QString,Entry> entries;
+		QMap<qint64,QString> lruList; // least recently used first
+		mutable QMutex mutex;
+		QThreadPool writer;
+};
+
+#endif // ASSETCACHE_H
@@ -0,0 +1,117 @@
+/*
+ * assetfetcher.h
+ * This file is part of QScratchRuntime
+ *
+ * Copyright (C) 2023 - adazem009
+ *
+ * QScratchRuntime is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * QScratchRuntime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QScratchRuntime. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ASSETFETCHER_H
+#define ASSETFETCHER_H
+
+#include <QObject>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QTimer>
+#include <QMap>
+#include <QList>
+#include <QSet>
+#include <QHash>
+#include "core/assetstore.h"
+#include "core/assetcache.h"
+
+/*!
+ * \brief The AssetFetcher class downloads assets into an AssetStore.
+ *
+ * At most maxConcurrent() requests run at the same time, the other assets wait in a queue
+ * ordered by priority (assets needed by running scripts can be moved to the front by prioritize()).
+ * Requests which fail with a transient error (e.g. a network or server error) or which don't receive
+ * any data for transferTimeout() ms are retried with an exponential backoff. Each request keeps its own context (the asset and the received data),
+ * so replies are handled without searching the list of assets.\n
+ * The data is appended to the request buffer as it arrives and added to the store (and to the AssetCache,
+ * if it's set) when the reply is finished.
+ */
+class AssetFetcher : public QObject
+{
+	Q_OBJECT
+	public:
+		explicit AssetFetcher(AssetStore *store, QObject *parent = nullptr);
+		~AssetFetcher();
+		void setUrlTemplate(const QString &urlTemplate);
+		QString urlTemplate(void) const;
+		void setMaxConcurrent(int count);
+		int maxConcurrent(void) const;
+		void setMaxRetries(int count);
+		int maxRetries(void) const;
+		void setTransferTimeout(int msecs);
+		int transferTimeout(void) const;
+		void setCache(AssetCache *cache);
+		void fetch(const QList<QMap<QString,QString>> &assets, int priority = 0);
+		Q_INVOKABLE void prioritize(const QString &assetId);
+		void abort(void);
+		int total(void) const;
+		int loadedCount(void) const;
+		int failedCount(void) const;
+		int runningCount(void) const;
+		bool isFinished(void) const;
+
+	signals:
+		/*! Emitted when an asset is added to the store. */
+		void assetLoaded(const QString &assetId);
+		/*! Emitted when an asset can't be downloaded. */
+		void assetFailed(const QString &assetId);
+		/*! Emitted when a request is finished (including failed requests). */
+		void progress(int finished, int total);
+		/*! Emitted when all assets are loaded or failed. */
+		void finished(void);
+
+	private:
+		/*! Download of an asset. */
+		struct Request
+		{
+			QMap<QString,QString> asset;
+			QNetworkReply *reply = nullptr;
+			QTimer *timer = nullptr; // transfer timeout
+			bool timedOut = false;
+			QByteArray data;
+			int attempts = 0;
+			int priority = 0;
+		};
+		void enqueue(Request *request, bool front = false);
+		void startRequests(void);
+		void start(Request *request);
+		void receive(Request *request);
+		void finish(Request *request);
+		void checkFinished(void);
+		static bool isTransient(QNetworkReply::NetworkError error);
+		QNetworkAccessManager *manager;
+		AssetStore *m_store;
+		AssetCache *m_cache = nullptr;
+		QString m_urlTemplate;
+		int m_maxConcurrent = 6;
+		int m_maxRetries = 3;
+		int m_transferTimeout = 30000;
+		QMap<int,QList<Request*>> queue; // lower values first
+		QHash<QString,Request*> queued;
+		QSet<Request*> running;
+		QSet<Request*> delayed; // waiting for a retry
+		int generation = 0;
+		int m_total = 0;
+		int loaded = 0;
+		int failed = 0;
+		bool finishedEmitted = true;
+};
+
+#endif // ASSETFETCHER_H
@@ -0,0 +1,68 @@
+/*
+ * assetstore.h
+ * This file is part of QScratchRuntime
+ *
+ * Copyright (C) 2023 - adazem009
+ *
+ * QScratchRuntime is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * QScratchRuntime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QScratchRuntime. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ASSETSTORE_H
+#define ASSETSTORE_H
+
+#include <QMap>
+#include <QList>
+#include <QFile>
+#include <QByteArray>
+#include <QMutex>
+#include <QSet>
+#include <functional>
+
+/*!
+ * \brief The AssetStore class holds the assets (costumes and sounds) of the loaded project.
+ *
+ * Asset files are memory-mapped once and returned as QByteArray views of the mapped memory,
+ * so the decoders can read them without copying.\n
+ * All functions are thread-safe, so assets can be added from worker threads while loading.\n
+ * When a project starts before all assets are downloaded, the missing assets are marked as pending.
+ * Scripts can request a pending asset, so it's downloaded before the other ones.
+ */
+class AssetStore
+{
+	public:
+		AssetStore();
+		~AssetStore();
+		QByteArray asset(const QString &assetId) const;
+		QByteArray mapFile(const QString &assetId, const QString &fileName);
+		QByteArray mapData(const QString &fileName);
+		void insert(const QString &assetId, const QByteArray &data);
+		bool contains(const QString &assetId) const;
+		void setPending(const QStringList &assetIds);
+		bool isPending(const QString &assetId) const;
+		void removePending(const QString &assetId);
+		void request(const QString &assetId);
+		void setRequestHandler(std::function<void(const QString&)> handler);
+		void clear(void);
+
+	private:
+		Q_DISABLE_COPY(AssetStore)
+		QMap<QString,QByteArray> assets;
+		QList<QFile*> mappedFiles;
+		QList<QByteArray> readFiles; // files which couldn't be mapped, kept for the views of their data
+		QSet<QString> pending;
+		std::function<void(const QString&)> requestHandler;
+		mutable QMutex mutex;
+};
+
+#endif // ASSETSTORE_H
@@ -0,0 +1,124 @@
+/*
+ * audioinput.h
+ * This file is part of QScratchRuntime
+ *
+ * Copyright (C) 2023 - adazem009
+ *
+ * QScratchRuntime is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * QScratchRuntime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QScratchRuntime. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef AUDIOINPUT_H
+#define AUDIOINPUT_H
+
+#include <QIODevice>
+#include <QVector>
+#include <QAtomicInteger>
+#include <QAudioInput>
+#include <QAudioDeviceInfo>
+
+/*!
+ * \brief The AudioInput class is the source of the samples measured by the LoudnessMeter.
+ *
+ * Inputs write mono samples at AudioMixer::sampleRate into a lock-free single-producer single-consumer
+ * ring buffer, which is read by the meter.\n
+ * Real-time inputs produce the samples as time passes and are read by the meter thread.
+ * Other inputs are fed by LoudnessMeter::processTo(), which follows the EngineClock (e.g. in headless mode).
+ */
+class AudioInput
+{
+	public:
+		AudioInput();
+		virtual ~AudioInput() { }
+		/*! Returns true if the input produces the samples in real time. */
+		virtual bool isRealTime(void) const = 0;
+		/*! Starts capturing (inputs which are always available ignore this). This can be called from any thread. */
+		virtual void start(void) { }
+		/*! Produces the samples until the given frame of the input stream. Inputs fed by a device ignore this. */
+		virtual void update(qint64 frame) = 0;
+		int read(float *samples, int count);
+
+	protected:
+		int write(const float *samples, int count);
+
+	private:
+		Q_DISABLE_COPY(AudioInput)
+		QVector<float> ring;
+		QAtomicInteger<qint64> writePosition, readPosition; // in samples
+};
+
+/*! \brief The WavFileAudioInput class plays a sound file (e.g. a WAV file) in a loop. */
+class WavFileAudioInput : public AudioInput
+{
+	public:
+		explicit WavFileAudioInput(const QString &fileName, bool realTime = false);
+		bool isOpen(void) const;
+		bool isRealTime(void) const override;
+		void update(qint64 frame) override;
+
+	private:
+		bool m_realTime;
+		QVector<float> samples;
+		qint64 position = 0;
+};
+
+/*!
+ * \brief The ToneAudioInput class generates a sine tone with the given amplitude (0 - 1).
+ *
+ * If a period is set, the tone is interrupted by silence of the same length,
+ * which is useful to test scripts started by loud sounds without a microphone.
+ */
+class ToneAudioInput : public AudioInput
+{
+	public:
+		explicit ToneAudioInput(qreal amplitude, int period = 0, bool realTime = false);
+		bool isRealTime(void) const override;
+		void update(qint64 frame) override;
+
+	private:
+		qreal m_amplitude;
+		qint64 periodFrames;
+		bool m_realTime;
+		qint64 position = 0;
+};
+
+/*!
+ * \brief The DeviceAudioInput class captures the samples from the default audio input device (microphone).
+ *
+ * The device isn't opened until start() is called (i.e. until a project uses the loudness).
+ * QAudioInput writes the samples in push mode, they're converted and written into the ring buffer.
+ */
+class DeviceAudioInput : public QIODevice, public AudioInput
+{
+	Q_OBJECT
+	public:
+		explicit DeviceAudioInput(QObject *parent = nullptr);
+		~DeviceAudioInput();
+		bool isRealTime(void) const override;
+		void start(void) override;
+		void update(qint64 frame) override;
+		bool isSequential(void) const override;
+
+	protected:
+		qint64 readData(char *data, qint64 maxSize) override;
+		qint64 writeData(const char *data, qint64 maxSize) override;
+
+	private slots:
+		void startCapture(void);
+
+	private:
+		QAudioInput *input = nullptr;
+		QAtomicInt startRequested;
+};
+
+#endif // AUDIOINPUT_H
@@ -0,0 +1,109 @@
+/*
+ * audiomixer.h
+ * This file is part of QScratchRuntime
+ *
+ * Copyright (C) 2023 - adazem009
+ *
+ * QScratchRuntime is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * QScratchRuntime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QScratchRuntime. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef AUDIOMIXER_H
+#define AUDIOMIXER_H
+
+#include <QVector>
+#include <QHash>
+#include <QMutex>
+#include <QAtomicInteger>
+#include "core/soundcache.h"
+#include "core/audiosink.h"
+
+/*!
+ * \brief The AudioMixer class mixes all playing sounds into a single output stream.
+ *
+ * Each playing sound is a voice, which belongs to a channel (the SpriteStore handle of the sprite)
+ * with its own volume, pitch and pan. Voices are resampled (if the pitch effect is used), panned
+ * and summed block by block (with SSE2 if it's available) and the result is written to the AudioSink.
+ * Changes of the channel settings are applied to the playing voices at the next block, the gains
+ * are ramped over the block to avoid clicks.\n
+ * The end of each voice is recorded as a frame of the output stream, so isPlaying() returns false
+ * exactly when the sink has played the last frame of the sound.\n
+ * Voice IDs can be reserved before the sound is started, so scripts running on worker threads
+ * can wait for sounds which are started when the writes are committed.
+ */
+class AudioMixer
+{
+	public:
+		static const int sampleRate = 48000;
+		static const int blockSize = 256;
+		AudioMixer();
+		~AudioMixer();
+		void setSink(AudioSink *sink);
+		AudioSink *sink(void) const;
+		quint64 reserveVoice(void);
+		void play(quint64 voice, const SoundBufferPtr &sound, int channel);
+		void finish(quint64 voice);
+		bool isPlaying(quint64 voice) const;
+		void stopAll(void);
+		void stopChannel(int channel);
+		void releaseChannel(int channel);
+		void setVolume(int channel, qreal volume);
+		void setEffects(int channel, qreal pitch, qreal pan);
+		int voiceCount(void) const;
+		void renderAvailable(void);
+		void renderTo(qint64 frame);
+		qint64 renderedFrames(void) const;
+		static void toInt16(const float *in, qint16 *out, int count);
+		static int resample(const float *samples, int frameCount, double *position, double step, float *out, int frames);
+		static void mixPanned(float *out, const float *in, int frames, const float *fromGains, const float *toGains);
+
+	private:
+		Q_DISABLE_COPY(AudioMixer)
+		/*! Settings of a channel. */
+		struct Channel
+		{
+			float volume = 1;
+			double rate = 1; // playback rate set by the pitch effect
+			float pan = 0;
+		};
+		/*! Playing sound. */
+		struct Voice
+		{
+			quint64 id;
+			SoundBufferPtr sound;
+			double position; // in frames of the sound
+			int channel;
+			float gains[4]; // gains of the last block, see channelGains()
+			bool started;
+		};
+		static void channelGains(const Channel &channel, bool mono, float *gains);
+		class Thread;
+		void render(int frames);
+		void threadLoop(void);
+		mutable QMutex mutex;
+		QVector<Voice> voices;
+		QHash<int,Channel> channels;
+		QHash<quint64,qint64> voiceEnds;
+		QAtomicInteger<quint64> nextVoice;
+		QAtomicInt stopping;
+		AudioSink *m_sink = nullptr;
+		Thread *thread = nullptr;
+		QVector<float> mixBuffer;
+		QVector<float> voiceBuffer;
+		QVector<qint16> outBuffer;
+		qint64 frames = 0;
+};
+
+extern AudioMixer audioMixer;
+
+#endif // AUDIOMIXER_H
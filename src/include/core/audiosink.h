@@ -0,0 +1,117 @@
+/*
+ * audiosink.h
+ * This file is part of QScratchRuntime
+ *
+ * Copyright (C) 2023 - adazem009
+ *
+ * QScratchRuntime is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * QScratchRuntime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QScratchRuntime. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef AUDIOSINK_H
+#define AUDIOSINK_H
+
+#include <QIODevice>
+#include <QFile>
+#include <QVector>
+#include <QAtomicInteger>
+#include <QElapsedTimer>
+#include <QAudioOutput>
+#include <QAudioDeviceInfo>
+
+/*!
+ * \brief The AudioSink class is the output of the AudioMixer.
+ *
+ * Sinks receive interleaved 16-bit stereo samples at AudioMixer::sampleRate.\n
+ * Real-time sinks are fed by the mixer thread whenever they can take more frames.
+ * Other sinks (e.g. a file in headless mode) are fed by AudioMixer::renderTo(), which follows the EngineClock.
+ */
+class AudioSink
+{
+	public:
+		virtual ~AudioSink() { }
+		/*! Returns true if the sink plays in real time. */
+		virtual bool isRealTime(void) const = 0;
+		/*! Returns the number of frames the sink can take now (only used by real-time sinks). */
+		virtual int writableFrames(void) = 0;
+		/*! Writes the given number of frames. */
+		virtual void write(const qint16 *samples, int frames) = 0;
+		/*! Returns the number of frames which were played. This is used to report the end of sounds. */
+		virtual qint64 playedFrames(void) const = 0;
+};
+
+/*! \brief The NullAudioSink class drops all samples (e.g. in headless mode or without an audio device). */
+class NullAudioSink : public AudioSink
+{
+	public:
+		explicit NullAudioSink(bool realTime = false);
+		bool isRealTime(void) const override;
+		int writableFrames(void) override;
+		void write(const qint16 *samples, int frames) override;
+		qint64 playedFrames(void) const override;
+
+	private:
+		bool m_realTime;
+		QElapsedTimer timer;
+		QAtomicInteger<qint64> writtenFrames;
+};
+
+/*! \brief The WavFileAudioSink class writes the samples into a WAV file. */
+class WavFileAudioSink : public AudioSink
+{
+	public:
+		explicit WavFileAudioSink(const QString &fileName);
+		~WavFileAudioSink();
+		bool isOpen(void) const;
+		bool isRealTime(void) const override;
+		int writableFrames(void) override;
+		void write(const qint16 *samples, int frames) override;
+		qint64 playedFrames(void) const override;
+
+	private:
+		void writeHeader(void);
+		QFile file;
+		QAtomicInteger<qint64> writtenFrames;
+};
+
+/*!
+ * \brief The DeviceAudioSink class plays the samples on the default audio output device.
+ *
+ * QAudioOutput pulls the samples from a lock-free single-producer single-consumer ring buffer,
+ * which is filled by the mixer thread.
+ */
+class DeviceAudioSink : public QIODevice, public AudioSink
+{
+	Q_OBJECT
+	public:
+		explicit DeviceAudioSink(QObject *parent = nullptr);
+		~DeviceAudioSink();
+		bool isRealTime(void) const override;
+		int writableFrames(void) override;
+		void write(const qint16 *samples, int frames) override;
+		qint64 playedFrames(void) const override;
+		bool isSequential(void) const override;
+		qint64 bytesAvailable(void) const override;
+
+	protected:
+		qint64 readData(char *data, qint64 maxSize) override;
+		qint64 writeData(const char *data, qint64 maxSize) override;
+
+	private:
+		QAudioOutput *output;
+		QVector<qint16> ring;
+		int capacity; // in frames
+		QAtomicInteger<qint64> writePosition, readPosition; // in frames
+};
+
+#endif // AUDIOSINK_H
@@ -42,6 +42,12 @@ class Blocks : public QObject
 		bool soundBlocks(QString opcode, QMap<QString,QString> inputs, QString *returnValue = nullptr);
 		bool eventBlocks(QString opcode, QMap<QString,QString> inputs, QString *returnValue = nullptr);
 		bool controlBlocks(QString opcode, QMap<QString,QString> inputs, QString *returnValue = nullptr);
+		bool penBlocks(QString opcode, QMap<QString,QString> inputs, QString *returnValue = nullptr);
+		bool sensingBlocks(QString opcode, QMap<QString,QString> inputs, QString *returnValue = nullptr);
+		bool waitForAsset(const QVariantMap &asset);
+		bool waitForSound(const QString &soundName);
+		PenLayer *penLayer(void);
+		SpriteSnapshot spriteState(scratchSprite *target);
 };
 
 #endif // BLOCKS_H
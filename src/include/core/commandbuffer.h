@@ -0,0 +1,97 @@
+/*
+ * commandbuffer.h
+ * This file is part of QScratchRuntime
+ *
+ * Copyright (C) 2023 - adazem009
+ *
+ * QScratchRuntime is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * QScratchRuntime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QScratchRuntime. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef COMMANDBUFFER_H
+#define COMMANDBUFFER_H
+
+#include <QVector>
+#include <QString>
+#include <QPointF>
+#include "core/penlayer.h"
+#include "core/spritestore.h"
+
+/*!
+ * \brief The CommandBuffer class records changes of a sprite and the scene during a frame.
+ *
+ * Frames can run on worker threads, so blocks don't change the graphics item, other sprites or the scene.
+ * They record small typed commands instead, which are applied on the main thread after the frame
+ * (see Engine#commitWrites()). Values of sprites (e.g. the position) are stored in the SpriteStore
+ * and the graphics items are updated from it after the commands are applied.\n
+ * Text, pen lines and stamps are stored in separate arrays.
+ * The arrays keep their capacity when the buffer is cleared, so recording doesn't allocate in most frames.
+ */
+class CommandBuffer
+{
+	public:
+		enum Type
+		{
+			ShowBubbleCommand, /*!< text, value is 1 for a thought bubble */
+			GoToFrontCommand,
+			GoToBackCommand,
+			MoveLayersCommand, /*!< value is the number of layers */
+			SetBackdropCommand, /*!< value is the backdrop, pointer is the waiting script or nullptr */
+			BroadcastCommand, /*!< text, pointer is the waiting script or nullptr */
+			CreateCloneCommand, /*!< pointer is the sprite to clone */
+			StopAllCommand,
+			DeleteCloneCommand,
+			PlaySoundCommand, /*!< text, value is a reserved voice ID of the AudioMixer or 0 */
+			StopAllSoundsCommand,
+			SetVolumeCommand,
+			SetSoundEffectCommand, /*!< text is the effect ("PITCH" or "PAN"), value */
+			ClearSoundEffectsCommand,
+			PenClearCommand,
+			PenLineCommand,
+			PenStampCommand /*!< values of the sprite when the stamp was made */
+		};
+		/*! Recorded command. */
+		struct Command
+		{
+			Type type;
+			int index; /*!< Index of the text or pen line. */
+			qreal value;
+			void *pointer;
+		};
+		/*! Line drawn by the pen (in Scratch coordinates). */
+		struct PenLine
+		{
+			QPointF from;
+			QPointF to;
+			PenState pen;
+		};
+		CommandBuffer();
+		void append(Type type, qreal value = 0, void *pointer = nullptr);
+		void appendText(Type type, const QString &text, qreal value = 0, void *pointer = nullptr);
+		void appendPenLine(QPointF from, QPointF to, const PenState &pen);
+		void appendStamp(const SpriteSnapshot &state);
+		int count(void) const;
+		const Command &at(int index) const;
+		const QString &text(const Command &command) const;
+		const PenLine &penLine(const Command &command) const;
+		const SpriteSnapshot &stamp(const Command &command) const;
+		void clear(void);
+
+	private:
+		QVector<Command> commands;
+		QVector<QString> texts;
+		QVector<PenLine> penLines;
+		QVector<SpriteSnapshot> stamps;
+};
+
+#endif // COMMANDBUFFER_H
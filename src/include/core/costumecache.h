@@ -0,0 +1,68 @@
+/*
+ * costumecache.h
+ * This file is part of QScratchRuntime
+ *
+ * Copyright (C) 2023 - adazem009
+ *
+ * QScratchRuntime is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * QScratchRuntime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QScratchRuntime. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef COSTUMECACHE_H
+#define COSTUMECACHE_H
+
+#include <QPixmap>
+#include <QCache>
+#include <QHash>
+
+/*! Cache key of a decoded costume. */
+struct CostumeKey
+{
+	QString costume; /*!< Asset ID of the costume. */
+	qreal scale;
+	bool hqSvg;
+	bool operator==(const CostumeKey &other) const
+	{
+		return (costume == other.costume) && (scale == other.scale) && (hqSvg == other.hqSvg);
+	}
+};
+
+inline uint qHash(const CostumeKey &key, uint seed = 0)
+{
+	return qHash(key.costume, seed) ^ (qHash(key.scale, seed) << 1) ^ key.hqSvg;
+}
+
+/*!
+ * \brief The CostumeCache class keeps the decoded costume pixmaps of all sprites.
+ *
+ * Switching to a costume which was shown before returns the same pixmap, so it isn't decoded again
+ * and caches keyed by the pixmap (e.g. the stamp cache of the PenLayer) can reuse their entries.
+ * Clones and other sprites using the same costume share the pixmaps.
+ * The cache is only used on the GUI thread.
+ */
+class CostumeCache
+{
+	public:
+		CostumeCache();
+		QPixmap pixmap(const QString &costume, qreal scale, bool hqSvg);
+		void insert(const QString &costume, qreal scale, bool hqSvg, const QPixmap &pixmap);
+		void remove(const QString &costume);
+		void clear(void);
+
+	private:
+		QCache<CostumeKey,QPixmap> cache;
+};
+
+extern CostumeCache costumeCache;
+
+#endif // COSTUMECACHE_H
@@ -23,6 +23,8 @@
 
 #include <QObject>
 #include <QVariantMap>
+#include "core/commandbuffer.h"
+#include "core/randomgenerator.h"
 
 class scratchSprite;
 class Blocks;
@@ -33,31 +35,33 @@ class Engine : public QObject
 	Q_OBJECT
 	public:
 		explicit Engine(scratchSprite *sprite, QObject *parent = nullptr);
+		void frameEvents(void);
 		void frame(void);
-		QMap<QString,QString> getInputs(QVariantMap block, bool readFields = false);
+		QMap<QString,QString> getInputs(const QVariantMap &block, bool readFields = false);
+		void setX(qreal x);
+		void setY(qreal y);
+		void setSize(qreal size);
+		void setDirection(qreal angle);
+		void setCostume(int id);
+		void setRotationStyle(const QString &style);
+		void setVisible(bool visible);
+		void resetGraphicEffects(void);
+		void showBubble(QString text, bool thought = false);
+		void commitWrites(void);
 		QList<QVariantMap> currentExecPos;
 		bool runFrameAgain;
 		int processID;
 		QVariantMap *newStack;
 		bool frameEnd, processEnd;
+		RandomGenerator random;
+		CommandBuffer commands;
 
 	private:
 		void spriteTimerEvent(void);
+		void spriteLoudnessEvent(const QString &blockID, qreal value);
+		void restartScript(const QString &topLevelBlock);
 		scratchSprite *m_sprite;
 		Blocks *blocks;
-
-	signals:
-		void setSceneScale(qreal value);
-		void setX(qreal x);
-		void setY(qreal y);
-		void setSize(qreal size);
-		void setDirection(qreal angle);
-		void setCostume(int id, QVariantMap *scripts = nullptr);
-		void resetGraphicEffects(void);
-		void installGraphicEffects(void);
-		void showBubble(QString text, bool thought = false);
-		void setVisible(bool visible);
-		void setZValue(qreal z);
 };
 
 #endif // ENGINE_H
@@ -0,0 +1,47 @@
+/*
+ * engineclock.h
+ * This file is part of QScratchRuntime
+ *
+ * Copyright (C) 2023 - adazem009
+ *
+ * QScratchRuntime is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * QScratchRuntime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QScratchRuntime. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ENGINECLOCK_H
+#define ENGINECLOCK_H
+
+#include <QElapsedTimer>
+
+/*!
+ * \brief The EngineClock class provides the time used by blocks (waits, glides, timer).
+ *
+ * By default it follows the real time. In virtual mode the time advances by a fixed step
+ * on every frame, so repeated runs of a project give identical results.
+ */
+class EngineClock
+{
+	public:
+		static qint64 msecs(void);
+		static void setVirtual(bool enabled, qreal stepMsecs = 1000.0 / 30);
+		static bool isVirtual(void);
+		static void advance(void);
+
+	private:
+		static QElapsedTimer realTimer;
+		static bool virtualMode;
+		static qreal virtualTime;
+		static qreal step;
+};
+
+#endif // ENGINECLOCK_H
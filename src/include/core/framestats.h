@@ -0,0 +1,78 @@
+/*
+ * framestats.h
+ * This file is part of QScratchRuntime
+ *
+ * Copyright (C) 2023 - adazem009
+ *
+ * QScratchRuntime is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * QScratchRuntime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QScratchRuntime. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FRAMESTATS_H
+#define FRAMESTATS_H
+
+#include <QVector>
+#include <QString>
+#include <QJsonObject>
+#include <atomic>
+
+/*!
+ * \brief The FrameStats class keeps rolling statistics of the phases of recent frames.
+ *
+ * Each phase keeps the durations of the last frames (300 by default, i.e. 10 seconds at 30 FPS),
+ * which are used to compute percentiles. The timer jitter is the difference between
+ * the measured and expected interval of the frame timer.
+ */
+class FrameStats
+{
+	public:
+		enum Phase
+		{
+			EventsPhase, /*!< Hat blocks checked on every frame (e.g. timer events). */
+			ScriptsPhase, /*!< Script execution. */
+			CloneDeletionPhase,
+			CloneCreationPhase,
+			EffectsPhase, /*!< Graphic effects (this is a part of the scripts and clone creation phases). */
+			PenPhase, /*!< Drawing of the queued pen lines and stamps. */
+			PaintingPhase, /*!< Scene painting, which runs after the frame. */
+			TickPhase, /*!< The whole frame (without painting). */
+			PhaseCount
+		};
+		explicit FrameStats(int windowSize = 300);
+		void addSample(Phase phase, qint64 nsecs);
+		void addJitter(qint64 nsecs);
+		qreal percentile(Phase phase, qreal p) const;
+		qreal jitterPercentile(qreal p) const;
+		void clear(void);
+		QString text(void) const;
+		QJsonObject toJson(void) const;
+		static QString phaseName(Phase phase);
+		static void addEffectsTime(qint64 nsecs);
+		static qint64 takeEffectsTime(void);
+
+	private:
+		/*! Ring buffer of the last samples. */
+		struct Window
+		{
+			QVector<qint64> samples;
+			int next = 0;
+		};
+		void add(Window &window, qint64 value);
+		static qreal windowPercentile(const Window &window, qreal p);
+		int m_windowSize;
+		Window windows[PhaseCount];
+		Window jitter;
+		static std::atomic<qint64> effectsTime;
+};
+
+#endif // FRAMESTATS_H
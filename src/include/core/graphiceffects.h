@@ -0,0 +1,119 @@
+/*
+ * graphiceffects.h
+ * This file is part of QScratchRuntime
+ *
+ * Copyright (C) 2023 - adazem009
+ *
+ * QScratchRuntime is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * QScratchRuntime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QScratchRuntime. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GRAPHICEFFECTS_H
+#define GRAPHICEFFECTS_H
+
+#include <QImage>
+#include <QPixmap>
+#include <QCache>
+#include <QHash>
+#include <QMap>
+
+/*! Values of the graphic effects which modify the costume image (the ghost effect is applied as opacity). */
+struct ImageEffects
+{
+	qreal color = 0;
+	qreal brightness = 0;
+	qreal fisheye = 0;
+	qreal whirl = 0;
+	qreal pixelate = 0;
+	qreal mosaic = 0;
+	bool isNull(void) const;
+	bool hasDistortion(void) const;
+	bool operator==(const ImageEffects &other) const;
+};
+
+/*! \brief The GraphicEffects class implements Scratch graphic effects on costume images. */
+class GraphicEffects
+{
+	public:
+		/*! Scratch graphic effects, used as indices of arrays of effect values. */
+		enum Effect
+		{
+			ColorEffect,
+			FisheyeEffect,
+			WhirlEffect,
+			PixelateEffect,
+			MosaicEffect,
+			BrightnessEffect,
+			GhostEffect,
+			EffectCount
+		};
+		static int effectIndex(const QString &name);
+		static qreal normalizeColor(qreal color);
+		static qreal normalizeBrightness(qreal brightness);
+		static ImageEffects imageEffects(const qreal *values);
+		static QImage apply(const QImage &image, const ImageEffects &effects, qreal pixelScale);
+		static void setMultithreaded(bool enabled);
+
+	private:
+		static QVector<int> displacementTable(int width, int height, const ImageEffects &effects, qreal pixelScale);
+		template<typename Function>
+		static void forEachBand(int width, int height, Function function);
+};
+
+/*! Cache key of an image with graphic effects applied. */
+struct GraphicEffectsKey
+{
+	QString costume; /*!< Asset ID of the costume. */
+	ImageEffects effects;
+	qreal scale;
+	bool operator==(const GraphicEffectsKey &other) const
+	{
+		return (costume == other.costume) && (effects == other.effects) && (scale == other.scale);
+	}
+};
+
+inline uint qHash(const ImageEffects &effects, uint seed = 0)
+{
+	return qHash(effects.color, seed) ^ (qHash(effects.brightness, seed) << 1) ^ (qHash(effects.fisheye, seed) << 2)
+		^ (qHash(effects.whirl, seed) << 3) ^ (qHash(effects.pixelate, seed) << 4) ^ (qHash(effects.mosaic, seed) << 5);
+}
+
+inline uint qHash(const GraphicEffectsKey &key, uint seed = 0)
+{
+	return qHash(key.costume, seed) ^ qHash(key.effects, seed) ^ (qHash(key.scale, seed) << 6);
+}
+
+/*!
+ * \brief The GraphicEffectsCache class caches costume images with graphic effects applied.
+ *
+ * Scripts like "change color effect by 5" in a forever loop cycle through the same images,
+ * so they are computed only once.\n
+ * There's one cache for all sprites with a single size limit. Images are identified by the asset ID
+ * of the costume and the scene scale, so clones (and other sprites using the same costume) share them.
+ * The cache is only used on the GUI thread.
+ */
+class GraphicEffectsCache
+{
+	public:
+		GraphicEffectsCache();
+		QPixmap pixmap(const QString &costume, const QPixmap &costumePixmap, const ImageEffects &effects, qreal pixelScale);
+		void remove(const QString &costume);
+		void clear(void);
+
+	private:
+		QCache<GraphicEffectsKey,QPixmap> cache;
+};
+
+extern GraphicEffectsCache graphicEffectsCache;
+
+#endif // GRAPHICEFFECTS_H
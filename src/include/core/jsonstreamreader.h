@@ -0,0 +1,104 @@
+/*
+ * jsonstreamreader.h
+ * This file is part of QScratchRuntime
+ *
+ * Copyright (C) 2023 - adazem009
+ *
+ * QScratchRuntime is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * QScratchRuntime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QScratchRuntime. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JSONSTREAMREADER_H
+#define JSONSTREAMREADER_H
+
+#include <QByteArray>
+#include <QString>
+#include <QVariant>
+#include <QHash>
+#include <QVector>
+
+/*!
+ * \brief The JsonStreamReader class reads JSON documents token by token, similar to QXmlStreamReader.
+ *
+ * No document tree is built, so the caller can convert the values directly to its own data structures
+ * and skip the parts it doesn't need.\n
+ * Short strings (including object keys) are interned: equal strings share the same QString data,
+ * so e.g. block IDs and opcodes which occur many times in a project are stored only once.
+ */
+class JsonStreamReader
+{
+	public:
+		/*! Types of tokens. */
+		enum TokenType
+		{
+			NoToken,
+			Invalid, /*!< the document is invalid, see errorString() */
+			StartObject,
+			EndObject,
+			StartArray,
+			EndArray,
+			Name, /*!< object key, see name() */
+			String,
+			Number,
+			Bool,
+			Null,
+			EndDocument
+		};
+		explicit JsonStreamReader(const QByteArray &data);
+		TokenType readNext(void);
+		TokenType tokenType(void) const;
+		bool readNextName(void);
+		bool readNextItem(void);
+		const QString &name(void) const;
+		QVariant readValue(void);
+		QString readString(void);
+		double readDouble(void);
+		bool readBool(void);
+		void skipValue(void);
+		bool hasError(void) const;
+		QString errorString(void) const;
+		qint64 errorOffset(void) const;
+
+	private:
+		/*! What the reader expects after the current token. */
+		enum State
+		{
+			ExpectValue,
+			ExpectName,
+			ExpectFirstValue, /*!< value or end of an empty array */
+			ExpectFirstName, /*!< name or end of an empty object */
+			AfterValue
+		};
+		static const int maxDepth = 1024;
+		static const int maxInternedLength = 128;
+		TokenType readValueToken(void);
+		bool readStringToken(QString *out);
+		QString unescape(const char *data, int length);
+		void skipWhitespace(void);
+		TokenType setError(const QString &message);
+		QByteArray m_data;
+		const char *pos;
+		const char *end;
+		TokenType m_token = NoToken;
+		State state = ExpectValue;
+		QVector<char> containers;
+		QString m_name;
+		QString m_string;
+		double m_number = 0;
+		bool m_bool = false;
+		QHash<QByteArray,QString> strings;
+		QString m_errorString;
+		qint64 m_errorOffset = -1;
+};
+
+#endif // JSONSTREAMREADER_H
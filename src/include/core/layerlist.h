@@ -0,0 +1,58 @@
+/*
+ * layerlist.h
+ * This file is part of QScratchRuntime
+ *
+ * Copyright (C) 2023 - adazem009
+ *
+ * QScratchRuntime is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * QScratchRuntime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QScratchRuntime. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LAYERLIST_H
+#define LAYERLIST_H
+
+#include <QMap>
+#include <QGraphicsItem>
+
+/*!
+ * \brief The LayerList class keeps the layer order of sprites.
+ *
+ * The layer of a sprite is its Z value. Layers are gap-numbered (sorted in a QMap), so "go to front",
+ * "go to back" and inserting a clone behind its parent only change the Z value of one sprite
+ * and take O(log n) time. Moving by n layers takes O(log n + n) time.\n
+ * When there's no gap left between two layers, all layers are renumbered (this rarely happens).\n
+ * Sprite layers are above bottomLayer, which is used by the stage and the pen layer.
+ */
+class LayerList
+{
+	public:
+		void insert(QGraphicsItem *item, qreal layer);
+		void remove(QGraphicsItem *item);
+		bool contains(QGraphicsItem *item) const;
+		int count(void) const;
+		void goToFront(QGraphicsItem *item);
+		void goToBack(QGraphicsItem *item);
+		void moveLayers(QGraphicsItem *item, int delta);
+		void moveBehind(QGraphicsItem *item, QGraphicsItem *other);
+		static const qreal bottomLayer;
+
+	private:
+		void setLayer(QGraphicsItem *item, qreal layer);
+		void placeBetween(QGraphicsItem *item, QGraphicsItem *below, QGraphicsItem *above);
+		void renumber(void);
+		QMap<qreal,QGraphicsItem*> items;
+};
+
+extern LayerList layerList;
+
+#endif // LAYERLIST_H
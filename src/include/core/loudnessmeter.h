@@ -0,0 +1,73 @@
+/*
+ * loudnessmeter.h
+ * This file is part of QScratchRuntime
+ *
+ * Copyright (C) 2023 - adazem009
+ *
+ * QScratchRuntime is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * QScratchRuntime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QScratchRuntime. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LOUDNESSMETER_H
+#define LOUDNESSMETER_H
+
+#include <QVector>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include "core/audioinput.h"
+
+/*!
+ * \brief The LoudnessMeter class measures the loudness of the AudioInput.
+ *
+ * The RMS of the last windowSize samples is updated incrementally as the samples are read from the input.
+ * The loudness is computed like in Scratch (0 - 100, falling slowly after loud sounds) every hopSize samples
+ * and stored in an atomic value, so loudness() never blocks.\n
+ * Real-time inputs are read by the meter thread. Other inputs are read by processTo(), which is called
+ * by HeadlessRunner with the EngineClock time.
+ */
+class LoudnessMeter
+{
+	public:
+		static const int windowSize = 2048;
+		static const int hopSize = 1600; // 30 updates per second
+		LoudnessMeter();
+		~LoudnessMeter();
+		void setInput(AudioInput *input);
+		AudioInput *input(void) const;
+		int loudness(void);
+		void processAvailable(void);
+		void processTo(qint64 frame);
+
+	private:
+		Q_DISABLE_COPY(LoudnessMeter)
+		class Thread;
+		void process(void);
+		void reset(void);
+		void threadLoop(void);
+		AudioInput *m_input = nullptr;
+		Thread *thread = nullptr;
+		QAtomicInt stopping;
+		QAtomicInt m_loudness;
+		QAtomicInt started;
+		QElapsedTimer timer;
+		QVector<float> squares;
+		QVector<float> readBuffer;
+		int windowPosition;
+		int hopPosition;
+		double sum;
+		qreal level;
+};
+
+extern LoudnessMeter loudnessMeter;
+
+#endif // LOUDNESSMETER_H
@@ -0,0 +1,142 @@
+/*
+ * penlayer.h
+ * This file is part of QScratchRuntime
+ *
+ * Copyright (C) 2023 - adazem009
+ *
+ * QScratchRuntime is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * QScratchRuntime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QScratchRuntime. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PENLAYER_H
+#define PENLAYER_H
+
+#include <QGraphicsItem>
+#include <QImage>
+#include <QPixmap>
+#include <QMutex>
+#include <QVector>
+#include <QCache>
+
+/*! Pen state of a sprite. Colors use the Scratch 3 ranges (0-100). */
+struct PenState
+{
+	bool down = false;
+	qreal size = 1;
+	qreal color = 66.66;
+	qreal saturation = 100;
+	qreal brightness = 100;
+	qreal transparency = 0;
+	qreal shade = 50; /*!< Used by the legacy shade blocks (0-200). */
+	QRgb rgba(void) const;
+	void setColor(const QString &value);
+	void setParam(const QString &param, qreal value);
+	qreal param(const QString &param) const;
+	void updateLegacyColor(void);
+};
+
+/*! Cache key of a transformed stamp image. */
+struct StampKey
+{
+	qint64 pixmap; /*!< QPixmap::cacheKey() */
+	qreal m11, m12, m21, m22;
+	qreal opacity;
+	int subpixelX, subpixelY; /*!< Subpixel position in 1/4 pixels. */
+	bool operator==(const StampKey &other) const
+	{
+		return (pixmap == other.pixmap) && (m11 == other.m11) && (m12 == other.m12) && (m21 == other.m21) && (m22 == other.m22) &&
+			(opacity == other.opacity) && (subpixelX == other.subpixelX) && (subpixelY == other.subpixelY);
+	}
+};
+
+inline uint qHash(const StampKey &key, uint seed = 0)
+{
+	return qHash(key.pixmap, seed) ^ (qHash(key.m11, seed) << 1) ^ (qHash(key.m12, seed) << 2) ^ (qHash(key.m21, seed) << 3)
+		^ (qHash(key.m22, seed) << 4) ^ (qHash(key.opacity, seed) << 5) ^ (key.subpixelX << 6) ^ (key.subpixelY << 8);
+}
+
+/*!
+ * \brief The PenLayer class is a stage-sized image with the pen drawings, which is displayed between the stage and the sprites.
+ *
+ * Pen commands are queued while the sprites run (possibly in multiple threads) and drawn
+ * in one batch at the end of the frame by flush(). Lines are drawn by an antialiased
+ * scanline rasterizer, which works on rows of pixels (using SSE2 where available).
+ * Stamps are transformed once and cached, so a stamp is an alpha blend of a ready image.
+ */
+class PenLayer : public QGraphicsItem
+{
+	public:
+		enum { Type = UserType + 2 };
+		explicit PenLayer(QGraphicsItem *parent = nullptr);
+		int type(void) const override;
+		QRectF boundingRect(void) const override;
+		void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget = nullptr) override;
+		void setStageScale(qreal value);
+		void clear(void);
+		void drawLine(QPointF from, QPointF to, const PenState &pen);
+		void stamp(const QPixmap &pixmap, const QTransform &transform, qreal opacity);
+		void flush(void);
+		const QImage &image(void) const;
+
+		/*! Antialiased line segment in image coordinates. */
+		struct Segment
+		{
+			float x1, y1, x2, y2;
+			float radius;
+			QRgb color; /*!< Premultiplied color. */
+		};
+
+	private:
+		/*! Queued pen command. Consecutive lines are merged into one command. */
+		struct Command
+		{
+			enum CommandType
+			{
+				ClearCommand,
+				LinesCommand,
+				StampCommand
+			};
+			CommandType type;
+			QVector<Segment> segments;
+			QPixmap pixmap;
+			QTransform transform;
+			qreal opacity;
+		};
+		/*! Transformed stamp image and the position of its top left corner relative to the stamp origin. */
+		struct StampImage
+		{
+			QImage image;
+			QPoint offset;
+		};
+		/*! Stamp image and its position in the pen layer. */
+		struct StampBlit
+		{
+			QImage image;
+			QPoint position;
+		};
+		template<typename Function>
+		void forEachBand(int itemCount, Function function);
+		void drawSegments(const QVector<Segment> &segments);
+		static void drawSegment(uchar *bits, int bytesPerLine, int width, const Segment &segment, int firstRow, int endRow, float *coverage);
+		StampKey stampKey(const Command &command, QPoint *origin) const;
+		StampImage stampImage(const StampKey &key, const Command &command);
+		void drawStamps(const QVector<StampBlit> &stamps);
+		static void blendImage(uchar *bits, int bytesPerLine, int width, const StampBlit &stamp, int firstRow, int endRow);
+		QCache<StampKey,StampImage> stampCache;
+		qreal stageScale = 1;
+		QImage m_image;
+		QVector<Command> queue;
+		QMutex mutex;
+};
+
+#endif // PENLAYER_H
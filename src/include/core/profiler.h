@@ -0,0 +1,90 @@
+/*
+ * profiler.h
+ * This file is part of QScratchRuntime
+ *
+ * Copyright (C) 2023 - adazem009
+ *
+ * QScratchRuntime is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * QScratchRuntime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QScratchRuntime. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <QString>
+#include <QHash>
+#include <QVector>
+#include <QList>
+#include <QMutex>
+#include <QElapsedTimer>
+
+/*!
+ * \brief The Profiler class records the time spent in blocks, scripts and sprites.
+ *
+ * The engine checks isEnabled() once per sprite frame, so the profiler costs only a branch when it's disabled.
+ * Each thread records into its own buffer, the buffers are merged when the results are read.
+ * The profiler must be enabled, disabled and reset only while no frames are running.
+ */
+class Profiler
+{
+	public:
+		/*! Time statistics of an opcode, script or sprite. */
+		struct Stats
+		{
+			qint64 count = 0;
+			qint64 time = 0; /*!< Cumulative time in nanoseconds. */
+		};
+		static inline bool isEnabled(void) { return enabled; }
+		static void setEnabled(bool value);
+		static void reset(void);
+		static qint64 now(void);
+		static void recordBlock(const QString &opcode, qint64 start);
+		static void recordScript(const QString &sprite, const QString &script, qint64 start);
+		static void recordSprite(const QString &sprite, qint64 start);
+		static void recordTick(qint64 start);
+		static QHash<QString,Stats> opcodeStats(void);
+		static QHash<QString,Stats> scriptStats(void);
+		static QHash<QString,Stats> spriteStats(void);
+		static QString summary(int maxRows = 20);
+		static bool writeTrace(const QString &fileName);
+
+	private:
+		/*! Trace event (Chrome "complete" event). */
+		struct Event
+		{
+			QString name;
+			const char *category;
+			qint64 start;
+			qint64 duration;
+		};
+		/*! Data recorded by one thread. */
+		struct Buffer
+		{
+			int threadIndex;
+			QHash<QString,Stats> opcodes;
+			QHash<QString,Stats> scripts;
+			QHash<QString,Stats> sprites;
+			QVector<Event> events;
+		};
+		static Buffer *threadBuffer(void);
+		static void addEvent(Buffer *buffer, const QString &name, const char *category, qint64 start, qint64 duration);
+		static QHash<QString,Stats> merge(QHash<QString,Stats> Buffer::*member);
+		static QString table(const QString &title, const QHash<QString,Stats> &stats, int maxRows);
+		static bool enabled;
+		static QElapsedTimer timer;
+		static QMutex mutex;
+		static QList<Buffer*> buffers;
+		static thread_local Buffer *currentBuffer;
+};
+
+#endif // PROFILER_H
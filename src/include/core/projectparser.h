@@ -23,12 +23,12 @@
 
 #include <QObject>
 #include <QFile>
-#include <QJsonDocument>
-#include <QJsonObject>
-#include <QJsonArray>
 #include <QVariantMap>
 #include <QFileInfo>
 #include "core/scratchsprite.h"
+#include "core/sb3reader.h"
+#include "core/targetdata.h"
+#include "core/jsonstreamreader.h"
 
 /*! \brief The projectParser class provides functions for local configuration reading and writing. */
 class projectParser : public QObject
@@ -36,14 +36,19 @@ class projectParser : public QObject
 	Q_OBJECT
 	public:
 		explicit projectParser(QString fileName, QByteArray projectJson = "", QObject *parent = nullptr);
-		QList<scratchSprite*> sprites(void);
+		~projectParser();
+		QList<scratchSprite*> sprites(qreal sceneScale = 1);
 		scratchSprite* stage(void);
 		QList<QMap<QString,QString>> assetIDs(void);
 
 	private:
-		QJsonDocument document;
-		QJsonObject mainObject;
+		void readProject(const QByteArray &projectJson);
+		void readTarget(JsonStreamReader &reader, TargetData *target);
+		void readAssets(JsonStreamReader &reader, QList<QVariantMap> *assets);
+		void readBlocks(JsonStreamReader &reader, QMap<QString,QVariantMap> *blocks);
+		QList<TargetData> targets;
 		QString assetDir;
+		Sb3Reader *archive = nullptr;
 };
 
 #endif // PROJECTPARSER_H
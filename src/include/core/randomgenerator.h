@@ -0,0 +1,48 @@
+/*
+ * randomgenerator.h
+ * This file is part of QScratchRuntime
+ *
+ * Copyright (C) 2023 - adazem009
+ *
+ * QScratchRuntime is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * QScratchRuntime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QScratchRuntime. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RANDOMGENERATOR_H
+#define RANDOMGENERATOR_H
+
+#include <QString>
+
+/*!
+ * \brief The RandomGenerator class is a fast seedable pseudo-random number generator (xoshiro256**).
+ *
+ * Every Engine has its own stream derived from the project seed, so sprites running
+ * on different threads don't share any state and the results don't depend on the thread schedule.
+ */
+class RandomGenerator
+{
+	public:
+		RandomGenerator();
+		void seed(quint64 value);
+		quint64 next(void);
+		int bounded(int lowest, int highest);
+		static void setProjectSeed(quint64 value);
+		static quint64 projectSeed(void);
+		static quint64 streamSeed(const QString &name);
+
+	private:
+		quint64 state[4];
+		static quint64 m_projectSeed;
+};
+
+#endif // RANDOMGENERATOR_H
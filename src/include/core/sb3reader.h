@@ -0,0 +1,67 @@
+/*
+ * sb3reader.h
+ * This file is part of QScratchRuntime
+ *
+ * Copyright (C) 2023 - adazem009
+ *
+ * QScratchRuntime is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * QScratchRuntime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QScratchRuntime. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SB3READER_H
+#define SB3READER_H
+
+#include <QByteArray>
+#include <QList>
+#include <QFuture>
+#include "core/assetstore.h"
+
+/*!
+ * \brief The Sb3Reader class reads Scratch 3 project archives (.sb3).
+ *
+ * The archive is memory-mapped by the AssetStore. Stored (uncompressed) entries are added to the store
+ * as views of the mapping and deflated entries are inflated in parallel.
+ */
+class Sb3Reader
+{
+	public:
+		explicit Sb3Reader(const QString &fileName, AssetStore *store);
+		~Sb3Reader();
+		bool isValid(void) const;
+		QByteArray projectJson(void);
+		void extractAssets(void);
+		void waitForAssets(void);
+
+	private:
+		Q_DISABLE_COPY(Sb3Reader)
+		/*! Zip archive entry. */
+		struct Entry
+		{
+			QString name;
+			quint16 method;
+			quint32 compressedSize;
+			quint32 size;
+			qint64 dataOffset;
+		};
+		bool readCentralDirectory(void);
+		QByteArray entryData(const Entry &entry) const;
+		void extractEntry(const Entry &entry);
+		AssetStore *m_store;
+		QByteArray archiveData;
+		QList<Entry> entries;
+		QList<Entry> deflatedEntries;
+		QFuture<void> extraction;
+		bool m_valid = false;
+};
+
+#endif // SB3READER_H
@@ -22,22 +22,25 @@
 #define SCRATCHSPRITE_H
 
 #include <QGraphicsPixmapItem>
-#include <QJsonObject>
-#include <QJsonArray>
 #include <QtMath>
 #if QT_VERSION >= QT_VERSION_CHECK(5, 10, 0)
 #include <QRandomGenerator>
 #endif
 #include <QGraphicsSceneMouseEvent>
 #include <QDateTime>
-#include <QMediaPlayer>
 #include <QElapsedTimer>
-#include <QBuffer>
 #include <QSvgRenderer>
 #include <QPainter>
 #include <QSettings>
 #include <QGraphicsScene>
 #include "global.h"
+#include "core/graphiceffects.h"
+#include "core/costumecache.h"
+#include "core/penlayer.h"
+#include "core/spritestore.h"
+#include "core/layerlist.h"
+#include "core/audiomixer.h"
+#include "core/targetdata.h"
 
 class Engine;
 
@@ -47,14 +50,18 @@ class scratchSprite : public QObject, public QGraphicsPixmapItem
 	Q_OBJECT
 	public:
 		enum { Type = UserType + 1 };
-		explicit scratchSprite(QJsonObject spriteObject, QString assetDir, QGraphicsItem *parent = nullptr);
+		explicit scratchSprite(const TargetData &target, QString assetDir, qreal scale = 1, const QImage &initialCostume = QImage(), QGraphicsItem *parent = nullptr);
 		~scratchSprite();
 		int type(void) const override;
 		scratchSprite *getSprite(QString name);
 		void setMousePos(QPointF pos);
 		void frame(void);
 		static void stopAllSounds(void);
+		static QByteArray assetData(const QVariantMap &asset, const QString &assetDir);
+		static QImage costumeImage(const QVariantMap &costume, const QByteArray &data, qreal sceneScale, bool hqSvg);
 		void setVolume(qreal newVolume);
+		void setSoundEffect(QString effect, qreal value);
+		void clearSoundEffects(void);
 		void spriteClicked(void);
 		void keyPressed(int key, QString keyText);
 		bool checkKey(int QtKey, QString keyText, QString scratchKey);
@@ -62,48 +69,76 @@ class scratchSprite : public QObject, public QGraphicsPixmapItem
 		void emitBroadcast(QString broadcastName, QVariantMap *script = nullptr);
 		void broadcastReceived(QString broadcastName, QVariantMap *script);
 		void startClone(void);
-		QPointer<QMediaPlayer> *playSound(QString soundName);
+		void playSound(QString soundName, quint64 voice = 0);
+		void assetLoaded(const QString &assetId);
 		Engine* engine(void);
 		bool isClone(void);
+		int handle(void) const;
+		qreal spriteX(void) const;
+		qreal spriteY(void) const;
+		qreal size(void) const;
+		qreal direction(void) const;
+		int currentCostume(void) const;
+		QImage currentCostumeImage(void) const;
+		qreal graphicEffect(const QString &name) const;
+		void setGraphicEffect(const QString &name, qreal value);
+		void clearGraphicEffects(void);
+		SpriteSnapshot state(void);
+		SpriteSnapshot snapshot(void) const;
+		void takeSnapshot(void);
+		void syncView(void);
+		void syncView(const SpriteSnapshot &state);
+		static qreal normalizeDirection(qreal angle);
 		qreal mouseX, mouseY;
 		bool isStage = false; /*!< True if this is a stage. */
 		QString name; /*!< Sprite name. */
-		qreal spriteX = 0; /*!< X position. */
-		qreal spriteY = 0; /*!< Y position. */
-		int currentCostume; /*!< Current costume ID. */
 		int volume; /*!< Volume for sound blocks. */
+		qreal pitchEffect = 0; /*!< Pitch sound effect (10 is a semitone). */
+		qreal panEffect = 0; /*!< Pan sound effect (-100 is left, 100 is right). */
 		int tempo; /*!< Tempo for instrument blocks. */
-		qreal size; /*!< Sprite size. */
-		qreal direction; /*!< Sprite direction. */
 		bool draggable; /*!< True if the sprite is draggable. */
 		QString rotationStyle; /*!< Sprite rotation style ("all around", "left-right", or "don't rotate"). */
 		QList<QVariantMap> costumes;
+		QList<QVariantMap> sounds;
 		QMap<QString,QVariantMap> frameEvents;
 		QMap<QString,QVariantMap> blocks;
-		QMap<QString,qreal> graphicEffects;
-		QElapsedTimer timer;
+		qint64 timerStart; /*!< Time of the last timer reset. \see EngineClock */
+		PenState pen;
 		QVector<QVariantMap*> stackPointers;
 		qreal sceneScale = 1;
-		QJsonObject jsonObject;
+		TargetData targetData; /*!< Data the sprite was created from (used to create clones). */
 		QString assetDir;
 
 	private:
 		qreal translateX(qreal x, bool toScratch = false);
 		qreal translateY(qreal y, bool toScratch = false);
 		void resetTimer(void);
+		QByteArray assetData(const QVariantMap &asset);
+		void loadCostume(int id);
+		void updateTransform(qreal size, qreal angle);
+		void updateView(const SpriteSnapshot &state, int flags);
+		void applyGraphicEffects(int costume, const qreal *values);
+		void stopPendingSounds(void);
+		SpriteSnapshot view;
 		Engine *m_engine;
+		int m_handle;
 		qreal rotationCenterX, rotationCenterY;
 		bool pointingLeft;
 		QMap<QString,QPair<QString,QString>> variables;
 		QMap<QString,QPair<QString,QList<QString>>> lists;
 		QMap<QString,QString> broadcasts;
-		QList<QVariantMap> sounds;
 		QGraphicsPixmapItem *speechBubble;
 		QGraphicsTextItem *speechBubbleText;
 		QPixmap costumePixmap;
+		QList<quint64> pendingVoices; // voices of sounds which are being decoded
+		QImage preparedCostume;
+		int preparedCostumeId = -1;
 		QSettings settings;
 		bool m_isClone = false;
 
+	protected:
+		QVariant itemChange(GraphicsItemChange change, const QVariant &value) override;
+
 	signals:
 		/*! A signal, which is emitted from the stage when the backdrop switches. */
 		void backdropSwitched(QVariantMap *script);
@@ -117,7 +152,6 @@ class scratchSprite : public QObject, public QGraphicsPixmapItem
 		void setDirection(qreal angle);
 		void setCostume(int id, QVariantMap *scripts = nullptr);
 		void resetGraphicEffects(void);
-		void installGraphicEffects(void);
 		void showBubble(QString text, bool thought = false);
 		void greenFlagClicked(void);
 		void stopAll(void);
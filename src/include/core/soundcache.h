@@ -0,0 +1,72 @@
+/*
+ * soundcache.h
+ * This file is part of QScratchRuntime
+ *
+ * Copyright (C) 2023 - adazem009
+ *
+ * QScratchRuntime is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * QScratchRuntime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QScratchRuntime. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SOUNDCACHE_H
+#define SOUNDCACHE_H
+
+#include <QVector>
+#include <QHash>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QFuture>
+#include <functional>
+
+class QObject;
+
+/*! Decoded sound: interleaved stereo samples at AudioMixer::sampleRate. */
+struct SoundBuffer
+{
+	QVector<float> samples;
+	bool mono = false; /*!< True if both channels are the same (used by the pan effect). */
+	int frameCount(void) const { return samples.count() / 2; }
+};
+
+typedef QSharedPointer<const SoundBuffer> SoundBufferPtr;
+
+/*!
+ * \brief The SoundCache class decodes each sound asset once and keeps the PCM samples.
+ *
+ * WAV files (PCM, float and IMA ADPCM) are decoded directly, other formats (e.g. MP3) use QAudioDecoder.
+ * The samples are converted to the format of the AudioMixer, so the mixer only sums them.\n
+ * Sounds are decoded in the background when a sprite is loaded (see preload()) or when they're
+ * requested (see request()), so the GUI thread never waits for a decoder.
+ */
+class SoundCache
+{
+	public:
+		void preload(const QString &assetId, const QByteArray &data);
+		void request(const QString &assetId, const QByteArray &data, QObject *context, const std::function<void(SoundBufferPtr)> &callback);
+		void waitForDecoding(void);
+		void clear(void);
+		static SoundBufferPtr decode(const QByteArray &data);
+
+	private:
+		static bool decodeWav(const QByteArray &data, QVector<float> *samples, int *channels, int *sampleRate);
+		static void decodeImaAdpcm(const uchar *data, int size, int channels, int blockAlign, QVector<float> *samples);
+		static bool decodeWithQt(const QByteArray &data, QVector<float> *samples, int *channels, int *sampleRate);
+		static QVector<float> convert(const QVector<float> &samples, int channels, int sampleRate);
+		QMutex mutex;
+		QHash<QString,SoundBufferPtr> sounds;
+		QHash<QString,QFuture<SoundBufferPtr>> pending;
+};
+
+extern SoundCache soundCache;
+
+#endif // SOUNDCACHE_H
@@ -0,0 +1,115 @@
+/*
+ * spritestore.h
+ * This file is part of QScratchRuntime
+ *
+ * Copyright (C) 2023 - adazem009
+ *
+ * QScratchRuntime is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * QScratchRuntime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QScratchRuntime. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SPRITESTORE_H
+#define SPRITESTORE_H
+
+#include <QVector>
+#include "core/graphiceffects.h"
+
+/*! Values of a sprite, e.g. to read other sprites during a frame. \see SpriteStore#frameSnapshot() */
+struct SpriteSnapshot
+{
+	qreal x = 0;
+	qreal y = 0;
+	qreal size = 100;
+	qreal direction = 90;
+	int costume = 0;
+	qreal layer = 0;
+	bool visible = true;
+	qreal effects[GraphicEffects::EffectCount] = {};
+};
+
+/*!
+ * \brief The SpriteStore class keeps the values of all sprites in arrays (struct of arrays).
+ *
+ * Each sprite has a handle, which is the index in the arrays. The graphics items are only views,
+ * which are updated once per frame (see scratchSprite#syncView()).\n
+ * Before each frame, takeSnapshot() copies the arrays of all sprites in one pass. Sprites read the values
+ * of other sprites from this copy (see frameSnapshot()), because frames of sprites can run in parallel.\n
+ * Values should be changed using the setters, which mark the changed parts of the view as dirty.
+ * Moving a sprite many times in a frame then results in a single position update of the graphics item.\n
+ * Handles are created and released on the main thread between frames, so the arrays don't move during a frame.
+ */
+class SpriteStore
+{
+	public:
+		/*! Parts of the graphics item which need to be updated. */
+		enum DirtyFlag
+		{
+			PositionDirty = 1,
+			TransformDirty = 2, /*!< size, direction or rotation style */
+			CostumeDirty = 4,
+			EffectsDirty = 8,
+			VisibilityDirty = 16,
+			AllDirty = 31
+		};
+		int create(void);
+		void release(int handle);
+		int capacity(void) const;
+		qreal *effects(int handle);
+		void snapshot(int handle, SpriteSnapshot *out) const;
+		void takeSnapshot(void);
+		void takeSnapshot(int handle);
+		void frameSnapshot(int handle, SpriteSnapshot *out) const;
+		void copy(int from, int to);
+		void setX(int handle, qreal value);
+		void setY(int handle, qreal value);
+		void setSize(int handle, qreal value);
+		void setDirection(int handle, qreal value);
+		void setCostume(int handle, int value);
+		void setVisible(int handle, bool value);
+		void setLayer(int handle, qreal value);
+		void setEffect(int handle, int effect, qreal value);
+		void clearEffects(int handle);
+		void markDirty(int handle, int flags);
+		int takeDirty(int handle);
+		QVector<qreal> x;
+		QVector<qreal> y;
+		QVector<qreal> size;
+		QVector<qreal> direction;
+		QVector<int> costume;
+		QVector<bool> visible;
+		QVector<qreal> layer; /*!< Z value of the graphics item, set by the LayerList when the writes are committed */
+		QVector<qreal> effectValues; /*!< GraphicEffects::EffectCount values per sprite */
+		QVector<quint8> dirty; /*!< DirtyFlag bits */
+
+	private:
+		/*! Values of all sprites from the start of the frame. */
+		struct FrameValues
+		{
+			QVector<qreal> x;
+			QVector<qreal> y;
+			QVector<qreal> size;
+			QVector<qreal> direction;
+			QVector<int> costume;
+			QVector<bool> visible;
+			QVector<qreal> layer;
+			QVector<qreal> effectValues;
+		};
+		template<typename T>
+		static void copyArray(const QVector<T> &from, QVector<T> *to);
+		FrameValues frameStart;
+		QVector<int> freeHandles;
+};
+
+extern SpriteStore spriteStore;
+
+#endif // SPRITESTORE_H
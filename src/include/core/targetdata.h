@@ -0,0 +1,55 @@
+/*
+ * targetdata.h
+ * This file is part of QScratchRuntime
+ *
+ * Copyright (C) 2023 - adazem009
+ *
+ * QScratchRuntime is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * QScratchRuntime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QScratchRuntime. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TARGETDATA_H
+#define TARGETDATA_H
+
+#include <QString>
+#include <QList>
+#include <QMap>
+#include <QVariantMap>
+
+/*!
+ * Target (sprite or stage) read from project.json. \see projectParser
+ *
+ * The blocks are stored in the form which is used by the engine, keyed by block ID.
+ * Blocks which are stored as arrays in project.json (top-level variable and list reporters) are empty maps.
+ */
+struct TargetData
+{
+	bool isStage = false;
+	QString name;
+	int currentCostume = 0;
+	qreal volume = 0;
+	int tempo = 0;
+	int layerOrder = 0;
+	bool visible = false;
+	qreal x = 0;
+	qreal y = 0;
+	qreal size = 0;
+	qreal direction = 0;
+	QString rotationStyle;
+	bool draggable = false;
+	QList<QVariantMap> costumes;
+	QList<QVariantMap> sounds;
+	QMap<QString,QVariantMap> blocks;
+};
+
+#endif // TARGETDATA_H
@@ -0,0 +1,68 @@
+/*
+ * workerpool.h
+ * This file is part of QScratchRuntime
+ *
+ * Copyright (C) 2023 - adazem009
+ *
+ * QScratchRuntime is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * QScratchRuntime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QScratchRuntime. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QVector>
+#include <functional>
+
+/*!
+ * \brief The WorkerPool class runs tasks on a persistent set of threads with work stealing.
+ *
+ * run() splits the task indices into one range per thread. Each thread takes tasks from the front
+ * of its own range and steals from the back of other ranges when it runs out, so a few slow tasks
+ * don't keep the other threads waiting. The calling thread works too.
+ */
+class WorkerPool
+{
+	public:
+		explicit WorkerPool(int threadCount = QThread::idealThreadCount());
+		~WorkerPool();
+		int threadCount(void) const;
+		void run(int count, const std::function<void(int)> &task);
+
+	private:
+		Q_DISABLE_COPY(WorkerPool)
+		/*! Range of task indices owned by a thread. */
+		struct Range
+		{
+			QMutex mutex;
+			int begin = 0;
+			int end = 0;
+		};
+		class Worker;
+		bool takeTask(int range, int *index);
+		void work(int range);
+		void workerLoop(int range);
+		QVector<Worker*> workers;
+		QVector<Range*> ranges;
+		const std::function<void(int)> *currentTask = nullptr;
+		QMutex mutex;
+		QWaitCondition startCondition, doneCondition;
+		quint64 generation = 0;
+		int busyWorkers = 0;
+		bool stopping = false;
+};
+
+#endif // WORKERPOOL_H
@@ -20,9 +20,8 @@
 
 #include <QList>
 #include <QPointer>
-#include <QMediaPlayer>
 #include <QTemporaryFile>
 #include <QMap>
+#include "core/assetstore.h"
 
-extern QList<QPointer<QMediaPlayer>> allSounds;
-extern QMap<QString,QByteArray*> projectAssets;
+extern AssetStore projectAssets;
@@ -0,0 +1,77 @@
+/*
+ * headlessrunner.h
+ * This file is part of QScratchRuntime
+ *
+ * Copyright (C) 2023 - adazem009
+ *
+ * QScratchRuntime is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * QScratchRuntime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QScratchRuntime. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HEADLESSRUNNER_H
+#define HEADLESSRUNNER_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QImage>
+#include <QJsonObject>
+#include "projectscene.h"
+#include "core/projectparser.h"
+
+/*! \brief The HeadlessRunner class runs a project without a window (e.g. for batch validation and benchmarks). */
+class HeadlessRunner : public QObject
+{
+	Q_OBJECT
+	public:
+		enum SummaryFormat
+		{
+			TextSummary,
+			JsonSummary
+		};
+		/*! Exit codes of run(). */
+		enum ExitCode
+		{
+			Finished = 0,
+			FrameLimitReached = 2 /*!< The scripts were still running after the last frame. */
+		};
+		explicit HeadlessRunner(QString fileName, QObject *parent = nullptr);
+		void setFrameLimit(int count);
+		void setFps(int value);
+		void setRenderEnabled(bool enabled);
+		void setSummaryFormat(SummaryFormat format);
+		bool load(void);
+		int run(void);
+		QJsonObject summary(void) const;
+		static qint64 peakMemoryUsage(void);
+		static void useSeparateSettings(void);
+
+	private:
+		bool frame(void);
+		void printSummary(void);
+		static qreal percentile(const QVector<qint64> &sortedTimes, qreal p);
+		QString fileName;
+		projectParser *parser = nullptr;
+		projectScene *scene;
+		QImage renderTarget;
+		int frameLimit = 0;
+		int fps = 0;
+		bool render = false;
+		SummaryFormat summaryFormat = TextSummary;
+		int frameCount = 0;
+		bool limitReached = false;
+		qint64 totalTime = 0;
+		qint64 audioStart = 0;
+		QVector<qint64> tickTimes;
+};
+
+#endif // HEADLESSRUNNER_H
@@ -30,8 +30,11 @@
 #include <QSurfaceFormat>
 #include <QInputDialog>
 #include <QScreen>
+#include <QLabel>
 #include "projectscene.h"
 #include "core/projectparser.h"
+#include "core/assetcache.h"
+#include "core/assetfetcher.h"
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class MainWindow; }
@@ -51,15 +54,15 @@ class MainWindow : public QMainWindow
 		projectParser *parser;
 		projectScene *scene;
 		QGraphicsView *view;
+		QLabel *frameStatsLabel;
 		QList<scratchSprite*> sprites;
 		QNetworkAccessManager *manager = nullptr;
 		QNetworkReply *currentReply = nullptr;
-		QVector<QNetworkReply*> assetReplies;
-		bool projectDataLoaded;
-		QList<QMap<QString,QString>> assets;
-		int loadedAssets;
-		QVector<QByteArray*> assetPointers;
 		QSettings settings;
+		AssetCache *assetCache;
+		AssetFetcher *fetcher;
+		QSet<QString> initialAssets; // assets which are needed to start the project
+		bool projectStarted = false;
 		QString projectID, token;
 		void continueLoading(QNetworkReply* reply);
 		void init(void);
@@ -71,10 +74,15 @@ class MainWindow : public QMainWindow
 		void openFile(void);
 		void loadFromUrl(void);
 		void adjustSceneSize(void);
+		void setAssetProgress(int finished, int total);
+		void assetFinished(const QString &assetId);
+		void finishLoading(void);
+		void toggleProgressiveLoading(bool state);
 		void changeFps(void);
 		void setCurrentFps(int fps);
 		void toggleMultithreading(bool state);
 		void toggleSvgUpscale(bool state);
+		void toggleFrameStats(bool state);
 };
 
 #endif // MAINWINDOW_H
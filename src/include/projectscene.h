@@ -24,11 +24,12 @@
 #include <QGraphicsScene>
 #include <QKeyEvent>
 #include <QSettings>
-#ifndef Q_OS_WASM
-#include <QtConcurrent>
-#endif // Q_OS_WASM
+#include <QElapsedTimer>
 #include "core/scratchsprite.h"
 #include "core/engine.h"
+#include "core/framestats.h"
+#include "core/penlayer.h"
+#include "core/workerpool.h"
 
 /*! \brief The projectScene class is a QGraphicsScene used to manage all sprites. */
 class projectScene : public QGraphicsScene
@@ -36,6 +37,7 @@ class projectScene : public QGraphicsScene
 	Q_OBJECT
 	public:
 		explicit projectScene(qreal scale, QObject *parent = nullptr);
+		~projectScene();
 		void loadSpriteList(QList<scratchSprite*> list);
 		void clearSpriteList(void);
 		void setFps(int fps);
@@ -43,14 +45,27 @@ class projectScene : public QGraphicsScene
 		void setMultithreading(bool state);
 		void setScale(qreal value);
 		qreal sceneScale(void);
+		void tick(void);
+		void setTimerEnabled(bool enabled);
+		bool isRunning(void);
+		const FrameStats &frameStats(void) const;
+		PenLayer *penLayer(void);
 
 	private:
+		void runEngines(qint64 *eventsTime, qint64 *scriptsTime);
+		void commitWrites(void);
+		void startFrameTimer(void);
 		bool projectRunning;
 		int timerID = -1, fpsTimerID = -1;
 		QSettings settings;
 		int frames = 0, fpsValue = 0;
 		bool multithreading;
 		qreal scale;
+		FrameStats stats;
+		PenLayer *m_penLayer;
+		WorkerPool *pool = nullptr;
+		int timerInterval = 0;
+		QElapsedTimer lastTickTimer, paintTimer;
 
 	signals:
 		/*! Emitted when the measured FPS value changes (every second). */
@@ -61,6 +76,7 @@ class projectScene : public QGraphicsScene
 		void stop(void);
 		void backdropSwitched(QVariantMap *script);
 		void broadcastSent(QString broadcastName, QVariantMap *script = nullptr);
+		void assetLoaded(const QString &assetId);
 		scratchSprite* createClone(scratchSprite *targetSprite);
 
 	protected:
@@ -69,6 +85,8 @@ class projectScene : public QGraphicsScene
 		void mouseDoubleClickEvent(QGraphicsSceneMouseEvent *event);
 		void mouseMoveEvent(QGraphicsSceneMouseEvent *event);
 		void keyPressEvent(QKeyEvent *event);
+		void drawBackground(QPainter *painter, const QRectF &rect) override;
+		void drawForeground(QPainter *painter, const QRectF &rect) override;
 };
 
 #endif // PROJECTSCENE_H
@@ -19,17 +19,167 @@
  */
 
 #include <QApplication>
+#include <QCommandLineParser>
+#include <QTextStream>
+#include <QtDebug>
+#include <cstring>
 #include "mainwindow.h"
+#include "headlessrunner.h"
+#include "core/engineclock.h"
+#include "core/randomgenerator.h"
+#include "core/profiler.h"
+#include "core/audiomixer.h"
+#include "core/loudnessmeter.h"
+#include "core/graphiceffects.h"
+#include "core/costumecache.h"
+
+/*! Disables the profiler, prints its summary and writes the trace file. */
+static void finishProfiling(const QString &traceFileName)
+{
+	Profiler::setEnabled(false);
+	QTextStream(stderr) << Profiler::summary();
+	if(!Profiler::writeTrace(traceFileName))
+		qWarning() << "Warning: could not write" << traceFileName;
+}
+
+/*!
+ * Creates the audio input given on the command line: a sound file or "tone:AMPLITUDE[:PERIOD]"
+ * (a generated tone with the amplitude from 0 to 1, interrupted every PERIOD milliseconds).
+ * Returns nullptr if the input can't be created.
+ */
+static AudioInput *createAudioInput(const QString &name, bool realTime)
+{
+	if(name.startsWith("tone:"))
+	{
+		QStringList parts = name.split(':');
+		return new ToneAudioInput(parts.value(1).toDouble(), parts.value(2).toInt(), realTime);
+	}
+	WavFileAudioInput *input = new WavFileAudioInput(name, realTime);
+	if(input->isOpen())
+		return input;
+	delete input;
+	return nullptr;
+}
 
 int main(int argc, char *argv[])
 {
+	// The platform must be set before QApplication is created
+	bool headless = false;
+	for(int i=1; i < argc; i++)
+	{
+		if(strcmp(argv[i], "--headless") == 0)
+		{
+			headless = true;
+			qputenv("QT_QPA_PLATFORM", "offscreen");
+		}
+	}
 	QApplication a(argc, argv);
 	QCoreApplication::setOrganizationName("adazem009");
 	QCoreApplication::setApplicationName("QScratchRuntime");
+	if(headless)
+		HeadlessRunner::useSeparateSettings();
 #if QT_VERSION < QT_VERSION_CHECK(5, 10, 0)
 	qsrand(QTime::currentTime().msec());
 #endif
+	// Command line
+	QCommandLineParser parser;
+	parser.setApplicationDescription("Scratch VM written in C++");
+	parser.addHelpOption();
+	QCommandLineOption headlessOption("headless", "Run the project without a window and print a timing summary.");
+	QCommandLineOption framesOption("frames", "Number of frames to run in headless mode (0 = until all scripts finish).", "N", "0");
+	QCommandLineOption fpsOption("fps", "Frame rate in headless mode (0 = as fast as possible).", "fps", "0");
+	QCommandLineOption renderOption("render", "Render the scene after each frame in headless mode.");
+	QCommandLineOption jsonOption("json", "Print the headless mode summary as JSON.");
+	QCommandLineOption deterministicOption("deterministic", "Use virtual time which advances by a fixed step on every frame and a fixed random seed.");
+	QCommandLineOption profileOption("profile", "Record the time spent in blocks, scripts and sprites, print a summary at exit and write a Chrome trace file.", "trace.json");
+	QCommandLineOption seedOption("seed", "Seed of the random number generator.", "seed");
+	QCommandLineOption audioOutputOption("audio-output", "Write the sound output of the headless mode into a WAV file.", "file.wav");
+	QCommandLineOption audioInputOption("audio-input", "Use a WAV file or a generated tone (tone:AMPLITUDE[:PERIOD]) instead of the microphone.", "input");
+	parser.addOption(headlessOption);
+	parser.addOption(framesOption);
+	parser.addOption(fpsOption);
+	parser.addOption(renderOption);
+	parser.addOption(jsonOption);
+	parser.addOption(deterministicOption);
+	parser.addOption(seedOption);
+	parser.addOption(profileOption);
+	parser.addOption(audioOutputOption);
+	parser.addOption(audioInputOption);
+	parser.addPositionalArgument("project", "Project file (.sb3 or project.json).");
+	parser.process(a);
+	if(parser.isSet(deterministicOption))
+	{
+		int fps = parser.value(fpsOption).toInt();
+		if(fps <= 0)
+			fps = QSettings().value("main/fps", 30).toInt();
+		EngineClock::setVirtual(true, 1000.0 / fps);
+		RandomGenerator::setProjectSeed(0);
+	}
+	if(parser.isSet(seedOption))
+		RandomGenerator::setProjectSeed(parser.value(seedOption).toULongLong());
+	if(parser.isSet(profileOption))
+		Profiler::setEnabled(true);
+	if(parser.isSet(headlessOption))
+	{
+		if(parser.positionalArguments().isEmpty())
+		{
+			qCritical("Error: no project file specified");
+			return 1;
+		}
+		// Sounds are rendered by HeadlessRunner on every frame
+		if(parser.isSet(audioOutputOption))
+		{
+			WavFileAudioSink *sink = new WavFileAudioSink(parser.value(audioOutputOption));
+			if(!sink->isOpen())
+			{
+				qCritical("Error: could not open the audio output file");
+				delete sink;
+				return 1;
+			}
+			audioMixer.setSink(sink);
+		}
+		else
+			audioMixer.setSink(new NullAudioSink);
+		// The audio input is read by HeadlessRunner too (there's no microphone in headless mode)
+		if(parser.isSet(audioInputOption))
+			loudnessMeter.setInput(createAudioInput(parser.value(audioInputOption), false));
+		HeadlessRunner runner(parser.positionalArguments().at(0));
+		runner.setFrameLimit(parser.value(framesOption).toInt());
+		runner.setFps(parser.value(fpsOption).toInt());
+		runner.setRenderEnabled(parser.isSet(renderOption));
+		if(parser.isSet(jsonOption))
+			runner.setSummaryFormat(HeadlessRunner::JsonSummary);
+		if(!runner.load())
+		{
+			qCritical("Error: could not load the project");
+			return 1;
+		}
+		int ret = runner.run();
+		// Pixmaps must be destroyed before the application
+		graphicEffectsCache.clear();
+		costumeCache.clear();
+		audioMixer.setSink(nullptr);
+		loudnessMeter.setInput(nullptr);
+		if(parser.isSet(profileOption))
+			finishProfiling(parser.value(profileOption));
+		return ret;
+	}
+	if(QAudioDeviceInfo::defaultOutputDevice().isNull())
+		audioMixer.setSink(new NullAudioSink(true));
+	else
+		audioMixer.setSink(new DeviceAudioSink);
+	if(parser.isSet(audioInputOption))
+		loudnessMeter.setInput(createAudioInput(parser.value(audioInputOption), true));
+	else if(!QAudioDeviceInfo::defaultInputDevice().isNull())
+		loudnessMeter.setInput(new DeviceAudioInput);
 	MainWindow w;
 	w.show();
-	return a.exec();
+	int ret = a.exec();
+	graphicEffectsCache.clear();
+	costumeCache.clear();
+	audioMixer.setSink(nullptr);
+	loudnessMeter.setInput(nullptr);
+	if(parser.isSet(profileOption))
+		finishProfiling(parser.value(profileOption));
+	return ret;
 }
@@ -19,6 +19,9 @@
  */
 
 #include <QJsonDocument>
+#include <QJsonObject>
+#include <QFontDatabase>
+#include <QStandardPaths>
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
 
@@ -37,6 +40,12 @@ MainWindow::MainWindow(QWidget *parent)
 	view->setSizePolicy(QSizePolicy::Preferred, QSizePolicy::Preferred);
 	view->setStyleSheet("QGraphicsView { background-color: rgb(255,255,255); }");
 	view->hide();
+	// Frame statistics overlay
+	frameStatsLabel = new QLabel(view);
+	frameStatsLabel->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+	frameStatsLabel->setStyleSheet("QLabel { background-color: rgba(0,0,0,160); color: white; padding: 4px; }");
+	frameStatsLabel->setAttribute(Qt::WA_TransparentForMouseEvents);
+	frameStatsLabel->move(0, 0);
 	QMetaObject::invokeMethod(this, "adjustSceneSize", Qt::QueuedConnection);
 #ifndef Q_OS_WASM
 	QOpenGLWidget *gl = new QOpenGLWidget();
@@ -54,27 +63,42 @@ MainWindow::MainWindow(QWidget *parent)
 	ui->actionMultithreading->setChecked(settings.value("main/multithreading", false).toBool());
 	ui->actionSvgUpscale->setChecked(settings.value("main/hqsvg", true).toBool());
 	ui->actionInfiniteClones->setChecked(settings.value("main/infiniteClones", false).toBool());
+	ui->actionFrameStats->setChecked(settings.value("main/frameStats", false).toBool());
+	ui->actionProgressiveLoading->setChecked(settings.value("main/progressiveLoading", true).toBool());
+	toggleFrameStats(ui->actionFrameStats->isChecked());
+	// Downloaded assets are cached
+	assetCache = new AssetCache(QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/assets",
+		AssetCache::maxSizeSetting());
+	fetcher = new AssetFetcher(&projectAssets, this);
+	fetcher->setCache(assetCache);
+	// Assets needed by running scripts are downloaded first (this is called from the engine threads)
+	projectAssets.setRequestHandler([this](const QString &assetId) {
+		QMetaObject::invokeMethod(fetcher, "prioritize", Qt::QueuedConnection, Q_ARG(QString, assetId));
+	});
 	// Connections
 	connect(ui->actionOpen,SIGNAL(triggered()),this,SLOT(openFile()));
 	connect(ui->actionFps, &QAction::triggered, this, &MainWindow::changeFps);
 	connect(ui->actionMultithreading, &QAction::triggered, this, &MainWindow::toggleMultithreading);
 	connect(ui->actionSvgUpscale, &QAction::triggered, this, &MainWindow::toggleSvgUpscale);
 	connect(ui->actionInfiniteClones, &QAction::triggered, this, [this](bool checked) { settings.setValue("main/infiniteClones", checked); });
+	connect(ui->actionFrameStats, &QAction::triggered, this, &MainWindow::toggleFrameStats);
+	connect(ui->actionProgressiveLoading, &QAction::triggered, this, &MainWindow::toggleProgressiveLoading);
 	connect(ui->loadFromUrlButton,SIGNAL(clicked()),this,SLOT(loadFromUrl()));
 	connect(ui->greenFlag,&QPushButton::clicked,scene,&projectScene::greenFlag);
 	connect(ui->stopButton,&QPushButton::clicked,scene,&projectScene::stop);
 	connect(scene ,&projectScene::currentFpsChanged, this, &MainWindow::setCurrentFps);
+	connect(fetcher, &AssetFetcher::progress, this, &MainWindow::setAssetProgress);
+	connect(fetcher, &AssetFetcher::assetLoaded, this, &MainWindow::assetFinished);
+	connect(fetcher, &AssetFetcher::assetFailed, this, &MainWindow::assetFinished);
+	connect(fetcher, &AssetFetcher::finished, this, &MainWindow::finishLoading);
 }
 
 /*! Destroys MainWindow. */
 MainWindow::~MainWindow()
 {
+	projectAssets.setRequestHandler(nullptr);
 	delete ui;
-	for(int i=0; i < assetPointers.count(); i++)
-	{
-		if(assetPointers[i])
-			delete assetPointers[i];
-	}
+	delete assetCache;
 }
 
 /*!
@@ -83,7 +107,7 @@ MainWindow::~MainWindow()
  */
 void MainWindow::openFile(void)
 {
-	if((fileName = QFileDialog::getOpenFileName(this,tr("Open Scratch project"),QString(),tr("Scratch project JSON file") + " (project.json)")) == "")
+	if((fileName = QFileDialog::getOpenFileName(this,tr("Open Scratch project"),QString(),tr("Scratch 3 project") + " (*.sb3 project.json)")) == "")
 		return;
 	if(manager != nullptr)
 	{
@@ -94,12 +118,13 @@ void MainWindow::openFile(void)
 		currentReply->deleteLater();
 		manager = nullptr;
 		currentReply = nullptr;
-		for(int i=0; i < assetReplies.count(); i++)
-			assetReplies[i]->deleteLater();
-		assetReplies.clear();
 	}
+	fetcher->abort();
 	ui->loaderFrame->hide();
 	view->show();
+	// Mapped assets of the previous project must not be used anymore
+	scratchSprite::stopAllSounds();
+	projectAssets.clear();
 	parser = new projectParser(fileName, "", this);
 	init();
 }
@@ -117,7 +142,9 @@ void MainWindow::loadFromUrl(void)
 		scene->removeItem(oldItems[i]);
 		delete oldItems[i];
 	}
-	allSounds.clear();
+	soundCache.clear();
+	graphicEffectsCache.clear();
+	costumeCache.clear();
 	ui->greenFlag->setEnabled(false);
 	ui->stopButton->setEnabled(false);
 	view->hide();
@@ -133,10 +160,8 @@ void MainWindow::loadFromUrl(void)
 		currentReply->deleteLater();
 		manager = nullptr;
 		currentReply = nullptr;
-		for(int i=0; i < assetReplies.count(); i++)
-			assetReplies[i]->deleteLater();
-		assetReplies.clear();
 	}
+	fetcher->abort();
 	manager = new QNetworkAccessManager(this);
 	connect(manager,&QNetworkAccessManager::finished,this,&MainWindow::continueLoading);
 	// Get project ID
@@ -157,7 +182,6 @@ void MainWindow::loadFromUrl(void)
 	}
 	// Get project token
 	ui->loadingProgressLabel->setText(tr("Loading project data..."));
-	projectDataLoaded = false;
 	currentReply = manager->get(QNetworkRequest(QUrl("https://api.scratch.mit.edu/projects/" + projectID)));
 }
 
@@ -172,42 +196,81 @@ void MainWindow::continueLoading(QNetworkReply* reply)
 		currentReply = manager->get(QNetworkRequest(QUrl("https://projects.scratch.mit.edu/" + projectID + "?token=" + token)));
 		return;
 	}
-	QString loadingAssetsText = tr("Loading assets...");
-	int currentAsset;
-	if(!projectDataLoaded)
+	parser = new projectParser("",reply->readAll());
+	ui->loadingProgressLabel->setText(tr("Loading assets..."));
+	projectAssets.clear();
+	projectStarted = false;
+	// Only the assets which aren't cached are downloaded
+	QList<QMap<QString,QString>> allAssets = parser->assetIDs();
+	QList<QMap<QString,QString>> assets = assetCache->load(allAssets, &projectAssets);
+	ui->loadingProgressBar->setRange(0,assets.count());
+	ui->loadingProgressBar->setValue(0);
+	if(!settings.value("main/progressiveLoading", true).toBool())
 	{
-		parser = new projectParser("",reply->readAll());
-		ui->loadingProgressLabel->setText(loadingAssetsText);
-		assets = parser->assetIDs();
-		ui->loadingProgressBar->setRange(0,assets.count());
-		for(int i=0; i < projectAssets.count(); i++)
-		{
-			assetPointers.removeAll(projectAssets[projectAssets.keys().at(i)]);
-			delete projectAssets[projectAssets.keys().at(i)];
-		}
-		projectAssets.clear();
-		projectDataLoaded = true;
-		currentAsset = 0;
-		loadedAssets = 0;
-		assetReplies.clear();
-		for(int i=0; i < assets.count(); i++)
-			assetReplies += manager->get(QNetworkRequest(QUrl("https://assets.scratch.mit.edu/internalapi/asset/" + assets[i]["assetId"] + "." + assets[i]["dataFormat"] + "/get/")));
+		fetcher->fetch(assets);
+		return;
 	}
-	else
+	// The project starts when the current costumes of the visible sprites are loaded,
+	// the other costumes and the sounds are downloaded in the background
+	QSet<QString> initialIds;
+	for(int i=0; i < allAssets.count(); i++)
 	{
-		currentAsset = assetReplies.indexOf(reply);
-		ui->loadingProgressBar->setValue(loadedAssets+1);
-		ui->loadingProgressLabel->setText(loadingAssetsText + " (" + QString::number(loadedAssets+1) + "/" + QString::number(assets.count()) + ")");
-		QByteArray *assetData = new QByteArray(reply->readAll());
-		projectAssets.insert(assets[currentAsset]["assetId"],assetData);
-		assetPointers.append(assetData);
-		loadedAssets++;
+		if(allAssets[i].value("initial") == "true")
+			initialIds.insert(allAssets[i].value("assetId"));
 	}
-	for(int i=0; i < assetReplies.count(); i++)
+	QList<QMap<QString,QString>> initial, costumes, sounds;
+	QStringList pending;
+	initialAssets.clear();
+	for(int i=0; i < assets.count(); i++)
 	{
-		if(assetReplies[i]->isRunning())
-			return;
+		QString assetId = assets[i].value("assetId");
+		pending.append(assetId);
+		if(initialIds.contains(assetId))
+		{
+			initial.append(assets[i]);
+			initialAssets.insert(assetId);
+		}
+		else if(assets[i].value("type") == "costume")
+			costumes.append(assets[i]);
+		else
+			sounds.append(assets[i]);
 	}
+	projectAssets.setPending(pending);
+	fetcher->fetch(initial, 0);
+	fetcher->fetch(costumes, 1);
+	fetcher->fetch(sounds, 2);
+	if(initialAssets.isEmpty())
+		finishLoading();
+}
+
+/*! Shows the number of downloaded assets. */
+void MainWindow::setAssetProgress(int finished, int total)
+{
+	ui->loadingProgressBar->setValue(finished);
+	ui->loadingProgressLabel->setText(tr("Loading assets...") + " (" + QString::number(finished) + "/" + QString::number(total) + ")");
+}
+
+/*!
+ * Starts the project when the initial assets are downloaded (with progressive loading),
+ * or updates the sprites which use an asset downloaded after the project started.
+ */
+void MainWindow::assetFinished(const QString &assetId)
+{
+	if(projectStarted)
+	{
+		scene->assetLoaded(assetId);
+		return;
+	}
+	if(initialAssets.remove(assetId) && initialAssets.isEmpty() && settings.value("main/progressiveLoading", true).toBool())
+		finishLoading();
+}
+
+/*! Initializes the project when the assets are downloaded. */
+void MainWindow::finishLoading(void)
+{
+	if(projectStarted)
+		return;
+	projectStarted = true;
 	ui->loaderFrame->hide();
 	view->show();
 	init();
@@ -224,8 +287,10 @@ void MainWindow::init(void)
 		scene->removeItem(oldItems[i]);
 		delete oldItems[i];
 	}
-	allSounds.clear();
-	sprites = parser->sprites();
+	soundCache.clear();
+	graphicEffectsCache.clear();
+	costumeCache.clear();
+	sprites = parser->sprites(scene->sceneScale());
 	// Uncomment the following 2 lines to show X and Y axis
 	//scene->addLine(-240,0,240,0);
 	//scene->addLine(0,-180,0,180);
@@ -272,6 +337,11 @@ void MainWindow::changeFps(void)
 void MainWindow::setCurrentFps(int fps)
 {
 	ui->fpsLabel->setText("FPS: " + QString::number(fps));
+	if(!frameStatsLabel->isHidden())
+	{
+		frameStatsLabel->setText(scene->frameStats().text());
+		frameStatsLabel->adjustSize();
+	}
 }
 
 /*! Toggles multithreading. */
@@ -284,6 +354,23 @@ void MainWindow::toggleMultithreading(bool state)
 void MainWindow::toggleSvgUpscale(bool state)
 {
 	settings.setValue("main/hqsvg", state);
+	// The cached images with graphic effects were made from the old costume images
+	graphicEffectsCache.clear();
 	// Set scale to refresh sprites
 	scene->setScale(scene->sceneScale());
 }
+
+/*! Shows or hides the frame statistics overlay. */
+void MainWindow::toggleFrameStats(bool state)
+{
+	settings.setValue("main/frameStats", state);
+	frameStatsLabel->setText(scene->frameStats().text());
+	frameStatsLabel->adjustSize();
+	frameStatsLabel->setVisible(state);
+}
+
+/*! Toggles starting projects before all assets are downloaded. */
+void MainWindow::toggleProgressiveLoading(bool state)
+{
+	settings.setValue("main/progressiveLoading", state);
+}
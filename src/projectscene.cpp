@@ -19,22 +19,41 @@
  */
 
 #include "projectscene.h"
+#include "core/engineclock.h"
+#include "core/profiler.h"
+#include "core/loudnessmeter.h"
 
 /*! Constructs projectScene. */
 projectScene::projectScene(qreal sceneScale, QObject *parent) :
-	QGraphicsScene(parent)
+	QGraphicsScene(parent),
+	m_penLayer(new PenLayer)
 {
 	setScale(sceneScale);
 	projectRunning = false;
 	multithreading = settings.value("main/multithreading", false).toBool();
-	timerID = startTimer(1000.0 / settings.value("main/fps", 30).toInt());
+	startFrameTimer();
 	fpsTimerID = startTimer(1000); // for measuring FPS
 }
 
+/*! Destroys the projectScene object. */
+projectScene::~projectScene()
+{
+	// The pen layer isn't in the scene if the sprite list is cleared
+	if(m_penLayer->scene() != this)
+		delete m_penLayer;
+	if(pool)
+		delete pool;
+}
+
 /*! Loads list of sprite pointers. */
 void projectScene::loadSpriteList(QList<scratchSprite*> list)
 {
 	spriteList = list;
+	// Start with an empty pen layer
+	m_penLayer->clear();
+	m_penLayer->flush();
+	if(m_penLayer->scene() != this)
+		addItem(m_penLayer);
 	for(int i=0; i < spriteList.count(); i++)
 	{
 		if(spriteList[i]->isStage)
@@ -48,6 +67,9 @@ void projectScene::loadSpriteList(QList<scratchSprite*> list)
 void projectScene::clearSpriteList(void)
 {
 	spriteList.clear();
+	// Keep the pen layer when the items of the previous project are deleted
+	if(m_penLayer->scene() == this)
+		removeItem(m_penLayer);
 }
 
 /*! Overrides QGraphicsScene#mousePressEvent(). */
@@ -116,53 +138,11 @@ void projectScene::timerEvent(QTimerEvent *event)
 {
 	if(event->timerId() == timerID)
 	{
-#ifndef Q_OS_WASM
-		QVector<QFuture<void>> futureList;
-		if(multithreading)
-		{
-			int threadCount = QThread::idealThreadCount();
-			int threads = 0;
-			for(int i=0; i < spriteList.count(); i++)
-			{
-				futureList += QtConcurrent::run(spriteList[i]->engine(), &Engine::frame);
-				threads++;
-				if(threads >= threadCount)
-				{
-					for(int j=0; j < futureList.count(); j++)
-						futureList[j].waitForFinished();
-					futureList.clear();
-					threads = 0;
-				}
-			}
-			for(int i=0; i < futureList.count(); i++)
-				futureList[i].waitForFinished();
-		}
-		else
-#endif // Q_OS_WASM
-		{
-			for(int i=0; i < spriteList.count(); i++)
-				spriteList[i]->engine()->frame();
-		}
-		// Delete requested sprites
-		for(int i=0; i < deleteRequests.count(); i++)
-		{
-			removeItem(deleteRequests[i]);
-			spriteList.removeAll(deleteRequests[i]);
-			deleteRequests[i]->deleteLater();
-		}
-		deleteRequests.clear();
-		if(cloneRequests.count() > 0)
-		{
-			// Create clones and run a frame on them
-			for(int i=0; i < cloneRequests.count(); i++)
-			{
-				scratchSprite *clone = createClone(cloneRequests[i]);
-				if(clone != nullptr)
-					clone->engine()->frame();
-			}
-			cloneRequests.clear();
-		}
-		frames++;
+		// Timer jitter
+		if(lastTickTimer.isValid())
+			stats.addJitter(lastTickTimer.nsecsElapsed() - (qint64) timerInterval * 1000000);
+		lastTickTimer.start();
+		tick();
 	}
 	else if(event->timerId() == fpsTimerID)
 	{
@@ -173,12 +153,194 @@ void projectScene::timerEvent(QTimerEvent *event)
 	event->accept();
 }
 
+/*! Runs one frame of all sprites. This is called by the frame timer. */
+void projectScene::tick(void)
+{
+	bool profiling = Profiler::isEnabled();
+	qint64 tickStart = profiling ? Profiler::now() : 0;
+	EngineClock::advance();
+#ifdef Q_OS_WASM
+	// There's no mixer thread and no loudness meter thread
+	audioMixer.renderAvailable();
+	loudnessMeter.processAvailable();
+#endif // Q_OS_WASM
+	QElapsedTimer tickTimer, phaseTimer;
+	tickTimer.start();
+	phaseTimer.start();
+	// Other sprites read the values from the start of the frame
+	spriteStore.takeSnapshot();
+	FrameStats::takeEffectsTime();
+	qint64 eventsTime, scriptsTime;
+	runEngines(&eventsTime, &scriptsTime);
+	phaseTimer.restart();
+	commitWrites();
+	stats.addSample(FrameStats::EventsPhase, eventsTime);
+	stats.addSample(FrameStats::ScriptsPhase, scriptsTime + phaseTimer.nsecsElapsed());
+	phaseTimer.restart();
+	// Delete requested sprites
+	for(int i=0; i < deleteRequests.count(); i++)
+	{
+		removeItem(deleteRequests[i]);
+		spriteList.removeAll(deleteRequests[i]);
+		deleteRequests[i]->deleteLater();
+	}
+	deleteRequests.clear();
+	stats.addSample(FrameStats::CloneDeletionPhase, phaseTimer.nsecsElapsed());
+	phaseTimer.restart();
+	if(cloneRequests.count() > 0)
+	{
+		// Create clones and run a frame on them
+		for(int i=0; i < cloneRequests.count(); i++)
+		{
+			scratchSprite *clone = createClone(cloneRequests[i]);
+			if(clone != nullptr)
+			{
+				clone->engine()->frameEvents();
+				clone->engine()->frame();
+				clone->engine()->commitWrites();
+			}
+		}
+		cloneRequests.clear();
+	}
+	stats.addSample(FrameStats::CloneCreationPhase, phaseTimer.nsecsElapsed());
+	stats.addSample(FrameStats::EffectsPhase, FrameStats::takeEffectsTime());
+	// Draw the pen lines and stamps of this frame
+	phaseTimer.restart();
+	for(int i=0; i < spriteList.count(); i++)
+	{
+		// The pen layer is between the stage and the sprites
+		if(spriteList[i]->isStage)
+			m_penLayer->setZValue(spriteList[i]->zValue() + 0.5);
+	}
+	m_penLayer->flush();
+	stats.addSample(FrameStats::PenPhase, phaseTimer.nsecsElapsed());
+	stats.addSample(FrameStats::TickPhase, tickTimer.nsecsElapsed());
+	if(profiling)
+		Profiler::recordTick(tickStart);
+	frames++;
+}
+
+/*!
+ * Runs a frame of all sprites (in parallel if multithreading is enabled).\n
+ * Each sprite checks its frame events and then runs its scripts. The time spent in both phases
+ * is added up over all sprites and stored in eventsTime and scriptsTime.
+ */
+void projectScene::runEngines(qint64 *eventsTime, qint64 *scriptsTime)
+{
+	int count = spriteList.count();
+	// Every sprite writes its own slot, so the workers don't need a lock
+	QVector<qint64> timeList(count * 2);
+	qint64 *times = timeList.data();
+	auto runSprite = [this, times](int i) {
+		QElapsedTimer timer;
+		timer.start();
+		Engine *engine = spriteList[i]->engine();
+		engine->frameEvents();
+		times[i * 2] = timer.nsecsElapsed();
+		engine->frame();
+		times[i * 2 + 1] = timer.nsecsElapsed() - times[i * 2];
+	};
+	if(multithreading)
+	{
+		if(pool == nullptr)
+			pool = new WorkerPool;
+		pool->run(count, runSprite);
+	}
+	else
+	{
+		for(int i=0; i < count; i++)
+			runSprite(i);
+	}
+	*eventsTime = 0;
+	*scriptsTime = 0;
+	for(int i=0; i < count; i++)
+	{
+		*eventsTime += times[i * 2];
+		*scriptsTime += times[i * 2 + 1];
+	}
+}
+
+/*!
+ * Runs the deferred writes of all sprites on the main thread.\n
+ * The writes are committed in the order of the sprite list, so the result doesn't depend on which
+ * sprites ran in parallel.
+ */
+void projectScene::commitWrites(void)
+{
+	for(int i=0; i < spriteList.count(); i++)
+		spriteList[i]->engine()->commitWrites();
+}
+
+/*! Starts the frame timer using the FPS from the settings. */
+void projectScene::startFrameTimer(void)
+{
+	if(timerID != -1)
+		killTimer(timerID);
+	timerInterval = 1000.0 / settings.value("main/fps", 30).toInt();
+	timerID = startTimer(timerInterval);
+	lastTickTimer.invalidate();
+}
+
+/*! Returns the pen layer. */
+PenLayer *projectScene::penLayer(void)
+{
+	return m_penLayer;
+}
+
+/*! Returns the statistics of recent frames. */
+const FrameStats &projectScene::frameStats(void) const
+{
+	return stats;
+}
+
+/*! Overrides QGraphicsScene#drawBackground(). Painting starts with the background. */
+void projectScene::drawBackground(QPainter *painter, const QRectF &rect)
+{
+	paintTimer.start();
+	QGraphicsScene::drawBackground(painter, rect);
+}
+
+/*! Overrides QGraphicsScene#drawForeground(). Painting ends with the foreground. */
+void projectScene::drawForeground(QPainter *painter, const QRectF &rect)
+{
+	QGraphicsScene::drawForeground(painter, rect);
+	if(paintTimer.isValid())
+	{
+		stats.addSample(FrameStats::PaintingPhase, paintTimer.nsecsElapsed());
+		paintTimer.invalidate();
+	}
+}
+
+/*! Starts or stops the frame timer. The timer is stopped when the frames are run by tick() calls (e.g. in headless mode). */
+void projectScene::setTimerEnabled(bool enabled)
+{
+	if(timerID != -1)
+		killTimer(timerID);
+	timerID = -1;
+	if(enabled)
+		startFrameTimer();
+}
+
+/*! Returns true if any script is running or any clone is waiting to be created. */
+bool projectScene::isRunning(void)
+{
+	if(cloneRequests.count() > 0)
+		return true;
+	for(int i=0; i < spriteList.count(); i++)
+	{
+		if(!spriteList[i]->engine()->currentExecPos.isEmpty())
+			return true;
+	}
+	return false;
+}
+
 /*! Sets FPS. */
 void projectScene::setFps(int fps)
 {
 	settings.setValue("main/fps", fps);
-	killTimer(timerID);
-	timerID = startTimer(1000.0 / fps);
+	if(timerID == -1)
+		return;
+	startFrameTimer();
 }
 
 /*! Returns measured FPS value. */
@@ -194,6 +356,13 @@ void projectScene::backdropSwitched(QVariantMap *script)
 		spriteList[i]->backdropSwitchEvent(script);
 }
 
+/*! Updates the sprites (and clones) which use the given asset, when it's downloaded after the project started. */
+void projectScene::assetLoaded(const QString &assetId)
+{
+	for(int i=0; i < spriteList.count(); i++)
+		spriteList[i]->assetLoaded(assetId);
+}
+
 /*! Connected from scratchSprite#broadcast(). */
 void projectScene::broadcastSent(QString broadcastName, QVariantMap *script)
 {
@@ -213,6 +382,7 @@ void projectScene::setScale(qreal value)
 {
 	scale = value;
 	setSceneRect(-240 * scale, -180 * scale, 480 * scale, 360 * scale);
+	m_penLayer->setStageScale(scale);
 	for(int i=0; i < spriteList.count(); i++)
 		spriteList[i]->setSceneScale(scale);
 }
@@ -236,26 +406,29 @@ scratchSprite* projectScene::createClone(scratchSprite *targetSprite)
 	// Clone limit
 	if((count >= 300) && !settings.value("main/infiniteClones", false).toBool())
 		return nullptr;
-	// Create the clone
-	scratchSprite *clone = new scratchSprite(targetSprite->jsonObject, targetSprite->assetDir);
+	// Create the clone at the scene scale with the costume of the target sprite, so the costume isn't decoded again
+	TargetData data = targetSprite->targetData;
+	data.currentCostume = targetSprite->currentCostume();
+	scratchSprite *clone = new scratchSprite(data, targetSprite->assetDir, targetSprite->sceneScale, targetSprite->currentCostumeImage());
 	addItem(clone);
 	spriteList.append(clone);
 	// Copy properties from target sprite to the clone
-	clone->setSceneScale(targetSprite->sceneScale);
-	clone->setXPos(targetSprite->spriteX);
-	clone->setYPos(targetSprite->spriteY);
-	clone->setCostume(targetSprite->currentCostume);
+	spriteStore.copy(targetSprite->handle(), clone->handle());
+	clone->rotationStyle = targetSprite->rotationStyle;
+	clone->setSceneScale(targetSprite->sceneScale); // updates the graphics item and releases the costume image
 	clone->setVolume(targetSprite->volume);
+	clone->setSoundEffect("PITCH", targetSprite->pitchEffect);
+	clone->setSoundEffect("PAN", targetSprite->panEffect);
 	clone->tempo = targetSprite->tempo;
-	clone->setSize(targetSprite->size);
-	clone->rotationStyle = targetSprite->rotationStyle; // Rotation style must be set before direction
-	clone->setDirection(targetSprite->direction);
 	clone->draggable = targetSprite->draggable; // TODO: draggable will probably need a function later
-	clone->graphicEffects = targetSprite->graphicEffects;
-	clone->installGraphicEffects();
-	clone->setVisible(targetSprite->isVisible());
+	clone->pen = targetSprite->pen;
+	// Clones are placed behind the target sprite
+	layerList.moveBehind(clone, targetSprite);
 	// TODO: Copy variables
 	// TODO: Copy lists
+	// Clones continue the random number stream of the target sprite
+	clone->engine()->random.seed(targetSprite->engine()->random.next());
+	clone->takeSnapshot();
 	clone->startClone();
 	return clone;
 }
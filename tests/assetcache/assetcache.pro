@@ -0,0 +1,21 @@
+include(../../runtime.pri)
+
+QT += testlib
+
+TARGET = tst_assetcache
+CONFIG += c++11 console testcase
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+# The stand-in server and the asset helpers are shared by the tests
+INCLUDEPATH += ../common
+
+SOURCES += \
+    tst_assetcache.cpp \
+    ../common/standinserver.cpp \
+    ../common/assetfixtures.cpp
+
+HEADERS += \
+    ../common/standinserver.h \
+    ../common/assetfixtures.h
@@ -0,0 +1,181 @@
+/*
+ * tst_assetcache.cpp
+ * This file is part of QScratchRuntime
+ *
+ * Copyright (C) 2023 - adazem009
+ *
+ * QScratchRuntime is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * QScratchRuntime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QScratchRuntime. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QtTest>
+#include <QTemporaryDir>
+#include <QCryptographicHash>
+#include "core/assetcache.h"
+#include "core/assetfetcher.h"
+#include "standinserver.h"
+#include "assetfixtures.h"
+
+/*! \brief The TestAssetCache class tests AssetCache together with AssetFetcher and a local stand-in server. */
+class TestAssetCache : public QObject
+{
+	Q_OBJECT
+	private slots:
+		void initTestCase(void);
+		void cacheHit(void);
+		void corruptedFile(void);
+		void lruEviction(void);
+		void interruptedWrite(void);
+
+	private:
+		static QByteArray data(int size, char seed);
+		static QString assetId(const QByteArray &data);
+		QTemporaryDir settingsDir;
+};
+
+/*! Uses a temporary directory for the settings, so the settings of the user aren't changed. */
+void TestAssetCache::initTestCase(void)
+{
+	QVERIFY(settingsDir.isValid());
+	QCoreApplication::setOrganizationName("QScratchRuntimeTest");
+	QCoreApplication::setApplicationName("tst_assetcache");
+	QSettings::setPath(QSettings::NativeFormat, QSettings::UserScope, settingsDir.path());
+	QSettings::setPath(QSettings::IniFormat, QSettings::UserScope, settingsDir.path());
+}
+
+/*! A cached asset is loaded from the disk without a request. */
+void TestAssetCache::cacheHit(void)
+{
+	QTemporaryDir dir;
+	StandInServer server;
+	AssetStore store;
+	QByteArray content = data(1000, 'a');
+	QString id = assetId(content);
+	server.setResponse("/" + id + ".svg", content);
+	QVERIFY(AssetCache(dir.path(), 1 << 20).insert(id, "svg", content));
+	// A new cache reads the files from the directory
+	AssetCache cache(dir.path(), 1 << 20);
+	QList<QMap<QString,QString>> missing = cache.load({AssetFixtures::asset(id)}, &store);
+	QVERIFY(missing.isEmpty());
+	QCOMPARE(store.asset(id), content);
+	AssetFetcher fetcher(&store);
+	fetcher.setUrlTemplate(server.urlTemplate());
+	fetcher.setCache(&cache);
+	QVERIFY(AssetFixtures::fetch(&fetcher, missing));
+	QCOMPARE(server.requestCount(), 0);
+}
+
+/*! A cached file which doesn't match its MD5 hash is removed, downloaded again and replaced. */
+void TestAssetCache::corruptedFile(void)
+{
+	QTemporaryDir dir;
+	StandInServer server;
+	AssetStore store;
+	QByteArray content = data(1000, 'b');
+	QString id = assetId(content);
+	QString fileName = dir.path() + "/" + id + ".svg";
+	server.setResponse("/" + id + ".svg", content);
+	QFile file(fileName);
+	QVERIFY(file.open(QFile::WriteOnly));
+	file.write(data(1000, 'c'));
+	file.close();
+	AssetCache cache(dir.path(), 1 << 20);
+	QList<QMap<QString,QString>> missing = cache.load({AssetFixtures::asset(id)}, &store);
+	QCOMPARE(missing.count(), 1);
+	QVERIFY(!QFile::exists(fileName));
+	QVERIFY(!store.contains(id));
+	AssetFetcher fetcher(&store);
+	fetcher.setUrlTemplate(server.urlTemplate());
+	fetcher.setCache(&cache);
+	QSignalSpy written(&cache, &AssetCache::assetWritten);
+	QVERIFY(AssetFixtures::fetch(&fetcher, missing));
+	cache.waitForWrites();
+	QCOMPARE(server.requestCount("/" + id + ".svg"), 1);
+	QCOMPARE(store.asset(id), content);
+	QCOMPARE(written.count(), 1);
+	QCOMPARE(written.first().at(1).toBool(), true);
+	QVERIFY(file.open(QFile::ReadOnly));
+	QCOMPARE(file.readAll(), content);
+}
+
+/*! The least recently used files are removed when the size set in main/assetCacheSize is exceeded. */
+void TestAssetCache::lruEviction(void)
+{
+	QTemporaryDir dir;
+	AssetStore store;
+	QSettings().setValue("main/assetCacheSize", 1);
+	QCOMPARE(AssetCache::maxSizeSetting(), qint64(1024 * 1024));
+	AssetCache cache(dir.path(), AssetCache::maxSizeSetting());
+	QByteArray a = data(400 * 1024, 'd');
+	QByteArray b = data(400 * 1024, 'e');
+	QByteArray c = data(400 * 1024, 'f');
+	QVERIFY(cache.insert(assetId(a), "png", a));
+	QVERIFY(cache.insert(assetId(b), "png", b));
+	// Loading the first asset makes it the most recently used one
+	QVERIFY(cache.load({AssetFixtures::asset(assetId(a))}, &store).isEmpty());
+	QVERIFY(cache.insert(assetId(c), "png", c));
+	QVERIFY(QFile::exists(dir.path() + "/" + assetId(a) + ".png"));
+	QVERIFY(!QFile::exists(dir.path() + "/" + assetId(b) + ".png"));
+	QVERIFY(QFile::exists(dir.path() + "/" + assetId(c) + ".png"));
+	QCOMPARE(cache.size(), qint64(800 * 1024));
+	QVERIFY(cache.size() <= cache.maxSize());
+	QSettings().remove("main/assetCacheSize");
+}
+
+/*! Interrupted downloads and writes don't leave partial files in the cache. */
+void TestAssetCache::interruptedWrite(void)
+{
+	QTemporaryDir dir;
+	StandInServer server;
+	AssetStore store;
+	QByteArray content = data(64 * 1024, 'g');
+	QString id = assetId(content);
+	server.setResponse("/" + id + ".svg", content);
+	server.setFailures("/" + id + ".svg", StandInServer::TruncateBody, 1);
+	AssetCache cache(dir.path(), 1 << 20);
+	AssetFetcher fetcher(&store);
+	fetcher.setUrlTemplate(server.urlTemplate());
+	fetcher.setCache(&cache);
+	fetcher.setMaxRetries(0);
+	QVERIFY(AssetFixtures::fetch(&fetcher, {AssetFixtures::asset(id)}));
+	cache.waitForWrites();
+	QCOMPARE(fetcher.failedCount(), 1);
+	QVERIFY(QDir(dir.path()).entryList(QDir::Files | QDir::Hidden).isEmpty());
+	// Temporary file of a write which was interrupted (e.g. by a crash)
+	QFile file(dir.path() + "/" + id + ".svg.aB3dE9");
+	QVERIFY(file.open(QFile::WriteOnly));
+	file.write(content.left(1000));
+	file.close();
+	AssetCache newCache(dir.path(), 1 << 20);
+	QVERIFY(!file.exists());
+	QCOMPARE(newCache.size(), qint64(0));
+	QCOMPARE(newCache.load({AssetFixtures::asset(id)}, &store).count(), 1);
+}
+
+/*! Returns data of the given size, which is different for each seed. */
+QByteArray TestAssetCache::data(int size, char seed)
+{
+	QByteArray out(size, seed);
+	for(int i=0; i < size; i += 7)
+		out[i] = char(i * seed);
+	return out;
+}
+
+/*! Returns the asset ID (MD5 hash) of the given data. */
+QString TestAssetCache::assetId(const QByteArray &data)
+{
+	return QCryptographicHash::hash(data, QCryptographicHash::Md5).toHex();
+}
+
+QTEST_GUILESS_MAIN(TestAssetCache)
+#include "tst_assetcache.moc"
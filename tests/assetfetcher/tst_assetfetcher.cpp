@@ -0,0 +1,144 @@
+/*
+ * tst_assetfetcher.cpp
+ * This file is part of QScratchRuntime
+ *
+ * Copyright (C) 2023 - adazem009
+ *
+ * QScratchRuntime is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * QScratchRuntime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QScratchRuntime. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QtTest>
+#include "core/assetfetcher.h"
+#include "standinserver.h"
+#include "assetfixtures.h"
+
+/*! \brief The TestAssetFetcher class tests AssetFetcher against a local stand-in server. */
+class TestAssetFetcher : public QObject
+{
+	Q_OBJECT
+	private slots:
+		void concurrencyLimit(void);
+		void retries(void);
+		void transferTimeout(void);
+		void finishedRequests(void);
+
+	private:
+};
+
+/*! The number of requests in flight never exceeds maxConcurrent(). */
+void TestAssetFetcher::concurrencyLimit(void)
+{
+	StandInServer server;
+	AssetStore store;
+	QList<QMap<QString,QString>> assets;
+	for(int i=0; i < 20; i++)
+	{
+		QString id = "asset" + QString::number(i);
+		server.setResponse("/" + id + ".svg", "data" + QByteArray::number(i), 50);
+		assets.append(AssetFixtures::asset(id));
+	}
+	AssetFetcher fetcher(&store);
+	fetcher.setUrlTemplate(server.urlTemplate());
+	fetcher.setMaxConcurrent(3);
+	int maxRunning = 0;
+	connect(&fetcher, &AssetFetcher::progress, this, [&fetcher, &maxRunning]() {
+		maxRunning = qMax(maxRunning, fetcher.runningCount());
+	});
+	QVERIFY(AssetFixtures::fetch(&fetcher, assets));
+	QCOMPARE(fetcher.loadedCount(), 20);
+	QCOMPARE(server.requestCount(), 20);
+	QVERIFY(server.maxInFlight() <= 3);
+	QVERIFY(server.maxInFlight() > 1);
+	QVERIFY(maxRunning <= 3);
+}
+
+/*! Server errors and dropped connections are retried with an exponential backoff, then the request fails. */
+void TestAssetFetcher::retries(void)
+{
+	StandInServer server;
+	AssetStore store;
+	server.setResponse("/flaky.svg", "flaky");
+	server.setFailures("/flaky.svg", StandInServer::ServerError, 2);
+	server.setResponse("/dropped.svg", "dropped");
+	server.setFailures("/dropped.svg", StandInServer::DropConnection, 100);
+	AssetFetcher fetcher(&store);
+	fetcher.setUrlTemplate(server.urlTemplate());
+	fetcher.setMaxRetries(2);
+	QSignalSpy failed(&fetcher, &AssetFetcher::assetFailed);
+	QVERIFY(AssetFixtures::fetch(&fetcher, {AssetFixtures::asset("flaky"), AssetFixtures::asset("dropped")}));
+	QCOMPARE(store.asset("flaky"), QByteArray("flaky"));
+	QVERIFY(!store.contains("dropped"));
+	QCOMPARE(failed.count(), 1);
+	QCOMPARE(failed.first().at(0).toString(), QString("dropped"));
+	// The first request and 2 retries
+	QCOMPARE(server.requestCount("/flaky.svg"), 3);
+	QCOMPARE(server.requestCount("/dropped.svg"), 3);
+	// The retries are delayed by 500 and 1000 ms (timers can fire a bit early)
+	QList<qint64> times = server.requestTimes("/flaky.svg");
+	QVERIFY(times[1] - times[0] >= 450);
+	QVERIFY(times[2] - times[1] >= 950);
+}
+
+/*! Requests which don't receive any data are aborted and retried. */
+void TestAssetFetcher::transferTimeout(void)
+{
+	StandInServer server;
+	AssetStore store;
+	server.setResponse("/stalled.svg", "stalled");
+	server.setFailures("/stalled.svg", StandInServer::Stall, 1);
+	AssetFetcher fetcher(&store);
+	fetcher.setUrlTemplate(server.urlTemplate());
+	fetcher.setTransferTimeout(300);
+	fetcher.setMaxRetries(1);
+	QVERIFY(AssetFixtures::fetch(&fetcher, {AssetFixtures::asset("stalled")}));
+	QCOMPARE(fetcher.loadedCount(), 1);
+	QCOMPARE(server.requestCount("/stalled.svg"), 2);
+	QCOMPARE(store.asset("stalled"), QByteArray("stalled"));
+}
+
+/*!
+ * Finished requests are removed from the running requests immediately (they're in a hash set,
+ * so this doesn't depend on the number of requests), before the next requests start.
+ */
+void TestAssetFetcher::finishedRequests(void)
+{
+	StandInServer server;
+	AssetStore store;
+	QList<QMap<QString,QString>> assets;
+	for(int i=0; i < 200; i++)
+	{
+		QString id = "asset" + QString::number(i);
+		if(i % 10 != 0)
+			server.setResponse("/" + id + ".svg", "data");
+		assets.append(AssetFixtures::asset(id));
+	}
+	AssetFetcher fetcher(&store);
+	fetcher.setUrlTemplate(server.urlTemplate());
+	fetcher.setMaxConcurrent(4);
+	bool removed = true;
+	auto check = [&fetcher, &removed]() {
+		removed = removed && (fetcher.runningCount() < fetcher.maxConcurrent());
+	};
+	connect(&fetcher, &AssetFetcher::assetLoaded, this, check);
+	connect(&fetcher, &AssetFetcher::assetFailed, this, check);
+	QVERIFY(AssetFixtures::fetch(&fetcher, assets));
+	QVERIFY(removed);
+	QCOMPARE(fetcher.loadedCount(), 180);
+	QCOMPARE(fetcher.failedCount(), 20);
+	QCOMPARE(fetcher.runningCount(), 0);
+	QVERIFY(fetcher.isFinished());
+}
+
+QTEST_GUILESS_MAIN(TestAssetFetcher)
+#include "tst_assetfetcher.moc"
@@ -0,0 +1,39 @@
+/*
+ * assetfixtures.cpp
+ * This file is part of QScratchRuntime
+ *
+ * Copyright (C) 2023 - adazem009
+ *
+ * QScratchRuntime is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * QScratchRuntime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QScratchRuntime. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QSignalSpy>
+#include "assetfixtures.h"
+
+/*! Returns the asset map of an SVG asset. The data format of the files doesn't matter to the fetcher and the cache. */
+QMap<QString,QString> AssetFixtures::asset(const QString &assetId)
+{
+	QMap<QString,QString> out;
+	out.insert("assetId", assetId);
+	out.insert("dataFormat", "svg");
+	return out;
+}
+
+/*! Fetches the given assets and waits until the fetcher is finished. Returns false on timeout (in milliseconds). */
+bool AssetFixtures::fetch(AssetFetcher *fetcher, const QList<QMap<QString,QString>> &assets, int timeout)
+{
+	QSignalSpy finished(fetcher, &AssetFetcher::finished);
+	fetcher->fetch(assets);
+	return finished.wait(timeout);
+}
@@ -0,0 +1,37 @@
+/*
+ * assetfixtures.h
+ * This file is part of QScratchRuntime
+ *
+ * Copyright (C) 2023 - adazem009
+ *
+ * QScratchRuntime is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * QScratchRuntime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QScratchRuntime. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ASSETFIXTURES_H
+#define ASSETFIXTURES_H
+
+#include <QMap>
+#include <QList>
+#include <QString>
+#include "core/assetfetcher.h"
+
+/*! \brief The AssetFixtures class has helper functions shared by the asset tests. */
+class AssetFixtures
+{
+	public:
+		static QMap<QString,QString> asset(const QString &assetId);
+		static bool fetch(AssetFetcher *fetcher, const QList<QMap<QString,QString>> &assets, int timeout = 20000);
+};
+
+#endif // ASSETFIXTURES_H
@@ -0,0 +1,139 @@
+/*
+ * standinserver.cpp
+ * This file is part of QScratchRuntime
+ *
+ * Copyright (C) 2023 - adazem009
+ *
+ * QScratchRuntime is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * QScratchRuntime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QScratchRuntime. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QTimer>
+#include "standinserver.h"
+
+/*! Constructs StandInServer and starts listening on a free local port. */
+StandInServer::StandInServer(QObject *parent) :
+	QTcpServer(parent)
+{
+	timer.start();
+	listen(QHostAddress::LocalHost);
+	connect(this, &QTcpServer::newConnection, this, [this]() {
+		while(hasPendingConnections())
+		{
+			QTcpSocket *socket = nextPendingConnection();
+			connect(socket, &QTcpSocket::readyRead, this, [this, socket]() {
+				readRequest(socket);
+			});
+			connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+		}
+	});
+}
+
+/*! Returns the asset URL template for AssetFetcher#setUrlTemplate(). Assets are at /<asset ID>.<data format>. */
+QString StandInServer::urlTemplate(void) const
+{
+	return QString("http://127.0.0.1:%1/%2.%3").arg(serverPort()).arg("%1", "%2");
+}
+
+/*! Sets the body of the response to the given path (e.g. "/abc.svg"). The response is sent after delay ms. */
+void StandInServer::setResponse(const QString &path, const QByteArray &body, int delay)
+{
+	routes[path].body = body;
+	routes[path].delay = delay;
+}
+
+/*! Makes the next count requests of the given path fail. */
+void StandInServer::setFailures(const QString &path, Failure failure, int count)
+{
+	routes[path].failure = failure;
+	routes[path].failureCount = count;
+}
+
+/*! Returns the number of received requests. */
+int StandInServer::requestCount(void) const
+{
+	return m_requestCount;
+}
+
+/*! Returns the number of received requests of the given path. */
+int StandInServer::requestCount(const QString &path) const
+{
+	return requests.value(path).count();
+}
+
+/*! Returns the times (in ms since the server was created) of the requests of the given path. */
+QList<qint64> StandInServer::requestTimes(const QString &path) const
+{
+	return requests.value(path);
+}
+
+/*! Returns the maximum number of requests which were in flight at the same time. */
+int StandInServer::maxInFlight(void) const
+{
+	return m_maxInFlight;
+}
+
+/*! Reads the request line when the whole request header is received. */
+void StandInServer::readRequest(QTcpSocket *socket)
+{
+	if(socket->property("handled").toBool() || !socket->peek(65536).contains("\r\n\r\n"))
+		return;
+	socket->setProperty("handled", true);
+	QList<QByteArray> requestLine = socket->readLine().trimmed().split(' ');
+	QString path = QString::fromUtf8(requestLine.value(1));
+	m_requestCount++;
+	requests[path].append(timer.elapsed());
+	inFlight++;
+	m_maxInFlight = qMax(m_maxInFlight, inFlight);
+	QTimer::singleShot(routes.value(path).delay, socket, [this, socket, path]() {
+		respond(socket, path);
+	});
+}
+
+/*! Sends the response (or the failure) of the given path. */
+void StandInServer::respond(QTcpSocket *socket, const QString &path)
+{
+	Route &route = routes[path];
+	int status = route.body.isNull() ? 404 : 200;
+	QByteArray body = route.body;
+	if(route.failureCount > 0)
+	{
+		route.failureCount--;
+		switch(route.failure)
+		{
+			case ServerError:
+				status = 503;
+				body = "Service Unavailable";
+				break;
+			case DropConnection:
+				inFlight--;
+				socket->abort();
+				return;
+			case TruncateBody:
+				body = body.left(body.size() / 2);
+				break;
+			case Stall:
+				// The request stays in flight until the client aborts it
+				connect(socket, &QTcpSocket::disconnected, this, [this]() { inFlight--; });
+				return;
+		}
+	}
+	QByteArray header = "HTTP/1.1 " + QByteArray::number(status) + (status == 200 ? " OK" : " Error") + "\r\n";
+	header += "Content-Type: application/octet-stream\r\n";
+	// The length of the whole body is sent even if the body is truncated
+	header += "Content-Length: " + QByteArray::number(route.body.isNull() || (status != 200) ? body.size() : route.body.size()) + "\r\n";
+	header += "Connection: close\r\n\r\n";
+	inFlight--;
+	socket->write(header + body);
+	socket->disconnectFromHost();
+}
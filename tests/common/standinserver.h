@@ -0,0 +1,77 @@
+/*
+ * standinserver.h
+ * This file is part of QScratchRuntime
+ *
+ * Copyright (C) 2023 - adazem009
+ *
+ * QScratchRuntime is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * QScratchRuntime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QScratchRuntime. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef STANDINSERVER_H
+#define STANDINSERVER_H
+
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QHash>
+#include <QList>
+#include <QElapsedTimer>
+
+/*!
+ * \brief The StandInServer class is a minimal local HTTP server, which stands in for the Scratch asset server in tests.
+ *
+ * Each path has a response, which can also fail in several ways (server error, dropped connection,
+ * truncated body or no response at all) for a given number of requests before it succeeds.
+ * The server counts the requests and the requests which are in flight (received, but not answered yet).
+ */
+class StandInServer : public QTcpServer
+{
+	Q_OBJECT
+	public:
+		/*! How the server fails. */
+		enum Failure
+		{
+			ServerError, /*!< 503 Service Unavailable */
+			DropConnection, /*!< the connection is closed without a response */
+			TruncateBody, /*!< the connection is closed in the middle of the body */
+			Stall /*!< nothing is sent and the connection stays open */
+		};
+		explicit StandInServer(QObject *parent = nullptr);
+		QString urlTemplate(void) const;
+		void setResponse(const QString &path, const QByteArray &body, int delay = 0);
+		void setFailures(const QString &path, Failure failure, int count);
+		int requestCount(void) const;
+		int requestCount(const QString &path) const;
+		QList<qint64> requestTimes(const QString &path) const;
+		int maxInFlight(void) const;
+
+	private:
+		/*! Response to the requests of a path. */
+		struct Route
+		{
+			QByteArray body;
+			int delay = 0;
+			Failure failure = ServerError;
+			int failureCount = 0;
+		};
+		void readRequest(QTcpSocket *socket);
+		void respond(QTcpSocket *socket, const QString &path);
+		QHash<QString,Route> routes;
+		QHash<QString,QList<qint64>> requests;
+		QElapsedTimer timer;
+		int m_requestCount = 0;
+		int inFlight = 0;
+		int m_maxInFlight = 0;
+};
+
+#endif // STANDINSERVER_H
@@ -0,0 +1,12 @@
+include(../../runtime.pri)
+
+QT += testlib
+
+TARGET = tst_graphiceffects
+CONFIG += c++11 console testcase
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+SOURCES += \
+    tst_graphiceffects.cpp
@@ -0,0 +1,244 @@
+/*
+ * tst_graphiceffects.cpp
+ * This file is part of QScratchRuntime
+ *
+ * Copyright (C) 2023 - adazem009
+ *
+ * QScratchRuntime is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * QScratchRuntime is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with QScratchRuntime. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QtTest>
+#include "core/graphiceffects.h"
+
+/*! \brief The TestGraphicEffects class compares graphic effects with the output of Scratch. */
+class TestGraphicEffects : public QObject
+{
+	Q_OBJECT
+	private slots:
+		void pixelate_data(void);
+		void pixelate(void);
+		void whirl(void);
+		void fisheye(void);
+		void mosaic(void);
+		void center_data(void);
+		void center(void);
+		void bands(void);
+
+	private:
+		static QImage coordinateImage(int width, int height);
+		static ImageEffects effects(GraphicEffects::Effect effect, qreal value);
+		static qreal distance(qreal x1, qreal y1, qreal x2, qreal y2);
+};
+
+/*! Returns an image where each pixel has its x coordinate in the red channel and y coordinate in the green channel. */
+QImage TestGraphicEffects::coordinateImage(int width, int height)
+{
+	QImage image(width, height, QImage::Format_ARGB32);
+	for(int y=0; y < height; y++)
+	{
+		for(int x=0; x < width; x++)
+			image.setPixel(x, y, qRgb(x, y, 0));
+	}
+	return image;
+}
+
+/*! Returns the image effects with one effect set to the given value. */
+ImageEffects TestGraphicEffects::effects(GraphicEffects::Effect effect, qreal value)
+{
+	qreal values[GraphicEffects::EffectCount] = {};
+	values[effect] = value;
+	return GraphicEffects::imageEffects(values);
+}
+
+/*! Returns the distance between two points. */
+qreal TestGraphicEffects::distance(qreal x1, qreal y1, qreal x2, qreal y2)
+{
+	return qSqrt((x1 - x2) * (x1 - x2) + (y1 - y2) * (y1 - y2));
+}
+
+/*! Pixelate values and the size of the cells in Scratch units. */
+void TestGraphicEffects::pixelate_data(void)
+{
+	QTest::addColumn<qreal>("value");
+	QTest::addColumn<qreal>("pixelScale");
+	QTest::addColumn<int>("cellSize");
+	QTest::newRow("50") << 50.0 << 1.0 << 5;
+	QTest::newRow("-50") << -50.0 << 1.0 << 5;
+	QTest::newRow("100") << 100.0 << 1.0 << 10;
+	QTest::newRow("50 at scale 2") << 50.0 << 2.0 << 10;
+}
+
+/*! Each cell of the pixelated image has the color of the pixel in its center, like in scratch-render. */
+void TestGraphicEffects::pixelate(void)
+{
+	QFETCH(qreal, value);
+	QFETCH(qreal, pixelScale);
+	QFETCH(int, cellSize);
+	QImage image(40, 40, QImage::Format_ARGB32);
+	for(int y=0; y < image.height(); y++)
+	{
+		for(int x=0; x < image.width(); x++)
+			image.setPixel(x, y, qRgb(x * 6, y * 6, 0));
+	}
+	qreal values[GraphicEffects::EffectCount] = {};
+	values[GraphicEffects::PixelateEffect] = value;
+	ImageEffects effects = GraphicEffects::imageEffects(values);
+	QCOMPARE(effects.pixelate, qAbs(value) / 10);
+	QImage out = GraphicEffects::apply(image, effects, pixelScale);
+	for(int y=0; y < out.height(); y++)
+	{
+		for(int x=0; x < out.width(); x++)
+		{
+			int sourceX = (x / cellSize) * cellSize + cellSize / 2;
+			int sourceY = (y / cellSize) * cellSize + cellSize / 2;
+			QCOMPARE(out.pixel(x, y), image.pixel(sourceX, sourceY));
+		}
+	}
+}
+
+/*! Whirl rotates pixels around the center, the corners (outside the whirl radius) don't move. */
+void TestGraphicEffects::whirl(void)
+{
+	const int size = 40;
+	const qreal center = size / 2.0;
+	QImage out = GraphicEffects::apply(coordinateImage(size, size), effects(GraphicEffects::WhirlEffect, 90), 1);
+	int moved = 0;
+	for(int y=0; y < size; y++)
+	{
+		for(int x=0; x < size; x++)
+		{
+			QRgb pixel = out.pixel(x, y);
+			qreal radius = distance(x + 0.5, y + 0.5, center, center);
+			qreal sourceRadius = distance(qRed(pixel) + 0.5, qGreen(pixel) + 0.5, center, center);
+			QVERIFY(qAbs(radius - sourceRadius) <= 1.5);
+			if(radius >= center)
+				QCOMPARE(pixel, qRgb(x, y, 0));
+			if(distance(qRed(pixel), qGreen(pixel), x, y) > 2)
+				moved++;
+		}
+	}
+	QVERIFY(moved > 0);
+	// The angle at a quarter of the size is 90 * (1 - 0.5)^2 = 22.5 degrees
+	QRgb pixel = out.pixel(size / 2 + size / 4, size / 2);
+	qreal angle = qRadiansToDegrees(qAtan2(qGreen(pixel) + 0.5 - center, qRed(pixel) + 0.5 - center));
+	QVERIFY(qAbs(qAbs(angle) - 22.5) <= 5);
+}
+
+/*! Positive fisheye magnifies the center, each pixel is taken from a point closer to the center in the same direction. */
+void TestGraphicEffects::fisheye(void)
+{
+	const int size = 40;
+	const qreal center = size / 2.0;
+	QImage out = GraphicEffects::apply(coordinateImage(size, size), effects(GraphicEffects::FisheyeEffect, 100), 1);
+	int moved = 0;
+	for(int y=0; y < size; y++)
+	{
+		for(int x=0; x < size; x++)
+		{
+			QRgb pixel = out.pixel(x, y);
+			qreal offsetX = x + 0.5 - center, offsetY = y + 0.5 - center;
+			qreal sourceX = qRed(pixel) + 0.5 - center, sourceY = qGreen(pixel) + 0.5 - center;
+			qreal radius = distance(offsetX, offsetY, 0, 0);
+			QVERIFY(distance(sourceX, sourceY, 0, 0) <= radius + 1);
+			if(radius >= center)
+				QCOMPARE(pixel, qRgb(x, y, 0));
+			else if(radius > 2)
+			{
+				// Same direction
+				QVERIFY(offsetX * sourceX + offsetY * sourceY >= 0);
+				if(distance(sourceX, sourceY, offsetX, offsetY) > 2)
+					moved++;
+			}
+		}
+	}
+	QVERIFY(moved > 0);
+}
+
+/*! Mosaic repeats a downscaled copy of the image in each tile. */
+void TestGraphicEffects::mosaic(void)
+{
+	const int size = 40;
+	ImageEffects imageEffects = effects(GraphicEffects::MosaicEffect, 10);
+	QCOMPARE(imageEffects.mosaic, 2.0);
+	QImage out = GraphicEffects::apply(coordinateImage(size, size), imageEffects, 1);
+	const int tile = size / 2;
+	for(int y=0; y < size; y++)
+	{
+		for(int x=0; x < size; x++)
+		{
+			QRgb pixel = out.pixel(x, y);
+			QVERIFY(qAbs(qRed(pixel) - 2 * (x % tile)) <= 1);
+			QVERIFY(qAbs(qGreen(pixel) - 2 * (y % tile)) <= 1);
+		}
+	}
+}
+
+/*! Image sizes (including non-square ones) for the distortion effects. */
+void TestGraphicEffects::center_data(void)
+{
+	QTest::addColumn<int>("width");
+	QTest::addColumn<int>("height");
+	QTest::addColumn<int>("effect");
+	QTest::addColumn<qreal>("value");
+	QTest::newRow("whirl 40x40") << 40 << 40 << (int) GraphicEffects::WhirlEffect << 180.0;
+	QTest::newRow("whirl 60x30") << 60 << 30 << (int) GraphicEffects::WhirlEffect << 180.0;
+	QTest::newRow("fisheye 60x30") << 60 << 30 << (int) GraphicEffects::FisheyeEffect << 100.0;
+	QTest::newRow("fisheye 31x51") << 31 << 51 << (int) GraphicEffects::FisheyeEffect << -50.0;
+}
+
+/*!
+ * The distortion is centered on the image and the image size doesn't change,
+ * so the rotation center of the costume (which is relative to the top left corner) stays the same.
+ */
+void TestGraphicEffects::center(void)
+{
+	QFETCH(int, width);
+	QFETCH(int, height);
+	QFETCH(int, effect);
+	QFETCH(qreal, value);
+	QImage out = GraphicEffects::apply(coordinateImage(width, height), effects((GraphicEffects::Effect) effect, value), 1);
+	QCOMPARE(out.size(), QSize(width, height));
+	QRgb pixel = out.pixel(width / 2, height / 2);
+	QVERIFY(qAbs(qRed(pixel) - width / 2) <= 1);
+	QVERIFY(qAbs(qGreen(pixel) - height / 2) <= 1);
+}
+
+/*! Images which are split into bands must be the same as images processed in one band. */
+void TestGraphicEffects::bands(void)
+{
+	// Large enough to be split into bands
+	const int size = 200;
+	QImage image(size, size, QImage::Format_ARGB32);
+	for(int y=0; y < size; y++)
+	{
+		for(int x=0; x < size; x++)
+			image.setPixel(x, y, qRgba(x, y, (x * y) % 256, 255 - x));
+	}
+	qreal values[GraphicEffects::EffectCount] = {};
+	values[GraphicEffects::ColorEffect] = 35;
+	values[GraphicEffects::BrightnessEffect] = -20;
+	values[GraphicEffects::FisheyeEffect] = 40;
+	values[GraphicEffects::WhirlEffect] = 120;
+	values[GraphicEffects::PixelateEffect] = 20;
+	values[GraphicEffects::MosaicEffect] = 15;
+	ImageEffects imageEffects = GraphicEffects::imageEffects(values);
+	QImage banded = GraphicEffects::apply(image, imageEffects, 1.5);
+	GraphicEffects::setMultithreaded(false);
+	QImage serial = GraphicEffects::apply(image, imageEffects, 1.5);
+	GraphicEffects::setMultithreaded(true);
+	QCOMPARE(banded, serial);
+}
+
+QTEST_GUILESS_MAIN(TestGraphicEffects)
+#include "tst_graphiceffects.moc"